@@ -0,0 +1,268 @@
+#include <psp2/io/fcntl.h>
+
+#include <string.h>
+
+#include "aio.h"
+#include "bufpool.h"
+#include "debug_screen.h"
+
+#define printf psvDebugScreenPrintf
+
+// Copy engine keeping up to aio_depth reads in flight.
+//
+// Asynchronous requests on one file descriptor complete in submission
+// order, one at a time, so every read slot gets its own descriptor on the
+// source and is positioned before its request is queued. Slot i always
+// carries the blocks i, i + depth, i + 2 * depth, ... which lets the writer
+// go round the ring and retire blocks in file order through a single
+// descriptor, with one write in flight while the reads run ahead.
+//
+// Files that fit in one block gain nothing from the ring and are copied
+// synchronously through a single descriptor, longer files get no more read
+// descriptors than they have blocks.
+//
+// A copy may fan out to several targets. Each block is still read once and
+// its write is queued on every live target at the same time, the slot only
+// refills once all of them are done with it. A target whose write fails is
+// dropped and the copy carries on with the rest.
+
+typedef struct {
+	SceUID fd;
+	char *buf;
+	int len;
+	int pending;
+} AioSlot;
+
+static char *aio_buffers = NULL;
+static int aio_depth = 0;
+static size_t aio_block = 0;
+static AioStats aio_stats;
+
+int aio_init(int depth, size_t block) {
+	char *buffers;
+
+	if (depth < 1)
+		depth = 1;
+	if (depth > AIO_MAX_DEPTH)
+		depth = AIO_MAX_DEPTH;
+
+	if ((buffers = pool_alloc(depth * block)) == NULL) {
+		printf("aio_init: no transfer buffers\n");
+		return -1;
+	}
+
+	aio_exit();
+	aio_buffers = buffers;
+	aio_depth = depth;
+	aio_block = block;
+	return 0;
+}
+
+void aio_exit(void) {
+	pool_free(aio_buffers);
+	aio_buffers = NULL;
+	aio_depth = 0;
+	aio_block = 0;
+}
+
+static int issue_read(AioSlot *slot, SceOff *offset, SceOff size) {
+	SceOff left = size - *offset;
+	int ret;
+
+	slot->len = (left < (SceOff)aio_block) ? (int)left : (int)aio_block;
+	if (slot->len == 0)
+		return 0;
+
+	if ((ret = sceIoLseek(slot->fd, *offset, SEEK_SET)) < 0) {
+		printf("sceIoLseek: 0x%08X\n", ret);
+		return -1;
+	}
+	if ((ret = sceIoReadAsync(slot->fd, slot->buf, slot->len)) < 0) {
+		printf("sceIoReadAsync: 0x%08X\n", ret);
+		return -1;
+	}
+	slot->pending = 1;
+	*offset += slot->len;
+	return 0;
+}
+
+static int wait_done(SceUID fd, int len, const char *what) {
+	SceInt64 res;
+	int ret;
+
+	if ((ret = sceIoWaitAsync(fd, &res)) < 0) {
+		printf("sceIoWaitAsync: 0x%08X\n", ret);
+		return -1;
+	}
+	if (res != len) {
+		printf("%s: 0x%08X\n", what, (int)res);
+		return -1;
+	}
+	return 0;
+}
+
+// single block files, one open and one read however many targets
+static int copy_sync(const SceUID *wfds, int *alive, int count, int live, const char *src, SceOff size, AioProgress progress, void *arg) {
+	SceUID fd;
+	int len, ret;
+
+	if (size == 0)
+		return 0;
+
+	if ((fd = sceIoOpen(src, SCE_O_RDONLY, 0)) < 0) {
+		printf("sceIoOpen(%s): 0x%08X\n", src, fd);
+		return -1;
+	}
+	len = sceIoRead(fd, aio_buffers, (SceSize)size);
+	sceIoClose(fd);
+	if (len != (int)size) {
+		printf("sceIoRead: 0x%08X\n", len);
+		return -1;
+	}
+	aio_stats.bytes_read += len;
+
+	for (int t = 0; t < count; t++) {
+		if (!alive[t])
+			continue;
+		if ((ret = sceIoWrite(wfds[t], aio_buffers, len)) != len) {
+			printf("sceIoWrite: 0x%08X\n", ret);
+			alive[t] = 0;
+			live--;
+			continue;
+		}
+		aio_stats.bytes_written += len;
+	}
+	if (live == 0)
+		return -1;
+
+	if (progress)
+		progress(arg, size, size);
+	return 0;
+}
+
+int aio_copy_multi(const SceUID *wfds, int *alive, int count, const char *src, SceOff size, AioProgress progress, void *arg) {
+	AioSlot slots[AIO_MAX_DEPTH];
+	AioSlot *writing = NULL;
+	int busy[AIO_MAX_TARGETS];
+	SceOff offset = 0, done = 0, blocks;
+	SceInt64 res;
+	int depth, max_depth, head = 0, live = 0;
+	int ret = -1;
+
+	if (aio_buffers == NULL || count < 1 || count > AIO_MAX_TARGETS)
+		return -1;
+
+	for (int t = 0; t < count; t++) {
+		busy[t] = 0;
+		if (alive[t])
+			live++;
+	}
+	if (live == 0)
+		return -1;
+
+	blocks = (size + aio_block - 1) / aio_block;
+	if (blocks <= 1)
+		return copy_sync(wfds, alive, count, live, src, size, progress, arg);
+	max_depth = (blocks < aio_depth) ? (int)blocks : aio_depth;
+
+	for (depth = 0; depth < max_depth; depth++) {
+		if ((slots[depth].fd = sceIoOpen(src, SCE_O_RDONLY, 0)) < 0) {
+			// fewer descriptors only means less in flight
+			if (depth > 0)
+				break;
+			printf("sceIoOpen(%s): 0x%08X\n", src, slots[depth].fd);
+			return -1;
+		}
+		slots[depth].buf = aio_buffers + depth * aio_block;
+		slots[depth].len = 0;
+		slots[depth].pending = 0;
+	}
+
+	for (int i = 0; i < depth; i++) {
+		if (issue_read(&slots[i], &offset, size) < 0)
+			goto error;
+		aio_stats.bytes_read += slots[i].len;
+	}
+
+	while (1) {
+		// the previous block is on every target, its slot can fetch the next one
+		if (writing) {
+			int len = writing->len;
+
+			for (int t = 0; t < count; t++) {
+				if (!busy[t])
+					continue;
+				busy[t] = 0;
+				if (wait_done(wfds[t], len, "sceIoWriteAsync") < 0) {
+					alive[t] = 0;
+					live--;
+					continue;
+				}
+				aio_stats.bytes_written += len;
+			}
+			if (live == 0 || issue_read(writing, &offset, size) < 0) {
+				writing = NULL;
+				goto error;
+			}
+			aio_stats.bytes_read += writing->len;
+			done += len;
+			if (progress)
+				progress(arg, done, size);
+			writing = NULL;
+		}
+
+		AioSlot *slot = &slots[head];
+		if (!slot->pending)
+			break;
+		slot->pending = 0;
+		if (wait_done(slot->fd, slot->len, "sceIoReadAsync") < 0)
+			goto error;
+
+		for (int t = 0; t < count; t++) {
+			int err;
+
+			if (!alive[t])
+				continue;
+			if ((err = sceIoWriteAsync(wfds[t], slot->buf, slot->len)) < 0) {
+				printf("sceIoWriteAsync: 0x%08X\n", err);
+				alive[t] = 0;
+				live--;
+				continue;
+			}
+			busy[t] = 1;
+			writing = slot;
+		}
+		if (live == 0)
+			goto error;
+		head = (head + 1) % depth;
+	}
+
+	ret = 0;
+
+error:
+	// nothing may still be transferring into the buffers once we return
+	for (int t = 0; t < count; t++) {
+		if (busy[t])
+			sceIoWaitAsync(wfds[t], &res);
+	}
+	for (int i = 0; i < depth; i++) {
+		if (slots[i].pending)
+			sceIoWaitAsync(slots[i].fd, &res);
+		sceIoClose(slots[i].fd);
+	}
+	return ret;
+}
+
+int aio_copy(SceUID wfd, const char *src, SceOff size, AioProgress progress, void *arg) {
+	int alive = 1;
+
+	return aio_copy_multi(&wfd, &alive, 1, src, size, progress, arg);
+}
+
+void aio_get_stats(AioStats *stats) {
+	*stats = aio_stats;
+}
+
+void aio_reset_stats(void) {
+	memset(&aio_stats, 0, sizeof(aio_stats));
+}
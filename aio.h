@@ -0,0 +1,31 @@
+#pragma once
+
+#include <psp2/io/fcntl.h>
+
+#include <stddef.h>
+
+#define AIO_MAX_DEPTH 8
+#define AIO_DEFAULT_DEPTH 4
+#define AIO_DEFAULT_BLOCK (64 * 1024)
+#define AIO_MAX_TARGETS 4
+
+// called after each block is written with the bytes written so far
+typedef void (*AioProgress)(void *arg, SceOff done, SceOff size);
+
+// bytes moved by every copy since the last reset, a fan-out copy reads
+// each block once however many targets it writes
+typedef struct {
+	SceOff bytes_read;
+	SceOff bytes_written;
+} AioStats;
+
+int aio_init(int depth, size_t block);
+void aio_exit(void);
+
+int aio_copy(SceUID wfd, const char *src, SceOff size, AioProgress progress, void *arg);
+// writes src to every target whose alive flag is set and clears the flag of
+// each target that fails, succeeds while at least one target is left
+int aio_copy_multi(const SceUID *wfds, int *alive, int count, const char *src, SceOff size, AioProgress progress, void *arg);
+
+void aio_get_stats(AioStats *stats);
+void aio_reset_stats(void);
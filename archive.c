@@ -0,0 +1,456 @@
+#include <psp2/kernel/processmgr.h>
+#include <psp2/io/fcntl.h>
+#include <psp2/io/stat.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "archive.h"
+#include "bufpool.h"
+#include "debug_screen.h"
+#include "walker.h"
+
+#define printf psvDebugScreenPrintf
+
+// Packs a tree into one archive written strictly front to back in
+// ARCHIVE_BLOCK sized writes, so the destination sees a single growing file
+// instead of a directory update and a partly used cluster per small file.
+// File contents are read straight into the output block. The index is
+// collected in a fixed buffer that spills to a scratch file next to the
+// archive, which keeps memory bounded however many entries there are.
+//
+// Restore reads the archive in ARCHIVE_BLOCK sized reads and writes every
+// file from the read buffer as its record goes by. Files are still created
+// with an open each: SceIofilemgr has no call that creates several at once.
+// The records of a directory follow one another, so its entries are at
+// least created back to back. Names come from the archive and are checked
+// before anything is created, an archive can't write outside of dst.
+
+#define ARCHIVE_SPOOL_SUFFIX "~idx"
+
+typedef struct {
+	SceUID fd;
+	char *buf;
+	size_t len;
+	uint64_t pos; // archive offset of the next byte, buffered ones included
+	char *index;
+	size_t index_len;
+	SceUID spool;
+	char spool_path[256];
+	size_t root_len;
+	const Rules *rules;
+	ArchiveTrailer trailer;
+	ArchiveStats *stats;
+} Packer;
+
+typedef struct {
+	SceUID fd;
+	char *buf;
+	size_t pos;
+	size_t len;
+	uint64_t offset; // archive offset of buf[pos]
+} Reader;
+
+static double since(SceUInt64 start) {
+	SceUInt64 us = sceKernelGetProcessTimeWide() - start;
+	return (us ? us : 1) / 1000000.0;
+}
+
+static int write_all(SceUID fd, const char *buf, size_t len) {
+	int ret;
+
+	while (len > 0) {
+		if ((ret = sceIoWrite(fd, buf, len)) <= 0) {
+			printf("sceIoWrite: 0x%08X\n", ret);
+			return -1;
+		}
+		buf += ret;
+		len -= ret;
+	}
+	return 0;
+}
+
+static int out_flush(Packer *p) {
+	if (write_all(p->fd, p->buf, p->len) < 0)
+		return -1;
+	p->len = 0;
+	return 0;
+}
+
+static int out_put(Packer *p, const void *data, size_t size) {
+	const char *src = data;
+
+	while (size > 0) {
+		size_t n = ARCHIVE_BLOCK - p->len;
+		if (n > size)
+			n = size;
+		memcpy(p->buf + p->len, src, n);
+		p->len += n;
+		p->pos += n;
+		src += n;
+		size -= n;
+		if (p->len == ARCHIVE_BLOCK && out_flush(p) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+static int index_spill(Packer *p) {
+	if (p->spool < 0 && (p->spool = sceIoOpen(p->spool_path, SCE_O_WRONLY | SCE_O_CREAT | SCE_O_TRUNC, 0777)) < 0) {
+		printf("sceIoOpen(%s): 0x%08X\n", p->spool_path, p->spool);
+		return -1;
+	}
+	if (write_all(p->spool, p->index, p->index_len) < 0)
+		return -1;
+	p->index_len = 0;
+	return 0;
+}
+
+static int add_entry(Packer *p, int type, const char *path, const SceIoStat *stat) {
+	const char *name = path + p->root_len;
+	ArchiveEntry entry;
+
+	while (*name == '/')
+		name++;
+	memset(&entry, 0, sizeof(entry));
+	entry.type = type;
+	entry.name_len = strlen(name);
+	entry.size = (type == ARCHIVE_FILE) ? stat->st_size : 0;
+	entry.ctime = stat->st_ctime;
+	entry.mtime = stat->st_mtime;
+	if (entry.name_len >= ARCHIVE_NAME_MAX) {
+		printf("Path too long: %s\n", path);
+		return -1;
+	}
+
+	if (out_put(p, &entry, sizeof(entry)) < 0 || out_put(p, name, entry.name_len) < 0)
+		return -1;
+
+	entry.offset = p->pos - sizeof(entry) - entry.name_len;
+	if (p->index_len + sizeof(entry) + entry.name_len > ARCHIVE_INDEX_SPOOL && index_spill(p) < 0)
+		return -1;
+	memcpy(p->index + p->index_len, &entry, sizeof(entry));
+	memcpy(p->index + p->index_len + sizeof(entry), name, entry.name_len);
+	p->index_len += sizeof(entry) + entry.name_len;
+	p->trailer.count++;
+	return 0;
+}
+
+// the contents go straight from the file into the output block
+static int pack_contents(Packer *p, const char *path, SceOff size) {
+	SceUID fd;
+	int rd;
+
+	if ((fd = sceIoOpen(path, SCE_O_RDONLY, 0)) < 0) {
+		printf("sceIoOpen(%s): 0x%08X\n", path, fd);
+		return -1;
+	}
+	while (size > 0) {
+		SceOff n = ARCHIVE_BLOCK - p->len;
+		if (n > size)
+			n = size;
+		if ((rd = sceIoRead(fd, p->buf + p->len, n)) <= 0) {
+			printf("sceIoRead(%s): 0x%08X\n", path, rd);
+			sceIoClose(fd);
+			return -1;
+		}
+		p->len += rd;
+		p->pos += rd;
+		size -= rd;
+		if (p->len == ARCHIVE_BLOCK && out_flush(p) < 0) {
+			sceIoClose(fd);
+			return -1;
+		}
+	}
+	sceIoClose(fd);
+	return 0;
+}
+
+static int pack_enter(void *arg, const char *path, const char *name, const SceIoStat *stat, void *parent, void *frame) {
+	Packer *p = arg;
+	int match = RULES_COPY;
+
+	if (p->rules)
+		match = rules_step(p->rules, parent, name, 1, 0, frame);
+	if (match == RULES_ERROR)
+		return WALK_ABORT;
+	if (match == RULES_SKIP)
+		return WALK_SKIP;
+	if (add_entry(p, ARCHIVE_DIR, path, stat) < 0)
+		return WALK_ABORT;
+	p->stats->dirs++;
+	return WALK_CONTINUE;
+}
+
+static int pack_file(void *arg, const char *path, const char *name, const SceIoStat *stat, void *parent) {
+	Packer *p = arg;
+	RulesState unused;
+	int match = RULES_COPY;
+
+	if (p->rules)
+		match = rules_step(p->rules, parent, name, 0, stat->st_size, &unused);
+	if (match == RULES_ERROR)
+		return WALK_ABORT;
+	if (match != RULES_COPY)
+		return WALK_CONTINUE;
+
+	printf("Packing %s ...\n", path);
+	// a short read would leave a record that does not match its header
+	if (add_entry(p, ARCHIVE_FILE, path, stat) < 0 || pack_contents(p, path, stat->st_size) < 0)
+		return WALK_ABORT;
+	p->trailer.bytes += stat->st_size;
+	p->stats->files++;
+	p->stats->bytes += stat->st_size;
+	return WALK_CONTINUE;
+}
+
+static const WalkOps pack_ops = {
+	sizeof(RulesState),
+	pack_enter,
+	pack_file,
+	NULL,
+};
+
+// appends the index, from the scratch file first if it spilled
+static int pack_index(Packer *p) {
+	int rd;
+
+	p->trailer.index_offset = p->pos;
+	if (p->spool >= 0) {
+		if (index_spill(p) < 0)
+			return -1;
+		sceIoClose(p->spool);
+		if ((p->spool = sceIoOpen(p->spool_path, SCE_O_RDONLY, 0)) < 0) {
+			printf("sceIoOpen(%s): 0x%08X\n", p->spool_path, p->spool);
+			return -1;
+		}
+		while ((rd = sceIoRead(p->spool, p->index, ARCHIVE_INDEX_SPOOL)) > 0) {
+			if (out_put(p, p->index, rd) < 0)
+				return -1;
+		}
+		if (rd < 0) {
+			printf("sceIoRead(%s): 0x%08X\n", p->spool_path, rd);
+			return -1;
+		}
+		return 0;
+	}
+	return out_put(p, p->index, p->index_len);
+}
+
+int archive_pack(const char *archive, const char *src, const Rules *rules, ArchiveStats *stats) {
+	ArchiveHeader header = { ARCHIVE_MAGIC, ARCHIVE_VERSION };
+	RulesState root;
+	SceUInt64 start = sceKernelGetProcessTimeWide();
+	Packer p;
+	int ret = -1;
+
+	memset(stats, 0, sizeof(*stats));
+	memset(&p, 0, sizeof(p));
+	p.spool = -1;
+	p.root_len = strlen(src);
+	p.rules = rules;
+	p.stats = stats;
+	p.trailer.magic = ARCHIVE_MAGIC;
+	snprintf(p.spool_path, sizeof(p.spool_path), "%s" ARCHIVE_SPOOL_SUFFIX, archive);
+	if (rules)
+		rules_root(rules, &root);
+
+	p.buf = pool_alloc(ARCHIVE_BLOCK);
+	p.index = pool_alloc(ARCHIVE_INDEX_SPOOL);
+	if (p.buf == NULL || p.index == NULL) {
+		printf("archive_pack: out of memory\n");
+		goto error;
+	}
+	if ((p.fd = sceIoOpen(archive, SCE_O_WRONLY | SCE_O_CREAT | SCE_O_TRUNC, 0777)) < 0) {
+		printf("sceIoOpen(%s): 0x%08X\n", archive, p.fd);
+		goto error;
+	}
+
+	if (out_put(&p, &header, sizeof(header)) < 0 ||
+	    walk_tree(src, WALK_ORDER_DIRENT, &pack_ops, &p, &root) < 0 ||
+	    pack_index(&p) < 0 ||
+	    out_put(&p, &p.trailer, sizeof(p.trailer)) < 0 ||
+	    out_flush(&p) < 0) {
+		sceIoClose(p.fd);
+		// a partial archive must not be mistaken for a backup
+		sceIoRemove(archive);
+		goto error;
+	}
+	sceIoClose(p.fd);
+	ret = 0;
+
+error:
+	if (p.spool >= 0) {
+		sceIoClose(p.spool);
+		sceIoRemove(p.spool_path);
+	}
+	pool_free(p.index);
+	pool_free(p.buf);
+	stats->seconds = since(start);
+	return ret;
+}
+
+static int in_fill(Reader *r) {
+	int rd;
+
+	if (r->pos < r->len)
+		return 0;
+	if ((rd = sceIoRead(r->fd, r->buf, ARCHIVE_BLOCK)) <= 0) {
+		printf("sceIoRead: 0x%08X\n", rd);
+		return -1;
+	}
+	r->pos = 0;
+	r->len = rd;
+	return 0;
+}
+
+static int in_read(Reader *r, void *data, size_t size) {
+	char *dst = data;
+
+	while (size > 0) {
+		if (in_fill(r) < 0)
+			return -1;
+		size_t n = r->len - r->pos;
+		if (n > size)
+			n = size;
+		memcpy(dst, r->buf + r->pos, n);
+		r->pos += n;
+		r->offset += n;
+		dst += n;
+		size -= n;
+	}
+	return 0;
+}
+
+// writes the next size bytes to wfd, or skips them if wfd is negative
+static int in_copy(Reader *r, SceUID wfd, uint64_t size) {
+	while (size > 0) {
+		if (in_fill(r) < 0)
+			return -1;
+		size_t n = r->len - r->pos;
+		if (n > size)
+			n = size;
+		if (wfd >= 0 && write_all(wfd, r->buf + r->pos, n) < 0)
+			return -1;
+		r->pos += n;
+		r->offset += n;
+		size -= n;
+	}
+	return 0;
+}
+
+// relative, without a device and without empty, "." or ".." components
+static int name_valid(const char *name) {
+	const char *p = name;
+
+	if (strchr(name, ':') != NULL)
+		return 0;
+	while (1) {
+		size_t len = strcspn(p, "/\\");
+		if (len == 0 || (len == 1 && p[0] == '.') || (len == 2 && p[0] == '.' && p[1] == '.'))
+			return 0;
+		if (p[len] == '\0')
+			return 1;
+		p += len + 1;
+	}
+}
+
+static int restore_entry(Reader *r, PathBuf *dst, const ArchiveEntry *entry, const char *name, ArchiveStats *stats) {
+	size_t root_len = dst->len;
+	SceIoStat stat;
+	SceUID wfd;
+	int ret = 0;
+
+	if (path_push(dst, name) < 0)
+		return -1;
+
+	if (entry->type == ARCHIVE_DIR) {
+		sceIoMkdir(dst->buf, 0777);
+		stats->dirs++;
+		path_truncate(dst, root_len);
+		return 0;
+	}
+
+	printf("Restoring %s ...\n", dst->buf);
+	if ((wfd = sceIoOpen(dst->buf, SCE_O_WRONLY | SCE_O_CREAT | SCE_O_TRUNC, 0777)) < 0) {
+		printf("sceIoOpen(%s): 0x%08X\n", dst->buf, wfd);
+		stats->failed++;
+	}
+	// the contents have to be consumed either way to reach the next record
+	if (in_copy(r, wfd, entry->size) < 0) {
+		ret = -1;
+	} else if (wfd >= 0) {
+		memset(&stat, 0, sizeof(stat));
+		stat.st_ctime = entry->ctime;
+		stat.st_mtime = entry->mtime;
+		sceIoChstatByFd(wfd, &stat, SCE_CST_CT | SCE_CST_MT);
+		stats->files++;
+		stats->bytes += entry->size;
+	}
+	if (wfd >= 0)
+		sceIoClose(wfd);
+
+	path_truncate(dst, root_len);
+	return ret;
+}
+
+int archive_restore(const char *archive, const char *dst, ArchiveStats *stats) {
+	ArchiveHeader header;
+	ArchiveTrailer trailer;
+	ArchiveEntry entry;
+	char name[ARCHIVE_NAME_MAX];
+	SceUInt64 start = sceKernelGetProcessTimeWide();
+	PathBuf path;
+	Reader r;
+	int ret = -1;
+
+	memset(stats, 0, sizeof(*stats));
+	memset(&r, 0, sizeof(r));
+	if ((r.fd = sceIoOpen(archive, SCE_O_RDONLY, 0)) < 0) {
+		printf("sceIoOpen(%s): 0x%08X\n", archive, r.fd);
+		return -1;
+	}
+	if (path_init(&path, dst) < 0) {
+		sceIoClose(r.fd);
+		return -1;
+	}
+	if ((r.buf = pool_alloc(ARCHIVE_BLOCK)) == NULL) {
+		printf("archive_restore: out of memory\n");
+		goto error;
+	}
+
+	// the trailer tells where the records end
+	if (sceIoLseek(r.fd, -(SceOff)sizeof(trailer), SEEK_END) < 0 ||
+	    sceIoRead(r.fd, &trailer, sizeof(trailer)) != sizeof(trailer) ||
+	    sceIoLseek(r.fd, 0, SEEK_SET) < 0 ||
+	    in_read(&r, &header, sizeof(header)) < 0 ||
+	    header.magic != ARCHIVE_MAGIC || header.version != ARCHIVE_VERSION ||
+	    trailer.magic != ARCHIVE_MAGIC) {
+		printf("%s is not a usbmc archive\n", archive);
+		goto error;
+	}
+
+	sceIoMkdir(dst, 0777);
+	while (r.offset < trailer.index_offset) {
+		if (in_read(&r, &entry, sizeof(entry)) < 0 || entry.name_len >= ARCHIVE_NAME_MAX ||
+		    in_read(&r, name, entry.name_len) < 0) {
+			printf("%s is damaged\n", archive);
+			goto error;
+		}
+		name[entry.name_len] = '\0';
+		if ((entry.type != ARCHIVE_DIR && entry.type != ARCHIVE_FILE) || !name_valid(name)) {
+			printf("%s has a bad entry: \"%s\"\n", archive, name);
+			goto error;
+		}
+		if (restore_entry(&r, &path, &entry, name, stats) < 0)
+			goto error;
+	}
+	ret = 0;
+
+error:
+	pool_free(r.buf);
+	path_free(&path);
+	sceIoClose(r.fd);
+	stats->seconds = since(start);
+	return ret;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <psp2/io/stat.h>
+
+#include <stdint.h>
+
+#include "rules.h"
+
+#define USBMC_ARCHIVE_PATH "uma0:ux0_backup.pkg"
+
+#define ARCHIVE_MAGIC 0x4B504D55 // "UMPK"
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_BLOCK (256 * 1024)
+#define ARCHIVE_INDEX_SPOOL (64 * 1024)
+#define ARCHIVE_NAME_MAX 1024
+
+// An archive is a header, one record per packed directory and file in walk
+// order, the index and a trailer. A record is an ArchiveEntry followed by the
+// path relative to the packed root and, for files, the contents. The index
+// repeats every entry and its name with the offset of its record so that
+// single entries can be found without reading the whole archive.
+
+enum {
+	ARCHIVE_DIR,
+	ARCHIVE_FILE,
+};
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+} ArchiveHeader;
+
+typedef struct {
+	uint16_t type;
+	uint16_t name_len;
+	uint32_t reserved;
+	uint64_t size;   // file contents following the name
+	uint64_t offset; // start of the record, only set in the index
+	SceDateTime ctime;
+	SceDateTime mtime;
+} ArchiveEntry;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t count;
+	uint64_t bytes;        // file contents in all records
+	uint64_t index_offset; // the index runs from here up to the trailer
+} ArchiveTrailer;
+
+typedef struct {
+	unsigned int files;
+	unsigned int dirs;
+	unsigned int failed;
+	uint64_t bytes;
+	double seconds;
+} ArchiveStats;
+
+// packs what the rules select below src (everything if rules is NULL)
+int archive_pack(const char *archive, const char *src, const Rules *rules, ArchiveStats *stats);
+int archive_restore(const char *archive, const char *dst, ArchiveStats *stats);
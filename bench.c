@@ -0,0 +1,273 @@
+#include <psp2/kernel/processmgr.h>
+#include <psp2/io/fcntl.h>
+#include <psp2/io/stat.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "bench.h"
+#include "bufpool.h"
+#include "debug_screen.h"
+
+#define printf psvDebugScreenPrintf
+
+// Storage benchmark run in a scratch directory at the root of a device.
+// Every write test ends with a sync inside the timed section so the
+// numbers reflect the media and not the write cache. Reads follow the
+// writes of the same file and may partly be served from cache.
+
+#define BENCH_DIR "usbmc_bench"
+#define BENCH_FILE_SIZE (16 * 1024 * 1024)
+#define BENCH_RANDOM_BLOCK 4096
+#define BENCH_RANDOM_OPS 1000
+#define BENCH_FILES 200
+#define BENCH_PATH_MAX 128
+#define MB (1024.0 * 1024.0)
+
+static const int seq_blocks[] = {
+	4 * 1024,
+	64 * 1024,
+	512 * 1024,
+};
+
+static char *bench_buf = NULL;
+static unsigned int bench_seed = 1;
+
+static unsigned int bench_rand(void) {
+	bench_seed = bench_seed * 1103515245 + 12345;
+	return bench_seed >> 8;
+}
+
+static SceUInt64 now(void) {
+	return sceKernelGetProcessTimeWide();
+}
+
+// elapsed seconds, never zero
+static double since(SceUInt64 start) {
+	SceUInt64 us = now() - start;
+	return (us ? us : 1) / 1000000.0;
+}
+
+static void add_result(BenchDevice *out, const char *test, int block, double value, const char *unit) {
+	BenchResult *r;
+
+	if (out->count == BENCH_MAX_RESULTS)
+		return;
+	r = &out->results[out->count++];
+	r->test = test;
+	r->block = block;
+	r->value = value;
+	r->unit = unit;
+}
+
+static int seq_write(const char *path, int block, double *mbps) {
+	SceUInt64 start;
+	int fd, ret = 0;
+
+	if ((fd = sceIoOpen(path, SCE_O_WRONLY | SCE_O_CREAT | SCE_O_TRUNC, 0777)) < 0) {
+		printf("sceIoOpen(%s): 0x%08X\n", path, fd);
+		return -1;
+	}
+
+	start = now();
+	for (int done = 0; done < BENCH_FILE_SIZE; done += block) {
+		if ((ret = sceIoWrite(fd, bench_buf, block)) != block) {
+			printf("sceIoWrite: 0x%08X\n", ret);
+			sceIoClose(fd);
+			return -1;
+		}
+	}
+	sceIoSyncByFd(fd, 0);
+	*mbps = BENCH_FILE_SIZE / MB / since(start);
+
+	sceIoClose(fd);
+	return 0;
+}
+
+static int seq_read(const char *path, int block, double *mbps) {
+	SceUInt64 start;
+	int fd, rd, total = 0;
+
+	if ((fd = sceIoOpen(path, SCE_O_RDONLY, 0)) < 0) {
+		printf("sceIoOpen(%s): 0x%08X\n", path, fd);
+		return -1;
+	}
+
+	start = now();
+	while ((rd = sceIoRead(fd, bench_buf, block)) > 0)
+		total += rd;
+	*mbps = total / MB / since(start);
+
+	sceIoClose(fd);
+	if (rd < 0) {
+		printf("sceIoRead: 0x%08X\n", rd);
+		return -1;
+	}
+	return 0;
+}
+
+static int random_io(const char *path, int write, double *iops) {
+	SceUInt64 start;
+	int fd, ret;
+
+	if ((fd = sceIoOpen(path, write ? SCE_O_WRONLY : SCE_O_RDONLY, 0)) < 0) {
+		printf("sceIoOpen(%s): 0x%08X\n", path, fd);
+		return -1;
+	}
+
+	start = now();
+	for (int i = 0; i < BENCH_RANDOM_OPS; i++) {
+		SceOff offset = (SceOff)(bench_rand() % (BENCH_FILE_SIZE / BENCH_RANDOM_BLOCK)) * BENCH_RANDOM_BLOCK;
+
+		if (write)
+			ret = sceIoPwrite(fd, bench_buf, BENCH_RANDOM_BLOCK, offset);
+		else
+			ret = sceIoPread(fd, bench_buf, BENCH_RANDOM_BLOCK, offset);
+		if (ret != BENCH_RANDOM_BLOCK) {
+			printf("%s: 0x%08X\n", write ? "sceIoPwrite" : "sceIoPread", ret);
+			sceIoClose(fd);
+			return -1;
+		}
+	}
+	if (write)
+		sceIoSyncByFd(fd, 0);
+	*iops = BENCH_RANDOM_OPS / since(start);
+
+	sceIoClose(fd);
+	return 0;
+}
+
+static int create_delete(const char *dir, double *creates, double *deletes) {
+	char path[BENCH_PATH_MAX];
+	SceUInt64 start;
+	int fd;
+
+	start = now();
+	for (int i = 0; i < BENCH_FILES; i++) {
+		snprintf(path, sizeof(path), "%s/f%04d", dir, i);
+		if ((fd = sceIoOpen(path, SCE_O_WRONLY | SCE_O_CREAT | SCE_O_TRUNC, 0777)) < 0) {
+			printf("sceIoOpen(%s): 0x%08X\n", path, fd);
+			return -1;
+		}
+		sceIoClose(fd);
+	}
+	*creates = BENCH_FILES / since(start);
+
+	start = now();
+	for (int i = 0; i < BENCH_FILES; i++) {
+		snprintf(path, sizeof(path), "%s/f%04d", dir, i);
+		sceIoRemove(path);
+	}
+	*deletes = BENCH_FILES / since(start);
+
+	return 0;
+}
+
+int bench_device(const char *dev, BenchDevice *out) {
+	char dir[BENCH_PATH_MAX], file[BENCH_PATH_MAX];
+	double value, value2;
+	int ret = -1;
+
+	out->dev = dev;
+	out->count = 0;
+
+	if ((bench_buf = pool_alloc(seq_blocks[sizeof(seq_blocks)/sizeof(*seq_blocks) - 1])) == NULL) {
+		printf("bench_device: no transfer buffer\n");
+		return -1;
+	}
+	for (int i = 0; i < seq_blocks[sizeof(seq_blocks)/sizeof(*seq_blocks) - 1]; i++)
+		bench_buf[i] = i;
+	bench_seed = 1;
+
+	snprintf(dir, sizeof(dir), "%s" BENCH_DIR, dev);
+	snprintf(file, sizeof(file), "%s/seq.bin", dir);
+	sceIoMkdir(dir, 0777);
+
+	for (size_t i = 0; i < sizeof(seq_blocks)/sizeof(*seq_blocks); ++i) {
+		printf("%s sequential %dK ...\n", dev, seq_blocks[i] / 1024);
+		if (seq_write(file, seq_blocks[i], &value) < 0)
+			goto error;
+		add_result(out, "seq write", seq_blocks[i], value, "MB/s");
+		if (seq_read(file, seq_blocks[i], &value) < 0)
+			goto error;
+		add_result(out, "seq read", seq_blocks[i], value, "MB/s");
+	}
+
+	printf("%s random 4K ...\n", dev);
+	if (random_io(file, 0, &value) < 0)
+		goto error;
+	add_result(out, "random read", BENCH_RANDOM_BLOCK, value, "IOPS");
+	if (random_io(file, 1, &value) < 0)
+		goto error;
+	add_result(out, "random write", BENCH_RANDOM_BLOCK, value, "IOPS");
+
+	printf("%s create/delete ...\n", dev);
+	if (create_delete(dir, &value, &value2) < 0)
+		goto error;
+	add_result(out, "create", 0, value, "files/s");
+	add_result(out, "delete", 0, value2, "files/s");
+
+	ret = 0;
+
+error:
+	sceIoRemove(file);
+	sceIoRmdir(dir);
+	pool_free(bench_buf);
+	bench_buf = NULL;
+	return ret;
+}
+
+static void result_label(char *label, size_t size, const BenchResult *r) {
+	if (r->block)
+		snprintf(label, size, "%s %dK", r->test, r->block / 1024);
+	else
+		snprintf(label, size, "%s", r->test);
+}
+
+// one row per test, one column per device; all devices run the same tests
+void bench_print(const BenchDevice *devs, int count) {
+	char label[32];
+
+	if (count == 0)
+		return;
+
+	printf("\n%-18s", "");
+	for (int d = 0; d < count; d++)
+		printf("%16s", devs[d].dev);
+	printf("\n");
+
+	for (int i = 0; i < devs[0].count; i++) {
+		result_label(label, sizeof(label), &devs[0].results[i]);
+		printf("%-18s", label);
+		for (int d = 0; d < count; d++) {
+			if (i < devs[d].count)
+				printf("%8.2f %-7s", devs[d].results[i].value, devs[d].results[i].unit);
+			else
+				printf("%16s", "-");
+		}
+		printf("\n");
+	}
+}
+
+int bench_save_csv(const char *path, const BenchDevice *devs, int count) {
+	char line[128];
+	int fd, len;
+
+	if ((fd = sceIoOpen(path, SCE_O_WRONLY | SCE_O_CREAT | SCE_O_TRUNC, 0777)) < 0) {
+		printf("sceIoOpen(%s): 0x%08X\n", path, fd);
+		return -1;
+	}
+
+	len = snprintf(line, sizeof(line), "device,test,block,value,unit\n");
+	sceIoWrite(fd, line, len);
+	for (int d = 0; d < count; d++) {
+		for (int i = 0; i < devs[d].count; i++) {
+			const BenchResult *r = &devs[d].results[i];
+			len = snprintf(line, sizeof(line), "%s,%s,%d,%.2f,%s\n", devs[d].dev, r->test, r->block, r->value, r->unit);
+			sceIoWrite(fd, line, len);
+		}
+	}
+
+	sceIoClose(fd);
+	return 0;
+}
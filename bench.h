@@ -0,0 +1,22 @@
+#pragma once
+
+#define USBMC_BENCH_CSV_PATH "ur0:tai/usbmc_bench.csv"
+
+#define BENCH_MAX_RESULTS 16
+
+typedef struct {
+	const char *test;
+	int block;          // bytes per request, 0 if not applicable
+	double value;
+	const char *unit;
+} BenchResult;
+
+typedef struct {
+	const char *dev;
+	int count;
+	BenchResult results[BENCH_MAX_RESULTS];
+} BenchDevice;
+
+int bench_device(const char *dev, BenchDevice *out);
+void bench_print(const BenchDevice *devs, int count);
+int bench_save_csv(const char *path, const BenchDevice *devs, int count);
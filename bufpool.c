@@ -0,0 +1,111 @@
+#include <psp2/kernel/sysmem.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#include "bufpool.h"
+#include "debug_screen.h"
+
+#define printf psvDebugScreenPrintf
+
+// Transfer buffers for the copy and config code, carved out of a single
+// memblock reserved at startup. Buffers are made of whole 64 KiB slots and
+// start on a slot boundary, which is as aligned as any DMA or cache line
+// needs; the memblock bounds how much user memory they can ever take.
+
+#define MEMBLOCK_ALIGN 0x1000
+
+static SceUID pool_memblk = -1;
+static char *pool_base = NULL;
+static unsigned int pool_slots = 0;
+// length of the run starting at each slot, 0 for free slots
+static unsigned char pool_runs[POOL_MAX_SLOTS];
+static uint32_t pool_used = 0;
+static PoolStats stats;
+
+int pool_init(size_t cap) {
+	unsigned int slots = cap / POOL_SLOT_SIZE;
+	void *base;
+
+	if (slots == 0)
+		slots = 1;
+	if (slots > POOL_MAX_SLOTS)
+		slots = POOL_MAX_SLOTS;
+
+	// room to round the base up to a slot boundary
+	pool_memblk = sceKernelAllocMemBlock("usbmc_pool", SCE_KERNEL_MEMBLOCK_TYPE_USER_RW,
+	                                     slots * POOL_SLOT_SIZE + POOL_SLOT_SIZE - MEMBLOCK_ALIGN, NULL);
+	if (pool_memblk < 0) {
+		printf("sceKernelAllocMemBlock: 0x%08X\n", pool_memblk);
+		return -1;
+	}
+	sceKernelGetMemBlockBase(pool_memblk, &base);
+
+	pool_base = (char *)(((uintptr_t)base + POOL_SLOT_SIZE - 1) & ~(uintptr_t)(POOL_SLOT_SIZE - 1));
+	pool_slots = slots;
+	pool_used = 0;
+	memset(pool_runs, 0, sizeof(pool_runs));
+	memset(&stats, 0, sizeof(stats));
+	stats.slots = slots;
+
+	return 0;
+}
+
+void pool_exit(void) {
+	if (pool_memblk >= 0)
+		sceKernelFreeMemBlock(pool_memblk);
+	pool_memblk = -1;
+	pool_base = NULL;
+	pool_slots = 0;
+}
+
+// first fit over the slot bitmap
+void *pool_alloc(size_t size) {
+	unsigned int need = (size + POOL_SLOT_SIZE - 1) / POOL_SLOT_SIZE;
+	uint32_t mask;
+
+	if (need == 0)
+		need = 1;
+	if (pool_base == NULL || need > pool_slots)
+		goto fail;
+
+	mask = (need == 32) ? 0xFFFFFFFF : ((1u << need) - 1);
+	for (unsigned int first = 0; first + need <= pool_slots; first++) {
+		if (pool_used & (mask << first))
+			continue;
+
+		pool_used |= mask << first;
+		pool_runs[first] = need;
+
+		stats.allocs++;
+		stats.in_use += need;
+		if (stats.in_use > stats.peak)
+			stats.peak = stats.in_use;
+		return pool_base + first * POOL_SLOT_SIZE;
+	}
+
+fail:
+	stats.failures++;
+	return NULL;
+}
+
+void pool_free(void *buffer) {
+	unsigned int first, need;
+	uint32_t mask;
+
+	if (buffer == NULL)
+		return;
+
+	first = ((char *)buffer - pool_base) / POOL_SLOT_SIZE;
+	if (first >= pool_slots || (need = pool_runs[first]) == 0)
+		return;
+
+	mask = (need == 32) ? 0xFFFFFFFF : ((1u << need) - 1);
+	pool_used &= ~(mask << first);
+	pool_runs[first] = 0;
+	stats.in_use -= need;
+}
+
+void pool_get_stats(PoolStats *out) {
+	*out = stats;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stddef.h>
+
+#define POOL_SLOT_SIZE (64 * 1024)
+#define POOL_MAX_SLOTS 32
+#define POOL_DEFAULT_CAP (2 * 1024 * 1024)
+
+typedef struct {
+	unsigned int slots;     // slots the cap allows
+	unsigned int in_use;
+	unsigned int peak;
+	unsigned int allocs;
+	unsigned int failures;  // requests that did not fit under the cap
+} PoolStats;
+
+int pool_init(size_t cap);
+void pool_exit(void);
+
+void *pool_alloc(size_t size);
+void pool_free(void *buffer);
+void pool_get_stats(PoolStats *stats);
@@ -0,0 +1,543 @@
+#include <psp2/kernel/threadmgr.h>
+#include <psp2/io/fcntl.h>
+#include <psp2/io/stat.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "bufpool.h"
+#include "copy.h"
+#include "debug_screen.h"
+#include "tiers.h"
+#include "walker.h"
+#include "plugin/trace_format.h"
+#include "plugin/vitashell_kernel.h"
+
+#define printf psvDebugScreenPrintf
+
+// The installer's tree copies. A single target goes through the plugin's
+// bulk copy in batches, fan-out copies and batches an older plugin does not
+// take are copied here through the async engine, synced the way the
+// plugin's sync_mode says. With a CopyDelta, files the target already has
+// are compared and left alone.
+
+#define GB_IN_BYTES (1073741824.0f)
+#define BULK_POLL_INTERVAL 50000 // 50ms
+
+#define DEV_MAX 16
+
+static AioProgress copy_progress = NULL;
+static void *copy_progress_arg = NULL;
+
+// the plugin's sync_mode, read whenever a tree copy starts
+static int sync_mode = USBMC_SYNC_DEFAULT;
+static unsigned int sync_interval = USBMC_SYNC_DEFAULT_INTERVAL;
+// written since the targets were last synced
+static unsigned int unsynced_files = 0;
+static uint64_t unsynced_bytes = 0;
+
+void copy_set_progress(AioProgress progress, void *arg) {
+	copy_progress = progress;
+	copy_progress_arg = arg;
+}
+
+// a plugin without the field, or without bulk copy, leaves the default
+static void sync_load(void) {
+	UsbmcBulkCopyStatus status;
+
+	unsynced_files = 0;
+	unsynced_bytes = 0;
+	memset(&status, 0, sizeof(status));
+	status.sync_mode = USBMC_SYNC_DEFAULT;
+	status.sync_interval = USBMC_SYNC_DEFAULT_INTERVAL;
+	if (shellKernelGetBulkCopyStatus(&status) < 0) {
+		return;
+	}
+	sync_mode = status.sync_mode;
+	sync_interval = status.sync_interval;
+}
+
+static void sync_targets(const char **dsts, const int *alive, int count) {
+	char dev[DEV_MAX];
+
+	for (int i = 0; i < count; i++) {
+		const char *colon = strchr(dsts[i], ':');
+
+		if (!alive[i] || colon == NULL || colon - dsts[i] + 2 > DEV_MAX) {
+			continue;
+		}
+		memcpy(dev, dsts[i], colon - dsts[i] + 1);
+		dev[colon - dsts[i] + 1] = '\0';
+		sceIoSync(dev, 0);
+	}
+	unsynced_files = 0;
+	unsynced_bytes = 0;
+}
+
+// batched modes sync every target device once enough has piled up, the
+// way the plugin's bulk copy does
+static void file_written(const char **dsts, const int *alive, int count, SceOff size) {
+	unsynced_files++;
+	unsynced_bytes += size;
+
+	if (sync_interval == 0) {
+		return;
+	}
+	if ((sync_mode == USBMC_SYNC_FILES && unsynced_files >= sync_interval) ||
+	    (sync_mode == USBMC_SYNC_MB && unsynced_bytes >= (uint64_t)sync_interval * 1024 * 1024)) {
+		sync_targets(dsts, alive, count);
+	}
+}
+
+// Copies src to every target still marked alive. A target that cannot be
+// opened or written is dropped, the others keep going.
+int copy_file_multi(const char **dsts, int *alive, int count, const char *src) {
+	SceUID wfds[AIO_MAX_TARGETS];
+	int ret;
+	SceIoStat stat;
+
+	printf("Copying %s ...\n", src);
+
+	// the copy engine opens src itself, an open here would only add one
+	ret = sceIoGetstat(src, &stat);
+	if (ret < 0) {
+		printf("sceIoGetstat(%s): 0x%08X\n", src, ret);
+		return -1;
+	}
+	for (int i = 0; i < count; i++) {
+		wfds[i] = -1;
+		if (!alive[i]) {
+			continue;
+		}
+		wfds[i] = sceIoOpen(dsts[i], SCE_O_WRONLY | SCE_O_TRUNC | SCE_O_CREAT, 0777);
+		if (wfds[i] < 0) {
+			printf("sceIoOpen(%s): 0x%08X\n", dsts[i], wfds[i]);
+			alive[i] = 0;
+		}
+	}
+
+	if (copy_progress) {
+		copy_progress(copy_progress_arg, 0, stat.st_size);
+	}
+	ret = aio_copy_multi(wfds, alive, count, src, stat.st_size, copy_progress, copy_progress_arg);
+
+	for (int i = 0; i < count; i++) {
+		// the times go on last, writing the data would move them again
+		if (ret >= 0 && alive[i]) {
+			int err = sceIoChstatByFd(wfds[i], &stat, SCE_CST_CT | SCE_CST_AT | SCE_CST_MT);
+			if (err < 0) {
+				printf("sceIoChstat: 0x%08X\n", err);
+				alive[i] = 0;
+			} else if (sync_mode == USBMC_SYNC_STRICT) {
+				sceIoSyncByFd(wfds[i], 0);
+			}
+		}
+		if (wfds[i] >= 0) {
+			sceIoClose(wfds[i]);
+		}
+		if (wfds[i] >= 0 && !alive[i]) {
+			printf("Dropped %s\n", dsts[i]);
+		}
+	}
+
+	if (ret >= 0 && sync_mode != USBMC_SYNC_STRICT) {
+		file_written(dsts, alive, count, stat.st_size);
+	}
+	return (ret < 0) ? -1 : 0;
+}
+
+int copy_file(const char *dst, const char *src) {
+	int alive = 1;
+
+	return copy_file_multi(&dst, &alive, 1, src);
+}
+
+// Copies a batch of NUL-terminated src, dst pairs. The plugin does the
+// whole batch in kernel with one syscall while we poll its progress; an
+// older plugin without bulk copy gets the files copied one by one here.
+static int copy_batch(const char *list, size_t size) {
+	UsbmcBulkCopyStatus status;
+	const char *next = list, *end = list + size;
+	unsigned int shown = 0;
+	int ret;
+
+	if (size == 0) {
+		return 0;
+	}
+
+	if (shellKernelBulkCopy(list, size) < 0) {
+		while (next < end) {
+			const char *dst = next + strlen(next) + 1;
+			copy_file(dst, next);
+			next = dst + strlen(dst) + 1;
+		}
+		return 0;
+	}
+
+	do {
+		sceKernelDelayThread(BULK_POLL_INTERVAL);
+		ret = shellKernelGetBulkCopyStatus(&status);
+		if (ret < 0) {
+			printf("shellKernelGetBulkCopyStatus: 0x%08X\n", ret);
+			return -1;
+		}
+
+		// name every file the plugin has started on since the last poll
+		while (shown <= status.files_done && shown < status.files_total && next < end) {
+			printf("Copying %s ...\n", next);
+			next += strlen(next) + 1;
+			next += strlen(next) + 1;
+			shown++;
+			if (copy_progress) {
+				copy_progress(copy_progress_arg, 0, status.file_size);
+			}
+		}
+		if (copy_progress && status.file_bytes > 0) {
+			copy_progress(copy_progress_arg, status.file_bytes, status.file_size);
+		}
+	} while (status.active);
+
+	if (status.files_failed > 0) {
+		printf("%u files failed to copy: 0x%08X\n", status.files_failed, status.result);
+	}
+
+	return 0;
+}
+
+typedef struct {
+	PathBuf dst[AIO_MAX_TARGETS];
+	int alive[AIO_MAX_TARGETS];
+	int targets;
+	size_t root_len;
+	int tier;           // -1 copies every tier
+	const Rules *rules; // NULL copies everything
+	char *list;         // pending bulk copy, NULL copies file by file
+	size_t list_len;
+	CopyDelta *delta;   // NULL copies whether the target differs or not
+} CopyContext;
+
+typedef struct {
+	size_t dst_len[AIO_MAX_TARGETS];
+	RulesState rules;
+} CopyFrame;
+
+// seconds since an arbitrary epoch, only good for telling times apart
+static uint64_t datetime_seconds(const SceDateTime *t) {
+	return ((((uint64_t)t->year * 12 + t->month) * 31 + t->day) * 24 + t->hour) * 3600 + t->minute * 60 + t->second;
+}
+
+static int same_contents(const char *a, const char *b, SceOff size) {
+	char *buf_a, *buf_b;
+	int fd_a, fd_b, rd_a = 0, rd_b = 0;
+	int same = 0;
+
+	buf_a = pool_alloc(AIO_DEFAULT_BLOCK);
+	buf_b = pool_alloc(AIO_DEFAULT_BLOCK);
+	fd_a = sceIoOpen(a, SCE_O_RDONLY, 0);
+	fd_b = sceIoOpen(b, SCE_O_RDONLY, 0);
+	if (buf_a && buf_b && fd_a >= 0 && fd_b >= 0) {
+		while (size > 0) {
+			rd_a = sceIoRead(fd_a, buf_a, AIO_DEFAULT_BLOCK);
+			rd_b = sceIoRead(fd_b, buf_b, AIO_DEFAULT_BLOCK);
+			if (rd_a <= 0 || rd_a != rd_b || memcmp(buf_a, buf_b, rd_a) != 0) {
+				break;
+			}
+			size -= rd_a;
+		}
+		same = (size == 0);
+	}
+
+	if (fd_a >= 0) {
+		sceIoClose(fd_a);
+	}
+	if (fd_b >= 0) {
+		sceIoClose(fd_b);
+	}
+	pool_free(buf_b);
+	pool_free(buf_a);
+	return same;
+}
+
+// Whether dst still matches src: same size and the same modification time,
+// give or take the 2 second resolution of FAT. copy_file() keeps the times,
+// so anything migrated and never touched since compares equal. With verify
+// the times are ignored and same sized files are compared byte by byte.
+int copy_unchanged(const char *dst, const char *src, const SceIoStat *stat, int verify) {
+	SceIoStat old;
+	uint64_t a, b;
+
+	if (sceIoGetstat(dst, &old) < 0 || old.st_size != stat->st_size) {
+		return 0;
+	}
+	if (verify) {
+		return same_contents(dst, src, stat->st_size);
+	}
+
+	a = datetime_seconds(&old.st_mtime);
+	b = datetime_seconds(&stat->st_mtime);
+	return ((a > b) ? a - b : b - a) <= 2;
+}
+
+static const char *copy_rel(const CopyContext *ctx, const char *path) {
+	path += ctx->root_len;
+	return (*path == '/') ? path + 1 : path;
+}
+
+// appends name to every target path, old receives the previous lengths
+static int copy_push(CopyContext *ctx, const char *name, size_t *old) {
+	for (int i = 0; i < ctx->targets; i++) {
+		int len = path_push(&ctx->dst[i], name);
+		if (len < 0) {
+			while (i-- > 0) {
+				path_truncate(&ctx->dst[i], old[i]);
+			}
+			return -1;
+		}
+		old[i] = len;
+	}
+	return 0;
+}
+
+static void copy_pop(CopyContext *ctx, const size_t *old) {
+	for (int i = 0; i < ctx->targets; i++) {
+		path_truncate(&ctx->dst[i], old[i]);
+	}
+}
+
+static int copy_enter(void *arg, const char *path, const char *name, const SceIoStat *stat, void *parent, void *frame) {
+	CopyContext *ctx = arg;
+	const CopyFrame *p = parent;
+	CopyFrame *f = frame;
+	int match = RULES_COPY;
+
+	if (ctx->rules) {
+		match = rules_step(ctx->rules, &p->rules, name, 1, 0, &f->rules);
+	}
+	if (match == RULES_ERROR) {
+		return WALK_ABORT;
+	}
+	if (match == RULES_SKIP) {
+		return WALK_SKIP;
+	}
+	// skip subtrees that cannot hold anything of the current tier
+	if (ctx->tier >= 0 && !tier_may_contain(copy_rel(ctx, path), ctx->tier)) {
+		return WALK_SKIP;
+	}
+	if (copy_push(ctx, name, f->dst_len) < 0) {
+		return WALK_ABORT;
+	}
+
+	printf("Reading %s ...\n", path);
+	for (int i = 0; i < ctx->targets; i++) {
+		if (ctx->alive[i]) {
+			sceIoMkdir(ctx->dst[i].buf, 0777);
+		}
+	}
+	return WALK_CONTINUE;
+}
+
+static int copy_visit_file(void *arg, const char *path, const char *name, const SceIoStat *stat, void *parent) {
+	CopyContext *ctx = arg;
+	const CopyFrame *p = parent;
+	RulesState unused;
+	size_t old[AIO_MAX_TARGETS];
+	int match = RULES_COPY;
+
+	if (ctx->rules) {
+		match = rules_step(ctx->rules, &p->rules, name, 0, stat->st_size, &unused);
+	}
+	if (match == RULES_ERROR) {
+		return WALK_ABORT;
+	}
+	if (match != RULES_COPY) {
+		return WALK_CONTINUE;
+	}
+	if (ctx->tier >= 0 && tier_classify(copy_rel(ctx, path)) != ctx->tier) {
+		return WALK_CONTINUE;
+	}
+	if (copy_push(ctx, name, old) < 0) {
+		return WALK_ABORT;
+	}
+
+	if (ctx->delta) {
+		if (copy_unchanged(ctx->dst[0].buf, path, stat, ctx->delta->verify)) {
+			ctx->delta->files_avoided++;
+			ctx->delta->bytes_avoided += stat->st_size;
+			copy_pop(ctx, old);
+			return WALK_CONTINUE;
+		}
+		ctx->delta->files_copied++;
+		ctx->delta->bytes_copied += stat->st_size;
+	}
+
+	// fan-out copies go through the installer so every block is read once
+	if (ctx->targets > 1) {
+		const char *dsts[AIO_MAX_TARGETS];
+		int alive[AIO_MAX_TARGETS];
+
+		for (int i = 0; i < ctx->targets; i++) {
+			dsts[i] = ctx->dst[i].buf;
+			alive[i] = ctx->alive[i];
+		}
+		copy_file_multi(dsts, alive, ctx->targets, path);
+		// a target that failed stays dropped for the rest of the tree
+		for (int i = 0; i < ctx->targets; i++) {
+			ctx->alive[i] = alive[i];
+		}
+		copy_pop(ctx, old);
+		return WALK_CONTINUE;
+	}
+
+	size_t src_size = strlen(path) + 1;
+	size_t dst_size = ctx->dst[0].len + 1;
+
+	if (ctx->list && ctx->list_len + src_size + dst_size > USBMC_BULK_LIST_MAX) {
+		copy_batch(ctx->list, ctx->list_len);
+		ctx->list_len = 0;
+	}
+	if (ctx->list && src_size + dst_size <= USBMC_BULK_LIST_MAX) {
+		memcpy(ctx->list + ctx->list_len, path, src_size);
+		ctx->list_len += src_size;
+		memcpy(ctx->list + ctx->list_len, ctx->dst[0].buf, dst_size);
+		ctx->list_len += dst_size;
+	} else {
+		copy_file(ctx->dst[0].buf, path);
+	}
+
+	copy_pop(ctx, old);
+	return WALK_CONTINUE;
+}
+
+static void copy_leave(void *arg, const char *path, void *frame) {
+	copy_pop(arg, ((CopyFrame *)frame)->dst_len);
+}
+
+static const WalkOps copy_ops = {
+	sizeof(CopyFrame),
+	copy_enter,
+	copy_visit_file,
+	copy_leave,
+};
+
+// copies what the rules select of one tier below src to every target in
+// dsts whose alive flag is set, reading src only once however many targets
+// there are. Targets that fail get their flag cleared. With delta set, files
+// the single target already has are left alone.
+int copy_tree(const char **dsts, int *alive, int count, const char *src, int tier, const Rules *rules, int order, CopyDelta *delta) {
+	CopyContext ctx;
+	CopyFrame root;
+	int ret, left = 0;
+
+	if (count < 1 || count > AIO_MAX_TARGETS || (delta && count != 1)) {
+		return -1;
+	}
+	for (ctx.targets = 0; ctx.targets < count; ctx.targets++) {
+		if (path_init(&ctx.dst[ctx.targets], dsts[ctx.targets]) < 0) {
+			ret = -1;
+			goto error;
+		}
+		ctx.alive[ctx.targets] = alive[ctx.targets];
+		root.dst_len[ctx.targets] = ctx.dst[ctx.targets].len;
+		if (alive[ctx.targets]) {
+			sceIoMkdir(dsts[ctx.targets], 0777);
+		}
+	}
+	ctx.root_len = strlen(src);
+	ctx.tier = tier;
+	ctx.rules = rules;
+	ctx.delta = delta;
+	// the bulk copy in the plugin only knows single destinations
+	ctx.list = (count == 1) ? pool_alloc(USBMC_BULK_LIST_MAX) : NULL;
+	ctx.list_len = 0;
+	if (rules) {
+		rules_root(rules, &root.rules);
+	}
+	sync_load();
+
+	ret = walk_tree(src, order, &copy_ops, &ctx, &root);
+
+	// whatever was queued before a failure still gets copied
+	if (ctx.list && copy_batch(ctx.list, ctx.list_len) < 0) {
+		ret = -1;
+	}
+	pool_free(ctx.list);
+
+	for (int i = 0; i < count; i++) {
+		alive[i] = ctx.alive[i];
+		if (alive[i]) {
+			left++;
+		}
+	}
+	// a finished tree leaves nothing unsynced behind unless asked not to
+	if (sync_mode != USBMC_SYNC_NONE && unsynced_files > 0) {
+		sync_targets(dsts, alive, count);
+	}
+	if (left == 0) {
+		ret = -1;
+	}
+
+error:
+	for (int i = 0; i < ctx.targets; i++) {
+		path_free(&ctx.dst[i]);
+	}
+	return ret;
+}
+
+int copy_directory(const char *dst, const char *src) {
+	int alive = 1;
+
+	printf("Reading %s ...\n", src);
+	return copy_tree(&dst, &alive, 1, src, -1, NULL, WALK_ORDER_LARGE_FIRST, NULL);
+}
+
+// how the transfer buffers held up; without a buffer a batch is copied file
+// by file here and a file to verify is copied again
+void copy_report_buffers(void) {
+	PoolStats stats;
+
+	pool_get_stats(&stats);
+	printf("Transfer buffers: peak %u of %u slots, %u requests did not fit\n", stats.peak, stats.slots, stats.failures);
+}
+
+// copies what the rules select below src (everything if rules is NULL), one
+// priority tier after the other. The tiers needed to boot into a usable
+// system are mostly small files and go small-first so they finish early,
+// the bulk tiers go large-first to keep the bus busy.
+int copy_by_priority(const char **dsts, int count, const char *src, const Rules *rules) {
+	int alive[AIO_MAX_TARGETS];
+	AioStats stats;
+	int ret = 0;
+
+	if (count < 1 || count > AIO_MAX_TARGETS) {
+		return -1;
+	}
+	for (int i = 0; i < count; i++) {
+		alive[i] = 1;
+	}
+
+	aio_reset_stats();
+	shellKernelTraceMark(TRACE_PHASE_COPY);
+	for (int tier = 0; tier < TIER_COUNT; tier++) {
+		int order = (tier < TIER_APPS) ? WALK_ORDER_SMALL_FIRST : WALK_ORDER_LARGE_FIRST;
+
+		printf("Copying %s ...\n", tier_name(tier));
+		if (copy_tree(dsts, alive, count, src, tier, rules, order, NULL) < 0) {
+			ret = -1;
+			break;
+		}
+	}
+	shellKernelTraceMark(TRACE_PHASE_INSTALLER);
+
+	if (count > 1) {
+		for (int i = 0; i < count; i++) {
+			if (!alive[i]) {
+				printf("Copy to %s failed\n", dsts[i]);
+			}
+		}
+		aio_get_stats(&stats);
+		printf("Read %0.02f GB, wrote %0.02f GB to %d targets\n", stats.bytes_read / GB_IN_BYTES, stats.bytes_written / GB_IN_BYTES, count);
+	}
+	copy_report_buffers();
+
+	return ret;
+}
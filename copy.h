@@ -0,0 +1,34 @@
+#pragma once
+
+#include <psp2/io/stat.h>
+
+#include <stdint.h>
+
+#include "aio.h"
+#include "rules.h"
+
+// what a delta copy compared, files it skipped count as avoided
+typedef struct {
+	int verify;            // also compare the contents of same sized files
+	unsigned int files_copied;
+	unsigned int files_avoided;
+	uint64_t bytes_copied;
+	uint64_t bytes_avoided;
+} CopyDelta;
+
+// progress() is called with done 0 whenever a file starts, then with the
+// bytes of it written so far
+void copy_set_progress(AioProgress progress, void *arg);
+
+int copy_file_multi(const char **dsts, int *alive, int count, const char *src);
+int copy_file(const char *dst, const char *src);
+
+// whether dst still matches src, whose status is stat
+int copy_unchanged(const char *dst, const char *src, const SceIoStat *stat, int verify);
+
+int copy_tree(const char **dsts, int *alive, int count, const char *src, int tier, const Rules *rules, int order, CopyDelta *delta);
+int copy_directory(const char *dst, const char *src);
+// prints the peak and failures of the transfer buffer pool
+void copy_report_buffers(void);
+
+int copy_by_priority(const char **dsts, int count, const char *src, const Rules *rules);
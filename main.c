@@ -13,9 +13,21 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "aio.h"
+#include "archive.h"
+#include "bench.h"
+#include "bufpool.h"
+#include "copy.h"
+#include "perf.h"
+#include "planner.h"
 #include "debug_screen.h"
+#include "rules.h"
+#include "walker.h"
+#include "plugin/trace_format.h"
+#include "plugin/vitashell_kernel.h"
 
 #define USBMC_INSTALL_PATH "ur0:tai/usbmc.skprx"
+#define USBMC_BACKUP_CONFIG_PATH "ur0:tai/usbmc_backup.txt"
 #define GB_IN_BYTES (1073741824.0f)
 
 #define printf psvDebugScreenPrintf
@@ -72,18 +84,34 @@ uint32_t get_key(void) {
 }
 
 void press_exit(void) {
+	perf_end();
 	printf("\nPress any key to exit this application.\n");
 	get_key();
 	sceKernelExitProcess(0);
 }
 
+// whatever a migration left in the write caches must reach the media
+// before the power goes, whichever durability mode it was copied with
+void flush_devices(void) {
+	static const char *devices[] = { "ux0:", "uma0:", "ur0:" };
+
+	shellKernelTraceFlush();
+
+	for (size_t i = 0; i < sizeof(devices)/sizeof(*devices); ++i)
+		sceIoSync(devices[i], 0);
+}
+
 void press_reboot(void) {
+	perf_end();
+	flush_devices();
 	printf("\nPress any key to reboot.\n");
 	get_key();
 	scePowerRequestColdReset();
 }
 
 void press_shutdown(void) {
+	perf_end();
+	flush_devices();
 	printf("\nPress any key to power off.\n");
 	get_key();
 	scePowerRequestStandby();
@@ -117,101 +145,14 @@ int check_enso(void) {
 	return exists("ur0:tai/boot_config.txt") || exists("vs0:tai/boot_config.txt");
 }
 
-int copy_file(const char *dst, const char *src) {
-	char buffer[0x1000];
-	int ret;
-	int off;
-	SceIoStat stat;
-
-	printf("Copying %s ...\n", src);
-
-	int fd = sceIoOpen(src, SCE_O_RDONLY, 0);
-	if (fd < 0) {
-		printf("sceIoOpen(%s): 0x%08X\n", src, fd);
-		return -1;
-	}
-	int wfd = sceIoOpen(dst, SCE_O_WRONLY | SCE_O_TRUNC | SCE_O_CREAT, 0777);
-	if (wfd < 0) {
-		printf("sceIoOpen(%s): 0x%08X\n", dst, wfd);
-		sceIoClose(fd);
-		return -1;
-	}
-	ret = sceIoGetstatByFd(fd, &stat);
-	if (ret < 0) {
-		printf("sceIoGetstatByFd: 0x%08X\n", ret);
-		goto error;
+// a new file starts with done 0
+static void draw_progress(void *arg, SceOff done, SceOff size) {
+	(void)arg;
+	if (done == 0) {
+		draw_rect(0, SCREEN_HEIGHT - PROGRESS_BAR_HEIGHT, PROGRESS_BAR_WIDTH, PROGRESS_BAR_HEIGHT, 0xFF666666);
+		return;
 	}
-	ret = sceIoChstatByFd(wfd, &stat, SCE_CST_CT | SCE_CST_AT | SCE_CST_MT);
-	if (ret < 0) {
-		printf("sceIoChstat: 0x%08X\n", ret);
-		return -1;
-	}
-
-	size_t rd, wr, total, write;
-	total = 0;
-	draw_rect(0, SCREEN_HEIGHT - PROGRESS_BAR_HEIGHT, PROGRESS_BAR_WIDTH, PROGRESS_BAR_HEIGHT, 0xFF666666);
-	while ((rd = sceIoRead(fd, buffer, sizeof(buffer))) > 0){
-		off = 0;
-		while ((off += (wr = sceIoWrite(wfd, buffer+off, rd-off))) < rd){
-			if (wr < 0){
-				printf("sceIoWrite: 0x%08X\n", wr);
-				goto error;
-			}
-		}
-		total += rd;
-		draw_rect(1, SCREEN_HEIGHT - PROGRESS_BAR_HEIGHT + 1, ((uint64_t)(PROGRESS_BAR_WIDTH - 2)) * total / stat.st_size, PROGRESS_BAR_HEIGHT - 2, 0xFFFFFFFF);
-	}
-	if (rd < 0) {
-		printf("sceIoRead: 0x%08X\n", rd);
-		goto error;
-	}
-
-	sceIoClose(fd);
-	sceIoClose(wfd);
-
-	return 0;
-
-error:
-	sceIoClose(fd);
-	sceIoClose(wfd);
-	return -1;
-}
-
-int copy_directory(const char *dst, const char *src) {
-	int fd;
-	SceIoDirent dir;
-	SceIoStat stat;
-	char src_2[256];
-	char dst_2[256];
-	int ret;
-
-	printf("Reading %s ...\n", src);
-
-	sceIoMkdir(dst, 0777);
-
-	if ((fd = sceIoDopen(src)) < 0) {
-		printf("sceIoDopen: 0x%08X\n", fd);
-	    return -1;
-	}
-
-	while ((ret = sceIoDread(fd, &dir)) > 0) {
-		if (dir.d_name[0] == '\0') {
-			continue;
-		}
-		sprintf(src_2, "%s/%s", src, dir.d_name);
-		sprintf(dst_2, "%s/%s", dst, dir.d_name);
-		if (SCE_S_ISDIR(dir.d_stat.st_mode)) {
-			copy_directory(dst_2, src_2);
-		} else {
-			copy_file(dst_2, src_2);
-		}
-	}
-
-	sceIoDclose(fd);
-	return 0;
-error:
-	sceIoDclose(fd);
-	return -1;
+	draw_rect(1, SCREEN_HEIGHT - PROGRESS_BAR_HEIGHT + 1, ((uint64_t)(PROGRESS_BAR_WIDTH - 2)) * done / size, PROGRESS_BAR_HEIGHT - 2, 0xFFFFFFFF);
 }
 
 int find_config(const char *configpath, int remove) {
@@ -235,7 +176,7 @@ int find_config(const char *configpath, int remove) {
 		return 0;
 	}
 
-	buffer = malloc(size);
+	buffer = pool_alloc(size + 1);
 	if (buffer == NULL) {
 		sceIoClose(fd);
 		return 0;
@@ -248,12 +189,13 @@ int find_config(const char *configpath, int remove) {
 	}
 	sceIoClose(fd);
 	if (rd < 0 || total != size) {
-		free(buffer);
+		pool_free(buffer);
 		return 0;
 	}
+	buffer[size] = '\0';
 
 	if ((line = strstr(buffer, USBMC_INSTALL_PATH "\n")) == NULL) {
-		free(buffer);
+		pool_free(buffer);
 		return 0;
 	} else {
 		if (remove) {
@@ -264,7 +206,7 @@ int find_config(const char *configpath, int remove) {
 			sceIoWrite(fd, buffer, newsize);
 			sceIoClose(fd);
 		}
-		free(buffer);
+		pool_free(buffer);
 		return 1;
 	}
 }
@@ -322,7 +264,94 @@ int install_plugin(void) {
 	return 0;
 }
 
+// the USB storage is only uma0 while ux0 is still the memory card
+static int mount_usb(void) {
+	SceIoDevInfo info;
+
+	if (shellKernelIsUx0Redirected() == 1 || !exists("sdstor0:uma-lp-act-entire")) {
+		printf("A USB storage device is not detected or already used as memory card.\n");
+		return -1;
+	}
+	vshIoMount(0xF00, NULL, 0, 0, 0, 0);
+	if (sceIoDevctl("uma0:", 0x3001, NULL, 0, &info, sizeof(SceIoDevInfo)) < 0) {
+		printf("Could not read the USB storage.\n");
+		return -1;
+	}
+	return 0;
+}
+
+// Copies what changed on the USB storage since the migration back to the
+// memory card, so that nothing is stranded on USB after uninstalling. With
+// the card inserted ux0 is the card again and the USB storage is uma0:.
+int sync_back(int verify) {
+	const char *dst = "ux0:";
+	CopyDelta delta;
+	Rules *rules;
+	int alive = 1;
+	int ret;
+
+	if (mount_usb() < 0) {
+		return -1;
+	}
+	if ((rules = rules_create()) == NULL) {
+		printf("Out of memory!\n");
+		return -1;
+	}
+	// backups made on the USB storage do not belong on the card
+	rules_add(rules, RULE_EXCLUDE, "ux0_backup", 0);
+	rules_add(rules, RULE_EXCLUDE, "ux0_backup.pkg", 0);
+	rules_add(rules, RULE_EXCLUDE, "ux0_backup.pkg~idx", 0);
+
+	memset(&delta, 0, sizeof(delta));
+	delta.verify = verify;
+
+	printf("\nCopying changes back to the memory card ...\n");
+	perf_begin();
+	shellKernelTraceMark(TRACE_PHASE_COPY);
+	ret = copy_tree(&dst, &alive, 1, "uma0:", -1, rules, WALK_ORDER_LARGE_FIRST, &delta);
+	shellKernelTraceMark(TRACE_PHASE_INSTALLER);
+	perf_end();
+	rules_free(rules);
+
+	printf("\nCopied %u files (%0.02f GB), %u files (%0.02f GB) were unchanged.\n",
+		   delta.files_copied, delta.bytes_copied / GB_IN_BYTES,
+		   delta.files_avoided, delta.bytes_avoided / GB_IN_BYTES);
+	copy_report_buffers();
+	if (ret < 0) {
+		printf("Some files could not be copied back.\n");
+		return -1;
+	}
+	flush_devices();
+	return 0;
+}
+
 int uninstall_plugin(void) {
+	if (shellKernelIsUx0Redirected() == 1) {
+		// the memory card is not mounted anywhere while ux0 is on USB
+		printf("The USB storage is used as memory card. To copy what changed on it back,\n"
+			   "insert the memory card, reboot and uninstall again.\n");
+		printf("  CROSS      Uninstall without copying anything back\n");
+		printf("  CIRCLE     Cancel\n\n");
+		if (get_key() != SCE_CTRL_CROSS) {
+			return 0;
+		}
+	} else if (exists("sdstor0:uma-lp-act-entire")) {
+		printf("Data written while the USB storage was used as memory card stays on it.\n");
+		printf("  CROSS      Copy what changed back to the memory card, by size and date\n");
+		printf("  SQUARE     Same, but compare the contents of files with the same size\n");
+		printf("  CIRCLE     Uninstall without copying anything back\n\n");
+		switch (get_key()) {
+		case SCE_CTRL_CROSS:
+			sync_back(0);
+			break;
+		case SCE_CTRL_SQUARE:
+			sync_back(1);
+			break;
+		default:
+			break;
+		}
+	}
+
 	printf("deleting plugin... ");
 	if (sceIoRemove(USBMC_INSTALL_PATH) < 0) {
 		printf("failed.\n");
@@ -353,9 +382,99 @@ int uninstall_plugin(void) {
 	return 0;
 }
 
+// walks src the way the copy will and shows per tier what it needs on dev,
+// cluster rounding and directories included
+int check_space(const char *src, const Rules *rules, const char *dev, const SceIoDevInfo *info) {
+	Plan plan;
+	int ret;
+
+	printf("\nPlanning migration to %s ...\n", dev);
+	shellKernelTraceMark(TRACE_PHASE_PLAN);
+	ret = plan_tree(src, rules, info->cluster_size, &plan);
+	shellKernelTraceMark(TRACE_PHASE_INSTALLER);
+	if (ret < 0) {
+		printf("Could not read %s\n", src);
+		return -1;
+	}
+	plan_print(&plan, dev, info->free_size);
+
+	if (plan.total.footprint > (uint64_t)info->free_size) {
+		printf("Not enough free space on %s!\n", dev);
+		return -1;
+	}
+	return 0;
+}
+
+// devices the backup of the R option may go to: not the USB storage it is
+// a backup of, not the memory card it is copied from, nothing of the system
+static const char * const backup_devices[] = { "grw0:", "imc0:" };
+
+// Reads the backup directory from the first line of USBMC_BACKUP_CONFIG_PATH
+// and checks that it is a directory on one of backup_devices. dev gets the
+// device part of it.
+int load_backup_path(char *path, size_t size, char *dev, size_t dev_size) {
+	const char *p = NULL;
+	size_t len;
+	int fd, rd;
+
+	if ((fd = sceIoOpen(USBMC_BACKUP_CONFIG_PATH, SCE_O_RDONLY, 0)) < 0) {
+		printf("Put the directory for the backup, e.g. grw0:ux0_backup, in\n"
+			   USBMC_BACKUP_CONFIG_PATH " first.\n");
+		return -1;
+	}
+	rd = sceIoRead(fd, path, size - 1);
+	sceIoClose(fd);
+	if (rd < 0) {
+		printf("sceIoRead(%s): 0x%08X\n", USBMC_BACKUP_CONFIG_PATH, rd);
+		return -1;
+	}
+	path[rd] = '\0';
+	path[strcspn(path, "\r\n")] = '\0';
+	while ((len = strlen(path)) > 0 && (path[len - 1] == ' ' || path[len - 1] == '\t' || path[len - 1] == '/')) {
+		path[len - 1] = '\0';
+	}
+
+	for (size_t i = 0; i < sizeof(backup_devices)/sizeof(*backup_devices); i++) {
+		len = strlen(backup_devices[i]);
+		if (strncmp(path, backup_devices[i], len) == 0) {
+			p = path + len;
+			break;
+		}
+	}
+	if (p == NULL || len >= dev_size) {
+		printf("The backup in %s must go to grw0: or imc0:, a backup on the USB\n"
+			   "storage would be lost together with it.\n", USBMC_BACKUP_CONFIG_PATH);
+		return -1;
+	}
+	memcpy(dev, path, len);
+	dev[len] = '\0';
+
+	while (*p == '/') {
+		p++;
+	}
+	if (*p == '\0') {
+		printf("The backup in %s must be a directory, not the whole device.\n", USBMC_BACKUP_CONFIG_PATH);
+		return -1;
+	}
+	// no component may climb out of the device
+	while (*p) {
+		const char *end = p + strcspn(p, "/\\");
+		if (end - p == 2 && p[0] == '.' && p[1] == '.') {
+			printf("The backup in %s may not contain \"..\".\n", USBMC_BACKUP_CONFIG_PATH);
+			return -1;
+		}
+		p = *end ? end + 1 : end;
+	}
+	return 0;
+}
+
 int install_redirect(void) {
-	SceIoDevInfo info;
+	SceIoDevInfo info, backup_info;
 	uint64_t ux0_free_space, ux0_max_space;
+	char backup[256], backup_dev[8];
+	const char *dsts[] = { "uma0:", backup };
+	Rules *rules;
+	int fd;
 
 	while (1) {
 		if (!exists("sdstor0:uma-lp-act-entire")) {
@@ -386,45 +505,80 @@ int install_redirect(void) {
 	printf("USB Storage: %0.02f GB Free / %0.02f GB Total\n", info.free_size / GB_IN_BYTES, info.max_size / GB_IN_BYTES);
 
 	printf("Would you like to migrate content from your current memory card?\n");
-	printf("  CROSS      Copy ONLY VitaShell and molecularShell (if installed)\n");
+	printf("  CROSS      Copy ONLY VitaShell and molecularShell (if installed), or what\n"
+		   "             " USBMC_RULES_PATH " selects\n");
 	printf("  SQUARE     Copy ALL data (existing data on USB will be replaced!)\n");
+	printf("  R          Copy ALL data and keep a backup of it in the directory\n"
+		   "             " USBMC_BACKUP_CONFIG_PATH " names\n");
+	printf("  TRIANGLE   Use USB now and copy ALL data in the background\n");
 	printf("  CIRCLE     Cancel installation\n");
 
 again:
 	switch (get_key()) {
 	case SCE_CTRL_CROSS:
-		if (exists("ux0:app/VITASHELL/eboot.bin")) {
-			sceIoMkdir("uma0:app", 0777);
-			sceIoMkdir("uma0:app/VITASHELL", 0777);
-			copy_directory("uma0:app/VITASHELL", "ux0:app/VITASHELL");
-			sceIoMkdir("uma0:appmeta", 0777);
-			sceIoMkdir("uma0:appmeta/VITASHELL", 0777);
-			copy_directory("uma0:appmeta/VITASHELL", "ux0:appmeta/VITASHELL");
-			sceIoMkdir("uma0:license", 0777);
-			sceIoMkdir("uma0:license/app", 0777);
-			sceIoMkdir("uma0:license/app/VITASHELL", 0777);
-			copy_directory("uma0:license/app/VITASHELL", "ux0:license/app/VITASHELL");
+		if (exists(USBMC_RULES_PATH)) {
+			// a broken rules file must not quietly migrate something else
+			if ((rules = rules_load(USBMC_RULES_PATH)) == NULL) {
+				printf("Could not load %s, fix it and try again.\n", USBMC_RULES_PATH);
+				goto again;
+			}
+			printf("Using rules from %s\n", USBMC_RULES_PATH);
+		} else if ((rules = rules_create()) != NULL) {
+			rules_add_title(rules, "VITASHELL");
+			rules_add_title(rules, "MLCL00001");
+		}
+		if (rules == NULL) {
+			printf("Out of memory!\n");
+			goto again;
 		}
-		if (exists("ux0:app/MLCL00001/eboot.bin")) {
-			sceIoMkdir("uma0:app", 0777);
-			sceIoMkdir("uma0:app/MLCL00001", 0777);
-			copy_directory("uma0:app/MLCL00001", "ux0:app/MLCL00001");
-			sceIoMkdir("uma0:appmeta", 0777);
-			sceIoMkdir("uma0:appmeta/MLCL00001", 0777);
-			copy_directory("uma0:appmeta/MLCL00001", "ux0:appmeta/MLCL00001");
-			sceIoMkdir("uma0:license", 0777);
-			sceIoMkdir("uma0:license/app", 0777);
-			sceIoMkdir("uma0:license/app/MLCL00001", 0777);
-			copy_directory("uma0:license/app/MLCL00001", "ux0:license/app/MLCL00001");
+		if (check_space("ux0:", rules, "uma0:", &info) < 0) {
+			rules_free(rules);
+			goto again;
 		}
+		perf_begin();
+		copy_by_priority(dsts, 1, "ux0:", rules);
+		perf_end();
+		rules_free(rules);
 		break;
 	case SCE_CTRL_SQUARE:
-		if ((ux0_max_space - ux0_free_space) > info.free_size) {
-			printf("Not enough free space!\n");
+		if (check_space("ux0:", NULL, "uma0:", &info) < 0) {
+			goto again;
+		}
+		perf_begin();
+		copy_by_priority(dsts, 1, "ux0:", NULL);
+		perf_end();
+		break;
+	case SCE_CTRL_RTRIGGER:
+		if (load_backup_path(backup, sizeof(backup), backup_dev, sizeof(backup_dev)) < 0) {
+			goto again;
+		}
+		if (sceIoDevctl(backup_dev, 0x3001, NULL, 0, &backup_info, sizeof(SceIoDevInfo)) < 0) {
+			printf("Could not read the size of %s, is it mounted?\n", backup_dev);
 			goto again;
 		}
-		copy_directory("uma0:", "ux0:");
+		// the two copies go to different devices, each needs room for one
+		if (check_space("ux0:", NULL, "uma0:", &info) < 0 ||
+		    check_space("ux0:", NULL, backup_dev, &backup_info) < 0) {
+			goto again;
+		}
+		perf_begin();
+		copy_by_priority(dsts, 2, "ux0:", NULL);
+		perf_end();
 		break;
+	case SCE_CTRL_TRIANGLE:
+		if (check_space("ux0:", NULL, "uma0:", &info) < 0) {
+			goto again;
+		}
+		if ((fd = sceIoOpen(USBMC_LAZY_PATH, SCE_O_WRONLY | SCE_O_CREAT | SCE_O_TRUNC, 0777)) < 0) {
+			printf("sceIoOpen(%s): 0x%08X\n", USBMC_LAZY_PATH, fd);
+			goto again;
+		}
+		sceIoClose(fd);
+		printf("\n\nAfter rebooting, the USB storage will be used as memory card right away and your\n"
+			   "data will be copied over in the background. Keep the Sony memory card inserted\n"
+			   "until this installer reports that the migration is complete.\n");
+		press_reboot();
+		return 0;
 	case SCE_CTRL_CIRCLE:
 		return 0;
 		break;
@@ -438,14 +592,137 @@ again:
 	return 0;
 }
 
+int run_benchmark(void) {
+	static char profile_label[16];
+	BenchDevice devs[3];
+	SceIoDevInfo info;
+	int count = 0;
+
+	printf("\nBenchmarking, this takes a few minutes ...\n");
+	shellKernelTraceMark(TRACE_PHASE_BENCH);
+
+	if (bench_device("ux0:", &devs[count]) == 0) {
+		count++;
+	}
+
+	// when redirected ux0 already is the USB storage, never mount it twice
+	if (shellKernelIsUx0Redirected() != 1 && exists("sdstor0:uma-lp-act-entire")) {
+		vshIoMount(0xF00, NULL, 0, 0, 0, 0);
+		if (sceIoDevctl("uma0:", 0x3001, NULL, 0, &info, sizeof(SceIoDevInfo)) >= 0 &&
+		    bench_device("uma0:", &devs[count]) == 0) {
+			count++;
+		}
+	}
+
+	// the last device once more at the clocks a migration runs with
+	if (count > 0) {
+		const char *dev = devs[count - 1].dev;
+
+		perf_begin();
+		if (bench_device(dev, &devs[count]) == 0) {
+			snprintf(profile_label, sizeof(profile_label), "%s profile", dev);
+			devs[count].dev = profile_label;
+			count++;
+		}
+		perf_end();
+	}
+
+	shellKernelTraceMark(TRACE_PHASE_INSTALLER);
+
+	if (count == 0) {
+		printf("Benchmark failed.\n");
+		return -1;
+	}
+
+	bench_print(devs, count);
+	if (bench_save_csv(USBMC_BENCH_CSV_PATH, devs, count) == 0) {
+		printf("\nResults saved to %s\n", USBMC_BENCH_CSV_PATH);
+	}
+
+	return 0;
+}
+
+static void print_archive_stats(const char *what, const ArchiveStats *stats) {
+	printf("\n%s %u files and %u directories, %0.02f MB in %0.01f s (%0.02f MB/s, %0.01f files/s)\n",
+		   what, stats->files, stats->dirs, stats->bytes / (1024.0 * 1024.0), stats->seconds,
+		   stats->bytes / (1024.0 * 1024.0) / stats->seconds, stats->files / stats->seconds);
+	if (stats->failed > 0) {
+		printf("%u files could not be restored.\n", stats->failed);
+	}
+}
+
+int pack_backup(void) {
+	ArchiveStats stats;
+	int ret;
+
+	if (mount_usb() < 0) {
+		return -1;
+	}
+
+	printf("\nPacking ux0: into " USBMC_ARCHIVE_PATH " ...\n");
+	perf_begin();
+	shellKernelTraceMark(TRACE_PHASE_COPY);
+	ret = archive_pack(USBMC_ARCHIVE_PATH, "ux0:", NULL, &stats);
+	shellKernelTraceMark(TRACE_PHASE_INSTALLER);
+	perf_end();
+	if (ret < 0) {
+		printf("Backup failed.\n");
+		return -1;
+	}
+	print_archive_stats("Packed", &stats);
+	flush_devices();
+	return 0;
+}
+
+int restore_backup(void) {
+	ArchiveStats stats;
+	int ret;
+
+	if (mount_usb() < 0) {
+		return -1;
+	}
+	if (!exists(USBMC_ARCHIVE_PATH)) {
+		printf("No backup found at " USBMC_ARCHIVE_PATH "\n");
+		return -1;
+	}
+
+	printf("Files on ux0: that are also in the backup will be replaced.\n"
+		   "Press CROSS to restore " USBMC_ARCHIVE_PATH " or any other key to cancel.\n\n");
+	if (get_key() != SCE_CTRL_CROSS) {
+		return 0;
+	}
+
+	perf_begin();
+	shellKernelTraceMark(TRACE_PHASE_COPY);
+	ret = archive_restore(USBMC_ARCHIVE_PATH, "ux0:", &stats);
+	shellKernelTraceMark(TRACE_PHASE_INSTALLER);
+	perf_end();
+	if (ret < 0) {
+		printf("Restore failed.\n");
+		return -1;
+	}
+	print_archive_stats("Restored", &stats);
+	flush_devices();
+	return 0;
+}
+
 int main(int argc, char *argv[]) {
 	(void)argc;
 	(void)argv;
 
 	int ret = 0;
+	UsbmcLazyStatus lazy;
 
 	psvDebugScreenInit();
 
+	if (pool_init(POOL_DEFAULT_CAP) < 0 || aio_init(AIO_DEFAULT_DEPTH, AIO_DEFAULT_BLOCK) < 0) {
+		press_exit();
+	}
+	copy_set_progress(draw_progress, NULL);
+
+	// only does something when the plugin was loaded with tracing on
+	shellKernelTraceMark(TRACE_PHASE_INSTALLER);
+
 	if (check_safe_mode()) {
 		printf("Please enable HENkaku unsafe homebrew from Settings before running this installer.\n\n");
 		press_exit();
@@ -472,9 +749,21 @@ int main(int argc, char *argv[]) {
 		sceKernelExitProcess(0);
 	}
 
+	if (shellKernelGetLazyStatus(&lazy) >= 0 && lazy.active) {
+		if (lazy.done) {
+			printf("Background migration complete. Shut down your device and remove the Sony memory card.\n\n");
+		} else {
+			printf("Background migration in progress: %u files (%0.02f GB) copied, %u queued.\n\n",
+				   lazy.files_copied, lazy.bytes_copied / GB_IN_BYTES, lazy.queued);
+		}
+	}
+
 	printf("Options:\n\n");
 	printf("  CROSS      Install USB as memory card.\n");
 	printf("  TRIANGLE   Uninstall usbmc plugin.\n");
+	printf("  SQUARE     Benchmark memory card and USB storage.\n");
+	printf("  R          Pack memory card into a backup archive on USB storage.\n");
+	printf("  L          Restore that backup archive to the memory card.\n");
 	printf("  CIRCLE     Exit without doing anything.\n\n");
 
 again:
@@ -485,6 +774,15 @@ again:
 	case SCE_CTRL_TRIANGLE:
 		uninstall_plugin();
 		break;
+	case SCE_CTRL_SQUARE:
+		run_benchmark();
+		break;
+	case SCE_CTRL_RTRIGGER:
+		pack_backup();
+		break;
+	case SCE_CTRL_LTRIGGER:
+		restore_backup();
+		break;
 	case SCE_CTRL_CIRCLE:
 		break;
 	default:
@@ -0,0 +1,105 @@
+#include <psp2/kernel/processmgr.h>
+#include <psp2/kernel/threadmgr.h>
+#include <psp2/power.h>
+
+#include "debug_screen.h"
+#include "perf.h"
+
+#define printf psvDebugScreenPrintf
+
+// Migration profile. Copying is bound by the bus and by the CPU time spent
+// in the filesystem for every small file, and the default clocks leave both
+// slow. The system also dims and then suspends after a few minutes without
+// input, which stops a copy dead; a thread ticking the power service keeps
+// it awake. Failing to change a clock is not fatal, the copy only runs at
+// whatever speed is left.
+
+typedef struct {
+	int arm;
+	int bus;
+	int gpu_xbar;
+} PerfClocks;
+
+static PerfClocks saved;
+static int perf_active = 0;
+static SceUID tick_thread = -1;
+static SceUID tick_stop = -1;
+
+static void set_clocks(const PerfClocks *clocks) {
+	int ret;
+
+	if ((ret = scePowerSetArmClockFrequency(clocks->arm)) < 0)
+		printf("scePowerSetArmClockFrequency: 0x%08X\n", ret);
+	if ((ret = scePowerSetBusClockFrequency(clocks->bus)) < 0)
+		printf("scePowerSetBusClockFrequency: 0x%08X\n", ret);
+	if ((ret = scePowerSetGpuXbarClockFrequency(clocks->gpu_xbar)) < 0)
+		printf("scePowerSetGpuXbarClockFrequency: 0x%08X\n", ret);
+}
+
+// ticks until tick_stop is signalled
+static int tick_loop(SceSize args, void *argp) {
+	SceUInt timeout;
+
+	do {
+		sceKernelPowerTick(SCE_KERNEL_POWER_TICK_DISABLE_AUTO_SUSPEND);
+		sceKernelPowerTick(SCE_KERNEL_POWER_TICK_DISABLE_OLED_DIMMING);
+		timeout = PERF_TICK_INTERVAL;
+	} while (sceKernelWaitSema(tick_stop, 1, &timeout) < 0);
+
+	return 0;
+}
+
+int perf_begin(void) {
+	static const PerfClocks fast = { PERF_ARM_CLOCK, PERF_BUS_CLOCK, PERF_GPU_XBAR_CLOCK };
+	int ret;
+
+	if (perf_active)
+		return 0;
+
+	saved.arm = scePowerGetArmClockFrequency();
+	saved.bus = scePowerGetBusClockFrequency();
+	saved.gpu_xbar = scePowerGetGpuXbarClockFrequency();
+	set_clocks(&fast);
+	perf_active = 1;
+
+	if ((tick_stop = sceKernelCreateSema("usbmc_tick_stop", 0, 0, 1, NULL)) < 0) {
+		printf("sceKernelCreateSema: 0x%08X\n", tick_stop);
+		goto error;
+	}
+	if ((tick_thread = sceKernelCreateThread("usbmc_tick", tick_loop, 0x10000100, 0x1000, 0, 0, NULL)) < 0) {
+		printf("sceKernelCreateThread: 0x%08X\n", tick_thread);
+		goto error;
+	}
+	if ((ret = sceKernelStartThread(tick_thread, 0, NULL)) < 0) {
+		printf("sceKernelStartThread: 0x%08X\n", ret);
+		sceKernelDeleteThread(tick_thread);
+		tick_thread = -1;
+		goto error;
+	}
+	return 0;
+
+error:
+	// without the ticks the device may suspend mid copy, so nothing of the
+	// profile is kept: the clocks go back and the next perf_begin() retries
+	perf_end();
+	return -1;
+}
+
+void perf_end(void) {
+	if (!perf_active)
+		return;
+
+	if (tick_thread >= 0) {
+		sceKernelSignalSema(tick_stop, 1);
+		sceKernelWaitThreadEnd(tick_thread, NULL, NULL);
+		sceKernelDeleteThread(tick_thread);
+		tick_thread = -1;
+	}
+	if (tick_stop >= 0) {
+		sceKernelDeleteSema(tick_stop);
+		tick_stop = -1;
+	}
+
+	set_clocks(&saved);
+	perf_active = 0;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+// clocks in MHz while a migration runs
+#define PERF_ARM_CLOCK 444
+#define PERF_BUS_CLOCK 222
+#define PERF_GPU_XBAR_CLOCK 166
+
+#define PERF_TICK_INTERVAL (1000 * 1000) // 1s
+
+// Raises the clocks and keeps the device awake until perf_end(), which puts
+// back the clocks that were set before. Both may be called any number of
+// times; only the first perf_begin() and the first perf_end() after it act.
+// A perf_begin() that fails leaves nothing changed.
+int perf_begin(void);
+void perf_end(void);
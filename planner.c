@@ -0,0 +1,145 @@
+#include <psp2/io/stat.h>
+
+#include <string.h>
+
+#include "debug_screen.h"
+#include "planner.h"
+#include "walker.h"
+
+#define printf psvDebugScreenPrintf
+
+#define MB_IN_BYTES (1048576.0f)
+#define PLAN_DEFAULT_CLUSTER (32 * 1024)
+#define DIRENT_SIZE 32
+
+// Works out what a copy of src takes on a destination with the given
+// cluster size: every non-empty file is rounded up to whole clusters and
+// every directory created holds its entries in at least one cluster of its
+// own. Entries are counted the worse of the exFAT way (file, stream and one
+// name entry per 15 characters) and the FAT32 way (short entry plus one
+// long name entry per 13 characters).
+
+typedef struct {
+	Plan *plan;
+	size_t root_len;
+	const Rules *rules;
+} PlanContext;
+
+typedef struct {
+	uint64_t entries; // bytes of directory entries this directory holds
+	int tier;
+	RulesState rules;
+} PlanFrame;
+
+static uint64_t round_up(uint64_t size, unsigned int cluster) {
+	return (size + cluster - 1) / cluster * cluster;
+}
+
+static unsigned int entry_bytes(const char *name) {
+	unsigned int len = strlen(name);
+	unsigned int exfat = 2 + (len + 14) / 15;
+	unsigned int fat = 1 + (len + 12) / 13;
+
+	return ((exfat > fat) ? exfat : fat) * DIRENT_SIZE;
+}
+
+static const char *plan_rel(const PlanContext *ctx, const char *path) {
+	path += ctx->root_len;
+	return (*path == '/') ? path + 1 : path;
+}
+
+static void account(Plan *plan, int tier, unsigned int files, unsigned int dirs, uint64_t bytes, uint64_t footprint) {
+	PlanTier *t[] = { &plan->tiers[tier], &plan->total };
+
+	for (size_t i = 0; i < sizeof(t)/sizeof(*t); ++i) {
+		t[i]->files += files;
+		t[i]->dirs += dirs;
+		t[i]->bytes += bytes;
+		t[i]->footprint += footprint;
+	}
+}
+
+static int plan_enter(void *arg, const char *path, const char *name, const SceIoStat *stat, void *parent, void *frame) {
+	PlanContext *ctx = arg;
+	PlanFrame *p = parent;
+	PlanFrame *f = frame;
+	int match = RULES_COPY;
+
+	if (ctx->rules)
+		match = rules_step(ctx->rules, &p->rules, name, 1, 0, &f->rules);
+	if (match == RULES_ERROR)
+		return WALK_ABORT;
+	if (match == RULES_SKIP)
+		return WALK_SKIP;
+
+	p->entries += entry_bytes(name);
+	f->entries = 0;
+	f->tier = tier_classify(plan_rel(ctx, path));
+	return WALK_CONTINUE;
+}
+
+static int plan_file(void *arg, const char *path, const char *name, const SceIoStat *stat, void *parent) {
+	PlanContext *ctx = arg;
+	PlanFrame *p = parent;
+	RulesState unused;
+	int match = RULES_COPY;
+
+	if (ctx->rules)
+		match = rules_step(ctx->rules, &p->rules, name, 0, stat->st_size, &unused);
+	if (match == RULES_ERROR)
+		return WALK_ABORT;
+	if (match != RULES_COPY)
+		return WALK_CONTINUE;
+
+	p->entries += entry_bytes(name);
+	account(ctx->plan, tier_classify(plan_rel(ctx, path)), 1, 0, stat->st_size, round_up(stat->st_size, ctx->plan->cluster));
+	return WALK_CONTINUE;
+}
+
+static void plan_leave(void *arg, const char *path, void *frame) {
+	PlanContext *ctx = arg;
+	PlanFrame *f = frame;
+	uint64_t size = round_up(f->entries, ctx->plan->cluster);
+
+	account(ctx->plan, f->tier, 0, 1, 0, size ? size : ctx->plan->cluster);
+}
+
+static const WalkOps plan_ops = {
+	sizeof(PlanFrame),
+	plan_enter,
+	plan_file,
+	plan_leave,
+};
+
+// the walk reads directory listings only, no file is opened
+int plan_tree(const char *src, const Rules *rules, unsigned int cluster, Plan *plan) {
+	PlanContext ctx;
+	PlanFrame root;
+
+	memset(plan, 0, sizeof(*plan));
+	plan->cluster = cluster ? cluster : PLAN_DEFAULT_CLUSTER;
+
+	ctx.plan = plan;
+	ctx.root_len = strlen(src);
+	ctx.rules = rules;
+	root.entries = 0;
+	root.tier = TIER_BULK;
+	if (rules)
+		rules_root(rules, &root.rules);
+
+	return walk_tree(src, WALK_ORDER_DIRENT, &plan_ops, &ctx, &root);
+}
+
+void plan_print(const Plan *plan, const char *dev, uint64_t free_size) {
+	printf("\n%-22s%9s%8s%11s%11s\n", "", "files", "dirs", "data MB", "on disk MB");
+	for (int i = 0; i < TIER_COUNT; i++) {
+		const PlanTier *t = &plan->tiers[i];
+		if (t->files == 0 && t->dirs == 0)
+			continue;
+		printf("%-22s%9u%8u%11.01f%11.01f\n", tier_name(i), t->files, t->dirs,
+		       t->bytes / MB_IN_BYTES, t->footprint / MB_IN_BYTES);
+	}
+	printf("%-22s%9u%8u%11.01f%11.01f\n", "total", plan->total.files, plan->total.dirs,
+	       plan->total.bytes / MB_IN_BYTES, plan->total.footprint / MB_IN_BYTES);
+	printf("%s free space: %0.01f MB with %u KB clusters\n", dev, free_size / MB_IN_BYTES, plan->cluster / 1024);
+}
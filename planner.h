@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "rules.h"
+#include "tiers.h"
+
+typedef struct {
+	unsigned int files;
+	unsigned int dirs;
+	uint64_t bytes;     // file contents
+	uint64_t footprint; // clusters taken on the destination, in bytes
+} PlanTier;
+
+typedef struct {
+	unsigned int cluster;
+	PlanTier tiers[TIER_COUNT];
+	PlanTier total;
+} Plan;
+
+int plan_tree(const char *src, const Rules *rules, unsigned int cluster, Plan *plan);
+void plan_print(const Plan *plan, const char *dev, uint64_t free_size);
@@ -0,0 +1,373 @@
+#include <psp2kern/kernel/cpu.h>
+#include <psp2kern/kernel/sysmem.h>
+#include <psp2kern/kernel/threadmgr.h>
+#include <psp2kern/io/fcntl.h>
+#include <psp2kern/io/stat.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "bulkcopy.h"
+#include "config.h"
+#include "vitashell_kernel.h"
+
+// Copies a whole batch of files for the installer in one syscall. The list
+// is a sequence of NUL-terminated "src", "dst" pairs; it is copied into a
+// kernel memblock together with the data buffer and a worker thread runs
+// through it while the installer polls shellKernelGetBulkCopyStatus().
+//
+// The data buffer is split into up to BULK_SLOTS slots that a reader thread
+// fills from the source while the worker writes the ones already read, so
+// reading ux0 and writing uma0 overlap the way the installer's async copy
+// overlaps them. The reader takes one file at a time from the worker and
+// ends every file with a slot of length 0, or the error of its read; the
+// worker always takes slots up to that one, so the reader is done with the
+// source before it is closed. A buffer too small for two slots of
+// BULK_MIN_BUF copies one block at a time.
+
+#define BULK_ALIGN 0x1000
+#define BULK_MIN_BUF (64 * 1024)
+#define BULK_SLOTS 4
+#define BULK_DEV_MAX 16
+
+typedef struct {
+	char *buf;
+	int len; // bytes read, 0 at the end of the file, < 0 the read error
+} BulkSlot;
+
+static UsbmcBulkCopyStatus status;
+
+static SceUID bulk_thid = -1, bulk_reader_thid = -1;
+static SceUID bulk_job_sema = -1, bulk_full_sema = -1, bulk_free_sema = -1;
+static SceUID bulk_memblk = -1;
+static char *bulk_list = NULL;
+static char *bulk_buf = NULL;
+static int bulk_list_size = 0;
+static int bulk_buf_size = 0;
+static volatile int bulk_quit = 0;
+
+static BulkSlot bulk_slots[BULK_SLOTS];
+static int bulk_slot_count = 0;
+static int bulk_slot_size = 0;
+static int bulk_head = 0; // the next slot the worker writes
+// the file the reader is on, -1 ends the reader
+static volatile SceUID bulk_read_fd = -1;
+// set by the worker once a write failed, the rest of the file is not read
+static volatile int bulk_read_stop = 0;
+
+// written since the destination device was last synced
+static unsigned int unsynced_files = 0;
+static unsigned long long unsynced_bytes = 0;
+
+static void sync_device(const char *path) {
+	char dev[BULK_DEV_MAX];
+	const char *colon = strchr(path, ':');
+
+	if (colon == NULL || colon - path + 2 > BULK_DEV_MAX)
+		return;
+	memcpy(dev, path, colon - path + 1);
+	dev[colon - path + 1] = '\0';
+
+	ksceIoSync(dev, 0);
+	status.syncs++;
+	unsynced_files = 0;
+	unsynced_bytes = 0;
+}
+
+// batched modes sync the whole device once enough has piled up
+static void file_written(const char *dst, SceOff size) {
+	unsigned int interval = usbmc_config.sync_interval;
+
+	unsynced_files++;
+	unsynced_bytes += size;
+
+	if (interval == 0)
+		return;
+	if ((usbmc_config.sync_mode == USBMC_SYNC_FILES && unsynced_files >= interval) ||
+	    (usbmc_config.sync_mode == USBMC_SYNC_MB && unsynced_bytes >= (unsigned long long)interval * 1024 * 1024))
+		sync_device(dst);
+}
+
+static int bulk_reader(SceSize args, void *argp) {
+	int next = 0;
+
+	while (1) {
+		ksceKernelWaitSema(bulk_job_sema, 1, NULL);
+		if (bulk_read_fd < 0)
+			break;
+
+		int len;
+		do {
+			BulkSlot *slot = &bulk_slots[next];
+
+			ksceKernelWaitSema(bulk_free_sema, 1, NULL);
+			len = (bulk_quit || bulk_read_stop) ? 0 : ksceIoRead(bulk_read_fd, slot->buf, bulk_slot_size);
+			slot->len = len;
+			next = (next + 1) % bulk_slot_count;
+			ksceKernelSignalSema(bulk_full_sema, 1);
+		} while (len > 0);
+	}
+	return 0;
+}
+
+static int copy_one(const char *src, const char *dst) {
+	SceIoStat stat;
+	int fd, wfd, rd, ret;
+
+	if ((fd = ksceIoOpen(src, SCE_O_RDONLY, 0)) < 0)
+		return fd;
+	if ((ret = ksceIoGetstatByFd(fd, &stat)) < 0) {
+		ksceIoClose(fd);
+		return ret;
+	}
+	if ((wfd = ksceIoOpen(dst, SCE_O_WRONLY | SCE_O_CREAT | SCE_O_TRUNC, 0777)) < 0) {
+		ksceIoClose(fd);
+		return wfd;
+	}
+
+	status.file_bytes = 0;
+	status.file_size = stat.st_size;
+
+	bulk_read_fd = fd;
+	bulk_read_stop = 0;
+	ksceKernelSignalSema(bulk_job_sema, 1);
+
+	ret = 0;
+	do {
+		BulkSlot *slot = &bulk_slots[bulk_head];
+
+		ksceKernelWaitSema(bulk_full_sema, 1, NULL);
+		rd = slot->len;
+		if (rd > 0 && ret == 0) {
+			if ((ret = ksceIoWrite(wfd, slot->buf, rd)) != rd) {
+				if (ret >= 0)
+					ret = -1;
+				bulk_read_stop = 1;
+			} else {
+				ret = 0;
+				status.file_bytes += rd;
+				status.bytes_copied += rd;
+			}
+		}
+		bulk_head = (bulk_head + 1) % bulk_slot_count;
+		ksceKernelSignalSema(bulk_free_sema, 1);
+	} while (rd > 0);
+	if (rd < 0 && ret == 0)
+		ret = rd;
+
+	if (ret == 0) {
+		ksceIoChstatByFd(wfd, &stat, SCE_CST_CT | SCE_CST_AT | SCE_CST_MT);
+		if (usbmc_config.sync_mode == USBMC_SYNC_STRICT) {
+			ksceIoSyncByFd(wfd, 0);
+			status.syncs++;
+		}
+	}
+
+	ksceIoClose(fd);
+	ksceIoClose(wfd);
+
+	if (ret == 0 && usbmc_config.sync_mode != USBMC_SYNC_STRICT)
+		file_written(dst, stat.st_size);
+
+	return ret;
+}
+
+static int bulk_thread(SceSize args, void *argp) {
+	const char *src = bulk_list;
+	const char *end = bulk_list + bulk_list_size;
+	const char *last = NULL;
+
+	while (!bulk_quit && src < end) {
+		const char *dst = src + strlen(src) + 1;
+		int ret;
+
+		if ((ret = copy_one(src, dst)) < 0) {
+			status.files_failed++;
+			if (status.result == 0)
+				status.result = ret;
+		}
+		status.files_done++;
+		last = dst;
+		src = dst + strlen(dst) + 1;
+	}
+
+	// a finished batch leaves nothing unsynced behind unless asked not to
+	if (last && usbmc_config.sync_mode != USBMC_SYNC_NONE && unsynced_files > 0)
+		sync_device(last);
+
+	status.active = 0;
+	return 0;
+}
+
+// joins the threads of a finished batch and drops its memory
+static void bulk_cleanup(void) {
+	if (bulk_thid >= 0) {
+		ksceKernelWaitThreadEnd(bulk_thid, NULL, NULL);
+		ksceKernelDeleteThread(bulk_thid);
+		bulk_thid = -1;
+	}
+	if (bulk_reader_thid >= 0) {
+		bulk_read_fd = -1;
+		ksceKernelSignalSema(bulk_job_sema, 1);
+		ksceKernelWaitThreadEnd(bulk_reader_thid, NULL, NULL);
+		ksceKernelDeleteThread(bulk_reader_thid);
+		bulk_reader_thid = -1;
+	}
+	if (bulk_job_sema >= 0)
+		ksceKernelDeleteSema(bulk_job_sema);
+	if (bulk_full_sema >= 0)
+		ksceKernelDeleteSema(bulk_full_sema);
+	if (bulk_free_sema >= 0)
+		ksceKernelDeleteSema(bulk_free_sema);
+	bulk_job_sema = bulk_full_sema = bulk_free_sema = -1;
+	if (bulk_memblk >= 0)
+		ksceKernelFreeMemBlock(bulk_memblk);
+	bulk_memblk = -1;
+	bulk_list = bulk_buf = NULL;
+}
+
+// any process can make this syscall, so the kernel only copies between the
+// two storages the installer migrates and never outside of them
+static const char * const bulk_devices[] = { "ux0:", "uma0:" };
+
+static int path_allowed(const char *path) {
+	const char *p = NULL;
+
+	for (size_t i = 0; i < sizeof(bulk_devices)/sizeof(*bulk_devices); i++) {
+		size_t len = strlen(bulk_devices[i]);
+		if (strncmp(path, bulk_devices[i], len) == 0) {
+			p = path + len;
+			break;
+		}
+	}
+	if (p == NULL)
+		return 0;
+
+	// no component may climb out of the device
+	while (*p) {
+		const char *end = p + strcspn(p, "/\\");
+		if (end - p == 2 && p[0] == '.' && p[1] == '.')
+			return 0;
+		p = *end ? end + 1 : end;
+	}
+	return 1;
+}
+
+// every string must be terminated, come in pairs and name an allowed path
+static int count_pairs(const char *list, int size) {
+	int strings = 0;
+
+	if (size <= 0 || list[size - 1] != '\0')
+		return -1;
+	for (int i = 0; i < size; i += strlen(list + i) + 1) {
+		if (!path_allowed(list + i))
+			return -1;
+		strings++;
+	}
+	return (strings % 2 == 0) ? strings / 2 : -1;
+}
+
+static int bulk_start(const char *list, unsigned int size) {
+	int pairs, total, ret;
+
+	if (status.active)
+		return -1;
+	bulk_cleanup();
+
+	if (size == 0 || size > USBMC_BULK_LIST_MAX)
+		return -1;
+
+	bulk_buf_size = usbmc_config.bulkcopy_mem;
+	if (bulk_buf_size < BULK_MIN_BUF)
+		bulk_buf_size = BULK_MIN_BUF;
+	bulk_buf_size &= ~(BULK_ALIGN - 1);
+	total = bulk_buf_size + ((size + BULK_ALIGN - 1) & ~(BULK_ALIGN - 1));
+
+	bulk_memblk = ksceKernelAllocMemBlock("usbmc_bulk", SCE_KERNEL_MEMBLOCK_TYPE_KERNEL_RW, total, NULL);
+	if (bulk_memblk < 0)
+		return bulk_memblk;
+	ksceKernelGetMemBlockBase(bulk_memblk, (void **)&bulk_buf);
+	bulk_list = bulk_buf + bulk_buf_size;
+
+	bulk_slot_count = bulk_buf_size / BULK_MIN_BUF;
+	if (bulk_slot_count > BULK_SLOTS)
+		bulk_slot_count = BULK_SLOTS;
+	bulk_slot_size = (bulk_buf_size / bulk_slot_count) & ~(BULK_ALIGN - 1);
+	for (int i = 0; i < bulk_slot_count; i++)
+		bulk_slots[i].buf = bulk_buf + i * bulk_slot_size;
+	bulk_head = 0;
+
+	if ((ret = ksceKernelMemcpyUserToKernel(bulk_list, (uintptr_t)list, size)) < 0)
+		goto error;
+	if ((pairs = count_pairs(bulk_list, size)) < 0) {
+		ret = -1;
+		goto error;
+	}
+	bulk_list_size = size;
+
+	bulk_job_sema = ksceKernelCreateSema("usbmc_bulk_job", 0, 0, 1, NULL);
+	bulk_full_sema = ksceKernelCreateSema("usbmc_bulk_full", 0, 0, bulk_slot_count, NULL);
+	bulk_free_sema = ksceKernelCreateSema("usbmc_bulk_free", 0, bulk_slot_count, bulk_slot_count, NULL);
+	if (bulk_job_sema < 0 || bulk_full_sema < 0 || bulk_free_sema < 0) {
+		ret = -1;
+		goto error;
+	}
+
+	bulk_reader_thid = ksceKernelCreateThread("usbmc_bulk_read", bulk_reader, 0x3C, 0x1000, 0, 0, NULL);
+	if (bulk_reader_thid < 0) {
+		ret = bulk_reader_thid;
+		goto error;
+	}
+	bulk_quit = 0;
+	ksceKernelStartThread(bulk_reader_thid, 0, NULL);
+
+	bulk_thid = ksceKernelCreateThread("usbmc_bulk", bulk_thread, 0x3C, 0x2000, 0, 0, NULL);
+	if (bulk_thid < 0) {
+		ret = bulk_thid;
+		goto error;
+	}
+
+	memset(&status, 0, sizeof(status));
+	status.active = 1;
+	status.files_total = pairs;
+	ksceKernelStartThread(bulk_thid, 0, NULL);
+
+	return 0;
+
+error:
+	bulk_cleanup();
+	return ret;
+}
+
+void bulkcopy_exit(void) {
+	bulk_quit = 1;
+	bulk_cleanup();
+	status.active = 0;
+}
+
+int shellKernelBulkCopy(const char *list, unsigned int size) {
+	uint32_t state;
+	int ret;
+
+	ENTER_SYSCALL(state);
+
+	ret = bulk_start(list, size);
+
+	EXIT_SYSCALL(state);
+	return ret;
+}
+
+int shellKernelGetBulkCopyStatus(UsbmcBulkCopyStatus *out) {
+	UsbmcBulkCopyStatus tmp;
+	uint32_t state;
+
+	ENTER_SYSCALL(state);
+
+	tmp = status;
+	tmp.sync_mode = usbmc_config.sync_mode;
+	tmp.sync_interval = usbmc_config.sync_interval;
+	ksceKernelMemcpyKernelToUser((uintptr_t)out, &tmp, sizeof(tmp));
+
+	EXIT_SYSCALL(state);
+	return 0;
+}
@@ -0,0 +1,6 @@
+#ifndef __USBMC_BULKCOPY_H__
+#define __USBMC_BULKCOPY_H__
+
+void bulkcopy_exit(void);
+
+#endif
@@ -0,0 +1,110 @@
+#include <psp2kern/io/fcntl.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+#include "vitashell_kernel.h"
+
+#define CONFIG_MAX_SIZE 0x1000
+
+UsbmcConfig usbmc_config = {
+	.readahead = 1,
+	.readahead_streams = 4,
+	.readahead_min_window = 64 * 1024,
+	.readahead_max_window = 128 * 1024,
+	.readahead_mem = 1024 * 1024,
+	.dircache_mem = 1024 * 1024,
+	.bulkcopy_mem = 1024 * 1024,
+	.sync_mode = USBMC_SYNC_DEFAULT,
+	.sync_interval = USBMC_SYNC_DEFAULT_INTERVAL,
+	.trace_mem = 0,
+};
+
+typedef struct {
+	const char *key;
+	int *value;
+} ConfigKey;
+
+static const ConfigKey config_keys[] = {
+	{ "readahead", &usbmc_config.readahead },
+	{ "readahead_streams", &usbmc_config.readahead_streams },
+	{ "readahead_min_window", &usbmc_config.readahead_min_window },
+	{ "readahead_max_window", &usbmc_config.readahead_max_window },
+	{ "readahead_mem", &usbmc_config.readahead_mem },
+	{ "dircache_mem", &usbmc_config.dircache_mem },
+	{ "bulkcopy_mem", &usbmc_config.bulkcopy_mem },
+	{ "sync_mode", &usbmc_config.sync_mode },
+	{ "sync_interval", &usbmc_config.sync_interval },
+	{ "trace_mem", &usbmc_config.trace_mem },
+};
+
+// accepts decimal numbers with an optional K or M suffix
+static int parse_value(const char *str, int *out) {
+	int value = 0;
+
+	if (*str < '0' || *str > '9')
+		return -1;
+
+	while (*str >= '0' && *str <= '9')
+		value = value * 10 + (*str++ - '0');
+
+	if (*str == 'K' || *str == 'k') {
+		value *= 1024;
+		str++;
+	} else if (*str == 'M' || *str == 'm') {
+		value *= 1024 * 1024;
+		str++;
+	}
+
+	if (*str != '\0')
+		return -1;
+
+	*out = value;
+	return 0;
+}
+
+static void parse_line(char *line) {
+	char *value;
+
+	while (*line == ' ' || *line == '\t')
+		line++;
+	if (*line == '#' || *line == '\0')
+		return;
+
+	if ((value = strchr(line, '=')) == NULL)
+		return;
+	*value++ = '\0';
+
+	for (size_t i = 0; i < sizeof(config_keys)/sizeof(*config_keys); ++i) {
+		if (strcmp(line, config_keys[i].key) == 0) {
+			parse_value(value, config_keys[i].value);
+			return;
+		}
+	}
+}
+
+void config_load(const char *path) {
+	static char buffer[CONFIG_MAX_SIZE + 1];
+	char *line, *end;
+	int fd, size;
+
+	if ((fd = ksceIoOpen(path, SCE_O_RDONLY, 0)) < 0)
+		return;
+	size = ksceIoRead(fd, buffer, CONFIG_MAX_SIZE);
+	ksceIoClose(fd);
+	if (size <= 0)
+		return;
+	buffer[size] = '\0';
+
+	line = buffer;
+	while (*line) {
+		end = line;
+		while (*end && *end != '\n' && *end != '\r')
+			end++;
+		if (*end)
+			*end++ = '\0';
+		parse_line(line);
+		line = end;
+	}
+}
@@ -0,0 +1,23 @@
+#ifndef __USBMC_CONFIG_H__
+#define __USBMC_CONFIG_H__
+
+#define USBMC_CONFIG_PATH "ur0:tai/usbmc.cfg"
+
+typedef struct {
+	int readahead;            // 0 disables sequential read-ahead
+	int readahead_streams;    // max number of tracked open files
+	int readahead_min_window; // bytes, first prefetch size
+	int readahead_max_window; // bytes, prefetch size after confirmed streaming
+	int readahead_mem;        // bytes, cap on all read-ahead buffers
+	int dircache_mem;         // bytes, 0 disables the directory/stat cache
+	int bulkcopy_mem;         // bytes, data buffer of installer bulk copies
+	int sync_mode;            // USBMC_SYNC_* for installer migration copies
+	int sync_interval;        // files or MB between syncs, by sync_mode
+	int trace_mem;            // bytes, I/O trace ring, 0 disables tracing
+} UsbmcConfig;
+
+extern UsbmcConfig usbmc_config;
+
+void config_load(const char *path);
+
+#endif
@@ -0,0 +1,827 @@
+#include <psp2kern/kernel/cpu.h>
+#include <psp2kern/kernel/sysmem.h>
+#include <psp2kern/kernel/threadmgr.h>
+#include <psp2kern/io/fcntl.h>
+#include <psp2kern/io/dirent.h>
+#include <psp2kern/io/stat.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include <taihen.h>
+
+#include "config.h"
+#include "dircache.h"
+#include "iohooks.h"
+#include "lazy.h"
+#include "vitashell_kernel.h"
+
+// Directory listing and stat cache for the redirected ux0.
+//
+// Everything lives in one kernel memory block: a bucket table of offsets
+// followed by bump-allocated entries and listing records. Entries are never
+// freed individually; invalidation unlinks them from the table and a full
+// block is reclaimed in one go once no handle is still reading a cached
+// listing. Listings are filled lazily while a directory is enumerated for the
+// first time and only become visible once the enumeration reaches the end.
+//
+// Both the driver calls of kernel modules and the user syscalls are served,
+// with handles and writers keyed by process and descriptor. While a lazy
+// migration runs, a path missing on USB may still be on the original device,
+// so misses are only cached when none does.
+
+#define DC_BUCKETS 1024
+#define DC_HANDLES 16
+#define DC_WRITERS 16
+#define DC_PATH_MAX 256
+
+#define SCE_ERROR_ERRNO_ENOENT 0x80010002
+#define SCE_ERROR_ERRNO_EFAULT 0x8001000E
+
+enum {
+	DC_HOOK_OPEN,
+	DC_HOOK_CLOSE,
+	DC_HOOK_REMOVE,
+	DC_HOOK_RENAME,
+	DC_HOOK_MKDIR,
+	DC_HOOK_RMDIR,
+	DC_HOOK_DOPEN,
+	DC_HOOK_DREAD,
+	DC_HOOK_DCLOSE,
+	DC_HOOK_GETSTAT,
+	DC_HOOK_CHSTAT,
+	DC_HOOK_USER_OPEN,
+	DC_HOOK_USER_CLOSE,
+	DC_HOOK_USER_REMOVE,
+	DC_HOOK_USER_RENAME,
+	DC_HOOK_USER_MKDIR,
+	DC_HOOK_USER_RMDIR,
+	DC_HOOK_USER_DOPEN,
+	DC_HOOK_USER_DREAD,
+	DC_HOOK_USER_DCLOSE,
+	DC_HOOK_USER_GETSTAT,
+	DC_HOOK_USER_CHSTAT,
+	DC_HOOK_COUNT,
+};
+
+enum {
+	DC_HAS_STAT = 1,
+	DC_HAS_LIST = 2,
+	DC_NOENT = 4,
+};
+
+enum {
+	DC_PASS,
+	DC_FILL,
+	DC_SERVE,
+};
+
+typedef struct {
+	uint32_t next;
+	uint32_t hash;
+	uint32_t flags;
+	uint32_t list;
+	SceIoStat stat;
+	char path[];
+} DirCacheEntry;
+
+typedef struct {
+	uint32_t next;
+	SceIoStat stat;
+	char name[];
+} DirCacheRecord;
+
+typedef struct {
+	SceUID pid;
+	SceUID fd;
+	int mode;
+	uint32_t gen;
+	uint32_t head;
+	uint32_t tail;
+	char path[DC_PATH_MAX];
+} DirCacheHandle;
+
+typedef struct {
+	SceUID pid;
+	SceUID fd;
+	char path[DC_PATH_MAX];
+} DirCacheWriter;
+
+static char *dc_base = NULL;
+static uint32_t dc_size = 0, dc_used = 0, dc_gen = 0;
+static uint32_t *dc_buckets;
+static SceUID dc_mutex = -1, dc_memblk = -1;
+
+static DirCacheHandle handles[DC_HANDLES];
+static DirCacheWriter writers[DC_WRITERS];
+
+static UsbmcDirCacheStats stats;
+
+static SceUID hooks[DC_HOOK_COUNT];
+static tai_hook_ref_t refs[DC_HOOK_COUNT];
+
+static inline void dc_lock(void) {
+	ksceKernelLockMutex(dc_mutex, 1, NULL);
+}
+
+static inline void dc_unlock(void) {
+	ksceKernelUnlockMutex(dc_mutex, 1);
+}
+
+#define DC_PTR(off) ((void *)(dc_base + (off)))
+
+static inline char lower(char c) {
+	return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+// FAT and exFAT are case insensitive, so is the cache
+static uint32_t dc_hash(const char *path) {
+	uint32_t hash = 2166136261u;
+	while (*path)
+		hash = (hash ^ (uint8_t)lower(*path++)) * 16777619u;
+	return hash;
+}
+
+static int dc_pathcmp(const char *a, const char *b) {
+	while (*a && lower(*a) == lower(*b)) {
+		a++;
+		b++;
+	}
+	return lower(*a) - lower(*b);
+}
+
+// "ux0:/app//TITLE/" and "ux0:app/TITLE" must share an entry
+static int dc_normalize(char *out, const char *path) {
+	int len = 4;
+
+	if (!is_ux0_path(path))
+		return -1;
+	memcpy(out, "ux0:", 4);
+	path += 4;
+
+	while (*path) {
+		while (*path == '/')
+			path++;
+		if (!*path)
+			break;
+		if (len > 4)
+			out[len++] = '/';
+		while (*path && *path != '/') {
+			if (len >= DC_PATH_MAX - 1)
+				return -1;
+			out[len++] = *path++;
+		}
+	}
+	out[len] = '\0';
+
+	return 0;
+}
+
+static int dc_parent(char *out, const char *path) {
+	char *slash;
+
+	strcpy(out, path);
+	if ((slash = strrchr(out, '/')) != NULL) {
+		*slash = '\0';
+		return 0;
+	}
+	if (out[4] == '\0')
+		return -1;
+	out[4] = '\0';
+	return 0;
+}
+
+static int dc_active(void) {
+	return dc_base && shellKernelIsUx0Redirected() == 1;
+}
+
+static int dc_serving(void) {
+	for (int i = 0; i < DC_HANDLES; i++) {
+		if (handles[i].fd >= 0 && handles[i].mode == DC_SERVE)
+			return 1;
+	}
+	return 0;
+}
+
+// drops every entry; memory is only reused when no listing is being served
+static void dc_flush(void) {
+	memset(dc_buckets, 0, DC_BUCKETS * sizeof(uint32_t));
+	stats.flushes++;
+	if (!dc_serving()) {
+		dc_used = DC_BUCKETS * sizeof(uint32_t);
+		dc_gen++;
+	}
+}
+
+static uint32_t dc_alloc(uint32_t size) {
+	uint32_t off;
+
+	size = (size + 7) & ~7;
+	if (dc_used + size > dc_size) {
+		dc_flush();
+		if (dc_used + size > dc_size)
+			return 0;
+	}
+	off = dc_used;
+	dc_used += size;
+	return off;
+}
+
+static DirCacheEntry *dc_lookup(const char *path, uint32_t hash) {
+	uint32_t off = dc_buckets[hash % DC_BUCKETS];
+
+	while (off) {
+		DirCacheEntry *e = DC_PTR(off);
+		if (e->hash == hash && dc_pathcmp(e->path, path) == 0)
+			return e;
+		off = e->next;
+	}
+	return NULL;
+}
+
+static DirCacheEntry *dc_get(const char *path) {
+	uint32_t hash = dc_hash(path);
+	DirCacheEntry *e = dc_lookup(path, hash);
+	uint32_t off;
+
+	if (e)
+		return e;
+	if ((off = dc_alloc(sizeof(DirCacheEntry) + strlen(path) + 1)) == 0)
+		return NULL;
+
+	e = DC_PTR(off);
+	e->hash = hash;
+	e->flags = 0;
+	e->list = 0;
+	strcpy(e->path, path);
+	e->next = dc_buckets[hash % DC_BUCKETS];
+	dc_buckets[hash % DC_BUCKETS] = off;
+	stats.inserts++;
+	return e;
+}
+
+static void dc_unlink(const char *path) {
+	uint32_t hash = dc_hash(path);
+	uint32_t *link = &dc_buckets[hash % DC_BUCKETS];
+
+	while (*link) {
+		DirCacheEntry *e = DC_PTR(*link);
+		if (e->hash == hash && dc_pathcmp(e->path, path) == 0) {
+			*link = e->next;
+			stats.invalidations++;
+			return;
+		}
+		link = &e->next;
+	}
+}
+
+// a path changed: forget it and the listing of the directory holding it
+static void dc_invalidate(const char *path) {
+	char norm[DC_PATH_MAX], parent[DC_PATH_MAX];
+
+	if (!dc_base || dc_normalize(norm, path) < 0)
+		return;
+
+	dc_lock();
+	dc_unlink(norm);
+	if (dc_parent(parent, norm) == 0)
+		dc_unlink(parent);
+	dc_unlock();
+}
+
+static void dc_put_stat(const char *path, const SceIoStat *stat, int noent) {
+	DirCacheEntry *e = dc_get(path);
+
+	if (!e)
+		return;
+	if (noent) {
+		e->flags = DC_NOENT;
+	} else {
+		e->stat = *stat;
+		e->flags = (e->flags & ~DC_NOENT) | DC_HAS_STAT;
+	}
+}
+
+// the handle of fd in the calling process, a free one for -1
+static DirCacheHandle *dc_handle(SceUID fd) {
+	SceUID pid = io_pid();
+
+	for (int i = 0; i < DC_HANDLES; i++) {
+		if (handles[i].fd == fd && (fd < 0 || handles[i].pid == pid))
+			return &handles[i];
+	}
+	return NULL;
+}
+
+static int dc_writing(const char *path, int flags) {
+	return (flags & (SCE_O_WRONLY | SCE_O_CREAT | SCE_O_TRUNC | SCE_O_APPEND)) && is_ux0_path(path);
+}
+
+// size and times change until the file is closed again
+static void dc_opened(SceUID fd, const char *path) {
+	int tracked = 0;
+
+	if (fd < 0 || !dc_base)
+		return;
+
+	dc_lock();
+	for (int i = 0; i < DC_WRITERS; i++) {
+		if (writers[i].fd < 0 && strlen(path) < DC_PATH_MAX) {
+			writers[i].pid = io_pid();
+			writers[i].fd = fd;
+			strcpy(writers[i].path, path);
+			tracked = 1;
+			break;
+		}
+	}
+	if (!tracked)
+		dc_flush();
+	dc_unlock();
+}
+
+static void dc_closed(SceUID fd) {
+	char path[DC_PATH_MAX];
+	SceUID pid = io_pid();
+
+	path[0] = '\0';
+	if (dc_base) {
+		dc_lock();
+		for (int i = 0; i < DC_WRITERS; i++) {
+			if (writers[i].fd == fd && writers[i].pid == pid) {
+				strcpy(path, writers[i].path);
+				writers[i].fd = -1;
+				break;
+			}
+		}
+		dc_unlock();
+	}
+	if (path[0])
+		dc_invalidate(path);
+}
+
+static void dc_renamed(const char *oldname, const char *newname, int ret) {
+	SceIoStat stat;
+
+	if (!dc_base || (!is_ux0_path(oldname) && !is_ux0_path(newname)))
+		return;
+
+	// a renamed directory moves everything below it
+	if (ret >= 0 && TAI_CONTINUE(int, refs[DC_HOOK_GETSTAT], newname, &stat) >= 0 && !SCE_S_ISDIR(stat.st_mode)) {
+		dc_invalidate(oldname);
+		dc_invalidate(newname);
+	} else {
+		dc_lock();
+		dc_flush();
+		dc_unlock();
+	}
+}
+
+// 1 with the cached result in *ret if norm is known
+static int dc_cached_stat(const char *norm, SceIoStat *stat, int *ret) {
+	DirCacheEntry *e;
+
+	dc_lock();
+	if ((e = dc_lookup(norm, dc_hash(norm))) != NULL && (e->flags & (DC_HAS_STAT | DC_NOENT))) {
+		*ret = (e->flags & DC_NOENT) ? (int)SCE_ERROR_ERRNO_ENOENT : 0;
+		if (*ret == 0)
+			*stat = e->stat;
+		stats.hits++;
+		dc_unlock();
+		return 1;
+	}
+	stats.misses++;
+	dc_unlock();
+	return 0;
+}
+
+static void dc_stat_result(const char *norm, const SceIoStat *stat, int ret) {
+	if (ret >= 0 || (ret == (int)SCE_ERROR_ERRNO_ENOENT && !lazy_active())) {
+		dc_lock();
+		dc_put_stat(norm, stat, ret < 0);
+		dc_unlock();
+	}
+}
+
+static void dc_opened_dir(SceUID fd, const char *dirname) {
+	char norm[DC_PATH_MAX];
+	DirCacheHandle *h;
+	DirCacheEntry *e;
+
+	if (fd < 0 || !dc_active() || dc_normalize(norm, dirname) < 0)
+		return;
+
+	dc_lock();
+	if ((h = dc_handle(-1)) != NULL) {
+		h->pid = io_pid();
+		h->fd = fd;
+		h->gen = dc_gen;
+		h->head = 0;
+		h->tail = 0;
+		strcpy(h->path, norm);
+		if ((e = dc_lookup(norm, dc_hash(norm))) != NULL && (e->flags & DC_HAS_LIST)) {
+			// the real handle stays open but is never read
+			h->mode = DC_SERVE;
+			h->head = e->list;
+			stats.hits++;
+		} else {
+			h->mode = DC_FILL;
+			stats.misses++;
+		}
+	}
+	dc_unlock();
+}
+
+// 1 with the next cached entry in *dir and the result in *ret if fd is
+// served from the cache
+static int dc_cached_dread(SceUID fd, SceIoDirent *dir, int *ret) {
+	DirCacheHandle *h;
+	DirCacheRecord *r;
+
+	dc_lock();
+	if ((h = dc_handle(fd)) == NULL || h->mode != DC_SERVE) {
+		dc_unlock();
+		return 0;
+	}
+	if (h->head == 0) {
+		*ret = 0;
+	} else {
+		r = DC_PTR(h->head);
+		memset(dir, 0, sizeof(SceIoDirent));
+		dir->d_stat = r->stat;
+		strncpy(dir->d_name, r->name, sizeof(dir->d_name) - 1);
+		h->head = r->next;
+		*ret = 1;
+	}
+	dc_unlock();
+	return 1;
+}
+
+static void dc_dread_result(SceUID fd, const SceIoDirent *dir, int ret) {
+	char child[DC_PATH_MAX];
+	DirCacheHandle *h;
+	DirCacheRecord *r;
+
+	dc_lock();
+	if ((h = dc_handle(fd)) == NULL || h->mode != DC_FILL) {
+		dc_unlock();
+		return;
+	}
+	if (h->gen != dc_gen || ret < 0) {
+		// memory was reclaimed or the listing is incomplete
+		h->mode = DC_PASS;
+	} else if (ret == 0) {
+		DirCacheEntry *e = dc_get(h->path);
+		if (e && h->gen == dc_gen) {
+			e->list = h->head;
+			e->flags |= DC_HAS_LIST;
+		}
+		h->mode = DC_PASS;
+	} else {
+		uint32_t off = dc_alloc(sizeof(DirCacheRecord) + strlen(dir->d_name) + 1);
+		if (off == 0 || h->gen != dc_gen) {
+			h->mode = DC_PASS;
+		} else {
+			r = DC_PTR(off);
+			r->next = 0;
+			r->stat = dir->d_stat;
+			strcpy(r->name, dir->d_name);
+			if (h->tail)
+				((DirCacheRecord *)DC_PTR(h->tail))->next = off;
+			else
+				h->head = off;
+			h->tail = off;
+
+			// the shell stats every entry it just listed
+			if (snprintf(child, sizeof(child), "%s/%s", h->path, dir->d_name) < (int)sizeof(child))
+				dc_put_stat(child, &dir->d_stat, 0);
+		}
+	}
+	dc_unlock();
+}
+
+static void dc_dclosed(SceUID fd) {
+	DirCacheHandle *h;
+
+	if (dc_base) {
+		dc_lock();
+		if ((h = dc_handle(fd)) != NULL)
+			h->fd = -1;
+		dc_unlock();
+	}
+}
+
+static SceUID ksceIoOpen_patched(const char *path, int flags, SceMode mode) {
+	SceUID fd;
+
+	if (!io_kernel_caller() || !dc_writing(path, flags))
+		return TAI_CONTINUE(SceUID, refs[DC_HOOK_OPEN], path, flags, mode);
+
+	dc_invalidate(path);
+	fd = TAI_CONTINUE(SceUID, refs[DC_HOOK_OPEN], path, flags, mode);
+	dc_opened(fd, path);
+
+	return fd;
+}
+
+static int ksceIoClose_patched(SceUID fd) {
+	int ret = TAI_CONTINUE(int, refs[DC_HOOK_CLOSE], fd);
+
+	if (io_kernel_caller())
+		dc_closed(fd);
+	return ret;
+}
+
+// changes are forgotten whoever makes them, twice does no harm
+static int ksceIoRemove_patched(const char *path) {
+	int ret = TAI_CONTINUE(int, refs[DC_HOOK_REMOVE], path);
+	dc_invalidate(path);
+	return ret;
+}
+
+static int ksceIoRename_patched(const char *oldname, const char *newname) {
+	int ret = TAI_CONTINUE(int, refs[DC_HOOK_RENAME], oldname, newname);
+	dc_renamed(oldname, newname, ret);
+	return ret;
+}
+
+static int ksceIoMkdir_patched(const char *path, SceMode mode) {
+	int ret = TAI_CONTINUE(int, refs[DC_HOOK_MKDIR], path, mode);
+	dc_invalidate(path);
+	return ret;
+}
+
+static int ksceIoRmdir_patched(const char *path) {
+	int ret = TAI_CONTINUE(int, refs[DC_HOOK_RMDIR], path);
+	dc_invalidate(path);
+	return ret;
+}
+
+static int ksceIoChstat_patched(const char *path, SceIoStat *stat, int bits) {
+	int ret = TAI_CONTINUE(int, refs[DC_HOOK_CHSTAT], path, stat, bits);
+	dc_invalidate(path);
+	return ret;
+}
+
+static int ksceIoGetstat_patched(const char *path, SceIoStat *stat) {
+	char norm[DC_PATH_MAX];
+	int ret;
+
+	if (!io_kernel_caller() || !dc_active() || dc_normalize(norm, path) < 0)
+		return TAI_CONTINUE(int, refs[DC_HOOK_GETSTAT], path, stat);
+
+	if (dc_cached_stat(norm, stat, &ret))
+		return ret;
+	ret = TAI_CONTINUE(int, refs[DC_HOOK_GETSTAT], path, stat);
+	dc_stat_result(norm, stat, ret);
+
+	return ret;
+}
+
+static SceUID ksceIoDopen_patched(const char *dirname) {
+	SceUID fd = TAI_CONTINUE(SceUID, refs[DC_HOOK_DOPEN], dirname);
+
+	if (io_kernel_caller())
+		dc_opened_dir(fd, dirname);
+	return fd;
+}
+
+static int ksceIoDread_patched(SceUID fd, SceIoDirent *dir) {
+	int ret;
+
+	if (!dc_base || !io_kernel_caller())
+		return TAI_CONTINUE(int, refs[DC_HOOK_DREAD], fd, dir);
+
+	if (dc_cached_dread(fd, dir, &ret))
+		return ret;
+	ret = TAI_CONTINUE(int, refs[DC_HOOK_DREAD], fd, dir);
+	dc_dread_result(fd, dir, ret);
+
+	return ret;
+}
+
+static int ksceIoDclose_patched(SceUID fd) {
+	if (io_kernel_caller())
+		dc_dclosed(fd);
+	return TAI_CONTINUE(int, refs[DC_HOOK_DCLOSE], fd);
+}
+
+static SceUID sceIoOpen_patched(const char *file, int flags, SceMode mode, void *opt) {
+	char path[DC_PATH_MAX];
+	SceUID fd;
+
+	if (io_user_path(path, file, sizeof(path)) < 0 || !dc_writing(path, flags))
+		return TAI_CONTINUE(SceUID, refs[DC_HOOK_USER_OPEN], file, flags, mode, opt);
+
+	dc_invalidate(path);
+	fd = TAI_CONTINUE(SceUID, refs[DC_HOOK_USER_OPEN], file, flags, mode, opt);
+	dc_opened(fd, path);
+
+	return fd;
+}
+
+static int sceIoClose_patched(SceUID fd) {
+	int ret = TAI_CONTINUE(int, refs[DC_HOOK_USER_CLOSE], fd);
+
+	dc_closed(fd);
+	return ret;
+}
+
+static int sceIoRemove_patched(const char *file) {
+	char path[DC_PATH_MAX];
+	int ret = TAI_CONTINUE(int, refs[DC_HOOK_USER_REMOVE], file);
+
+	if (io_user_path(path, file, sizeof(path)) == 0)
+		dc_invalidate(path);
+	return ret;
+}
+
+static int sceIoRename_patched(const char *oldname, const char *newname) {
+	char old_path[DC_PATH_MAX], new_path[DC_PATH_MAX];
+	int ret = TAI_CONTINUE(int, refs[DC_HOOK_USER_RENAME], oldname, newname);
+
+	if (io_user_path(old_path, oldname, sizeof(old_path)) == 0 &&
+	    io_user_path(new_path, newname, sizeof(new_path)) == 0) {
+		dc_renamed(old_path, new_path, ret);
+	} else if (dc_base) {
+		dc_lock();
+		dc_flush();
+		dc_unlock();
+	}
+	return ret;
+}
+
+static int sceIoMkdir_patched(const char *dir, SceMode mode) {
+	char path[DC_PATH_MAX];
+	int ret = TAI_CONTINUE(int, refs[DC_HOOK_USER_MKDIR], dir, mode);
+
+	if (io_user_path(path, dir, sizeof(path)) == 0)
+		dc_invalidate(path);
+	return ret;
+}
+
+static int sceIoRmdir_patched(const char *dir) {
+	char path[DC_PATH_MAX];
+	int ret = TAI_CONTINUE(int, refs[DC_HOOK_USER_RMDIR], dir);
+
+	if (io_user_path(path, dir, sizeof(path)) == 0)
+		dc_invalidate(path);
+	return ret;
+}
+
+static int sceIoGetstat_patched(const char *file, SceIoStat *stat) {
+	char path[DC_PATH_MAX];
+	SceIoStat kstat;
+	int ret;
+
+	// normalizing never makes a path longer
+	if (!dc_active() || io_user_path(path, file, sizeof(path)) < 0 || dc_normalize(path, path) < 0)
+		return TAI_CONTINUE(int, refs[DC_HOOK_USER_GETSTAT], file, stat);
+
+	if (dc_cached_stat(path, &kstat, &ret) &&
+	    (ret < 0 || ksceKernelMemcpyKernelToUser((uintptr_t)stat, &kstat, sizeof(kstat)) >= 0))
+		return ret;
+	ret = TAI_CONTINUE(int, refs[DC_HOOK_USER_GETSTAT], file, stat);
+	if (ret < 0 || ksceKernelMemcpyUserToKernel(&kstat, (uintptr_t)stat, sizeof(kstat)) >= 0)
+		dc_stat_result(path, &kstat, ret);
+
+	return ret;
+}
+
+static int sceIoChstat_patched(const char *file, SceIoStat *stat, int bits) {
+	char path[DC_PATH_MAX];
+	int ret = TAI_CONTINUE(int, refs[DC_HOOK_USER_CHSTAT], file, stat, bits);
+
+	if (io_user_path(path, file, sizeof(path)) == 0)
+		dc_invalidate(path);
+	return ret;
+}
+
+static SceUID sceIoDopen_patched(const char *dirname) {
+	char path[DC_PATH_MAX];
+	SceUID fd = TAI_CONTINUE(SceUID, refs[DC_HOOK_USER_DOPEN], dirname);
+
+	if (fd >= 0 && io_user_path(path, dirname, sizeof(path)) == 0)
+		dc_opened_dir(fd, path);
+	return fd;
+}
+
+static int sceIoDread_patched(SceUID fd, SceIoDirent *dir) {
+	SceIoDirent kdir;
+	int ret;
+
+	if (!dc_base)
+		return TAI_CONTINUE(int, refs[DC_HOOK_USER_DREAD], fd, dir);
+
+	if (dc_cached_dread(fd, &kdir, &ret)) {
+		if (ret > 0 && ksceKernelMemcpyKernelToUser((uintptr_t)dir, &kdir, sizeof(kdir)) < 0)
+			return (int)SCE_ERROR_ERRNO_EFAULT;
+		return ret;
+	}
+	ret = TAI_CONTINUE(int, refs[DC_HOOK_USER_DREAD], fd, dir);
+	// an entry we could not read back leaves the listing incomplete
+	if (ret > 0 && ksceKernelMemcpyUserToKernel(&kdir, (uintptr_t)dir, sizeof(kdir)) < 0)
+		dc_dread_result(fd, NULL, -1);
+	else
+		dc_dread_result(fd, &kdir, ret);
+
+	return ret;
+}
+
+static int sceIoDclose_patched(SceUID fd) {
+	dc_dclosed(fd);
+	return TAI_CONTINUE(int, refs[DC_HOOK_USER_DCLOSE], fd);
+}
+
+int dircache_init(void) {
+	if (usbmc_config.dircache_mem <= 0)
+		return 0;
+
+	for (int i = 0; i < DC_HOOK_COUNT; i++)
+		hooks[i] = -1;
+	for (int i = 0; i < DC_HANDLES; i++)
+		handles[i].fd = -1;
+	for (int i = 0; i < DC_WRITERS; i++)
+		writers[i].fd = -1;
+
+	dc_size = (usbmc_config.dircache_mem + 0xFFF) & ~0xFFF;
+	if (dc_size <= DC_BUCKETS * sizeof(uint32_t))
+		return -1;
+
+	dc_memblk = ksceKernelAllocMemBlock("usbmc_dircache", SCE_KERNEL_MEMBLOCK_TYPE_KERNEL_RW, dc_size, NULL);
+	if (dc_memblk < 0)
+		goto error;
+	dc_mutex = ksceKernelCreateMutex("usbmc_dc_mutex", 0, 0, NULL);
+	if (dc_mutex < 0)
+		goto error;
+
+	ksceKernelGetMemBlockBase(dc_memblk, (void **)&dc_base);
+	dc_buckets = (uint32_t *)dc_base;
+	memset(dc_buckets, 0, DC_BUCKETS * sizeof(uint32_t));
+	dc_used = DC_BUCKETS * sizeof(uint32_t);
+	memset(&stats, 0, sizeof(stats));
+
+	hooks[DC_HOOK_OPEN] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[DC_HOOK_OPEN], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoOpen, ksceIoOpen_patched);
+	hooks[DC_HOOK_CLOSE] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[DC_HOOK_CLOSE], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoClose, ksceIoClose_patched);
+	hooks[DC_HOOK_REMOVE] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[DC_HOOK_REMOVE], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoRemove, ksceIoRemove_patched);
+	hooks[DC_HOOK_RENAME] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[DC_HOOK_RENAME], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoRename, ksceIoRename_patched);
+	hooks[DC_HOOK_MKDIR] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[DC_HOOK_MKDIR], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoMkdir, ksceIoMkdir_patched);
+	hooks[DC_HOOK_RMDIR] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[DC_HOOK_RMDIR], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoRmdir, ksceIoRmdir_patched);
+	hooks[DC_HOOK_DOPEN] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[DC_HOOK_DOPEN], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoDopen, ksceIoDopen_patched);
+	hooks[DC_HOOK_DREAD] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[DC_HOOK_DREAD], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoDread, ksceIoDread_patched);
+	hooks[DC_HOOK_DCLOSE] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[DC_HOOK_DCLOSE], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoDclose, ksceIoDclose_patched);
+	hooks[DC_HOOK_GETSTAT] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[DC_HOOK_GETSTAT], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoGetstat, ksceIoGetstat_patched);
+	hooks[DC_HOOK_CHSTAT] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[DC_HOOK_CHSTAT], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoChstat, ksceIoChstat_patched);
+	hooks[DC_HOOK_USER_OPEN] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[DC_HOOK_USER_OPEN], "SceIofilemgr", LIB_SceIofilemgr, NID_sceIoOpen, sceIoOpen_patched);
+	hooks[DC_HOOK_USER_CLOSE] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[DC_HOOK_USER_CLOSE], "SceIofilemgr", LIB_SceIofilemgr, NID_sceIoClose, sceIoClose_patched);
+	hooks[DC_HOOK_USER_REMOVE] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[DC_HOOK_USER_REMOVE], "SceIofilemgr", LIB_SceIofilemgr, NID_sceIoRemove, sceIoRemove_patched);
+	hooks[DC_HOOK_USER_RENAME] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[DC_HOOK_USER_RENAME], "SceIofilemgr", LIB_SceIofilemgr, NID_sceIoRename, sceIoRename_patched);
+	hooks[DC_HOOK_USER_MKDIR] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[DC_HOOK_USER_MKDIR], "SceIofilemgr", LIB_SceIofilemgr, NID_sceIoMkdir, sceIoMkdir_patched);
+	hooks[DC_HOOK_USER_RMDIR] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[DC_HOOK_USER_RMDIR], "SceIofilemgr", LIB_SceIofilemgr, NID_sceIoRmdir, sceIoRmdir_patched);
+	hooks[DC_HOOK_USER_DOPEN] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[DC_HOOK_USER_DOPEN], "SceIofilemgr", LIB_SceIofilemgr, NID_sceIoDopen, sceIoDopen_patched);
+	hooks[DC_HOOK_USER_DREAD] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[DC_HOOK_USER_DREAD], "SceIofilemgr", LIB_SceIofilemgr, NID_sceIoDread, sceIoDread_patched);
+	hooks[DC_HOOK_USER_DCLOSE] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[DC_HOOK_USER_DCLOSE], "SceIofilemgr", LIB_SceIofilemgr, NID_sceIoDclose, sceIoDclose_patched);
+	hooks[DC_HOOK_USER_GETSTAT] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[DC_HOOK_USER_GETSTAT], "SceIofilemgr", LIB_SceIofilemgr, NID_sceIoGetstat, sceIoGetstat_patched);
+	hooks[DC_HOOK_USER_CHSTAT] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[DC_HOOK_USER_CHSTAT], "SceIofilemgr", LIB_SceIofilemgr, NID_sceIoChstat, sceIoChstat_patched);
+
+	return 0;
+
+error:
+	dircache_exit();
+	return -1;
+}
+
+void dircache_exit(void) {
+	for (int i = DC_HOOK_COUNT - 1; i >= 0; i--) {
+		if (hooks[i] >= 0)
+			taiHookReleaseForKernel(hooks[i], refs[i]);
+		hooks[i] = -1;
+	}
+
+	dc_base = NULL;
+	if (dc_mutex >= 0)
+		ksceKernelDeleteMutex(dc_mutex);
+	if (dc_memblk >= 0)
+		ksceKernelFreeMemBlock(dc_memblk);
+	dc_mutex = dc_memblk = -1;
+}
+
+int shellKernelGetDirCacheStats(UsbmcDirCacheStats *out) {
+	UsbmcDirCacheStats tmp;
+	uint32_t state;
+
+	ENTER_SYSCALL(state);
+
+	if (dc_base) {
+		dc_lock();
+		tmp = stats;
+		tmp.used = dc_used;
+		tmp.capacity = dc_size;
+		dc_unlock();
+	} else {
+		memset(&tmp, 0, sizeof(tmp));
+	}
+	ksceKernelMemcpyKernelToUser((uintptr_t)out, &tmp, sizeof(tmp));
+
+	EXIT_SYSCALL(state);
+	return 0;
+}
@@ -0,0 +1,7 @@
+#ifndef __USBMC_DIRCACHE_H__
+#define __USBMC_DIRCACHE_H__
+
+int dircache_init(void);
+void dircache_exit(void);
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef __USBMC_IOHOOKS_H__
+#define __USBMC_IOHOOKS_H__
+
+#include <psp2kern/kernel/sysmem.h>
+#include <psp2kern/kernel/threadmgr.h>
+
+#include <string.h>
+
+#include <taihen.h>
+
+// SceIofilemgrForDriver NIDs. These are what kernel modules call, with kernel
+// pointers; hooking them sees the plugin's own workers and other kernel code.
+#define NID_ksceIoOpen    0x75192972
+#define NID_ksceIoClose   0xF99DD8A3
+#define NID_ksceIoRead    0xE17EFC03
+#define NID_ksceIoWrite   0x21EE91F0
+#define NID_ksceIoLseek   0x62090481
+#define NID_ksceIoRemove  0x0D7BB3E1
+#define NID_ksceIoRename  0xDC0C4997
+#define NID_ksceIoMkdir   0x7F710B25
+#define NID_ksceIoRmdir   0x1CC9C634
+#define NID_ksceIoDopen   0x463B25CC
+#define NID_ksceIoDread   0x20CF5FC7
+#define NID_ksceIoDclose  0x19C81DD6
+#define NID_ksceIoGetstat 0x75C96D25
+#define NID_ksceIoChstat  0x7D42B8DC
+#define NID_ksceIoPread   0x2A17515D
+#define NID_ksceIoPwrite  0x5F1512C7
+#define NID_ksceIoDevctl  0x16336A0D
+#define NID_ksceIoSync    0xDDF78594
+
+// SceIofilemgr syscalls, what SceShell, games and the installer end up in.
+// Nothing says they go through the driver exports above, so whatever has to
+// see user I/O hooks these as well. They run in the caller's process with
+// user pointers:
+//   SceUID _sceIoOpen(const char *file, int flags, SceMode mode, void *opt)
+//   SceOff _sceIoLseek(SceUID fd, SceOff offset, int whence)
+//   the others take the arguments of their ksceIo counterparts
+#define LIB_SceIofilemgr  0xF2FF276E
+#define NID_sceIoOpen     0xCC67B6FD
+#define NID_sceIoClose    0xC70B8886
+#define NID_sceIoRead     0xFDB32293
+#define NID_sceIoWrite    0x34EFD876
+#define NID_sceIoLseek    0xA604764A
+#define NID_sceIoRemove   0xE20ED0F3
+#define NID_sceIoRename   0xF737E369
+#define NID_sceIoMkdir    0x8F1ACC32
+#define NID_sceIoRmdir    0xE9F91EC8
+#define NID_sceIoDopen    0xA9283DD0
+#define NID_sceIoDread    0x9C8B6624
+#define NID_sceIoDclose   0x422A221A
+#define NID_sceIoGetstat  0x8E7E11F2
+#define NID_sceIoChstat   0x9739A5E2
+
+static inline int is_ux0_path(const char *path) {
+	return strncmp(path, "ux0:", 4) == 0;
+}
+
+// Modules hooking both layers handle a call once, in the hook of the layer
+// it came in through: their driver hooks leave calls made in a user process
+// to the syscall hooks, in case a syscall does call a driver export itself.
+static inline int io_kernel_caller(void) {
+	return ksceKernelGetProcessId() == KERNEL_PID;
+}
+
+// descriptors are only unique within a process
+static inline SceUID io_pid(void) {
+	return ksceKernelGetProcessId();
+}
+
+// a user path copied into dst, -1 if it is unreadable or does not fit
+static inline int io_user_path(char *dst, const char *src, SceSize size) {
+	if (src == NULL || ksceKernelStrncpyUserToKernel(dst, (uintptr_t)src, size) < 0)
+		return -1;
+	dst[size - 1] = '\0';
+	return (strlen(dst) < size - 1) ? 0 : -1;
+}
+
+#endif
@@ -0,0 +1,741 @@
+#include <psp2kern/kernel/cpu.h>
+#include <psp2kern/kernel/sysmem.h>
+#include <psp2kern/kernel/threadmgr.h>
+#include <psp2kern/io/fcntl.h>
+#include <psp2kern/io/dirent.h>
+#include <psp2kern/io/stat.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include <taihen.h>
+
+#include "iohooks.h"
+#include "lazy.h"
+#include "vitashell_kernel.h"
+
+// Lazy migration: ux0 already points at the USB drive while the original
+// device stays reachable as uma0:. Lookups that miss on USB fall through to
+// the original device, files opened from there are queued for copying, and
+// whenever no request has arrived for LAZY_IDLE_TIMEOUT the worker trickles
+// one more missing file across. Once a full pass over the original device
+// finds nothing left to copy the marker file is removed.
+//
+// Kernel modules are served through the driver exports, user processes
+// through the syscalls. A user process falling through to the original
+// device gets a descriptor of its own from ksceIoOpenForPid(), and a
+// directory that only exists there is created on USB first, so the listing
+// the process holds is its own as well; what only the original device has
+// is always listed through a kernel descriptor of the plugin.
+
+#define LAZY_PATH_MAX 256
+#define LAZY_QUEUE 32
+#define LAZY_HANDLES 16
+#define LAZY_DEPTH 32
+#define LAZY_BUF_SIZE (64 * 1024)
+#define LAZY_IDLE_TIMEOUT 1000000
+#define LAZY_TMP_SUFFIX ".usbmctmp"
+
+#define SCE_ERROR_ERRNO_ENOENT 0x80010002
+#define SCE_ERROR_ERRNO_EFAULT 0x8001000E
+
+enum {
+	LAZY_HOOK_OPEN,
+	LAZY_HOOK_REMOVE,
+	LAZY_HOOK_RENAME,
+	LAZY_HOOK_RMDIR,
+	LAZY_HOOK_DOPEN,
+	LAZY_HOOK_DREAD,
+	LAZY_HOOK_DCLOSE,
+	LAZY_HOOK_GETSTAT,
+	LAZY_HOOK_CHSTAT,
+	LAZY_HOOK_USER_OPEN,
+	LAZY_HOOK_USER_REMOVE,
+	LAZY_HOOK_USER_RENAME,
+	LAZY_HOOK_USER_RMDIR,
+	LAZY_HOOK_USER_DOPEN,
+	LAZY_HOOK_USER_DREAD,
+	LAZY_HOOK_USER_DCLOSE,
+	LAZY_HOOK_USER_GETSTAT,
+	LAZY_HOOK_COUNT,
+};
+
+typedef struct {
+	SceUID pid;
+	SceUID fd;
+	SceUID card_fd;
+	char path[LAZY_PATH_MAX];
+} LazyDirHandle;
+
+typedef struct {
+	SceUID fd;
+	int len;
+} LazyWalkFrame;
+
+static char queue[LAZY_QUEUE][LAZY_PATH_MAX];
+static int queue_head = 0, queue_count = 0;
+
+static LazyDirHandle handles[LAZY_HANDLES];
+
+static LazyWalkFrame walk_stack[LAZY_DEPTH];
+static char walk_path[LAZY_PATH_MAX];
+static int walk_depth = 0, walk_missing = 0;
+
+static char *lazy_buf = NULL;
+static SceUID lazy_mutex = -1, copy_mutex = -1, lazy_sema = -1, lazy_thid = -1, lazy_memblk = -1;
+static volatile int lazy_quit = 0;
+static UsbmcLazyStatus status;
+
+static SceUID hooks[LAZY_HOOK_COUNT];
+static tai_hook_ref_t refs[LAZY_HOOK_COUNT];
+
+static inline void lazy_lock(void) {
+	ksceKernelLockMutex(lazy_mutex, 1, NULL);
+}
+
+static inline void lazy_unlock(void) {
+	ksceKernelUnlockMutex(lazy_mutex, 1);
+}
+
+static int lazy_skip(const char *path) {
+	return !status.active || !is_ux0_path(path) || ksceKernelGetThreadId() == lazy_thid;
+}
+
+// the driver hooks leave calls made in a user process to the syscall hooks
+static int lazy_skip_driver(const char *path) {
+	return !io_kernel_caller() || lazy_skip(path);
+}
+
+// "ux0:foo" -> "uma0:foo"
+static int to_card(char *out, const char *path) {
+	if (snprintf(out, LAZY_PATH_MAX, LAZY_CARD_DEV "%s", path + 4) >= LAZY_PATH_MAX)
+		return -1;
+	return 0;
+}
+
+static int card_stat(const char *path, SceIoStat *stat) {
+	char card[LAZY_PATH_MAX];
+
+	if (to_card(card, path) < 0)
+		return SCE_ERROR_ERRNO_ENOENT;
+	return TAI_CONTINUE(int, refs[LAZY_HOOK_GETSTAT], card, stat);
+}
+
+static int usb_missing(const char *path) {
+	SceIoStat stat;
+	return TAI_CONTINUE(int, refs[LAZY_HOOK_GETSTAT], path, &stat) == (int)SCE_ERROR_ERRNO_ENOENT;
+}
+
+// creates the missing parents of a ux0 path that exist on the original device
+static void mirror_parents(const char *path) {
+	char dir[LAZY_PATH_MAX];
+	SceIoStat stat;
+
+	strncpy(dir, path, sizeof(dir) - 1);
+	dir[sizeof(dir) - 1] = '\0';
+	for (char *p = dir + 4; *p; p++) {
+		if (*p != '/' || p == dir + 4)
+			continue;
+		*p = '\0';
+		if (usb_missing(dir) && card_stat(dir, &stat) >= 0)
+			ksceIoMkdir(dir, 0777);
+		*p = '/';
+	}
+}
+
+// copies one file from the original device; runs with the hooks bypassed
+// when called from the worker, through them otherwise
+static int copy_to_usb(const char *path) {
+	char card[LAZY_PATH_MAX], tmp[LAZY_PATH_MAX];
+	SceIoStat stat;
+	int fd, wfd, rd, ret = -1;
+
+	if (to_card(card, path) < 0 || snprintf(tmp, sizeof(tmp), "%s" LAZY_TMP_SUFFIX, path) >= (int)sizeof(tmp))
+		return -1;
+
+	mirror_parents(path);
+
+	// the worker and an in-place update may both want the copy buffer
+	ksceKernelLockMutex(copy_mutex, 1, NULL);
+
+	if ((fd = ksceIoOpen(card, SCE_O_RDONLY, 0)) < 0) {
+		ksceKernelUnlockMutex(copy_mutex, 1);
+		return fd;
+	}
+	if ((wfd = ksceIoOpen(tmp, SCE_O_WRONLY | SCE_O_CREAT | SCE_O_TRUNC, 0777)) < 0) {
+		ksceIoClose(fd);
+		ksceKernelUnlockMutex(copy_mutex, 1);
+		return wfd;
+	}
+
+	while ((rd = ksceIoRead(fd, lazy_buf, LAZY_BUF_SIZE)) > 0) {
+		if (ksceIoWrite(wfd, lazy_buf, rd) != rd)
+			goto error;
+		status.bytes_copied += rd;
+	}
+	if (rd < 0)
+		goto error;
+
+	if (ksceIoGetstatByFd(fd, &stat) >= 0)
+		ksceIoChstatByFd(wfd, &stat, SCE_CST_CT | SCE_CST_AT | SCE_CST_MT);
+
+	ksceIoClose(fd);
+	ksceIoClose(wfd);
+
+	// whoever created the file on USB in the meantime wins
+	if (usb_missing(path) && ksceIoRename(tmp, path) >= 0)
+		status.files_copied++;
+	else
+		ksceIoRemove(tmp);
+
+	ksceKernelUnlockMutex(copy_mutex, 1);
+	return 0;
+
+error:
+	ksceIoClose(fd);
+	ksceIoClose(wfd);
+	ksceIoRemove(tmp);
+	ksceKernelUnlockMutex(copy_mutex, 1);
+	return ret;
+}
+
+static void lazy_enqueue(const char *path) {
+	if (strlen(path) >= LAZY_PATH_MAX)
+		return;
+
+	lazy_lock();
+	for (int i = 0; i < queue_count; i++) {
+		if (strcmp(queue[(queue_head + i) % LAZY_QUEUE], path) == 0) {
+			lazy_unlock();
+			return;
+		}
+	}
+	// a full queue only delays the copy until the trickle pass gets there
+	if (queue_count < LAZY_QUEUE) {
+		strcpy(queue[(queue_head + queue_count) % LAZY_QUEUE], path);
+		queue_count++;
+		status.queued = queue_count;
+		ksceKernelSignalSema(lazy_sema, 1);
+	}
+	lazy_unlock();
+}
+
+// what an open on USB needs before it: the old contents for an update in
+// place, the parent directories for a new file
+static void lazy_before_open(const char *path, int flags) {
+	SceIoStat stat;
+
+	if ((flags & SCE_O_WRONLY) && !(flags & SCE_O_TRUNC) && usb_missing(path) && card_stat(path, &stat) >= 0)
+		copy_to_usb(path);
+}
+
+static SceUID ksceIoOpen_patched(const char *path, int flags, SceMode mode) {
+	char card[LAZY_PATH_MAX];
+	SceUID fd;
+
+	if (lazy_skip_driver(path))
+		return TAI_CONTINUE(SceUID, refs[LAZY_HOOK_OPEN], path, flags, mode);
+
+	lazy_before_open(path, flags);
+	fd = TAI_CONTINUE(SceUID, refs[LAZY_HOOK_OPEN], path, flags, mode);
+	if (fd != (int)SCE_ERROR_ERRNO_ENOENT)
+		return fd;
+
+	if (flags & SCE_O_WRONLY) {
+		// new file in a directory that has not been migrated yet
+		mirror_parents(path);
+		return TAI_CONTINUE(SceUID, refs[LAZY_HOOK_OPEN], path, flags, mode);
+	}
+
+	if (to_card(card, path) < 0)
+		return fd;
+	fd = TAI_CONTINUE(SceUID, refs[LAZY_HOOK_OPEN], card, flags, mode);
+	if (fd >= 0)
+		lazy_enqueue(path);
+
+	return fd;
+}
+
+static int ksceIoGetstat_patched(const char *path, SceIoStat *stat) {
+	int ret = TAI_CONTINUE(int, refs[LAZY_HOOK_GETSTAT], path, stat);
+
+	if (ret == (int)SCE_ERROR_ERRNO_ENOENT && !lazy_skip_driver(path))
+		ret = card_stat(path, stat);
+
+	return ret;
+}
+
+static int ksceIoChstat_patched(const char *path, SceIoStat *stat, int bits) {
+	char card[LAZY_PATH_MAX];
+	int ret = TAI_CONTINUE(int, refs[LAZY_HOOK_CHSTAT], path, stat, bits);
+
+	if (ret == (int)SCE_ERROR_ERRNO_ENOENT && !lazy_skip_driver(path) && to_card(card, path) == 0)
+		ret = TAI_CONTINUE(int, refs[LAZY_HOOK_CHSTAT], card, stat, bits);
+
+	return ret;
+}
+
+// deleting on USB alone would let the old copy reappear; ret is the result
+// on USB, the one on the original device counts if USB had nothing
+static int card_remove(const char *path, int ret) {
+	char card[LAZY_PATH_MAX];
+	int card_ret;
+
+	if (to_card(card, path) < 0)
+		return ret;
+	card_ret = TAI_CONTINUE(int, refs[LAZY_HOOK_REMOVE], card);
+	return (ret == (int)SCE_ERROR_ERRNO_ENOENT) ? card_ret : ret;
+}
+
+static int card_rmdir(const char *path, int ret) {
+	char card[LAZY_PATH_MAX];
+	int card_ret;
+
+	if (to_card(card, path) < 0)
+		return ret;
+	card_ret = TAI_CONTINUE(int, refs[LAZY_HOOK_RMDIR], card);
+	return (ret == (int)SCE_ERROR_ERRNO_ENOENT) ? card_ret : ret;
+}
+
+// renames on both devices so whatever was not migrated yet moves along
+static int card_rename(const char *oldname, const char *newname, int ret) {
+	char card_old[LAZY_PATH_MAX], card_new[LAZY_PATH_MAX];
+	int card_ret;
+
+	if (!is_ux0_path(newname) || to_card(card_old, oldname) < 0 || to_card(card_new, newname) < 0)
+		return ret;
+	card_ret = TAI_CONTINUE(int, refs[LAZY_HOOK_RENAME], card_old, card_new);
+	return (ret == (int)SCE_ERROR_ERRNO_ENOENT) ? card_ret : ret;
+}
+
+static int ksceIoRemove_patched(const char *path) {
+	int ret = TAI_CONTINUE(int, refs[LAZY_HOOK_REMOVE], path);
+
+	return lazy_skip_driver(path) ? ret : card_remove(path, ret);
+}
+
+static int ksceIoRmdir_patched(const char *path) {
+	int ret = TAI_CONTINUE(int, refs[LAZY_HOOK_RMDIR], path);
+
+	return lazy_skip_driver(path) ? ret : card_rmdir(path, ret);
+}
+
+static int ksceIoRename_patched(const char *oldname, const char *newname) {
+	int ret = TAI_CONTINUE(int, refs[LAZY_HOOK_RENAME], oldname, newname);
+
+	return lazy_skip_driver(oldname) ? ret : card_rename(oldname, newname, ret);
+}
+
+// the merged listing of fd in the calling process, a free slot for -1
+static LazyDirHandle *find_handle(SceUID fd) {
+	SceUID pid = io_pid();
+
+	for (int i = 0; i < LAZY_HANDLES; i++) {
+		if (handles[i].fd == fd && (fd < 0 || handles[i].pid == pid))
+			return &handles[i];
+	}
+	return NULL;
+}
+
+// fd lists a directory present on both devices: USB first, then what only
+// the original device has, through a descriptor of the plugin
+static void lazy_opened_dir(SceUID fd, const char *dirname) {
+	char card[LAZY_PATH_MAX];
+	LazyDirHandle *h;
+	SceUID card_fd;
+
+	if (fd < 0 || to_card(card, dirname) < 0)
+		return;
+	if ((card_fd = TAI_CONTINUE(SceUID, refs[LAZY_HOOK_DOPEN], card)) < 0)
+		return;
+
+	lazy_lock();
+	if ((h = find_handle(-1)) != NULL) {
+		h->pid = io_pid();
+		h->fd = fd;
+		h->card_fd = card_fd;
+		strcpy(h->path, dirname);
+		card_fd = -1;
+	}
+	lazy_unlock();
+
+	if (card_fd >= 0)
+		TAI_CONTINUE(int, refs[LAZY_HOOK_DCLOSE], card_fd);
+}
+
+// the original device's descriptor of a merged listing, -1 for others;
+// child is set to the path of the directory
+static SceUID lazy_card_dir(SceUID fd, char *child) {
+	LazyDirHandle *h;
+	SceUID card_fd = -1;
+
+	if (!status.active)
+		return -1;
+	lazy_lock();
+	if ((h = find_handle(fd)) != NULL) {
+		card_fd = h->card_fd;
+		strcpy(child, h->path);
+	}
+	lazy_unlock();
+	return card_fd;
+}
+
+// the next entry only the original device has, once USB listed everything
+static int card_dread(SceUID card_fd, char *child, SceIoDirent *dir) {
+	int len = strlen(child);
+	int ret;
+
+	while ((ret = TAI_CONTINUE(int, refs[LAZY_HOOK_DREAD], card_fd, dir)) > 0) {
+		if (snprintf(child + len, LAZY_PATH_MAX - len, "/%s", dir->d_name) >= LAZY_PATH_MAX - len)
+			continue;
+		if (usb_missing(child))
+			break;
+	}
+	return ret;
+}
+
+// the original device's descriptor goes with the listing it belongs to
+static void lazy_closed_dir(SceUID fd) {
+	LazyDirHandle *h;
+	SceUID card_fd = -1;
+
+	if (status.active) {
+		lazy_lock();
+		if ((h = find_handle(fd)) != NULL) {
+			card_fd = h->card_fd;
+			h->fd = -1;
+		}
+		lazy_unlock();
+	}
+
+	if (card_fd >= 0)
+		TAI_CONTINUE(int, refs[LAZY_HOOK_DCLOSE], card_fd);
+}
+
+static SceUID ksceIoDopen_patched(const char *dirname) {
+	char card[LAZY_PATH_MAX];
+	SceUID fd = TAI_CONTINUE(SceUID, refs[LAZY_HOOK_DOPEN], dirname);
+
+	if (lazy_skip_driver(dirname))
+		return fd;
+	// only on the original device: a kernel descriptor serves kernel callers
+	if (fd < 0) {
+		if (to_card(card, dirname) < 0)
+			return fd;
+		return TAI_CONTINUE(SceUID, refs[LAZY_HOOK_DOPEN], card);
+	}
+	lazy_opened_dir(fd, dirname);
+	return fd;
+}
+
+static int ksceIoDread_patched(SceUID fd, SceIoDirent *dir) {
+	char child[LAZY_PATH_MAX];
+	SceUID card_fd = lazy_card_dir(fd, child);
+	int ret;
+
+	if ((ret = TAI_CONTINUE(int, refs[LAZY_HOOK_DREAD], fd, dir)) != 0 || card_fd < 0)
+		return ret;
+
+	return card_dread(card_fd, child, dir);
+}
+
+static int ksceIoDclose_patched(SceUID fd) {
+	lazy_closed_dir(fd);
+	return TAI_CONTINUE(int, refs[LAZY_HOOK_DCLOSE], fd);
+}
+
+static SceUID sceIoOpen_patched(const char *file, int flags, SceMode mode, void *opt) {
+	char path[LAZY_PATH_MAX], card[LAZY_PATH_MAX];
+	SceUID fd;
+
+	if (io_user_path(path, file, sizeof(path)) < 0 || lazy_skip(path))
+		return TAI_CONTINUE(SceUID, refs[LAZY_HOOK_USER_OPEN], file, flags, mode, opt);
+
+	lazy_before_open(path, flags);
+	fd = TAI_CONTINUE(SceUID, refs[LAZY_HOOK_USER_OPEN], file, flags, mode, opt);
+	if (fd != (int)SCE_ERROR_ERRNO_ENOENT)
+		return fd;
+
+	if (flags & SCE_O_WRONLY) {
+		mirror_parents(path);
+		return TAI_CONTINUE(SceUID, refs[LAZY_HOOK_USER_OPEN], file, flags, mode, opt);
+	}
+
+	// the descriptor has to belong to the caller
+	if (to_card(card, path) < 0)
+		return fd;
+	fd = ksceIoOpenForPid(io_pid(), card, flags, mode);
+	if (fd >= 0)
+		lazy_enqueue(path);
+
+	return fd;
+}
+
+static int sceIoGetstat_patched(const char *file, SceIoStat *stat) {
+	char path[LAZY_PATH_MAX];
+	SceIoStat kstat;
+	int ret = TAI_CONTINUE(int, refs[LAZY_HOOK_USER_GETSTAT], file, stat);
+
+	if (ret != (int)SCE_ERROR_ERRNO_ENOENT || io_user_path(path, file, sizeof(path)) < 0 || lazy_skip(path))
+		return ret;
+
+	if ((ret = card_stat(path, &kstat)) >= 0 && ksceKernelMemcpyKernelToUser((uintptr_t)stat, &kstat, sizeof(kstat)) < 0)
+		ret = SCE_ERROR_ERRNO_EFAULT;
+	return ret;
+}
+
+static int sceIoRemove_patched(const char *file) {
+	char path[LAZY_PATH_MAX];
+	int ret = TAI_CONTINUE(int, refs[LAZY_HOOK_USER_REMOVE], file);
+
+	if (io_user_path(path, file, sizeof(path)) < 0 || lazy_skip(path))
+		return ret;
+	return card_remove(path, ret);
+}
+
+static int sceIoRmdir_patched(const char *dir) {
+	char path[LAZY_PATH_MAX];
+	int ret = TAI_CONTINUE(int, refs[LAZY_HOOK_USER_RMDIR], dir);
+
+	if (io_user_path(path, dir, sizeof(path)) < 0 || lazy_skip(path))
+		return ret;
+	return card_rmdir(path, ret);
+}
+
+static int sceIoRename_patched(const char *oldname, const char *newname) {
+	char old_path[LAZY_PATH_MAX], new_path[LAZY_PATH_MAX];
+	int ret = TAI_CONTINUE(int, refs[LAZY_HOOK_USER_RENAME], oldname, newname);
+
+	if (io_user_path(old_path, oldname, sizeof(old_path)) < 0 || io_user_path(new_path, newname, sizeof(new_path)) < 0 ||
+	    lazy_skip(old_path))
+		return ret;
+	return card_rename(old_path, new_path, ret);
+}
+
+static SceUID sceIoDopen_patched(const char *dirname) {
+	char path[LAZY_PATH_MAX];
+	SceIoStat stat;
+	SceUID fd = TAI_CONTINUE(SceUID, refs[LAZY_HOOK_USER_DOPEN], dirname);
+
+	if (io_user_path(path, dirname, sizeof(path)) < 0 || lazy_skip(path))
+		return fd;
+
+	// only on the original device: the directory is created on USB, so the
+	// caller gets a descriptor of its own that lists nothing until the
+	// original device's entries
+	if (fd == (int)SCE_ERROR_ERRNO_ENOENT && card_stat(path, &stat) >= 0 && SCE_S_ISDIR(stat.st_mode)) {
+		mirror_parents(path);
+		ksceIoMkdir(path, 0777);
+		fd = TAI_CONTINUE(SceUID, refs[LAZY_HOOK_USER_DOPEN], dirname);
+	}
+	lazy_opened_dir(fd, path);
+	return fd;
+}
+
+static int sceIoDread_patched(SceUID fd, SceIoDirent *dir) {
+	char child[LAZY_PATH_MAX];
+	SceUID card_fd = lazy_card_dir(fd, child);
+	SceIoDirent kdir;
+	int ret;
+
+	if ((ret = TAI_CONTINUE(int, refs[LAZY_HOOK_USER_DREAD], fd, dir)) != 0 || card_fd < 0)
+		return ret;
+
+	if ((ret = card_dread(card_fd, child, &kdir)) > 0 && ksceKernelMemcpyKernelToUser((uintptr_t)dir, &kdir, sizeof(kdir)) < 0)
+		ret = SCE_ERROR_ERRNO_EFAULT;
+	return ret;
+}
+
+static int sceIoDclose_patched(SceUID fd) {
+	lazy_closed_dir(fd);
+	return TAI_CONTINUE(int, refs[LAZY_HOOK_USER_DCLOSE], fd);
+}
+
+// copies at most one missing file of the original device per call,
+// returns 1 once a whole pass found nothing left to copy
+static int trickle_step(void) {
+	char usb[LAZY_PATH_MAX];
+	SceIoDirent dir;
+	int ret;
+
+	if (walk_depth == 0) {
+		strcpy(walk_path, LAZY_CARD_DEV);
+		walk_missing = 0;
+		if ((walk_stack[0].fd = ksceIoDopen(walk_path)) < 0)
+			return 0;
+		walk_stack[0].len = strlen(walk_path);
+		walk_depth = 1;
+	}
+
+	while (walk_depth > 0) {
+		LazyWalkFrame *f = &walk_stack[walk_depth - 1];
+		walk_path[f->len] = '\0';
+
+		if ((ret = ksceIoDread(f->fd, &dir)) <= 0) {
+			ksceIoDclose(f->fd);
+			walk_depth--;
+			continue;
+		}
+
+		int len = f->len;
+		if (snprintf(walk_path + len, sizeof(walk_path) - len, "%s%s", walk_path[len - 1] == ':' ? "" : "/", dir.d_name) >= (int)(sizeof(walk_path) - len))
+			continue;
+		snprintf(usb, sizeof(usb), "ux0:%s", walk_path + strlen(LAZY_CARD_DEV));
+
+		if (SCE_S_ISDIR(dir.d_stat.st_mode)) {
+			if (usb_missing(usb))
+				ksceIoMkdir(usb, 0777);
+			if (walk_depth < LAZY_DEPTH && (walk_stack[walk_depth].fd = ksceIoDopen(walk_path)) >= 0) {
+				walk_stack[walk_depth].len = strlen(walk_path);
+				walk_depth++;
+			} else {
+				// never report done while something could not be visited
+				walk_missing++;
+			}
+			continue;
+		}
+
+		if (usb_missing(usb)) {
+			walk_missing++;
+			copy_to_usb(usb);
+			return 0;
+		}
+	}
+
+	return walk_missing == 0;
+}
+
+static int lazy_thread(SceSize args, void *argp) {
+	char path[LAZY_PATH_MAX];
+	SceUInt timeout;
+
+	while (!lazy_quit) {
+		timeout = LAZY_IDLE_TIMEOUT;
+		if (ksceKernelWaitSema(lazy_sema, 1, &timeout) < 0) {
+			// idle: trickle the next file across
+			if (!status.done && trickle_step()) {
+				status.done = 1;
+				ksceIoRemove(USBMC_LAZY_PATH);
+			}
+			continue;
+		}
+		if (lazy_quit)
+			break;
+
+		lazy_lock();
+		if (queue_count == 0) {
+			lazy_unlock();
+			continue;
+		}
+		strcpy(path, queue[queue_head]);
+		queue_head = (queue_head + 1) % LAZY_QUEUE;
+		queue_count--;
+		status.queued = queue_count;
+		lazy_unlock();
+
+		if (usb_missing(path))
+			copy_to_usb(path);
+	}
+
+	while (walk_depth > 0)
+		ksceIoDclose(walk_stack[--walk_depth].fd);
+
+	return 0;
+}
+
+int lazy_init(void) {
+	for (int i = 0; i < LAZY_HOOK_COUNT; i++)
+		hooks[i] = -1;
+	for (int i = 0; i < LAZY_HANDLES; i++)
+		handles[i].fd = -1;
+
+	lazy_memblk = ksceKernelAllocMemBlock("usbmc_lazy", SCE_KERNEL_MEMBLOCK_TYPE_KERNEL_RW, LAZY_BUF_SIZE, NULL);
+	if (lazy_memblk < 0)
+		goto error;
+	ksceKernelGetMemBlockBase(lazy_memblk, (void **)&lazy_buf);
+
+	lazy_mutex = ksceKernelCreateMutex("usbmc_lazy_mutex", 0, 0, NULL);
+	copy_mutex = ksceKernelCreateMutex("usbmc_lazy_copy", 0, 0, NULL);
+	lazy_sema = ksceKernelCreateSema("usbmc_lazy_sema", 0, 0, LAZY_QUEUE, NULL);
+	if (lazy_mutex < 0 || copy_mutex < 0 || lazy_sema < 0)
+		goto error;
+
+	// low priority, foreground I/O goes first
+	lazy_thid = ksceKernelCreateThread("usbmc_lazy", lazy_thread, 0x70, 0x2000, 0, 0, NULL);
+	if (lazy_thid < 0)
+		goto error;
+
+	memset(&status, 0, sizeof(status));
+	status.active = 1;
+
+	hooks[LAZY_HOOK_OPEN] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[LAZY_HOOK_OPEN], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoOpen, ksceIoOpen_patched);
+	hooks[LAZY_HOOK_REMOVE] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[LAZY_HOOK_REMOVE], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoRemove, ksceIoRemove_patched);
+	hooks[LAZY_HOOK_RENAME] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[LAZY_HOOK_RENAME], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoRename, ksceIoRename_patched);
+	hooks[LAZY_HOOK_RMDIR] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[LAZY_HOOK_RMDIR], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoRmdir, ksceIoRmdir_patched);
+	hooks[LAZY_HOOK_DOPEN] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[LAZY_HOOK_DOPEN], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoDopen, ksceIoDopen_patched);
+	hooks[LAZY_HOOK_DREAD] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[LAZY_HOOK_DREAD], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoDread, ksceIoDread_patched);
+	hooks[LAZY_HOOK_DCLOSE] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[LAZY_HOOK_DCLOSE], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoDclose, ksceIoDclose_patched);
+	hooks[LAZY_HOOK_GETSTAT] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[LAZY_HOOK_GETSTAT], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoGetstat, ksceIoGetstat_patched);
+	hooks[LAZY_HOOK_CHSTAT] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[LAZY_HOOK_CHSTAT], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoChstat, ksceIoChstat_patched);
+	hooks[LAZY_HOOK_USER_OPEN] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[LAZY_HOOK_USER_OPEN], "SceIofilemgr", LIB_SceIofilemgr, NID_sceIoOpen, sceIoOpen_patched);
+	hooks[LAZY_HOOK_USER_REMOVE] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[LAZY_HOOK_USER_REMOVE], "SceIofilemgr", LIB_SceIofilemgr, NID_sceIoRemove, sceIoRemove_patched);
+	hooks[LAZY_HOOK_USER_RENAME] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[LAZY_HOOK_USER_RENAME], "SceIofilemgr", LIB_SceIofilemgr, NID_sceIoRename, sceIoRename_patched);
+	hooks[LAZY_HOOK_USER_RMDIR] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[LAZY_HOOK_USER_RMDIR], "SceIofilemgr", LIB_SceIofilemgr, NID_sceIoRmdir, sceIoRmdir_patched);
+	hooks[LAZY_HOOK_USER_DOPEN] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[LAZY_HOOK_USER_DOPEN], "SceIofilemgr", LIB_SceIofilemgr, NID_sceIoDopen, sceIoDopen_patched);
+	hooks[LAZY_HOOK_USER_DREAD] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[LAZY_HOOK_USER_DREAD], "SceIofilemgr", LIB_SceIofilemgr, NID_sceIoDread, sceIoDread_patched);
+	hooks[LAZY_HOOK_USER_DCLOSE] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[LAZY_HOOK_USER_DCLOSE], "SceIofilemgr", LIB_SceIofilemgr, NID_sceIoDclose, sceIoDclose_patched);
+	hooks[LAZY_HOOK_USER_GETSTAT] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[LAZY_HOOK_USER_GETSTAT], "SceIofilemgr", LIB_SceIofilemgr, NID_sceIoGetstat, sceIoGetstat_patched);
+
+	ksceKernelStartThread(lazy_thid, 0, NULL);
+
+	return 0;
+
+error:
+	lazy_exit();
+	return -1;
+}
+
+void lazy_exit(void) {
+	for (int i = LAZY_HOOK_COUNT - 1; i >= 0; i--) {
+		if (hooks[i] >= 0)
+			taiHookReleaseForKernel(hooks[i], refs[i]);
+		hooks[i] = -1;
+	}
+	status.active = 0;
+
+	if (lazy_thid >= 0) {
+		lazy_quit = 1;
+		ksceKernelSignalSema(lazy_sema, 1);
+		ksceKernelWaitThreadEnd(lazy_thid, NULL, NULL);
+		ksceKernelDeleteThread(lazy_thid);
+		lazy_thid = -1;
+	}
+
+	if (lazy_sema >= 0)
+		ksceKernelDeleteSema(lazy_sema);
+	if (copy_mutex >= 0)
+		ksceKernelDeleteMutex(copy_mutex);
+	if (lazy_mutex >= 0)
+		ksceKernelDeleteMutex(lazy_mutex);
+	if (lazy_memblk >= 0)
+		ksceKernelFreeMemBlock(lazy_memblk);
+	lazy_sema = lazy_mutex = copy_mutex = lazy_memblk = -1;
+	lazy_buf = NULL;
+}
+
+int lazy_active(void) {
+	return status.active;
+}
+
+int shellKernelGetLazyStatus(UsbmcLazyStatus *out) {
+	UsbmcLazyStatus tmp;
+	uint32_t state;
+
+	ENTER_SYSCALL(state);
+
+	tmp = status;
+	ksceKernelMemcpyKernelToUser((uintptr_t)out, &tmp, sizeof(tmp));
+
+	EXIT_SYSCALL(state);
+	return 0;
+}
@@ -0,0 +1,12 @@
+#ifndef __USBMC_LAZY_H__
+#define __USBMC_LAZY_H__
+
+// where the original ux0 device stays reachable during a lazy migration
+#define LAZY_CARD_DEV "uma0:"
+
+int lazy_init(void);
+void lazy_exit(void);
+// 1 while a path missing on USB may still be on the original device
+int lazy_active(void);
+
+#endif
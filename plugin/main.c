@@ -27,7 +27,17 @@
 
 #include <taihen.h>
 
+#include "bulkcopy.h"
+#include "config.h"
+#include "dircache.h"
+#include "lazy.h"
+#include "readahead.h"
+#include "trace.h"
+#include "trace_format.h"
+#include "vitashell_kernel.h"
+
 #define MOUNT_POINT_ID 0x800
+#define UMA0_MOUNT_POINT_ID 0xF00
 
 const char check_patch[] = {0x01, 0x20, 0x01, 0x20};
 
@@ -61,6 +71,8 @@ typedef struct {
 
 static SceIoDevice uma_ux0_dev = { "ux0:", "exfatux0", "sdstor0:uma-pp-act-a", "sdstor0:uma-lp-act-entire", MOUNT_POINT_ID };
 
+static SceIoDevice ori_uma0_dev = { LAZY_CARD_DEV, "exfatuma0", NULL, NULL, UMA0_MOUNT_POINT_ID };
+
 static SceIoMountPoint *(* sceIoFindMountPoint)(int id) = NULL;
 
 static SceIoDevice *ori_dev = NULL, *ori_dev2 = NULL;
@@ -135,6 +147,23 @@ int shellKernelUnredirectUx0() {
 	return 0;
 }
 
+// make the device ux0 pointed at before the redirect reachable as uma0:
+static int mount_original_as_uma0() {
+	SceIoMountPoint *mount = sceIoFindMountPoint(UMA0_MOUNT_POINT_ID);
+	if (!mount || !ori_dev) {
+		return -1;
+	}
+
+	ori_uma0_dev.blkdev = ori_dev->blkdev;
+	ori_uma0_dev.blkdev2 = ori_dev->blkdev2;
+
+	mount->dev = &ori_uma0_dev;
+	mount->dev2 = &ori_uma0_dev;
+	io_remount(UMA0_MOUNT_POINT_ID);
+
+	return 0;
+}
+
 // allow Memory Card remount
 void patch_appmgr() {
 	tai_module_info_t appmgr_info;
@@ -164,6 +193,9 @@ int module_start(SceSize args, void *argp) {
 	SceUID tmp1, tmp2;
 	int ret;
 
+	config_load(USBMC_CONFIG_PATH);
+	trace_init();
+
 	patch_appmgr();
 
 	// Get tai module info
@@ -230,7 +262,10 @@ int module_start(SceSize args, void *argp) {
 	// Fake safe mode in SceUsbServ
 	hookid = taiHookFunctionImportForKernel(KERNEL_PID, &ksceSysrootIsSafeModeRef, "SceUsbServ", 0x2ED7F97A, 0x834439A7, ksceSysrootIsSafeModePatched);
 
-	if (exists("sdstor0:xmc-lp-ign-userext") || shellKernelIsUx0Redirected()) {
+	// a lazy migration redirects even with the memory card inserted
+	int lazy = exists(USBMC_LAZY_PATH);
+
+	if (!lazy && (exists("sdstor0:xmc-lp-ign-userext") || shellKernelIsUx0Redirected())) {
 		return SCE_KERNEL_START_SUCCESS;
 	}
 
@@ -246,15 +281,34 @@ int module_start(SceSize args, void *argp) {
 		ksceKernelDelayThread(200000);
 	}
 
+	if (shellKernelIsUx0Redirected() == 1) {
+		readahead_init();
+		dircache_init();
+
+		if (lazy && (mount_original_as_uma0() < 0 || lazy_init() < 0)) {
+			// nothing to fall through to, keep using the original device
+			shellKernelUnredirectUx0();
+			io_remount(MOUNT_POINT_ID);
+		}
+	}
+
 	// load taiHEN plugins on this new memory stick
 	if (exists("ux0:tai/config.txt")) {
 		taiReloadConfigForKernel(1, 1);
 	}
 
+	trace_set_phase(TRACE_PHASE_SYSTEM);
+
 	return SCE_KERNEL_START_SUCCESS;
 }
 
 int module_stop(SceSize args, void *argp) {
+	bulkcopy_exit();
+	lazy_exit();
+	dircache_exit();
+	readahead_exit();
+	trace_exit();
+
 	if (hooks[1] >= 0)
 		taiInjectReleaseForKernel(hooks[1]);
 
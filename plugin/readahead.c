@@ -0,0 +1,548 @@
+#include <psp2kern/kernel/sysmem.h>
+#include <psp2kern/kernel/threadmgr.h>
+#include <psp2kern/io/fcntl.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include <taihen.h>
+
+#include "config.h"
+#include "iohooks.h"
+#include "readahead.h"
+#include "vitashell_kernel.h"
+
+// Sequential read-ahead for files opened read-only on the redirected ux0.
+//
+// Every tracked stream owns two buffers. Once a stream has issued
+// RA_SEQ_THRESHOLD reads without seeking, the worker thread starts filling
+// the buffer following the current one through a private file descriptor,
+// and reads that fall inside a ready buffer are served from memory. The
+// prefetch window doubles every time a whole buffer is consumed, up to
+// readahead_max_window. Any seek away from the current position drops the
+// buffers and the window back to readahead_min_window.
+//
+// Streams come from the driver calls of other kernel modules and from the
+// user syscalls alike, keyed by process and descriptor. A process that exits
+// never closes its files, so when every stream is taken the one read least
+// recently is given to the new file.
+
+#define RA_MAX_STREAMS 16
+#define RA_PATH_MAX 256
+#define RA_SEQ_THRESHOLD 2
+
+enum {
+	RA_HOOK_OPEN,
+	RA_HOOK_CLOSE,
+	RA_HOOK_READ,
+	RA_HOOK_LSEEK,
+	RA_HOOK_USER_OPEN,
+	RA_HOOK_USER_CLOSE,
+	RA_HOOK_USER_READ,
+	RA_HOOK_USER_LSEEK,
+	RA_HOOK_COUNT,
+};
+
+enum {
+	RA_EMPTY,
+	RA_PENDING,
+	RA_FILLING,
+	RA_READY,
+};
+
+typedef struct {
+	char *base;
+	SceOff off;
+	int want;
+	int len;
+	int state;
+	int stale;
+} ReadAheadBuffer;
+
+typedef struct {
+	SceUID pid;
+	SceUID fd;
+	SceUID kfd;
+	int closing;
+	int seq;
+	int window;
+	int cur;
+	SceOff pos;
+	uint64_t used;
+	ReadAheadBuffer buf[2];
+	char path[RA_PATH_MAX];
+} ReadAheadStream;
+
+static ReadAheadStream streams[RA_MAX_STREAMS];
+static int num_streams = 0;
+
+static SceUID ra_mutex = -1, ra_sema = -1, ra_evf = -1, ra_thid = -1, ra_memblk = -1;
+static volatile int ra_quit = 0;
+
+static SceUID hooks[RA_HOOK_COUNT] = { -1, -1, -1, -1, -1, -1, -1, -1 };
+static tai_hook_ref_t refs[RA_HOOK_COUNT];
+
+static inline void ra_lock(void) {
+	ksceKernelLockMutex(ra_mutex, 1, NULL);
+}
+
+static inline void ra_unlock(void) {
+	ksceKernelUnlockMutex(ra_mutex, 1);
+}
+
+static ReadAheadStream *ra_find(SceUID fd) {
+	SceUID pid = io_pid();
+
+	for (int i = 0; i < num_streams; i++) {
+		if (streams[i].fd == fd && streams[i].pid == pid && !streams[i].closing)
+			return &streams[i];
+	}
+	return NULL;
+}
+
+static int ra_filling(ReadAheadStream *s) {
+	return s->buf[0].state == RA_FILLING || s->buf[1].state == RA_FILLING;
+}
+
+// nobody waits on a stream without a fill on its way
+static int ra_busy(ReadAheadStream *s) {
+	return ra_filling(s) || s->buf[0].state == RA_PENDING || s->buf[1].state == RA_PENDING;
+}
+
+// forget everything buffered; in-flight fills are discarded by the worker
+static void ra_reset(ReadAheadStream *s) {
+	for (int i = 0; i < 2; i++) {
+		if (s->buf[i].state == RA_FILLING)
+			s->buf[i].stale = 1;
+		else
+			s->buf[i].state = RA_EMPTY;
+	}
+	s->seq = 0;
+	s->window = usbmc_config.readahead_min_window;
+}
+
+static void ra_request(ReadAheadBuffer *b, SceOff off, int want) {
+	b->off = off;
+	b->want = want;
+	b->len = 0;
+	b->stale = 0;
+	b->state = RA_PENDING;
+	ksceKernelSignalSema(ra_sema, 1);
+}
+
+// keep one buffer ahead of the reader
+static void ra_schedule(ReadAheadStream *s) {
+	ReadAheadBuffer *a = &s->buf[s->cur];
+	ReadAheadBuffer *b = &s->buf[s->cur ^ 1];
+
+	if (a->state == RA_EMPTY) {
+		ra_request(a, s->pos, s->window);
+		return;
+	}
+	if (b->state != RA_EMPTY || a->stale)
+		return;
+	// a short fill means we already hit the end of the file
+	if (a->state == RA_READY && a->len < a->want)
+		return;
+	ra_request(b, a->off + a->want, s->window);
+}
+
+// copies what the buffers hold at s->pos, stops at the first gap
+static int ra_serve(ReadAheadStream *s, char *data, int size, int *eof) {
+	int copied = 0;
+
+	while (copied < size) {
+		ReadAheadBuffer *b = &s->buf[s->cur];
+		if (b->state != RA_READY || b->stale || s->pos < b->off || s->pos > b->off + b->len)
+			break;
+
+		int avail = (int)(b->off + b->len - s->pos);
+		if (avail == 0) {
+			if (b->len < b->want) {
+				*eof = 1;
+				break;
+			}
+			// whole buffer consumed sequentially, grow the window
+			b->state = RA_EMPTY;
+			s->cur ^= 1;
+			if (s->window < usbmc_config.readahead_max_window)
+				s->window *= 2;
+			// the buffers hold readahead_max_window bytes, never ask for more
+			if (s->window > usbmc_config.readahead_max_window)
+				s->window = usbmc_config.readahead_max_window;
+			continue;
+		}
+
+		int n = (size - copied < avail) ? size - copied : avail;
+		if (s->pid == KERNEL_PID)
+			memcpy(data + copied, b->base + (s->pos - b->off), n);
+		else if (ksceKernelMemcpyKernelToUser((uintptr_t)(data + copied), b->base + (s->pos - b->off), n) < 0)
+			break;
+		copied += n;
+		s->pos += n;
+	}
+
+	return copied;
+}
+
+// what is left of a stream once the worker is done with it
+static SceUID ra_release(ReadAheadStream *s) {
+	SceUID kfd = -1;
+
+	if (ra_filling(s)) {
+		// the worker releases the slot once its read completes
+		s->closing = 1;
+		ra_reset(s);
+	} else {
+		kfd = s->kfd;
+		s->kfd = -1;
+		s->fd = -1;
+	}
+	return kfd;
+}
+
+static void ra_open(SceUID fd, const char *path, int flags) {
+	ReadAheadStream *s = NULL;
+	SceUID kfd = -1;
+
+	if (fd < 0 || (flags & SCE_O_WRONLY) || ksceKernelGetThreadId() == ra_thid)
+		return;
+	if (!is_ux0_path(path) || strlen(path) >= RA_PATH_MAX || shellKernelIsUx0Redirected() != 1)
+		return;
+
+	ra_lock();
+	for (int i = 0; i < num_streams; i++) {
+		ReadAheadStream *t = &streams[i];
+		if (t->fd < 0 && !t->closing) {
+			s = t;
+			break;
+		}
+		if (!t->closing && !ra_busy(t) && (s == NULL || t->used < s->used))
+			s = t;
+	}
+	if (s && s->fd >= 0)
+		kfd = ra_release(s);
+	if (s) {
+		s->pid = io_pid();
+		s->fd = fd;
+		s->kfd = -1;
+		s->pos = 0;
+		s->cur = 0;
+		s->used = ksceKernelGetSystemTimeWide();
+		s->buf[0].state = RA_EMPTY;
+		s->buf[1].state = RA_EMPTY;
+		ra_reset(s);
+		strcpy(s->path, path);
+	}
+	ra_unlock();
+
+	if (kfd >= 0)
+		ksceIoClose(kfd);
+}
+
+static void ra_close(SceUID fd) {
+	ReadAheadStream *s;
+	SceUID kfd = -1;
+
+	if (ksceKernelGetThreadId() == ra_thid)
+		return;
+
+	ra_lock();
+	if ((s = ra_find(fd)) != NULL)
+		kfd = ra_release(s);
+	ra_unlock();
+
+	if (kfd >= 0)
+		ksceIoClose(kfd);
+}
+
+static void ra_seeked(SceUID fd, SceOff pos) {
+	ReadAheadStream *s;
+
+	if (pos < 0 || ksceKernelGetThreadId() == ra_thid)
+		return;
+
+	ra_lock();
+	if ((s = ra_find(fd)) != NULL && pos != s->pos) {
+		s->pos = pos;
+		ra_reset(s);
+	}
+	ra_unlock();
+}
+
+// reads and seeks through to the layer the call came in on
+static int ra_read_through(int user, SceUID fd, void *data, SceSize size) {
+	if (user)
+		return TAI_CONTINUE(int, refs[RA_HOOK_USER_READ], fd, data, size);
+	return TAI_CONTINUE(int, refs[RA_HOOK_READ], fd, data, size);
+}
+
+static SceOff ra_seek_through(int user, SceUID fd, SceOff offset, int whence) {
+	if (user)
+		return TAI_CONTINUE(SceOff, refs[RA_HOOK_USER_LSEEK], fd, offset, whence);
+	return TAI_CONTINUE(SceOff, refs[RA_HOOK_LSEEK], fd, offset, whence);
+}
+
+static int ra_read(int user, SceUID fd, void *data, SceSize size) {
+	ReadAheadStream *s;
+	int copied = 0, eof = 0, ret;
+
+	if (ksceKernelGetThreadId() == ra_thid)
+		return ra_read_through(user, fd, data, size);
+
+	ra_lock();
+	while ((s = ra_find(fd)) != NULL) {
+		s->used = ksceKernelGetSystemTimeWide();
+		copied += ra_serve(s, (char *)data + copied, (int)size - copied, &eof);
+		if (copied == (int)size || eof)
+			break;
+
+		// the data we need is on its way, wait instead of reading it twice
+		ReadAheadBuffer *b = &s->buf[s->cur];
+		if ((b->state == RA_PENDING || b->state == RA_FILLING) && !b->stale &&
+		    s->pos >= b->off && s->pos < b->off + b->want) {
+			int idx = s - streams;
+			ksceKernelClearEventFlag(ra_evf, ~(1 << idx));
+			ra_unlock();
+			ksceKernelWaitEventFlag(ra_evf, 1 << idx, SCE_EVENT_WAITOR, NULL, NULL);
+			ra_lock();
+			continue;
+		}
+		break;
+	}
+
+	if (s && (copied == (int)size || eof)) {
+		ra_schedule(s);
+		ra_unlock();
+		// keep the real file position in step with what we handed out
+		ra_seek_through(user, fd, (SceOff)copied, SCE_SEEK_CUR);
+		return copied;
+	}
+
+	// not (fully) buffered: read the rest through
+	if (s && s->buf[s->cur].state == RA_READY)
+		ra_reset(s);
+	ra_unlock();
+
+	if (copied > 0)
+		ra_seek_through(user, fd, (SceOff)copied, SCE_SEEK_CUR);
+
+	ret = ra_read_through(user, fd, (char *)data + copied, size - copied);
+	if (ret < 0)
+		return copied ? copied : ret;
+
+	ra_lock();
+	if ((s = ra_find(fd)) != NULL && ret > 0) {
+		s->pos += ret;
+		// requests as large as our window gain nothing from an extra copy
+		if (++s->seq >= RA_SEQ_THRESHOLD && size < (SceSize)s->window)
+			ra_schedule(s);
+	}
+	ra_unlock();
+
+	return copied + ret;
+}
+
+static SceUID ksceIoOpen_patched(const char *path, int flags, SceMode mode) {
+	SceUID fd = TAI_CONTINUE(SceUID, refs[RA_HOOK_OPEN], path, flags, mode);
+
+	if (io_kernel_caller())
+		ra_open(fd, path, flags);
+	return fd;
+}
+
+static int ksceIoClose_patched(SceUID fd) {
+	if (io_kernel_caller())
+		ra_close(fd);
+	return TAI_CONTINUE(int, refs[RA_HOOK_CLOSE], fd);
+}
+
+static SceOff ksceIoLseek_patched(SceUID fd, SceOff offset, int whence) {
+	SceOff ret = TAI_CONTINUE(SceOff, refs[RA_HOOK_LSEEK], fd, offset, whence);
+
+	if (io_kernel_caller())
+		ra_seeked(fd, ret);
+	return ret;
+}
+
+static int ksceIoRead_patched(SceUID fd, void *data, SceSize size) {
+	if (!io_kernel_caller())
+		return TAI_CONTINUE(int, refs[RA_HOOK_READ], fd, data, size);
+	return ra_read(0, fd, data, size);
+}
+
+static SceUID sceIoOpen_patched(const char *file, int flags, SceMode mode, void *opt) {
+	char path[RA_PATH_MAX];
+	SceUID fd = TAI_CONTINUE(SceUID, refs[RA_HOOK_USER_OPEN], file, flags, mode, opt);
+
+	if (fd >= 0 && io_user_path(path, file, sizeof(path)) == 0)
+		ra_open(fd, path, flags);
+	return fd;
+}
+
+static int sceIoClose_patched(SceUID fd) {
+	ra_close(fd);
+	return TAI_CONTINUE(int, refs[RA_HOOK_USER_CLOSE], fd);
+}
+
+static SceOff sceIoLseek_patched(SceUID fd, SceOff offset, int whence) {
+	SceOff ret = TAI_CONTINUE(SceOff, refs[RA_HOOK_USER_LSEEK], fd, offset, whence);
+
+	ra_seeked(fd, ret);
+	return ret;
+}
+
+static int sceIoRead_patched(SceUID fd, void *data, SceSize size) {
+	return ra_read(1, fd, data, size);
+}
+
+static int ra_thread(SceSize args, void *argp) {
+	while (1) {
+		ksceKernelWaitSema(ra_sema, 1, NULL);
+		if (ra_quit)
+			break;
+
+		ra_lock();
+		for (int i = 0; i < num_streams; i++) {
+			ReadAheadStream *s = &streams[i];
+			for (int j = 0; j < 2; j++) {
+				ReadAheadBuffer *b = &s->buf[j];
+				if (b->state != RA_PENDING)
+					continue;
+
+				b->state = RA_FILLING;
+				ra_unlock();
+
+				if (s->kfd < 0)
+					s->kfd = ksceIoOpen(s->path, SCE_O_RDONLY, 0);
+				int ret = (s->kfd < 0) ? s->kfd : ksceIoPread(s->kfd, b->base, b->want, b->off);
+
+				ra_lock();
+				if (ret < 0 || b->stale) {
+					b->state = RA_EMPTY;
+				} else {
+					b->len = ret;
+					b->state = RA_READY;
+				}
+				b->stale = 0;
+
+				SceUID kfd = -1;
+				if (s->closing && !ra_filling(s)) {
+					kfd = s->kfd;
+					s->kfd = -1;
+					s->fd = -1;
+					s->closing = 0;
+				}
+				ksceKernelSetEventFlag(ra_evf, 1 << i);
+
+				if (kfd >= 0) {
+					ra_unlock();
+					ksceIoClose(kfd);
+					ra_lock();
+				}
+			}
+		}
+		ra_unlock();
+	}
+
+	return 0;
+}
+
+int readahead_init(void) {
+	char *base;
+	int size, window;
+
+	if (!usbmc_config.readahead)
+		return 0;
+
+	window = usbmc_config.readahead_min_window;
+	if (window <= 0 || usbmc_config.readahead_max_window < window)
+		return -1;
+
+	// the window doubles from the minimum, so round the maximum down to the
+	// largest size it can actually reach
+	while (window <= usbmc_config.readahead_max_window / 2)
+		window *= 2;
+	usbmc_config.readahead_max_window = window;
+
+	num_streams = usbmc_config.readahead_mem / (2 * window);
+	if (num_streams > usbmc_config.readahead_streams)
+		num_streams = usbmc_config.readahead_streams;
+	if (num_streams > RA_MAX_STREAMS)
+		num_streams = RA_MAX_STREAMS;
+	if (num_streams <= 0)
+		return -1;
+
+	size = (num_streams * 2 * window + 0xFFF) & ~0xFFF;
+	ra_memblk = ksceKernelAllocMemBlock("usbmc_readahead", SCE_KERNEL_MEMBLOCK_TYPE_KERNEL_RW, size, NULL);
+	if (ra_memblk < 0)
+		goto error;
+	ksceKernelGetMemBlockBase(ra_memblk, (void **)&base);
+
+	for (int i = 0; i < num_streams; i++) {
+		streams[i].fd = -1;
+		streams[i].kfd = -1;
+		streams[i].buf[0].base = base + (2 * i) * window;
+		streams[i].buf[1].base = base + (2 * i + 1) * window;
+	}
+
+	ra_mutex = ksceKernelCreateMutex("usbmc_ra_mutex", 0, 0, NULL);
+	ra_sema = ksceKernelCreateSema("usbmc_ra_sema", 0, 0, 0x7FFFFFFF, NULL);
+	ra_evf = ksceKernelCreateEventFlag("usbmc_ra_evf", SCE_KERNEL_ATTR_MULTI, 0, NULL);
+	if (ra_mutex < 0 || ra_sema < 0 || ra_evf < 0)
+		goto error;
+
+	ra_thid = ksceKernelCreateThread("usbmc_readahead", ra_thread, 0x3C, 0x1000, 0, 0, NULL);
+	if (ra_thid < 0)
+		goto error;
+	ksceKernelStartThread(ra_thid, 0, NULL);
+
+	hooks[RA_HOOK_OPEN] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[RA_HOOK_OPEN], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoOpen, ksceIoOpen_patched);
+	hooks[RA_HOOK_CLOSE] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[RA_HOOK_CLOSE], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoClose, ksceIoClose_patched);
+	hooks[RA_HOOK_READ] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[RA_HOOK_READ], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoRead, ksceIoRead_patched);
+	hooks[RA_HOOK_LSEEK] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[RA_HOOK_LSEEK], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoLseek, ksceIoLseek_patched);
+	hooks[RA_HOOK_USER_OPEN] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[RA_HOOK_USER_OPEN], "SceIofilemgr", LIB_SceIofilemgr, NID_sceIoOpen, sceIoOpen_patched);
+	hooks[RA_HOOK_USER_CLOSE] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[RA_HOOK_USER_CLOSE], "SceIofilemgr", LIB_SceIofilemgr, NID_sceIoClose, sceIoClose_patched);
+	hooks[RA_HOOK_USER_READ] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[RA_HOOK_USER_READ], "SceIofilemgr", LIB_SceIofilemgr, NID_sceIoRead, sceIoRead_patched);
+	hooks[RA_HOOK_USER_LSEEK] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[RA_HOOK_USER_LSEEK], "SceIofilemgr", LIB_SceIofilemgr, NID_sceIoLseek, sceIoLseek_patched);
+
+	return 0;
+
+error:
+	readahead_exit();
+	return -1;
+}
+
+void readahead_exit(void) {
+	for (int i = RA_HOOK_COUNT - 1; i >= 0; i--) {
+		if (hooks[i] >= 0)
+			taiHookReleaseForKernel(hooks[i], refs[i]);
+		hooks[i] = -1;
+	}
+
+	if (ra_thid >= 0) {
+		ra_quit = 1;
+		ksceKernelSignalSema(ra_sema, 1);
+		ksceKernelWaitThreadEnd(ra_thid, NULL, NULL);
+		ksceKernelDeleteThread(ra_thid);
+		ra_thid = -1;
+	}
+
+	for (int i = 0; i < num_streams; i++) {
+		if (streams[i].kfd >= 0)
+			ksceIoClose(streams[i].kfd);
+		streams[i].kfd = -1;
+		streams[i].fd = -1;
+	}
+	num_streams = 0;
+
+	if (ra_evf >= 0)
+		ksceKernelDeleteEventFlag(ra_evf);
+	if (ra_sema >= 0)
+		ksceKernelDeleteSema(ra_sema);
+	if (ra_mutex >= 0)
+		ksceKernelDeleteMutex(ra_mutex);
+	if (ra_memblk >= 0)
+		ksceKernelFreeMemBlock(ra_memblk);
+	ra_evf = ra_sema = ra_mutex = ra_memblk = -1;
+}
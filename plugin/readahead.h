@@ -0,0 +1,7 @@
+#ifndef __USBMC_READAHEAD_H__
+#define __USBMC_READAHEAD_H__
+
+int readahead_init(void);
+void readahead_exit(void);
+
+#endif
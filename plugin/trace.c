@@ -0,0 +1,750 @@
+#include <psp2kern/kernel/cpu.h>
+#include <psp2kern/kernel/sysmem.h>
+#include <psp2kern/kernel/threadmgr.h>
+#include <psp2kern/io/fcntl.h>
+#include <psp2kern/io/dirent.h>
+#include <psp2kern/io/stat.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include <taihen.h>
+
+#include "config.h"
+#include "iohooks.h"
+#include "trace.h"
+#include "trace_format.h"
+#include "vitashell_kernel.h"
+
+// I/O trace recorder. Every hooked call appends a TraceRecord to a ring in
+// a kernel memblock; a low priority thread appends the ring to
+// USBMC_TRACE_PATH whenever it is half full and once a second otherwise.
+// Paths are logged once, as TRACE_OP_NAME records, and referenced by id
+// afterwards; file descriptors are mapped back to the id they were opened
+// with. When the ring is full records are dropped and counted rather than
+// blocking the caller. With trace_mem at 0 nothing is hooked at all.
+//
+// The hooks are installed before the other modules hook the same calls, so
+// they sit closest to the filesystem and record what actually reaches it.
+// Calls from user processes are recorded by hooks on the syscalls, those
+// from kernel modules by hooks on the driver exports.
+// Not traced: the asynchronous calls (ksceIoOpenAsync, ksceIoReadAsync, ...)
+// and ksceIoChstatByFd/ksceIoSyncByFd, whose driver NIDs are not known well
+// enough to hook, and pread, pwrite, chstat, devctl and sync made by user
+// processes, which have no syscall hook. They show up in the trace as gaps.
+
+#define TRACE_PATH_MAX 256
+#define TRACE_NAMES 512
+#define TRACE_FDS 256
+#define TRACE_FLUSH_INTERVAL 1000000
+#define TRACE_MIN_RECORDS 64
+
+enum {
+	TRACE_HOOK_OPEN,
+	TRACE_HOOK_CLOSE,
+	TRACE_HOOK_READ,
+	TRACE_HOOK_WRITE,
+	TRACE_HOOK_LSEEK,
+	TRACE_HOOK_REMOVE,
+	TRACE_HOOK_RENAME,
+	TRACE_HOOK_MKDIR,
+	TRACE_HOOK_RMDIR,
+	TRACE_HOOK_DOPEN,
+	TRACE_HOOK_DREAD,
+	TRACE_HOOK_DCLOSE,
+	TRACE_HOOK_GETSTAT,
+	TRACE_HOOK_PREAD,
+	TRACE_HOOK_PWRITE,
+	TRACE_HOOK_CHSTAT,
+	TRACE_HOOK_DEVCTL,
+	TRACE_HOOK_SYNC,
+	TRACE_HOOK_USER_OPEN,
+	TRACE_HOOK_USER_CLOSE,
+	TRACE_HOOK_USER_READ,
+	TRACE_HOOK_USER_WRITE,
+	TRACE_HOOK_USER_LSEEK,
+	TRACE_HOOK_USER_REMOVE,
+	TRACE_HOOK_USER_RENAME,
+	TRACE_HOOK_USER_MKDIR,
+	TRACE_HOOK_USER_RMDIR,
+	TRACE_HOOK_USER_DOPEN,
+	TRACE_HOOK_USER_DREAD,
+	TRACE_HOOK_USER_DCLOSE,
+	TRACE_HOOK_USER_GETSTAT,
+	TRACE_HOOK_COUNT,
+};
+
+typedef struct {
+	uint32_t hash;
+	uint16_t id;
+} TraceName;
+
+typedef struct {
+	SceUID pid;
+	SceUID fd;
+	uint16_t id;
+} TraceFd;
+
+static TraceRecord *ring = NULL;
+static unsigned int ring_size = 0;
+static unsigned int ring_head = 0, ring_tail = 0;
+static unsigned int dropped = 0;
+static volatile int phase = TRACE_PHASE_BOOT;
+
+static TraceName names[TRACE_NAMES];
+static TraceFd fds[TRACE_FDS];
+static uint16_t next_id = 0;
+
+static SceUID trace_mutex = -1, trace_sema = -1, trace_thid = -1, trace_memblk = -1;
+static SceUID trace_fd = -1;
+static volatile int trace_quit = 0;
+static volatile int flush_pending = 0;
+static volatile unsigned int flush_count = 0;
+
+static SceUID hooks[TRACE_HOOK_COUNT];
+static tai_hook_ref_t refs[TRACE_HOOK_COUNT];
+
+static inline void trace_lock(void) {
+	ksceKernelLockMutex(trace_mutex, 1, NULL);
+}
+
+static inline void trace_unlock(void) {
+	ksceKernelUnlockMutex(trace_mutex, 1);
+}
+
+// the flush thread's own writes are not traced, nor are user calls reaching
+// the driver exports, the syscall hooks have them already
+static inline int trace_skip(void) {
+	return ksceKernelGetThreadId() == trace_thid || !io_kernel_caller();
+}
+
+static inline uint64_t now(void) {
+	return ksceKernelGetSystemTimeWide();
+}
+
+static uint32_t hash_path(const char *path) {
+	uint32_t hash = 2166136261u;
+
+	while (*path)
+		hash = (hash ^ (unsigned char)*path++) * 16777619u;
+	return hash;
+}
+
+#define RING(i) (&ring[(i) & (ring_size - 1)])
+
+// reserves n consecutive records, with the lock held
+static int ring_reserve(unsigned int n, unsigned int *index) {
+	if (ring_head - ring_tail + n > ring_size) {
+		dropped++;
+		return -1;
+	}
+	*index = ring_head;
+	ring_head += n;
+	return 0;
+}
+
+static void ring_written(void) {
+	if (!flush_pending && ring_head - ring_tail >= ring_size / 2) {
+		flush_pending = 1;
+		ksceKernelSignalSema(trace_sema, 1);
+	}
+}
+
+// id of a path, logging its name the first time it is seen
+static uint16_t path_id(const char *path) {
+	uint32_t hash = hash_path(path);
+	TraceName *name = &names[hash % TRACE_NAMES];
+	unsigned int len = strnlen(path, TRACE_PATH_MAX - 1);
+	unsigned int n = (len + sizeof(TraceRecord) - 1) / sizeof(TraceRecord);
+	unsigned int index;
+	TraceRecord *rec;
+
+	if (name->hash == hash && name->id != TRACE_NO_PATH)
+		return name->id;
+
+	if (ring_reserve(1 + n, &index) < 0)
+		return TRACE_NO_PATH;
+
+	if (next_id == TRACE_NO_PATH)
+		next_id = 0;
+	name->hash = hash;
+	name->id = next_id++;
+
+	rec = RING(index);
+	memset(rec, 0, sizeof(*rec));
+	rec->op = TRACE_OP_NAME;
+	rec->phase = phase;
+	rec->path = name->id;
+	rec->fd = -1;
+	rec->size = len;
+	rec->start = now();
+
+	// the text may wrap around the end of the ring
+	for (unsigned int i = 0; i < n; i++) {
+		unsigned int off = i * sizeof(TraceRecord);
+		unsigned int chunk = (len - off < sizeof(TraceRecord)) ? len - off : sizeof(TraceRecord);
+
+		rec = RING(index + 1 + i);
+		memset(rec, 0, sizeof(*rec));
+		memcpy(rec, path + off, chunk);
+	}
+
+	return name->id;
+}
+
+static void fd_set_id(SceUID fd, uint16_t id) {
+	SceUID pid = io_pid();
+	TraceFd *entry = &fds[(unsigned int)(fd ^ pid) % TRACE_FDS];
+
+	entry->pid = pid;
+	entry->fd = fd;
+	entry->id = id;
+}
+
+static uint16_t fd_id(SceUID fd) {
+	SceUID pid = io_pid();
+	TraceFd *entry = &fds[(unsigned int)(fd ^ pid) % TRACE_FDS];
+
+	return (entry->fd == fd && entry->pid == pid) ? entry->id : TRACE_NO_PATH;
+}
+
+static void record(int op, uint16_t path, SceUID fd, uint32_t size, uint64_t offset, uint64_t start, int result) {
+	unsigned int index;
+	TraceRecord *rec;
+
+	if (ring_reserve(1, &index) < 0)
+		return;
+	rec = RING(index);
+	rec->op = op;
+	rec->phase = phase;
+	rec->path = path;
+	rec->size = size;
+	rec->offset = offset;
+	rec->start = start;
+	rec->duration = now() - start;
+	rec->result = result;
+	rec->fd = fd;
+	rec->pid = io_pid();
+	ring_written();
+}
+
+static void record_path(int op, const char *path, uint32_t size, uint64_t offset, uint64_t start, int result) {
+	trace_lock();
+	record(op, path_id(path), -1, size, offset, start, result);
+	trace_unlock();
+}
+
+static void record_fd(int op, SceUID fd, uint32_t size, uint64_t offset, uint64_t start, int result) {
+	trace_lock();
+	record(op, fd_id(fd), fd, size, offset, start, result);
+	trace_unlock();
+}
+
+// path is NULL for a user path that could not be read
+static void record_open(int op, const char *path, uint32_t flags, uint64_t mode, uint64_t start, SceUID fd) {
+	trace_lock();
+	uint16_t id = path ? path_id(path) : TRACE_NO_PATH;
+	if (fd >= 0)
+		fd_set_id(fd, id);
+	record(op, id, fd, flags, mode, start, fd);
+	trace_unlock();
+}
+
+static void record_user_path(int op, const char *user_path, uint32_t size, uint64_t offset, uint64_t start, int result) {
+	char path[TRACE_PATH_MAX];
+
+	if (io_user_path(path, user_path, sizeof(path)) == 0) {
+		record_path(op, path, size, offset, start, result);
+	} else {
+		trace_lock();
+		record(op, TRACE_NO_PATH, -1, size, offset, start, result);
+		trace_unlock();
+	}
+}
+
+static SceUID ksceIoOpen_patched(const char *path, int flags, SceMode mode) {
+	uint64_t start = now();
+	SceUID fd = TAI_CONTINUE(SceUID, refs[TRACE_HOOK_OPEN], path, flags, mode);
+
+	if (!trace_skip())
+		record_open(TRACE_OP_OPEN, path, flags, mode, start, fd);
+	return fd;
+}
+
+static int ksceIoClose_patched(SceUID fd) {
+	uint64_t start = now();
+	int ret = TAI_CONTINUE(int, refs[TRACE_HOOK_CLOSE], fd);
+
+	if (!trace_skip())
+		record_fd(TRACE_OP_CLOSE, fd, 0, 0, start, ret);
+	return ret;
+}
+
+static int ksceIoRead_patched(SceUID fd, void *data, SceSize size) {
+	uint64_t start = now();
+	int ret = TAI_CONTINUE(int, refs[TRACE_HOOK_READ], fd, data, size);
+
+	if (!trace_skip())
+		record_fd(TRACE_OP_READ, fd, size, 0, start, ret);
+	return ret;
+}
+
+static int ksceIoWrite_patched(SceUID fd, const void *data, SceSize size) {
+	uint64_t start = now();
+	int ret = TAI_CONTINUE(int, refs[TRACE_HOOK_WRITE], fd, data, size);
+
+	if (!trace_skip())
+		record_fd(TRACE_OP_WRITE, fd, size, 0, start, ret);
+	return ret;
+}
+
+static SceOff ksceIoLseek_patched(SceUID fd, SceOff offset, int whence) {
+	uint64_t start = now();
+	SceOff ret = TAI_CONTINUE(SceOff, refs[TRACE_HOOK_LSEEK], fd, offset, whence);
+
+	if (!trace_skip())
+		record_fd(TRACE_OP_LSEEK, fd, whence, offset, start, (ret < 0) ? (int)ret : 0);
+	return ret;
+}
+
+static int ksceIoRemove_patched(const char *path) {
+	uint64_t start = now();
+	int ret = TAI_CONTINUE(int, refs[TRACE_HOOK_REMOVE], path);
+
+	if (!trace_skip())
+		record_path(TRACE_OP_REMOVE, path, 0, 0, start, ret);
+	return ret;
+}
+
+static int ksceIoRename_patched(const char *oldname, const char *newname) {
+	uint64_t start = now();
+	int ret = TAI_CONTINUE(int, refs[TRACE_HOOK_RENAME], oldname, newname);
+
+	if (!trace_skip()) {
+		trace_lock();
+		uint16_t id = path_id(oldname);
+		record(TRACE_OP_RENAME, id, -1, 0, path_id(newname), start, ret);
+		trace_unlock();
+	}
+	return ret;
+}
+
+static int ksceIoMkdir_patched(const char *path, SceMode mode) {
+	uint64_t start = now();
+	int ret = TAI_CONTINUE(int, refs[TRACE_HOOK_MKDIR], path, mode);
+
+	if (!trace_skip())
+		record_path(TRACE_OP_MKDIR, path, mode, 0, start, ret);
+	return ret;
+}
+
+static int ksceIoRmdir_patched(const char *path) {
+	uint64_t start = now();
+	int ret = TAI_CONTINUE(int, refs[TRACE_HOOK_RMDIR], path);
+
+	if (!trace_skip())
+		record_path(TRACE_OP_RMDIR, path, 0, 0, start, ret);
+	return ret;
+}
+
+static SceUID ksceIoDopen_patched(const char *dirname) {
+	uint64_t start = now();
+	SceUID fd = TAI_CONTINUE(SceUID, refs[TRACE_HOOK_DOPEN], dirname);
+
+	if (!trace_skip())
+		record_open(TRACE_OP_DOPEN, dirname, 0, 0, start, fd);
+	return fd;
+}
+
+static int ksceIoDread_patched(SceUID fd, SceIoDirent *dir) {
+	uint64_t start = now();
+	int ret = TAI_CONTINUE(int, refs[TRACE_HOOK_DREAD], fd, dir);
+
+	if (!trace_skip())
+		record_fd(TRACE_OP_DREAD, fd, 0, 0, start, ret);
+	return ret;
+}
+
+static int ksceIoDclose_patched(SceUID fd) {
+	uint64_t start = now();
+	int ret = TAI_CONTINUE(int, refs[TRACE_HOOK_DCLOSE], fd);
+
+	if (!trace_skip())
+		record_fd(TRACE_OP_DCLOSE, fd, 0, 0, start, ret);
+	return ret;
+}
+
+static int ksceIoGetstat_patched(const char *path, SceIoStat *stat) {
+	uint64_t start = now();
+	int ret = TAI_CONTINUE(int, refs[TRACE_HOOK_GETSTAT], path, stat);
+
+	if (!trace_skip())
+		record_path(TRACE_OP_GETSTAT, path, 0, 0, start, ret);
+	return ret;
+}
+
+static int ksceIoPread_patched(SceUID fd, void *data, SceSize size, SceOff offset) {
+	uint64_t start = now();
+	int ret = TAI_CONTINUE(int, refs[TRACE_HOOK_PREAD], fd, data, size, offset);
+
+	if (!trace_skip())
+		record_fd(TRACE_OP_PREAD, fd, size, offset, start, ret);
+	return ret;
+}
+
+static int ksceIoPwrite_patched(SceUID fd, const void *data, SceSize size, SceOff offset) {
+	uint64_t start = now();
+	int ret = TAI_CONTINUE(int, refs[TRACE_HOOK_PWRITE], fd, data, size, offset);
+
+	if (!trace_skip())
+		record_fd(TRACE_OP_PWRITE, fd, size, offset, start, ret);
+	return ret;
+}
+
+static int ksceIoChstat_patched(const char *path, SceIoStat *stat, int bits) {
+	uint64_t start = now();
+	int ret = TAI_CONTINUE(int, refs[TRACE_HOOK_CHSTAT], path, stat, bits);
+
+	if (!trace_skip())
+		record_path(TRACE_OP_CHSTAT, path, bits, 0, start, ret);
+	return ret;
+}
+
+static int ksceIoDevctl_patched(const char *dev, unsigned int cmd, void *indata, int inlen, void *outdata, int outlen) {
+	uint64_t start = now();
+	int ret = TAI_CONTINUE(int, refs[TRACE_HOOK_DEVCTL], dev, cmd, indata, inlen, outdata, outlen);
+
+	if (!trace_skip())
+		record_path(TRACE_OP_DEVCTL, dev, cmd, 0, start, ret);
+	return ret;
+}
+
+static int ksceIoSync_patched(const char *device, unsigned int flags) {
+	uint64_t start = now();
+	int ret = TAI_CONTINUE(int, refs[TRACE_HOOK_SYNC], device, flags);
+
+	if (!trace_skip())
+		record_path(TRACE_OP_SYNC, device, flags, 0, start, ret);
+	return ret;
+}
+
+static SceUID sceIoOpen_patched(const char *file, int flags, SceMode mode, void *opt) {
+	char path[TRACE_PATH_MAX];
+	uint64_t start = now();
+	SceUID fd = TAI_CONTINUE(SceUID, refs[TRACE_HOOK_USER_OPEN], file, flags, mode, opt);
+
+	record_open(TRACE_OP_OPEN, io_user_path(path, file, sizeof(path)) == 0 ? path : NULL, flags, mode, start, fd);
+	return fd;
+}
+
+static int sceIoClose_patched(SceUID fd) {
+	uint64_t start = now();
+	int ret = TAI_CONTINUE(int, refs[TRACE_HOOK_USER_CLOSE], fd);
+
+	record_fd(TRACE_OP_CLOSE, fd, 0, 0, start, ret);
+	return ret;
+}
+
+static int sceIoRead_patched(SceUID fd, void *data, SceSize size) {
+	uint64_t start = now();
+	int ret = TAI_CONTINUE(int, refs[TRACE_HOOK_USER_READ], fd, data, size);
+
+	record_fd(TRACE_OP_READ, fd, size, 0, start, ret);
+	return ret;
+}
+
+static int sceIoWrite_patched(SceUID fd, const void *data, SceSize size) {
+	uint64_t start = now();
+	int ret = TAI_CONTINUE(int, refs[TRACE_HOOK_USER_WRITE], fd, data, size);
+
+	record_fd(TRACE_OP_WRITE, fd, size, 0, start, ret);
+	return ret;
+}
+
+static SceOff sceIoLseek_patched(SceUID fd, SceOff offset, int whence) {
+	uint64_t start = now();
+	SceOff ret = TAI_CONTINUE(SceOff, refs[TRACE_HOOK_USER_LSEEK], fd, offset, whence);
+
+	record_fd(TRACE_OP_LSEEK, fd, whence, offset, start, (ret < 0) ? (int)ret : 0);
+	return ret;
+}
+
+static int sceIoRemove_patched(const char *file) {
+	uint64_t start = now();
+	int ret = TAI_CONTINUE(int, refs[TRACE_HOOK_USER_REMOVE], file);
+
+	record_user_path(TRACE_OP_REMOVE, file, 0, 0, start, ret);
+	return ret;
+}
+
+static int sceIoRename_patched(const char *oldname, const char *newname) {
+	char old_path[TRACE_PATH_MAX], new_path[TRACE_PATH_MAX];
+	uint64_t start = now();
+	int ret = TAI_CONTINUE(int, refs[TRACE_HOOK_USER_RENAME], oldname, newname);
+	int old_ok = io_user_path(old_path, oldname, sizeof(old_path)) == 0;
+	int new_ok = io_user_path(new_path, newname, sizeof(new_path)) == 0;
+
+	trace_lock();
+	uint16_t id = old_ok ? path_id(old_path) : TRACE_NO_PATH;
+	record(TRACE_OP_RENAME, id, -1, 0, new_ok ? path_id(new_path) : TRACE_NO_PATH, start, ret);
+	trace_unlock();
+	return ret;
+}
+
+static int sceIoMkdir_patched(const char *dir, SceMode mode) {
+	uint64_t start = now();
+	int ret = TAI_CONTINUE(int, refs[TRACE_HOOK_USER_MKDIR], dir, mode);
+
+	record_user_path(TRACE_OP_MKDIR, dir, mode, 0, start, ret);
+	return ret;
+}
+
+static int sceIoRmdir_patched(const char *dir) {
+	uint64_t start = now();
+	int ret = TAI_CONTINUE(int, refs[TRACE_HOOK_USER_RMDIR], dir);
+
+	record_user_path(TRACE_OP_RMDIR, dir, 0, 0, start, ret);
+	return ret;
+}
+
+static SceUID sceIoDopen_patched(const char *dirname) {
+	char path[TRACE_PATH_MAX];
+	uint64_t start = now();
+	SceUID fd = TAI_CONTINUE(SceUID, refs[TRACE_HOOK_USER_DOPEN], dirname);
+
+	record_open(TRACE_OP_DOPEN, io_user_path(path, dirname, sizeof(path)) == 0 ? path : NULL, 0, 0, start, fd);
+	return fd;
+}
+
+static int sceIoDread_patched(SceUID fd, SceIoDirent *dir) {
+	uint64_t start = now();
+	int ret = TAI_CONTINUE(int, refs[TRACE_HOOK_USER_DREAD], fd, dir);
+
+	record_fd(TRACE_OP_DREAD, fd, 0, 0, start, ret);
+	return ret;
+}
+
+static int sceIoDclose_patched(SceUID fd) {
+	uint64_t start = now();
+	int ret = TAI_CONTINUE(int, refs[TRACE_HOOK_USER_DCLOSE], fd);
+
+	record_fd(TRACE_OP_DCLOSE, fd, 0, 0, start, ret);
+	return ret;
+}
+
+static int sceIoGetstat_patched(const char *file, SceIoStat *stat) {
+	uint64_t start = now();
+	int ret = TAI_CONTINUE(int, refs[TRACE_HOOK_USER_GETSTAT], file, stat);
+
+	record_user_path(TRACE_OP_GETSTAT, file, 0, 0, start, ret);
+	return ret;
+}
+
+static void trace_flush(void) {
+	unsigned int head, tail, lost;
+
+	trace_lock();
+	head = ring_head;
+	tail = ring_tail;
+	lost = dropped;
+	dropped = 0;
+	flush_pending = 0;
+	trace_unlock();
+
+	// records between tail and head are ours until tail moves
+	while (tail != head) {
+		unsigned int start = tail & (ring_size - 1);
+		unsigned int count = head - tail;
+
+		if (start + count > ring_size)
+			count = ring_size - start;
+		ksceIoWrite(trace_fd, &ring[start], count * sizeof(TraceRecord));
+		tail += count;
+	}
+
+	if (lost > 0) {
+		TraceRecord rec;
+
+		memset(&rec, 0, sizeof(rec));
+		rec.op = TRACE_OP_DROPPED;
+		rec.phase = phase;
+		rec.path = TRACE_NO_PATH;
+		rec.fd = -1;
+		rec.pid = io_pid();
+		rec.size = lost;
+		rec.start = now();
+		ksceIoWrite(trace_fd, &rec, sizeof(rec));
+	}
+
+	trace_lock();
+	ring_tail = tail;
+	trace_unlock();
+
+	flush_count++;
+}
+
+static int trace_thread(SceSize args, void *argp) {
+	SceUInt timeout;
+
+	while (!trace_quit) {
+		timeout = TRACE_FLUSH_INTERVAL;
+		ksceKernelWaitSema(trace_sema, 1, &timeout);
+		trace_flush();
+	}
+	trace_flush();
+
+	return 0;
+}
+
+void trace_set_phase(int new_phase) {
+	if (ring == NULL || new_phase < 0 || new_phase >= TRACE_PHASE_COUNT)
+		return;
+
+	trace_lock();
+	phase = new_phase;
+	record(TRACE_OP_MARK, TRACE_NO_PATH, -1, 0, 0, now(), 0);
+	trace_unlock();
+}
+
+int trace_init(void) {
+	TraceHeader header;
+	int size = usbmc_config.trace_mem & ~0xFFF;
+
+	for (int i = 0; i < TRACE_HOOK_COUNT; i++)
+		hooks[i] = -1;
+
+	if (size < (int)(TRACE_MIN_RECORDS * sizeof(TraceRecord)))
+		return 0;
+
+	for (int i = 0; i < TRACE_NAMES; i++)
+		names[i].id = TRACE_NO_PATH;
+	for (int i = 0; i < TRACE_FDS; i++)
+		fds[i].fd = -1;
+
+	trace_memblk = ksceKernelAllocMemBlock("usbmc_trace", SCE_KERNEL_MEMBLOCK_TYPE_KERNEL_RW, size, NULL);
+	if (trace_memblk < 0)
+		goto error;
+	ksceKernelGetMemBlockBase(trace_memblk, (void **)&ring);
+	// a power of two keeps the indices valid across wrap-around
+	for (ring_size = TRACE_MIN_RECORDS; ring_size * 2 * sizeof(TraceRecord) <= (unsigned int)size; ring_size *= 2)
+		;
+	ring_head = ring_tail = 0;
+
+	trace_mutex = ksceKernelCreateMutex("usbmc_trace_mutex", 0, 0, NULL);
+	trace_sema = ksceKernelCreateSema("usbmc_trace_sema", 0, 0, 1, NULL);
+	if (trace_mutex < 0 || trace_sema < 0)
+		goto error;
+
+	if ((trace_fd = ksceIoOpen(USBMC_TRACE_PATH, SCE_O_WRONLY | SCE_O_CREAT | SCE_O_TRUNC, 0777)) < 0)
+		goto error;
+	memset(&header, 0, sizeof(header));
+	header.magic = TRACE_MAGIC;
+	header.version = TRACE_VERSION;
+	header.record_size = sizeof(TraceRecord);
+	ksceIoWrite(trace_fd, &header, sizeof(header));
+
+	trace_thid = ksceKernelCreateThread("usbmc_trace", trace_thread, 0x78, 0x1000, 0, 0, NULL);
+	if (trace_thid < 0)
+		goto error;
+
+	phase = TRACE_PHASE_BOOT;
+	trace_set_phase(TRACE_PHASE_BOOT);
+
+	hooks[TRACE_HOOK_OPEN] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[TRACE_HOOK_OPEN], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoOpen, ksceIoOpen_patched);
+	hooks[TRACE_HOOK_CLOSE] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[TRACE_HOOK_CLOSE], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoClose, ksceIoClose_patched);
+	hooks[TRACE_HOOK_READ] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[TRACE_HOOK_READ], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoRead, ksceIoRead_patched);
+	hooks[TRACE_HOOK_WRITE] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[TRACE_HOOK_WRITE], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoWrite, ksceIoWrite_patched);
+	hooks[TRACE_HOOK_LSEEK] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[TRACE_HOOK_LSEEK], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoLseek, ksceIoLseek_patched);
+	hooks[TRACE_HOOK_REMOVE] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[TRACE_HOOK_REMOVE], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoRemove, ksceIoRemove_patched);
+	hooks[TRACE_HOOK_RENAME] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[TRACE_HOOK_RENAME], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoRename, ksceIoRename_patched);
+	hooks[TRACE_HOOK_MKDIR] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[TRACE_HOOK_MKDIR], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoMkdir, ksceIoMkdir_patched);
+	hooks[TRACE_HOOK_RMDIR] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[TRACE_HOOK_RMDIR], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoRmdir, ksceIoRmdir_patched);
+	hooks[TRACE_HOOK_DOPEN] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[TRACE_HOOK_DOPEN], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoDopen, ksceIoDopen_patched);
+	hooks[TRACE_HOOK_DREAD] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[TRACE_HOOK_DREAD], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoDread, ksceIoDread_patched);
+	hooks[TRACE_HOOK_DCLOSE] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[TRACE_HOOK_DCLOSE], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoDclose, ksceIoDclose_patched);
+	hooks[TRACE_HOOK_GETSTAT] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[TRACE_HOOK_GETSTAT], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoGetstat, ksceIoGetstat_patched);
+	hooks[TRACE_HOOK_PREAD] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[TRACE_HOOK_PREAD], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoPread, ksceIoPread_patched);
+	hooks[TRACE_HOOK_PWRITE] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[TRACE_HOOK_PWRITE], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoPwrite, ksceIoPwrite_patched);
+	hooks[TRACE_HOOK_CHSTAT] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[TRACE_HOOK_CHSTAT], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoChstat, ksceIoChstat_patched);
+	hooks[TRACE_HOOK_DEVCTL] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[TRACE_HOOK_DEVCTL], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoDevctl, ksceIoDevctl_patched);
+	hooks[TRACE_HOOK_SYNC] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[TRACE_HOOK_SYNC], "SceIofilemgr", TAI_ANY_LIBRARY, NID_ksceIoSync, ksceIoSync_patched);
+	hooks[TRACE_HOOK_USER_OPEN] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[TRACE_HOOK_USER_OPEN], "SceIofilemgr", LIB_SceIofilemgr, NID_sceIoOpen, sceIoOpen_patched);
+	hooks[TRACE_HOOK_USER_CLOSE] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[TRACE_HOOK_USER_CLOSE], "SceIofilemgr", LIB_SceIofilemgr, NID_sceIoClose, sceIoClose_patched);
+	hooks[TRACE_HOOK_USER_READ] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[TRACE_HOOK_USER_READ], "SceIofilemgr", LIB_SceIofilemgr, NID_sceIoRead, sceIoRead_patched);
+	hooks[TRACE_HOOK_USER_WRITE] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[TRACE_HOOK_USER_WRITE], "SceIofilemgr", LIB_SceIofilemgr, NID_sceIoWrite, sceIoWrite_patched);
+	hooks[TRACE_HOOK_USER_LSEEK] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[TRACE_HOOK_USER_LSEEK], "SceIofilemgr", LIB_SceIofilemgr, NID_sceIoLseek, sceIoLseek_patched);
+	hooks[TRACE_HOOK_USER_REMOVE] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[TRACE_HOOK_USER_REMOVE], "SceIofilemgr", LIB_SceIofilemgr, NID_sceIoRemove, sceIoRemove_patched);
+	hooks[TRACE_HOOK_USER_RENAME] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[TRACE_HOOK_USER_RENAME], "SceIofilemgr", LIB_SceIofilemgr, NID_sceIoRename, sceIoRename_patched);
+	hooks[TRACE_HOOK_USER_MKDIR] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[TRACE_HOOK_USER_MKDIR], "SceIofilemgr", LIB_SceIofilemgr, NID_sceIoMkdir, sceIoMkdir_patched);
+	hooks[TRACE_HOOK_USER_RMDIR] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[TRACE_HOOK_USER_RMDIR], "SceIofilemgr", LIB_SceIofilemgr, NID_sceIoRmdir, sceIoRmdir_patched);
+	hooks[TRACE_HOOK_USER_DOPEN] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[TRACE_HOOK_USER_DOPEN], "SceIofilemgr", LIB_SceIofilemgr, NID_sceIoDopen, sceIoDopen_patched);
+	hooks[TRACE_HOOK_USER_DREAD] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[TRACE_HOOK_USER_DREAD], "SceIofilemgr", LIB_SceIofilemgr, NID_sceIoDread, sceIoDread_patched);
+	hooks[TRACE_HOOK_USER_DCLOSE] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[TRACE_HOOK_USER_DCLOSE], "SceIofilemgr", LIB_SceIofilemgr, NID_sceIoDclose, sceIoDclose_patched);
+	hooks[TRACE_HOOK_USER_GETSTAT] = taiHookFunctionExportForKernel(KERNEL_PID, &refs[TRACE_HOOK_USER_GETSTAT], "SceIofilemgr", LIB_SceIofilemgr, NID_sceIoGetstat, sceIoGetstat_patched);
+
+	ksceKernelStartThread(trace_thid, 0, NULL);
+
+	return 0;
+
+error:
+	trace_exit();
+	return -1;
+}
+
+void trace_exit(void) {
+	for (int i = TRACE_HOOK_COUNT - 1; i >= 0; i--) {
+		if (hooks[i] >= 0)
+			taiHookReleaseForKernel(hooks[i], refs[i]);
+		hooks[i] = -1;
+	}
+
+	if (trace_thid >= 0) {
+		trace_quit = 1;
+		ksceKernelSignalSema(trace_sema, 1);
+		ksceKernelWaitThreadEnd(trace_thid, NULL, NULL);
+		ksceKernelDeleteThread(trace_thid);
+		trace_thid = -1;
+	}
+
+	if (trace_fd >= 0)
+		ksceIoClose(trace_fd);
+	if (trace_sema >= 0)
+		ksceKernelDeleteSema(trace_sema);
+	if (trace_mutex >= 0)
+		ksceKernelDeleteMutex(trace_mutex);
+	if (trace_memblk >= 0)
+		ksceKernelFreeMemBlock(trace_memblk);
+	trace_fd = trace_sema = trace_mutex = trace_memblk = -1;
+	ring = NULL;
+}
+
+int shellKernelTraceMark(int new_phase) {
+	uint32_t state;
+
+	ENTER_SYSCALL(state);
+
+	trace_set_phase(new_phase);
+
+	EXIT_SYSCALL(state);
+	return (ring != NULL) ? 0 : -1;
+}
+
+// hands everything recorded so far to the flush thread and waits for it
+int shellKernelTraceFlush(void) {
+	uint32_t state;
+	unsigned int count;
+	int ret = -1;
+
+	ENTER_SYSCALL(state);
+
+	if (ring != NULL && trace_thid >= 0) {
+		count = flush_count;
+		ksceKernelSignalSema(trace_sema, 1);
+		for (int i = 0; i < 100 && flush_count == count; i++)
+			ksceKernelDelayThread(10000);
+		ret = (flush_count != count) ? 0 : -1;
+	}
+
+	EXIT_SYSCALL(state);
+	return ret;
+}
@@ -0,0 +1,8 @@
+#ifndef __USBMC_TRACE_H__
+#define __USBMC_TRACE_H__
+
+int trace_init(void);
+void trace_exit(void);
+void trace_set_phase(int phase);
+
+#endif
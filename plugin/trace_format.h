@@ -0,0 +1,75 @@
+#ifndef __USBMC_TRACE_FORMAT_H__
+#define __USBMC_TRACE_FORMAT_H__
+
+#include <stdint.h>
+
+// On-disk format of the I/O trace, shared by the plugin, the installer and
+// the host replay tool. The file starts with a TraceHeader followed by
+// fixed-size records. A TRACE_OP_NAME record gives path id `path` the name
+// stored in the `size` bytes (without terminator) of the records right
+// after it, padded with NULs to whole records. Calls on a descriptor carry
+// it in `fd`, opens carry the one they returned, so two handles on the same
+// path can be told apart; descriptors are only unique together with `pid`.
+
+#define USBMC_TRACE_PATH "ur0:tai/usbmc_trace.bin"
+
+#define TRACE_MAGIC 0x52544D55 // "UMTR"
+#define TRACE_VERSION 2
+#define TRACE_NO_PATH 0xFFFF
+
+enum {
+	TRACE_OP_NAME,
+	TRACE_OP_MARK,    // phase change, `phase` is the new one
+	TRACE_OP_DROPPED, // `size` records lost to a full ring
+	TRACE_OP_OPEN,    // size: flags, offset: mode, result: fd
+	TRACE_OP_CLOSE,
+	TRACE_OP_READ,    // size: bytes asked for, result: bytes read
+	TRACE_OP_WRITE,
+	TRACE_OP_LSEEK,   // size: whence, offset: target
+	TRACE_OP_REMOVE,
+	TRACE_OP_RENAME,  // offset: path id of the new name
+	TRACE_OP_MKDIR,
+	TRACE_OP_RMDIR,
+	TRACE_OP_DOPEN,
+	TRACE_OP_DREAD,
+	TRACE_OP_DCLOSE,
+	TRACE_OP_GETSTAT,
+	TRACE_OP_PREAD,   // like READ, offset: position
+	TRACE_OP_PWRITE,  // like WRITE, offset: position
+	TRACE_OP_CHSTAT,  // size: bits
+	TRACE_OP_DEVCTL,  // path: device, size: command
+	TRACE_OP_SYNC,    // path: device, size: flags
+	TRACE_OP_COUNT,
+};
+
+enum {
+	TRACE_PHASE_BOOT,      // plugin module_start
+	TRACE_PHASE_SYSTEM,    // everything after boot
+	TRACE_PHASE_INSTALLER, // installer menus
+	TRACE_PHASE_PLAN,      // installer space planning
+	TRACE_PHASE_COPY,      // installer migration copy
+	TRACE_PHASE_BENCH,     // installer benchmark
+	TRACE_PHASE_COUNT,
+};
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t record_size;
+	uint32_t reserved[5];
+} TraceHeader;
+
+typedef struct {
+	uint8_t op;
+	uint8_t phase;
+	uint16_t path;
+	uint32_t size;
+	uint64_t offset;
+	uint64_t start;    // microseconds of system time
+	uint32_t duration; // microseconds
+	int32_t result;
+	int32_t fd;        // -1 for calls on a path
+	int32_t pid;       // process of the caller
+} TraceRecord;
+
+#endif
@@ -19,8 +19,66 @@
 #ifndef __VITASHELL_KERNEL_H__
 #define __VITASHELL_KERNEL_H__
 
+// present while a lazy migration has files left to copy
+#define USBMC_LAZY_PATH "ur0:tai/usbmc_lazy.txt"
+
+// largest list of NUL-terminated src, dst pairs taken by one bulk copy,
+// every path must be on ux0: or uma0: and free of ".." components
+#define USBMC_BULK_LIST_MAX (64 * 1024)
+
+// when migration copies sync the destination (sync_mode in usbmc.cfg), the
+// installer's own copies read it from the bulk copy status
+enum {
+	USBMC_SYNC_NONE,   // leave it to the filesystem
+	USBMC_SYNC_FILES,  // device sync every sync_interval files
+	USBMC_SYNC_MB,     // device sync every sync_interval MB
+	USBMC_SYNC_STRICT, // sync every file before it is closed
+};
+
+#define USBMC_SYNC_DEFAULT USBMC_SYNC_MB
+#define USBMC_SYNC_DEFAULT_INTERVAL 64
+
+typedef struct {
+	unsigned int hits;
+	unsigned int misses;
+	unsigned int inserts;
+	unsigned int invalidations;
+	unsigned int flushes;
+	unsigned int used;
+	unsigned int capacity;
+} UsbmcDirCacheStats;
+
+typedef struct {
+	int active;
+	int done;
+	unsigned int queued;
+	unsigned int files_copied;
+	unsigned long long bytes_copied;
+} UsbmcLazyStatus;
+
+typedef struct {
+	int active;
+	int result;                    // first error of the batch, 0 if none
+	unsigned int files_done;       // including failed ones
+	unsigned int files_failed;
+	unsigned int files_total;
+	unsigned long long bytes_copied;
+	unsigned long long file_bytes; // progress within the current file
+	unsigned long long file_size;
+	// new fields go last, older plugins copy out a shorter struct
+	unsigned int syncs;
+	int sync_mode;                 // USBMC_SYNC_*, reported even when idle
+	unsigned int sync_interval;
+} UsbmcBulkCopyStatus;
+
 int shellKernelIsUx0Redirected();
 int shellKernelRedirectUx0();
 int shellKernelUnredirectUx0();
+int shellKernelGetDirCacheStats(UsbmcDirCacheStats *stats);
+int shellKernelGetLazyStatus(UsbmcLazyStatus *status);
+int shellKernelBulkCopy(const char *list, unsigned int size);
+int shellKernelGetBulkCopyStatus(UsbmcBulkCopyStatus *status);
+int shellKernelTraceMark(int phase);
+int shellKernelTraceFlush(void);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,374 @@
+#include <psp2/io/fcntl.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug_screen.h"
+#include "rules.h"
+
+#define printf psvDebugScreenPrintf
+
+// Include/exclude rules compiled into a trie over path components.
+//
+// Each rule is a path relative to the device root whose components may use
+// '*' and '?', and "**" matches any number of components. The walker keeps a
+// RulesState per directory: the set of trie nodes reached so far plus the
+// decision inherited from the closest matching ancestor. The deepest match
+// wins, and exclude wins over include on the same level; an excluded
+// directory is never opened though, so nothing below it can be included
+// again. With no include rule at all, everything not excluded is copied.
+// A path that reaches more than RULES_MAX_ACTIVE trie nodes at once cannot
+// be decided correctly, rules_step() reports it instead of guessing.
+//
+// Rules file syntax, one rule per line:
+//   include <pattern>
+//   exclude <pattern> [>size]   size in bytes with optional K, M or G
+//   title <TITLEID>             app, patch, DLC, metadata, license and saves
+
+#define DOUBLE_STAR "**"
+#define RULES_MAX_DEPTH 32
+
+typedef struct {
+	char *name;
+	int is_glob;
+	int child;
+	int sibling;
+	int action;
+	int includes_below;
+	uint64_t min_size;
+} RuleNode;
+
+struct Rules {
+	RuleNode *nodes;
+	int count;
+	int capacity;
+	int includes;
+};
+
+static const char *title_dirs[] = {
+	"app",
+	"patch",
+	"addcont",
+	"appmeta",
+	"license/app",
+	"license/addcont",
+	"user/00/savedata",
+};
+
+static char lower(char c) {
+	return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+static int glob_match(const char *pattern, const char *name) {
+	for (; *pattern; pattern++, name++) {
+		if (*pattern == '*') {
+			for (const char *n = name; ; n++) {
+				if (glob_match(pattern + 1, n))
+					return 1;
+				if (*n == '\0')
+					return 0;
+			}
+		}
+		if (*name == '\0' || (*pattern != '?' && lower(*pattern) != lower(*name)))
+			return 0;
+	}
+	return *name == '\0';
+}
+
+static int node_matches(const RuleNode *node, const char *name) {
+	const char *a = node->name;
+
+	if (node->is_glob)
+		return glob_match(a, name);
+	while (*a && lower(*a) == lower(*name)) {
+		a++;
+		name++;
+	}
+	return *a == '\0' && *name == '\0';
+}
+
+static int new_node(Rules *rules, const char *name, size_t len) {
+	RuleNode *node;
+
+	if (rules->count == rules->capacity) {
+		int capacity = rules->capacity ? rules->capacity * 2 : 32;
+		RuleNode *nodes = realloc(rules->nodes, capacity * sizeof(RuleNode));
+		if (nodes == NULL)
+			return -1;
+		rules->nodes = nodes;
+		rules->capacity = capacity;
+	}
+
+	node = &rules->nodes[rules->count];
+	memset(node, 0, sizeof(*node));
+	if ((node->name = malloc(len + 1)) == NULL)
+		return -1;
+	memcpy(node->name, name, len);
+	node->name[len] = '\0';
+	node->is_glob = strpbrk(node->name, "*?") != NULL && strcmp(node->name, DOUBLE_STAR) != 0;
+	node->child = -1;
+	node->sibling = -1;
+
+	return rules->count++;
+}
+
+Rules *rules_create(void) {
+	Rules *rules = calloc(1, sizeof(Rules));
+
+	if (rules == NULL)
+		return NULL;
+	if (new_node(rules, "", 0) < 0) {
+		rules_free(rules);
+		return NULL;
+	}
+
+	return rules;
+}
+
+void rules_free(Rules *rules) {
+	if (rules == NULL)
+		return;
+	for (int i = 0; i < rules->count; i++)
+		free(rules->nodes[i].name);
+	free(rules->nodes);
+	free(rules);
+}
+
+int rules_add(Rules *rules, int action, const char *pattern, uint64_t min_size) {
+	int path[RULES_MAX_DEPTH];
+	int depth = 0, cur = 0;
+
+	while (*pattern) {
+		const char *end = strchr(pattern, '/');
+		size_t len = end ? (size_t)(end - pattern) : strlen(pattern);
+		int child;
+
+		if (len > 0) {
+			for (child = rules->nodes[cur].child; child >= 0; child = rules->nodes[child].sibling) {
+				if (strlen(rules->nodes[child].name) == len && strncmp(rules->nodes[child].name, pattern, len) == 0)
+					break;
+			}
+			if (child < 0) {
+				if ((child = new_node(rules, pattern, len)) < 0)
+					return -1;
+				rules->nodes[child].sibling = rules->nodes[cur].child;
+				rules->nodes[cur].child = child;
+			}
+			cur = child;
+			if (depth == RULES_MAX_DEPTH)
+				return -1;
+			path[depth++] = cur;
+		}
+
+		pattern += len;
+		if (*pattern == '/')
+			pattern++;
+	}
+
+	if (cur == 0)
+		return -1;
+	rules->nodes[cur].action = action;
+	rules->nodes[cur].min_size = min_size;
+	if (action == RULE_INCLUDE) {
+		rules->includes++;
+		// lets the walker prune directories no include can reach
+		rules->nodes[0].includes_below = 1;
+		for (int i = 0; i < depth - 1; i++)
+			rules->nodes[path[i]].includes_below = 1;
+	}
+
+	return 0;
+}
+
+int rules_add_title(Rules *rules, const char *titleid) {
+	char pattern[64];
+
+	for (size_t i = 0; i < sizeof(title_dirs)/sizeof(*title_dirs); ++i) {
+		if (strlen(title_dirs[i]) + strlen(titleid) + 2 > sizeof(pattern))
+			return -1;
+		strcpy(pattern, title_dirs[i]);
+		strcat(pattern, "/");
+		strcat(pattern, titleid);
+		if (rules_add(rules, RULE_INCLUDE, pattern, 0) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+int rules_has_includes(const Rules *rules) {
+	return rules->includes > 0;
+}
+
+static int parse_size(const char *str, uint64_t *size) {
+	char *end;
+
+	if (*str < '0' || *str > '9')
+		return -1;
+	*size = strtoull(str, &end, 10);
+
+	switch (*end) {
+	case 'G': case 'g':
+		*size <<= 10;
+		// fallthrough
+	case 'M': case 'm':
+		*size <<= 10;
+		// fallthrough
+	case 'K': case 'k':
+		*size <<= 10;
+		end++;
+		break;
+	}
+
+	return (*end == '\0') ? 0 : -1;
+}
+
+static int parse_rule(Rules *rules, char *line) {
+	char *word, *arg, *size, *extra;
+	uint64_t min_size = 0;
+
+	while (*line == ' ' || *line == '\t')
+		line++;
+	if (*line == '#' || *line == '\0')
+		return 0;
+
+	word = strtok(line, " \t");
+	arg = strtok(NULL, " \t");
+	size = strtok(NULL, " \t");
+	extra = strtok(NULL, " \t");
+	if (arg == NULL || extra != NULL)
+		return -1;
+
+	if (strcmp(word, "include") == 0 && size == NULL)
+		return rules_add(rules, RULE_INCLUDE, arg, 0);
+	if (strcmp(word, "exclude") == 0) {
+		if (size && (*size != '>' || parse_size(size + 1, &min_size) < 0))
+			return -1;
+		return rules_add(rules, RULE_EXCLUDE, arg, min_size);
+	}
+	if (strcmp(word, "title") == 0 && size == NULL)
+		return rules_add_title(rules, arg);
+	return -1;
+}
+
+Rules *rules_load(const char *path) {
+	Rules *rules;
+	char *buffer, *line, *end;
+	char copy[128];
+	int fd, size, rd, total, number = 0, errors = 0;
+
+	if ((fd = sceIoOpen(path, SCE_O_RDONLY, 0)) < 0)
+		return NULL;
+
+	size = sceIoLseek32(fd, 0, SEEK_END);
+	if (size < 0 || sceIoLseek32(fd, 0, SEEK_SET) < 0 || (buffer = malloc(size + 1)) == NULL) {
+		sceIoClose(fd);
+		return NULL;
+	}
+
+	total = 0;
+	while ((rd = sceIoRead(fd, buffer + total, size - total)) > 0)
+		total += rd;
+	sceIoClose(fd);
+	buffer[total] = '\0';
+
+	if ((rules = rules_create()) != NULL) {
+		for (line = buffer; *line; line = end) {
+			end = line;
+			while (*end && *end != '\n' && *end != '\r')
+				end++;
+			// "\r\n" ends one line, not two
+			if (end[0] == '\r' && end[1] == '\n')
+				*end++ = '\0';
+			if (*end)
+				*end++ = '\0';
+			number++;
+			// parsing cuts the line up, keep it for the message
+			strncpy(copy, line, sizeof(copy) - 1);
+			copy[sizeof(copy) - 1] = '\0';
+			if (parse_rule(rules, line) < 0) {
+				printf("%s:%d: invalid rule: %s\n", path, number, copy);
+				errors++;
+			}
+		}
+	}
+
+	free(buffer);
+	if (rules && errors) {
+		rules_free(rules);
+		return NULL;
+	}
+	return rules;
+}
+
+static void add_active(RulesState *state, int node) {
+	for (int i = 0; i < state->count; i++)
+		if (state->nodes[i] == node)
+			return;
+	if (state->count < RULES_MAX_ACTIVE)
+		state->nodes[state->count++] = node;
+	else
+		state->overflow = 1;
+}
+
+// "**" also matches zero components
+static void closure(const Rules *rules, RulesState *state) {
+	for (int i = 0; i < state->count; i++) {
+		for (int c = rules->nodes[state->nodes[i]].child; c >= 0; c = rules->nodes[c].sibling) {
+			if (strcmp(rules->nodes[c].name, DOUBLE_STAR) == 0)
+				add_active(state, c);
+		}
+	}
+}
+
+void rules_root(const Rules *rules, RulesState *state) {
+	state->count = 0;
+	state->overflow = 0;
+	state->decision = rules->includes ? RULE_NONE : RULE_INCLUDE;
+	add_active(state, 0);
+	closure(rules, state);
+}
+
+int rules_step(const Rules *rules, const RulesState *parent, const char *name, int is_dir, uint64_t size, RulesState *child) {
+	int include = 0, exclude = 0, deeper = 0;
+
+	child->count = 0;
+	child->overflow = parent->overflow;
+	child->decision = parent->decision;
+
+	for (int i = 0; i < parent->count; i++) {
+		int n = parent->nodes[i];
+		if (strcmp(rules->nodes[n].name, DOUBLE_STAR) == 0)
+			add_active(child, n);
+		for (int c = rules->nodes[n].child; c >= 0; c = rules->nodes[c].sibling) {
+			if (strcmp(rules->nodes[c].name, DOUBLE_STAR) != 0 && node_matches(&rules->nodes[c], name))
+				add_active(child, c);
+		}
+	}
+	closure(rules, child);
+	if (child->overflow) {
+		printf("More than %d rules match %s\n", RULES_MAX_ACTIVE, name);
+		return RULES_ERROR;
+	}
+
+	for (int i = 0; i < child->count; i++) {
+		const RuleNode *node = &rules->nodes[child->nodes[i]];
+		if (node->action == RULE_EXCLUDE && (node->min_size == 0 || (!is_dir && size >= node->min_size)))
+			exclude = 1;
+		else if (node->action == RULE_INCLUDE)
+			include = 1;
+		if (node->includes_below)
+			deeper = 1;
+	}
+
+	if (exclude)
+		child->decision = RULE_EXCLUDE;
+	else if (include)
+		child->decision = RULE_INCLUDE;
+
+	if (child->decision == RULE_EXCLUDE)
+		return RULES_SKIP;
+	if (child->decision == RULE_INCLUDE)
+		return RULES_COPY;
+	return (is_dir && deeper) ? RULES_DESCEND : RULES_SKIP;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+
+#define USBMC_RULES_PATH "ur0:tai/usbmc_rules.txt"
+
+#define RULES_MAX_ACTIVE 16
+
+enum {
+	RULE_NONE,
+	RULE_INCLUDE,
+	RULE_EXCLUDE,
+};
+
+// what the walker should do with an entry
+enum {
+	RULES_SKIP,    // excluded, do not even open it
+	RULES_COPY,    // included
+	RULES_DESCEND, // directory holding included paths further down
+	RULES_ERROR,   // more rules match than a state can track, stop the walk
+};
+
+typedef struct Rules Rules;
+
+// position of a directory in the compiled matcher
+typedef struct {
+	int count;
+	int nodes[RULES_MAX_ACTIVE];
+	int decision;
+	int overflow;
+} RulesState;
+
+Rules *rules_create(void);
+// prints every line it cannot parse and fails if there was one
+Rules *rules_load(const char *path);
+void rules_free(Rules *rules);
+
+int rules_add(Rules *rules, int action, const char *pattern, uint64_t min_size);
+int rules_add_title(Rules *rules, const char *titleid);
+int rules_has_includes(const Rules *rules);
+
+void rules_root(const Rules *rules, RulesState *state);
+int rules_step(const Rules *rules, const RulesState *parent, const char *name, int is_dir, uint64_t size, RulesState *child);
@@ -0,0 +1,89 @@
+#include <string.h>
+
+#include "tiers.h"
+
+typedef struct {
+	const char *prefix; // relative to the device root
+	int tier;
+} TierRule;
+
+// the longest matching prefix decides, anything unmatched is bulk data
+static const TierRule tier_rules[] = {
+	{ "tai",      TIER_CONFIG },
+	{ "id.dat",   TIER_CONFIG },
+	{ "license",  TIER_LICENSE },
+	{ "appmeta",  TIER_APPMETA },
+	{ "user",     TIER_SAVES },
+	{ "app",      TIER_APPS },
+	{ "patch",    TIER_APPS },
+	{ "addcont",  TIER_APPS },
+	{ "data",     TIER_APPS },
+	{ "pspemu",   TIER_APPS },
+	{ "video",    TIER_BULK },
+	{ "music",    TIER_BULK },
+	{ "picture",  TIER_BULK },
+	{ "temp",     TIER_CACHE },
+	{ "cache",    TIER_CACHE },
+	{ "mms",      TIER_CACHE },
+};
+
+#define TIER_DEFAULT TIER_BULK
+
+static const char *tier_names[TIER_COUNT] = {
+	"taiHEN configuration",
+	"licenses",
+	"application metadata",
+	"save data",
+	"applications",
+	"media and other data",
+	"caches",
+};
+
+static char lower(char c) {
+	return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+// number of characters of prefix matched at a path component boundary, or 0
+static size_t prefix_match(const char *rel, const char *prefix) {
+	size_t i;
+
+	for (i = 0; prefix[i]; ++i)
+		if (lower(rel[i]) != lower(prefix[i]))
+			return 0;
+
+	return (rel[i] == '\0' || rel[i] == '/') ? i : 0;
+}
+
+const char *tier_name(int tier) {
+	return (tier >= 0 && tier < TIER_COUNT) ? tier_names[tier] : "unknown";
+}
+
+int tier_classify(const char *rel) {
+	size_t best = 0, len;
+	int tier = TIER_DEFAULT;
+
+	for (size_t i = 0; i < sizeof(tier_rules)/sizeof(*tier_rules); ++i) {
+		if ((len = prefix_match(rel, tier_rules[i].prefix)) > best) {
+			best = len;
+			tier = tier_rules[i].tier;
+		}
+	}
+
+	return tier;
+}
+
+// whether descending into rel_dir can find anything of the given tier
+int tier_may_contain(const char *rel_dir, int tier) {
+	size_t len = strlen(rel_dir);
+
+	if (len == 0 || tier_classify(rel_dir) == tier)
+		return 1;
+
+	// a more specific rule further down may still apply
+	for (size_t i = 0; i < sizeof(tier_rules)/sizeof(*tier_rules); ++i) {
+		if (tier_rules[i].tier == tier && prefix_match(tier_rules[i].prefix, rel_dir) == len && tier_rules[i].prefix[len] == '/')
+			return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+// Migration priority tiers, copied in this order so an interrupted run
+// leaves the most important data behind.
+enum {
+	TIER_CONFIG,
+	TIER_LICENSE,
+	TIER_APPMETA,
+	TIER_SAVES,
+	TIER_APPS,
+	TIER_BULK,
+	TIER_CACHE,
+	TIER_COUNT,
+};
+
+const char *tier_name(int tier);
+int tier_classify(const char *rel);
+int tier_may_contain(const char *rel_dir, int tier);
@@ -0,0 +1,91 @@
+#ifndef __BOOTSIM_SHIM_H__
+#define __BOOTSIM_SHIM_H__
+
+// Host stand-ins for the kernel and taiHEN APIs the plugin's boot path uses.
+// Every call advances a virtual clock by a modelled cost instead of taking
+// real time, and the mount points live in a table the simulation inspects
+// afterwards. The psp2kern and taihen headers next to this one only include
+// it, so plugin sources build unchanged.
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef int SceUID;
+typedef unsigned int SceSize;
+typedef unsigned int SceUInt;
+typedef int SceMode;
+typedef int64_t SceOff;
+
+typedef uintptr_t tai_hook_ref_t;
+
+typedef struct {
+	size_t size;
+	SceUID modid;
+	uint32_t module_nid;
+	char name[27];
+	uintptr_t exports_start;
+	uintptr_t exports_end;
+	uintptr_t imports_start;
+	uintptr_t imports_end;
+} tai_module_info_t;
+
+#define KERNEL_PID 0x10005
+
+#define SCE_KERNEL_START_SUCCESS 0
+#define SCE_KERNEL_START_NO_RESIDENT 1
+#define SCE_KERNEL_STOP_SUCCESS 0
+
+#define SCE_O_RDONLY 0x0001
+#define SCE_O_WRONLY 0x0002
+#define SCE_O_RDWR   (SCE_O_RDONLY | SCE_O_WRONLY)
+#define SCE_O_CREAT  0x0200
+#define SCE_O_TRUNC  0x0400
+
+SceUID ksceIoOpen(const char *file, int flags, SceMode mode);
+int ksceIoClose(SceUID fd);
+int ksceIoMount(int id, const char *path, int permission, int a4, int a5, int a6);
+int ksceIoUmount(int id, int a2, int a3, int a4);
+
+int ksceKernelDelayThread(SceUInt delay);
+SceUID ksceKernelLoadModule(const char *path, int flags, void *opt);
+int ksceKernelStartModule(SceUID modid, SceSize args, void *argp, int flags, void *opt, int *status);
+
+int taiGetModuleInfoForKernel(SceUID pid, const char *module, tai_module_info_t *info);
+SceUID taiInjectDataForKernel(SceUID pid, SceUID modid, int segidx, uint32_t offset, const void *data, size_t size);
+int taiInjectReleaseForKernel(SceUID tai_uid);
+SceUID taiHookFunctionImportForKernel(SceUID pid, tai_hook_ref_t *p_hook, const char *module, uint32_t import_library_nid, uint32_t import_func_nid, const void *hook_func);
+int taiHookReleaseForKernel(SceUID tai_uid, tai_hook_ref_t hook);
+int taiReloadConfigForKernel(int schedule, int load_kernel);
+
+int module_get_export_func(SceUID pid, const char *modname, uint32_t libnid, uint32_t funcnid, uintptr_t *func);
+int module_get_offset(SceUID pid, SceUID modid, int segidx, size_t offset, uintptr_t *addr);
+
+// what the simulated console looks like at boot
+typedef struct {
+	int card;      // Sony memory card inserted
+	int lazy;      // a lazy migration is pending
+	int usb_at_ms; // when the USB storage shows up, -1 never
+} ShimDevice;
+
+// where the virtual time went
+enum {
+	SHIM_COST_WAIT,   // thread delays
+	SHIM_COST_IO,     // opens and closes
+	SHIM_COST_MOUNT,  // mounts and unmounts
+	SHIM_COST_MODULE, // module loading and taiHEN
+	SHIM_COST_COUNT,
+};
+
+typedef struct {
+	uint64_t us[SHIM_COST_COUNT];
+	unsigned int opens;
+	unsigned int remounts;
+} ShimStats;
+
+void shim_reset(const ShimDevice *device);
+uint64_t shim_now(void);
+void shim_get_stats(ShimStats *stats);
+// whether the ux0 mount point refers to the USB storage
+int shim_ux0_on_usb(void);
+
+#endif
@@ -0,0 +1,232 @@
+#include <string.h>
+
+#include "shim.h"
+
+// Virtual kernel for bootsim. Costs are rough figures for a 3.60 console
+// with a USB stick on the accessory port; change them to model another
+// setup. Only the relative cost of the boot paths matters.
+
+#define COST_OPEN_US         300   // sdstor lookups go to the block layer
+#define COST_CLOSE_US        20
+#define COST_MOUNT_US        40000
+#define COST_UMOUNT_US       15000
+#define COST_BOOTFS_US       5000
+#define COST_LOAD_MODULE_US  30000
+#define COST_START_MODULE_US 60000 // SceUsbMass probing the bus
+#define COST_TAI_US          100
+#define COST_RELOAD_US       80000 // taiHEN parsing and loading plugins
+
+#define ERROR_NOT_FOUND 0x80010002
+
+#define MODID_IOFILEMGR 0x10001
+#define MODID_APPMGR    0x10002
+#define MODID_UMASS     0x10003
+
+#define USB_BLKDEV "sdstor0:uma-lp-act-entire"
+
+// same layout as the plugin's view of the kernel structures
+typedef struct {
+	const char *dev;
+	const char *dev2;
+	const char *blkdev;
+	const char *blkdev2;
+	int id;
+} ShimIoDevice;
+
+typedef struct {
+	int id;
+	const char *dev_unix;
+	int unk;
+	int dev_major;
+	int dev_minor;
+	const char *dev_filesystem;
+	int unk2;
+	ShimIoDevice *dev;
+	int unk3;
+	ShimIoDevice *dev2;
+	int unk4;
+	int unk5;
+	int unk6;
+	int unk7;
+} ShimMountPoint;
+
+static ShimIoDevice card_dev = { "ux0:", "exfatux0", "sdstor0:xmc-lp-ign-userext", "sdstor0:xmc-lp-ign-userext", 0x800 };
+static ShimIoDevice internal_dev = { "ux0:", "exfatux0", "sdstor0:int-lp-ign-userext", "sdstor0:int-lp-ign-userext", 0x800 };
+static ShimIoDevice usb_dev = { "uma0:", "exfatuma0", "sdstor0:uma-pp-act-a", USB_BLKDEV, 0xF00 };
+
+static ShimMountPoint mounts[2];
+static ShimDevice device;
+static ShimStats stats;
+static int umass_started;
+static SceUID next_uid;
+
+static void spend(int what, uint64_t us) {
+	stats.us[what] += us;
+}
+
+uint64_t shim_now(void) {
+	uint64_t now = 0;
+
+	for (int i = 0; i < SHIM_COST_COUNT; i++)
+		now += stats.us[i];
+	return now;
+}
+
+void shim_reset(const ShimDevice *dev) {
+	device = *dev;
+	memset(&stats, 0, sizeof(stats));
+	memset(mounts, 0, sizeof(mounts));
+	mounts[0].id = 0x800;
+	mounts[0].dev = mounts[0].dev2 = device.card ? &card_dev : &internal_dev;
+	mounts[1].id = 0xF00;
+	mounts[1].dev = mounts[1].dev2 = &usb_dev;
+	umass_started = 0;
+	next_uid = 0x20001;
+}
+
+void shim_get_stats(ShimStats *out) {
+	*out = stats;
+}
+
+int shim_ux0_on_usb(void) {
+	const ShimIoDevice *dev = mounts[0].dev;
+	return dev && dev->blkdev2 && strcmp(dev->blkdev2, USB_BLKDEV) == 0;
+}
+
+static int usb_attached(void) {
+	return umass_started && device.usb_at_ms >= 0 && shim_now() >= (uint64_t)device.usb_at_ms * 1000;
+}
+
+static int path_exists(const char *path) {
+	if (strcmp(path, USB_BLKDEV) == 0)
+		return usb_attached();
+	if (strcmp(path, "sdstor0:xmc-lp-ign-userext") == 0)
+		return device.card;
+	if (strcmp(path, "ur0:tai/usbmc_lazy.txt") == 0)
+		return device.lazy;
+	// the plugin configuration only exists on a migrated drive
+	if (strcmp(path, "ux0:tai/config.txt") == 0)
+		return shim_ux0_on_usb();
+	return 0;
+}
+
+SceUID ksceIoOpen(const char *file, int flags, SceMode mode) {
+	spend(SHIM_COST_IO, COST_OPEN_US);
+	stats.opens++;
+	return path_exists(file) ? next_uid++ : (SceUID)ERROR_NOT_FOUND;
+}
+
+int ksceIoClose(SceUID fd) {
+	spend(SHIM_COST_IO, COST_CLOSE_US);
+	return 0;
+}
+
+int ksceIoMount(int id, const char *path, int permission, int a4, int a5, int a6) {
+	spend(SHIM_COST_MOUNT, COST_MOUNT_US);
+	stats.remounts++;
+	return 0;
+}
+
+int ksceIoUmount(int id, int a2, int a3, int a4) {
+	spend(SHIM_COST_MOUNT, COST_UMOUNT_US);
+	return 0;
+}
+
+int ksceKernelDelayThread(SceUInt delay) {
+	spend(SHIM_COST_WAIT, delay);
+	return 0;
+}
+
+static ShimMountPoint *find_mount_point(int id) {
+	for (size_t i = 0; i < sizeof(mounts)/sizeof(*mounts); i++) {
+		if (mounts[i].id == id)
+			return &mounts[i];
+	}
+	return NULL;
+}
+
+static int mount_bootfs(const char *path) {
+	spend(SHIM_COST_MOUNT, COST_BOOTFS_US);
+	return 0;
+}
+
+static int umount_bootfs(void) {
+	spend(SHIM_COST_MOUNT, COST_BOOTFS_US);
+	return 0;
+}
+
+SceUID ksceKernelLoadModule(const char *path, int flags, void *opt) {
+	spend(SHIM_COST_MODULE, COST_LOAD_MODULE_US);
+	return MODID_UMASS;
+}
+
+int ksceKernelStartModule(SceUID modid, SceSize args, void *argp, int flags, void *opt, int *status) {
+	spend(SHIM_COST_MODULE, COST_START_MODULE_US);
+	if (modid == MODID_UMASS)
+		umass_started = 1;
+	return 0;
+}
+
+int taiGetModuleInfoForKernel(SceUID pid, const char *module, tai_module_info_t *info) {
+	spend(SHIM_COST_MODULE, COST_TAI_US);
+	if (strcmp(module, "SceIofilemgr") == 0) {
+		info->modid = MODID_IOFILEMGR;
+		info->module_nid = 0x9642948C; // 3.60 retail
+	} else if (strcmp(module, "SceAppMgr") == 0) {
+		info->modid = MODID_APPMGR;
+		info->module_nid = 0xDBB29DB7;
+	} else {
+		return ERROR_NOT_FOUND;
+	}
+	strncpy(info->name, module, sizeof(info->name) - 1);
+	return 0;
+}
+
+SceUID taiInjectDataForKernel(SceUID pid, SceUID modid, int segidx, uint32_t offset, const void *data, size_t size) {
+	spend(SHIM_COST_MODULE, COST_TAI_US);
+	return next_uid++;
+}
+
+int taiInjectReleaseForKernel(SceUID tai_uid) {
+	spend(SHIM_COST_MODULE, COST_TAI_US);
+	return 0;
+}
+
+SceUID taiHookFunctionImportForKernel(SceUID pid, tai_hook_ref_t *p_hook, const char *module, uint32_t import_library_nid, uint32_t import_func_nid, const void *hook_func) {
+	spend(SHIM_COST_MODULE, COST_TAI_US);
+	*p_hook = 0;
+	return next_uid++;
+}
+
+int taiHookReleaseForKernel(SceUID tai_uid, tai_hook_ref_t hook) {
+	spend(SHIM_COST_MODULE, COST_TAI_US);
+	return 0;
+}
+
+int taiReloadConfigForKernel(int schedule, int load_kernel) {
+	spend(SHIM_COST_MODULE, COST_RELOAD_US);
+	return 0;
+}
+
+// SceKernelModulemgr mount/umount bootfs, by either library NID
+int module_get_export_func(SceUID pid, const char *modname, uint32_t libnid, uint32_t funcnid, uintptr_t *func) {
+	spend(SHIM_COST_MODULE, COST_TAI_US);
+	if (libnid != 0xC445FA63)
+		return ERROR_NOT_FOUND;
+	if (funcnid == 0x01360661)
+		*func = (uintptr_t)mount_bootfs;
+	else if (funcnid == 0x9C838A6B)
+		*func = (uintptr_t)umount_bootfs;
+	else
+		return ERROR_NOT_FOUND;
+	return 0;
+}
+
+// the only private function the plugin looks up is sceIoFindMountPoint
+int module_get_offset(SceUID pid, SceUID modid, int segidx, size_t offset, uintptr_t *addr) {
+	spend(SHIM_COST_MODULE, COST_TAI_US);
+	if (modid != MODID_IOFILEMGR)
+		return ERROR_NOT_FOUND;
+	*addr = (uintptr_t)find_mount_point;
+	return 0;
+}
@@ -0,0 +1,83 @@
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "bufpool.h"
+#include "test.h"
+
+// Runs the installer's storage benchmark unchanged on host directories:
+//   hostbench [-o results.csv] [dir/ ...]
+// Paths without a device pass through the shim as they are, so each
+// directory is benchmarked in place. Without arguments it benchmarks two
+// devices in a scratch directory, which is what ctest runs.
+
+#define HOSTBENCH_MAX_DEVS 8
+
+static int count_lines(const char *path) {
+	char host[PATH_MAX];
+	FILE *f = fopen(shim_path(path, host, sizeof(host)), "r");
+	int lines = 0, c;
+
+	if (f == NULL)
+		return -1;
+	while ((c = fgetc(f)) != EOF) {
+		if (c == '\n')
+			lines++;
+	}
+	fclose(f);
+	return lines;
+}
+
+int main(int argc, char *argv[]) {
+	static const char *scratch[] = { "ux0:", "uma0:" };
+	BenchDevice devs[HOSTBENCH_MAX_DEVS];
+	const char *csv = NULL;
+	const char **dirs;
+	int opt, count, done = 0, results = 0;
+
+	while ((opt = getopt(argc, argv, "o:")) != -1) {
+		if (opt != 'o') {
+			fprintf(stderr, "usage: %s [-o results.csv] [dir/ ...]\n", argv[0]);
+			return 2;
+		}
+		csv = optarg;
+	}
+	dirs = (const char **)argv + optind;
+	count = argc - optind;
+
+	test_root();
+	if (count == 0) {
+		dirs = scratch;
+		count = 2;
+		test_mkdir("ux0:");
+		test_mkdir("uma0:");
+		if (csv == NULL)
+			csv = "ux0:usbmc_bench.csv";
+	}
+	if (count > HOSTBENCH_MAX_DEVS)
+		count = HOSTBENCH_MAX_DEVS;
+	shim_set_verbose(1);
+
+	CHECK_EQ(pool_init(POOL_DEFAULT_CAP), 0);
+	for (int i = 0; i < count; i++) {
+		if (bench_device(dirs[i], &devs[done]) < 0) {
+			fprintf(stderr, "%s: benchmark failed\n", dirs[i]);
+			test_failures++;
+			continue;
+		}
+		results += devs[done].count;
+		done++;
+	}
+	bench_print(devs, done);
+
+	if (csv) {
+		CHECK_EQ(bench_save_csv(csv, devs, done), 0);
+		// a header and one line per result
+		CHECK_EQ(count_lines(csv), results + 1);
+	}
+	pool_exit();
+
+	return test_result();
+}
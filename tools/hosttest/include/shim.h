@@ -0,0 +1,187 @@
+#ifndef __HOSTTEST_SHIM_H__
+#define __HOSTTEST_SHIM_H__
+
+// Host stand-ins for the user mode APIs the installer's copy code uses.
+// File I/O goes to a directory tree standing in for the Vita devices
+// (ux0:foo becomes ROOT/ux0/foo), asynchronous requests run on a thread of
+// their own so that several can be in flight, and every request can be
+// given a fixed latency to model a slow device. The psp2 headers next to
+// this one only include it, so the installer sources build unchanged.
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef int SceUID;
+typedef unsigned int SceSize;
+typedef int SceInt32;
+typedef unsigned int SceUInt;
+typedef unsigned int SceUInt32;
+typedef int64_t SceInt64;
+typedef uint64_t SceUInt64;
+typedef int SceMode;
+typedef int64_t SceOff;
+
+typedef struct {
+	unsigned short year;
+	unsigned short month;
+	unsigned short day;
+	unsigned short hour;
+	unsigned short minute;
+	unsigned short second;
+	unsigned int microsecond;
+} SceDateTime;
+
+typedef struct {
+	SceMode st_mode;
+	unsigned int st_attr;
+	SceOff st_size;
+	SceDateTime st_ctime;
+	SceDateTime st_atime;
+	SceDateTime st_mtime;
+	unsigned int st_private[6];
+} SceIoStat;
+
+typedef struct {
+	SceIoStat d_stat;
+	char d_name[256];
+	void *d_private;
+	int dummy;
+} SceIoDirent;
+
+#define SCE_O_RDONLY 0x0001
+#define SCE_O_WRONLY 0x0002
+#define SCE_O_RDWR   (SCE_O_RDONLY | SCE_O_WRONLY)
+#define SCE_O_APPEND 0x0100
+#define SCE_O_CREAT  0x0200
+#define SCE_O_TRUNC  0x0400
+#define SCE_O_EXCL   0x0800
+
+#define SCE_SEEK_SET 0
+#define SCE_SEEK_CUR 1
+#define SCE_SEEK_END 2
+#ifndef SEEK_SET
+#define SEEK_SET SCE_SEEK_SET
+#define SEEK_CUR SCE_SEEK_CUR
+#define SEEK_END SCE_SEEK_END
+#endif
+
+#define SCE_S_IFMT  0xF000
+#define SCE_S_IFDIR 0x1000
+#define SCE_S_IFREG 0x2000
+#define SCE_S_ISDIR(m) (((m) & SCE_S_IFMT) == SCE_S_IFDIR)
+#define SCE_S_ISREG(m) (((m) & SCE_S_IFMT) == SCE_S_IFREG)
+
+#define SCE_CST_MODE 0x0001
+#define SCE_CST_SIZE 0x0004
+#define SCE_CST_CT   0x0008
+#define SCE_CST_AT   0x0010
+#define SCE_CST_MT   0x0020
+
+#define SCE_KERNEL_MEMBLOCK_TYPE_USER_RW 0x0C20D060
+
+#define SCE_KERNEL_ERROR_WAIT_TIMEOUT 0x80028005
+
+#define SCE_KERNEL_POWER_TICK_DEFAULT              0
+#define SCE_KERNEL_POWER_TICK_DISABLE_AUTO_SUSPEND 1
+#define SCE_KERNEL_POWER_TICK_DISABLE_OLED_OFF     4
+#define SCE_KERNEL_POWER_TICK_DISABLE_OLED_DIMMING 6
+
+typedef int (*SceKernelThreadEntry)(SceSize args, void *argp);
+
+SceUID sceIoOpen(const char *file, int flags, SceMode mode);
+int sceIoClose(SceUID fd);
+int sceIoRead(SceUID fd, void *data, SceSize size);
+int sceIoWrite(SceUID fd, const void *data, SceSize size);
+int sceIoPread(SceUID fd, void *data, SceSize size, SceOff offset);
+int sceIoPwrite(SceUID fd, const void *data, SceSize size, SceOff offset);
+SceOff sceIoLseek(SceUID fd, SceOff offset, int whence);
+int sceIoLseek32(SceUID fd, int offset, int whence);
+int sceIoReadAsync(SceUID fd, void *data, SceSize size);
+int sceIoWriteAsync(SceUID fd, const void *data, SceSize size);
+int sceIoWaitAsync(SceUID fd, SceInt64 *res);
+int sceIoRemove(const char *file);
+int sceIoRename(const char *oldname, const char *newname);
+int sceIoMkdir(const char *dir, SceMode mode);
+int sceIoRmdir(const char *path);
+SceUID sceIoDopen(const char *dirname);
+int sceIoDread(SceUID fd, SceIoDirent *dir);
+int sceIoDclose(SceUID fd);
+int sceIoGetstat(const char *file, SceIoStat *stat);
+int sceIoGetstatByFd(SceUID fd, SceIoStat *stat);
+int sceIoChstat(const char *file, SceIoStat *stat, int bits);
+int sceIoChstatByFd(SceUID fd, const SceIoStat *stat, unsigned int bits);
+int sceIoSync(const char *device, unsigned int unk);
+int sceIoSyncByFd(SceUID fd, int flag);
+
+SceUID sceKernelAllocMemBlock(const char *name, SceUInt32 type, SceSize size, void *opt);
+int sceKernelFreeMemBlock(SceUID uid);
+int sceKernelGetMemBlockBase(SceUID uid, void **base);
+
+SceUInt64 sceKernelGetProcessTimeWide(void);
+int sceKernelDelayThread(SceUInt delay);
+
+SceUID sceKernelCreateThread(const char *name, SceKernelThreadEntry entry, int prio, SceSize stack, SceUInt attr, int cpu, const void *opt);
+int sceKernelStartThread(SceUID thid, SceSize args, void *argp);
+int sceKernelWaitThreadEnd(SceUID thid, int *stat, SceUInt *timeout);
+int sceKernelDeleteThread(SceUID thid);
+SceUID sceKernelCreateSema(const char *name, SceUInt attr, int init, int max, void *opt);
+int sceKernelSignalSema(SceUID semaid, int signal);
+int sceKernelWaitSema(SceUID semaid, int signal, SceUInt *timeout);
+int sceKernelDeleteSema(SceUID semaid);
+
+int sceKernelPowerTick(int type);
+int scePowerGetArmClockFrequency(void);
+int scePowerGetBusClockFrequency(void);
+int scePowerGetGpuXbarClockFrequency(void);
+int scePowerSetArmClockFrequency(int freq);
+int scePowerSetBusClockFrequency(int freq);
+int scePowerSetGpuXbarClockFrequency(int freq);
+
+// the directory holding one subdirectory per device
+void shim_set_root(const char *root);
+// fixed cost of every read, write, open and directory listing, in us
+void shim_set_latency(unsigned int us);
+// whether the installer's debug output is shown
+void shim_set_verbose(int verbose);
+// maps a device path to the host path it stands for
+const char *shim_path(const char *path, char *out, size_t size);
+
+typedef struct {
+	unsigned int opens;
+	unsigned int dopens;
+	unsigned int reads;
+	unsigned int writes;
+	uint64_t bytes_read;
+	uint64_t bytes_written;
+	unsigned int syncs;
+	unsigned int power_ticks;
+	int dirs;           // open right now
+	int memblocks;      // allocated right now
+	int threads;        // created and not deleted
+	int semas;
+} ShimStats;
+
+void shim_get_stats(ShimStats *stats);
+void shim_reset_stats(void);
+
+// the next calls of a function fail, for testing error paths
+enum {
+	SHIM_FAIL_CREATE_SEMA,
+	SHIM_FAIL_CREATE_THREAD,
+	SHIM_FAIL_START_THREAD,
+	SHIM_FAIL_SET_CLOCK,
+	SHIM_FAIL_COUNT,
+};
+
+void shim_fail(int what, int times);
+
+// the sync_mode the plugin reports in its bulk copy status
+void shim_set_sync_mode(int mode, unsigned int interval);
+// what every sync costs, in us
+void shim_set_sync_latency(unsigned int us);
+
+// clocks the power service stand-in is running at
+void shim_get_clocks(int *arm, int *bus, int *gpu_xbar);
+void shim_set_clocks(int arm, int bus, int gpu_xbar);
+
+#endif
@@ -0,0 +1,758 @@
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// the host struct stat names its time fields like SceIoStat does
+#undef st_atime
+#undef st_ctime
+#undef st_mtime
+
+#include "shim.h"
+#include "plugin/vitashell_kernel.h"
+
+// Host backend for the installer's copy code, see shim.h. Errors come back
+// the way SceIofilemgr reports them, 0x80010000 plus the errno.
+
+#define MAX_FDS 1024
+#define MAX_DIRS 256
+#define MAX_OBJECTS 64
+#define UID_DIR_BASE 0x40000
+#define UID_OBJECT_BASE 0x50000
+
+#define SCE_ERRNO(e) ((int)(0x80010000 | (e)))
+
+typedef struct {
+	pthread_t thread;
+	int pending;
+	int write;
+	void *data;
+	SceSize size;
+	SceInt64 result;
+} AsyncRequest;
+
+typedef struct {
+	DIR *dir;
+	char path[PATH_MAX];
+} HostDir;
+
+enum {
+	OBJECT_FREE,
+	OBJECT_MEMBLOCK,
+	OBJECT_THREAD,
+	OBJECT_SEMA,
+};
+
+typedef struct {
+	int type;
+	// memblock
+	void *base;
+	// thread
+	pthread_t thread;
+	int started;
+	SceKernelThreadEntry entry;
+	SceSize args;
+	void *argp;
+	// sema
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int count;
+} HostObject;
+
+static const char *root = ".";
+static unsigned int latency_us = 0;
+static unsigned int sync_latency_us = 0;
+static int sync_mode = USBMC_SYNC_DEFAULT;
+static unsigned int sync_interval = USBMC_SYNC_DEFAULT_INTERVAL;
+static int verbose = 1;
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static ShimStats stats;
+
+static AsyncRequest requests[MAX_FDS];
+static HostDir dirs[MAX_DIRS];
+static HostObject objects[MAX_OBJECTS];
+static int failures[SHIM_FAIL_COUNT];
+
+static int clocks[3] = { 333, 111, 111 };
+
+int psvDebugScreenPrintf(const char *format, ...) {
+	va_list args;
+	int ret = 0;
+
+	if (verbose) {
+		va_start(args, format);
+		ret = vprintf(format, args);
+		va_end(args);
+	}
+	return ret;
+}
+
+void shim_set_root(const char *dir) {
+	root = dir;
+}
+
+void shim_set_latency(unsigned int us) {
+	latency_us = us;
+}
+
+void shim_set_verbose(int on) {
+	verbose = on;
+}
+
+void shim_get_stats(ShimStats *out) {
+	pthread_mutex_lock(&stats_lock);
+	*out = stats;
+	pthread_mutex_unlock(&stats_lock);
+}
+
+void shim_reset_stats(void) {
+	pthread_mutex_lock(&stats_lock);
+	// live object counts are state, not statistics
+	int dirs = stats.dirs, memblocks = stats.memblocks, threads = stats.threads, semas = stats.semas;
+	memset(&stats, 0, sizeof(stats));
+	stats.dirs = dirs;
+	stats.memblocks = memblocks;
+	stats.threads = threads;
+	stats.semas = semas;
+	pthread_mutex_unlock(&stats_lock);
+}
+
+void shim_set_sync_mode(int mode, unsigned int interval) {
+	sync_mode = mode;
+	sync_interval = interval;
+}
+
+void shim_set_sync_latency(unsigned int us) {
+	sync_latency_us = us;
+}
+
+void shim_fail(int what, int times) {
+	failures[what] = times;
+}
+
+static int failing(int what) {
+	if (failures[what] == 0)
+		return 0;
+	failures[what]--;
+	return 1;
+}
+
+void shim_get_clocks(int *arm, int *bus, int *gpu_xbar) {
+	*arm = clocks[0];
+	*bus = clocks[1];
+	*gpu_xbar = clocks[2];
+}
+
+void shim_set_clocks(int arm, int bus, int gpu_xbar) {
+	clocks[0] = arm;
+	clocks[1] = bus;
+	clocks[2] = gpu_xbar;
+}
+
+#define COUNT(field, n) do { \
+	pthread_mutex_lock(&stats_lock); \
+	stats.field += (n); \
+	pthread_mutex_unlock(&stats_lock); \
+} while (0)
+
+static void delay(void) {
+	if (latency_us)
+		usleep(latency_us);
+}
+
+const char *shim_path(const char *path, char *out, size_t size) {
+	const char *colon = strchr(path, ':');
+
+	if (colon == NULL) {
+		snprintf(out, size, "%s", path);
+		return out;
+	}
+	// "ux0:" and "ux0:/" are the device root alike
+	const char *rest = colon + 1;
+	while (*rest == '/')
+		rest++;
+	snprintf(out, size, "%s/%.*s%s%s", root, (int)(colon - path), path, *rest ? "/" : "", rest);
+	return out;
+}
+
+static void to_datetime(const struct timespec *ts, SceDateTime *dt) {
+	struct tm tm;
+
+	gmtime_r(&ts->tv_sec, &tm);
+	dt->year = tm.tm_year + 1900;
+	dt->month = tm.tm_mon + 1;
+	dt->day = tm.tm_mday;
+	dt->hour = tm.tm_hour;
+	dt->minute = tm.tm_min;
+	dt->second = tm.tm_sec;
+	dt->microsecond = ts->tv_nsec / 1000;
+}
+
+static void to_timespec(const SceDateTime *dt, struct timespec *ts) {
+	struct tm tm;
+
+	memset(&tm, 0, sizeof(tm));
+	tm.tm_year = dt->year - 1900;
+	tm.tm_mon = dt->month - 1;
+	tm.tm_mday = dt->day;
+	tm.tm_hour = dt->hour;
+	tm.tm_min = dt->minute;
+	tm.tm_sec = dt->second;
+	ts->tv_sec = timegm(&tm);
+	ts->tv_nsec = dt->microsecond * 1000L;
+}
+
+static void to_iostat(const struct stat *st, SceIoStat *out) {
+	memset(out, 0, sizeof(*out));
+	out->st_mode = S_ISDIR(st->st_mode) ? SCE_S_IFDIR : SCE_S_IFREG;
+	out->st_mode |= st->st_mode & 0777;
+	out->st_size = S_ISDIR(st->st_mode) ? 0 : st->st_size;
+	to_datetime(&st->st_ctim, &out->st_ctime);
+	to_datetime(&st->st_atim, &out->st_atime);
+	to_datetime(&st->st_mtim, &out->st_mtime);
+}
+
+static int host_flags(int flags) {
+	int out;
+
+	if ((flags & SCE_O_RDWR) == SCE_O_RDWR)
+		out = O_RDWR;
+	else if (flags & SCE_O_WRONLY)
+		out = O_WRONLY;
+	else
+		out = O_RDONLY;
+	if (flags & SCE_O_APPEND)
+		out |= O_APPEND;
+	if (flags & SCE_O_CREAT)
+		out |= O_CREAT;
+	if (flags & SCE_O_TRUNC)
+		out |= O_TRUNC;
+	if (flags & SCE_O_EXCL)
+		out |= O_EXCL;
+	return out;
+}
+
+SceUID sceIoOpen(const char *file, int flags, SceMode mode) {
+	char path[PATH_MAX];
+	int fd;
+
+	COUNT(opens, 1);
+	delay();
+	if ((fd = open(shim_path(file, path, sizeof(path)), host_flags(flags), 0644)) < 0)
+		return SCE_ERRNO(errno);
+	if (fd >= MAX_FDS) {
+		close(fd);
+		return SCE_ERRNO(EMFILE);
+	}
+	return fd;
+}
+
+int sceIoClose(SceUID fd) {
+	return close(fd) < 0 ? SCE_ERRNO(errno) : 0;
+}
+
+int sceIoRead(SceUID fd, void *data, SceSize size) {
+	ssize_t ret;
+
+	delay();
+	if ((ret = read(fd, data, size)) < 0)
+		return SCE_ERRNO(errno);
+	COUNT(reads, 1);
+	COUNT(bytes_read, ret);
+	return ret;
+}
+
+int sceIoWrite(SceUID fd, const void *data, SceSize size) {
+	ssize_t ret;
+
+	delay();
+	if ((ret = write(fd, data, size)) < 0)
+		return SCE_ERRNO(errno);
+	COUNT(writes, 1);
+	COUNT(bytes_written, ret);
+	return ret;
+}
+
+int sceIoPread(SceUID fd, void *data, SceSize size, SceOff offset) {
+	ssize_t ret;
+
+	delay();
+	if ((ret = pread(fd, data, size, offset)) < 0)
+		return SCE_ERRNO(errno);
+	COUNT(reads, 1);
+	COUNT(bytes_read, ret);
+	return ret;
+}
+
+int sceIoPwrite(SceUID fd, const void *data, SceSize size, SceOff offset) {
+	ssize_t ret;
+
+	delay();
+	if ((ret = pwrite(fd, data, size, offset)) < 0)
+		return SCE_ERRNO(errno);
+	COUNT(writes, 1);
+	COUNT(bytes_written, ret);
+	return ret;
+}
+
+SceOff sceIoLseek(SceUID fd, SceOff offset, int whence) {
+	off_t ret = lseek(fd, offset, whence);
+
+	return ret < 0 ? SCE_ERRNO(errno) : ret;
+}
+
+int sceIoLseek32(SceUID fd, int offset, int whence) {
+	return sceIoLseek(fd, offset, whence);
+}
+
+// one request in flight per descriptor, like SceIofilemgr
+static void *async_run(void *arg) {
+	SceUID fd = (AsyncRequest *)arg - requests;
+	AsyncRequest *req = arg;
+
+	if (req->write)
+		req->result = sceIoWrite(fd, req->data, req->size);
+	else
+		req->result = sceIoRead(fd, req->data, req->size);
+	return NULL;
+}
+
+static int async_start(SceUID fd, void *data, SceSize size, int write) {
+	AsyncRequest *req;
+
+	if (fd < 0 || fd >= MAX_FDS)
+		return SCE_ERRNO(EBADF);
+	req = &requests[fd];
+	if (req->pending)
+		return SCE_ERRNO(EBUSY);
+	req->write = write;
+	req->data = data;
+	req->size = size;
+	if (pthread_create(&req->thread, NULL, async_run, req) != 0)
+		return SCE_ERRNO(EAGAIN);
+	req->pending = 1;
+	return 0;
+}
+
+int sceIoReadAsync(SceUID fd, void *data, SceSize size) {
+	return async_start(fd, data, size, 0);
+}
+
+int sceIoWriteAsync(SceUID fd, const void *data, SceSize size) {
+	return async_start(fd, (void *)data, size, 1);
+}
+
+int sceIoWaitAsync(SceUID fd, SceInt64 *res) {
+	AsyncRequest *req;
+
+	if (fd < 0 || fd >= MAX_FDS || !requests[fd].pending)
+		return SCE_ERRNO(EINVAL);
+	req = &requests[fd];
+	pthread_join(req->thread, NULL);
+	req->pending = 0;
+	*res = req->result;
+	return 0;
+}
+
+int sceIoRemove(const char *file) {
+	char path[PATH_MAX];
+
+	return unlink(shim_path(file, path, sizeof(path))) < 0 ? SCE_ERRNO(errno) : 0;
+}
+
+int sceIoRename(const char *oldname, const char *newname) {
+	char from[PATH_MAX], to[PATH_MAX];
+
+	shim_path(oldname, from, sizeof(from));
+	shim_path(newname, to, sizeof(to));
+	return rename(from, to) < 0 ? SCE_ERRNO(errno) : 0;
+}
+
+int sceIoMkdir(const char *dir, SceMode mode) {
+	char path[PATH_MAX];
+
+	return mkdir(shim_path(dir, path, sizeof(path)), 0755) < 0 ? SCE_ERRNO(errno) : 0;
+}
+
+int sceIoRmdir(const char *dir) {
+	char path[PATH_MAX];
+
+	return rmdir(shim_path(dir, path, sizeof(path))) < 0 ? SCE_ERRNO(errno) : 0;
+}
+
+SceUID sceIoDopen(const char *dirname) {
+	COUNT(dopens, 1);
+	delay();
+	for (int i = 0; i < MAX_DIRS; i++) {
+		HostDir *d = &dirs[i];
+		if (d->dir)
+			continue;
+		if ((d->dir = opendir(shim_path(dirname, d->path, sizeof(d->path)))) == NULL)
+			return SCE_ERRNO(errno);
+		COUNT(dirs, 1);
+		return UID_DIR_BASE + i;
+	}
+	return SCE_ERRNO(EMFILE);
+}
+
+static HostDir *find_dir(SceUID fd) {
+	int i = fd - UID_DIR_BASE;
+
+	return (i >= 0 && i < MAX_DIRS && dirs[i].dir) ? &dirs[i] : NULL;
+}
+
+int sceIoDread(SceUID fd, SceIoDirent *dir) {
+	HostDir *d = find_dir(fd);
+	struct dirent *e;
+	struct stat st;
+	char path[PATH_MAX + 256];
+
+	if (d == NULL)
+		return SCE_ERRNO(EBADF);
+
+	// the Vita lists neither "." nor ".."
+	do {
+		errno = 0;
+		if ((e = readdir(d->dir)) == NULL)
+			return errno ? SCE_ERRNO(errno) : 0;
+	} while (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0);
+
+	snprintf(path, sizeof(path), "%s/%s", d->path, e->d_name);
+	if (stat(path, &st) < 0)
+		return SCE_ERRNO(errno);
+
+	memset(dir, 0, sizeof(*dir));
+	to_iostat(&st, &dir->d_stat);
+	snprintf(dir->d_name, sizeof(dir->d_name), "%s", e->d_name);
+	return 1;
+}
+
+int sceIoDclose(SceUID fd) {
+	HostDir *d = find_dir(fd);
+
+	if (d == NULL)
+		return SCE_ERRNO(EBADF);
+	closedir(d->dir);
+	d->dir = NULL;
+	COUNT(dirs, -1);
+	return 0;
+}
+
+int sceIoGetstat(const char *file, SceIoStat *out) {
+	char path[PATH_MAX];
+	struct stat st;
+
+	if (stat(shim_path(file, path, sizeof(path)), &st) < 0)
+		return SCE_ERRNO(errno);
+	to_iostat(&st, out);
+	return 0;
+}
+
+int sceIoGetstatByFd(SceUID fd, SceIoStat *out) {
+	struct stat st;
+
+	if (fstat(fd, &st) < 0)
+		return SCE_ERRNO(errno);
+	to_iostat(&st, out);
+	return 0;
+}
+
+// creation times cannot be set on the host, the rest is
+static void change_times(const SceIoStat *in, unsigned int bits, struct timespec *times) {
+	times[0].tv_nsec = times[1].tv_nsec = UTIME_OMIT;
+	if (bits & SCE_CST_AT)
+		to_timespec(&in->st_atime, &times[0]);
+	if (bits & SCE_CST_MT)
+		to_timespec(&in->st_mtime, &times[1]);
+}
+
+int sceIoChstat(const char *file, SceIoStat *in, int bits) {
+	struct timespec times[2];
+	char path[PATH_MAX];
+
+	shim_path(file, path, sizeof(path));
+	if ((bits & SCE_CST_SIZE) && truncate(path, in->st_size) < 0)
+		return SCE_ERRNO(errno);
+	change_times(in, bits, times);
+	return utimensat(AT_FDCWD, path, times, 0) < 0 ? SCE_ERRNO(errno) : 0;
+}
+
+int sceIoChstatByFd(SceUID fd, const SceIoStat *in, unsigned int bits) {
+	struct timespec times[2];
+
+	if ((bits & SCE_CST_SIZE) && ftruncate(fd, in->st_size) < 0)
+		return SCE_ERRNO(errno);
+	change_times(in, bits, times);
+	return futimens(fd, times) < 0 ? SCE_ERRNO(errno) : 0;
+}
+
+int sceIoSync(const char *device, unsigned int unk) {
+	COUNT(syncs, 1);
+	if (sync_latency_us)
+		usleep(sync_latency_us);
+	sync();
+	return 0;
+}
+
+int sceIoSyncByFd(SceUID fd, int flag) {
+	COUNT(syncs, 1);
+	if (sync_latency_us)
+		usleep(sync_latency_us);
+	return fsync(fd) < 0 ? SCE_ERRNO(errno) : 0;
+}
+
+static HostObject *find_object(SceUID uid, int type) {
+	int i = uid - UID_OBJECT_BASE;
+
+	return (i >= 0 && i < MAX_OBJECTS && objects[i].type == type) ? &objects[i] : NULL;
+}
+
+static SceUID new_object(int type) {
+	for (int i = 0; i < MAX_OBJECTS; i++) {
+		if (objects[i].type == OBJECT_FREE) {
+			memset(&objects[i], 0, sizeof(objects[i]));
+			objects[i].type = type;
+			return UID_OBJECT_BASE + i;
+		}
+	}
+	return SCE_ERRNO(ENOMEM);
+}
+
+SceUID sceKernelAllocMemBlock(const char *name, SceUInt32 type, SceSize size, void *opt) {
+	SceUID uid;
+	void *base;
+
+	if ((base = aligned_alloc(0x1000, (size + 0xFFF) & ~0xFFF)) == NULL)
+		return SCE_ERRNO(ENOMEM);
+	if ((uid = new_object(OBJECT_MEMBLOCK)) < 0) {
+		free(base);
+		return uid;
+	}
+	find_object(uid, OBJECT_MEMBLOCK)->base = base;
+	COUNT(memblocks, 1);
+	return uid;
+}
+
+int sceKernelFreeMemBlock(SceUID uid) {
+	HostObject *o = find_object(uid, OBJECT_MEMBLOCK);
+
+	if (o == NULL)
+		return SCE_ERRNO(EINVAL);
+	free(o->base);
+	o->type = OBJECT_FREE;
+	COUNT(memblocks, -1);
+	return 0;
+}
+
+int sceKernelGetMemBlockBase(SceUID uid, void **base) {
+	HostObject *o = find_object(uid, OBJECT_MEMBLOCK);
+
+	if (o == NULL)
+		return SCE_ERRNO(EINVAL);
+	*base = o->base;
+	return 0;
+}
+
+SceUInt64 sceKernelGetProcessTimeWide(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (SceUInt64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int sceKernelDelayThread(SceUInt delay) {
+	usleep(delay);
+	return 0;
+}
+
+static void *thread_run(void *arg) {
+	HostObject *o = arg;
+
+	o->entry(o->args, o->argp);
+	return NULL;
+}
+
+SceUID sceKernelCreateThread(const char *name, SceKernelThreadEntry entry, int prio, SceSize stack, SceUInt attr, int cpu, const void *opt) {
+	SceUID uid;
+
+	if (failing(SHIM_FAIL_CREATE_THREAD))
+		return SCE_ERRNO(ENOMEM);
+	if ((uid = new_object(OBJECT_THREAD)) < 0)
+		return uid;
+	find_object(uid, OBJECT_THREAD)->entry = entry;
+	COUNT(threads, 1);
+	return uid;
+}
+
+int sceKernelStartThread(SceUID thid, SceSize args, void *argp) {
+	HostObject *o = find_object(thid, OBJECT_THREAD);
+
+	if (o == NULL || o->started)
+		return SCE_ERRNO(EINVAL);
+	if (failing(SHIM_FAIL_START_THREAD))
+		return SCE_ERRNO(EAGAIN);
+	o->args = args;
+	o->argp = argp;
+	if (pthread_create(&o->thread, NULL, thread_run, o) != 0)
+		return SCE_ERRNO(EAGAIN);
+	o->started = 1;
+	return 0;
+}
+
+int sceKernelWaitThreadEnd(SceUID thid, int *stat, SceUInt *timeout) {
+	HostObject *o = find_object(thid, OBJECT_THREAD);
+
+	if (o == NULL || !o->started)
+		return SCE_ERRNO(EINVAL);
+	pthread_join(o->thread, NULL);
+	o->started = 0;
+	return 0;
+}
+
+int sceKernelDeleteThread(SceUID thid) {
+	HostObject *o = find_object(thid, OBJECT_THREAD);
+
+	// a thread has to end before it can go
+	if (o == NULL || o->started)
+		return SCE_ERRNO(EINVAL);
+	o->type = OBJECT_FREE;
+	COUNT(threads, -1);
+	return 0;
+}
+
+SceUID sceKernelCreateSema(const char *name, SceUInt attr, int init, int max, void *opt) {
+	HostObject *o;
+	SceUID uid;
+
+	if (failing(SHIM_FAIL_CREATE_SEMA))
+		return SCE_ERRNO(ENOMEM);
+	if ((uid = new_object(OBJECT_SEMA)) < 0)
+		return uid;
+	o = find_object(uid, OBJECT_SEMA);
+	pthread_mutex_init(&o->lock, NULL);
+	pthread_cond_init(&o->cond, NULL);
+	o->count = init;
+	COUNT(semas, 1);
+	return uid;
+}
+
+int sceKernelSignalSema(SceUID semaid, int signal) {
+	HostObject *o = find_object(semaid, OBJECT_SEMA);
+
+	if (o == NULL)
+		return SCE_ERRNO(EINVAL);
+	pthread_mutex_lock(&o->lock);
+	o->count += signal;
+	pthread_cond_broadcast(&o->cond);
+	pthread_mutex_unlock(&o->lock);
+	return 0;
+}
+
+int sceKernelWaitSema(SceUID semaid, int signal, SceUInt *timeout) {
+	HostObject *o = find_object(semaid, OBJECT_SEMA);
+	struct timespec until;
+	int ret = 0;
+
+	if (o == NULL)
+		return SCE_ERRNO(EINVAL);
+	if (timeout) {
+		clock_gettime(CLOCK_REALTIME, &until);
+		until.tv_sec += *timeout / 1000000;
+		until.tv_nsec += (*timeout % 1000000) * 1000L;
+		if (until.tv_nsec >= 1000000000L) {
+			until.tv_sec++;
+			until.tv_nsec -= 1000000000L;
+		}
+	}
+
+	pthread_mutex_lock(&o->lock);
+	while (o->count < signal && ret == 0) {
+		if (timeout)
+			ret = pthread_cond_timedwait(&o->cond, &o->lock, &until);
+		else
+			ret = pthread_cond_wait(&o->cond, &o->lock);
+	}
+	if (o->count >= signal) {
+		o->count -= signal;
+		ret = 0;
+	}
+	pthread_mutex_unlock(&o->lock);
+
+	return ret ? SCE_KERNEL_ERROR_WAIT_TIMEOUT : 0;
+}
+
+int sceKernelDeleteSema(SceUID semaid) {
+	HostObject *o = find_object(semaid, OBJECT_SEMA);
+
+	if (o == NULL)
+		return SCE_ERRNO(EINVAL);
+	pthread_cond_destroy(&o->cond);
+	pthread_mutex_destroy(&o->lock);
+	o->type = OBJECT_FREE;
+	COUNT(semas, -1);
+	return 0;
+}
+
+int sceKernelPowerTick(int type) {
+	COUNT(power_ticks, 1);
+	return 0;
+}
+
+int scePowerGetArmClockFrequency(void) {
+	return clocks[0];
+}
+
+int scePowerGetBusClockFrequency(void) {
+	return clocks[1];
+}
+
+int scePowerGetGpuXbarClockFrequency(void) {
+	return clocks[2];
+}
+
+static int set_clock(int which, int freq) {
+	if (failing(SHIM_FAIL_SET_CLOCK))
+		return SCE_ERRNO(EINVAL);
+	clocks[which] = freq;
+	return 0;
+}
+
+int scePowerSetArmClockFrequency(int freq) {
+	return set_clock(0, freq);
+}
+
+int scePowerSetBusClockFrequency(int freq) {
+	return set_clock(1, freq);
+}
+
+int scePowerSetGpuXbarClockFrequency(int freq) {
+	return set_clock(2, freq);
+}
+
+// There is no kernel to run the plugin's bulk copy here: the installer
+// copies every batch itself, the way it does when the plugin refuses one.
+int shellKernelBulkCopy(const char *list, unsigned int size) {
+	return SCE_ERRNO(ENOSYS);
+}
+
+int shellKernelGetBulkCopyStatus(UsbmcBulkCopyStatus *status) {
+	memset(status, 0, sizeof(*status));
+	status->sync_mode = sync_mode;
+	status->sync_interval = sync_interval;
+	return 0;
+}
+
+int shellKernelTraceMark(int phase) {
+	return 0;
+}
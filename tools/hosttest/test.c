@@ -0,0 +1,99 @@
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#undef st_atime
+#undef st_ctime
+#undef st_mtime
+
+#include "test.h"
+
+int test_failures = 0;
+
+static char root[256];
+
+static void remove_root(void) {
+	char cmd[300];
+
+	snprintf(cmd, sizeof(cmd), "rm -rf '%s'", root);
+	if (system(cmd) != 0)
+		fprintf(stderr, "could not remove %s\n", root);
+}
+
+const char *test_root(void) {
+	if (root[0] == '\0') {
+		const char *tmp = getenv("TMPDIR");
+
+		snprintf(root, sizeof(root), "%s/usbmc-test-XXXXXX", tmp ? tmp : "/tmp");
+		if (mkdtemp(root) == NULL) {
+			perror("mkdtemp");
+			exit(2);
+		}
+		atexit(remove_root);
+		shim_set_root(root);
+	}
+	return root;
+}
+
+void test_mkdir(const char *path) {
+	char host[PATH_MAX];
+
+	shim_path(path, host, sizeof(host));
+	for (char *p = host + strlen(root) + 1; *p; p++) {
+		if (*p == '/') {
+			*p = '\0';
+			mkdir(host, 0755);
+			*p = '/';
+		}
+	}
+	mkdir(host, 0755);
+}
+
+void test_write(const char *path, size_t size, unsigned int seed) {
+	char host[PATH_MAX], buf[4096];
+	FILE *f;
+
+	shim_path(path, host, sizeof(host));
+	if ((f = fopen(host, "wb")) == NULL) {
+		perror(host);
+		exit(2);
+	}
+	while (size > 0) {
+		size_t n = size < sizeof(buf) ? size : sizeof(buf);
+		for (size_t i = 0; i < n; i++) {
+			seed = seed * 1103515245 + 12345;
+			buf[i] = seed >> 16;
+		}
+		fwrite(buf, 1, n, f);
+		size -= n;
+	}
+	fclose(f);
+}
+
+int test_same_tree(const char *a, const char *b) {
+	char cmd[2 * PATH_MAX + 32], ha[PATH_MAX], hb[PATH_MAX];
+
+	snprintf(cmd, sizeof(cmd), "diff -r '%s' '%s' > /dev/null",
+	         shim_path(a, ha, sizeof(ha)), shim_path(b, hb, sizeof(hb)));
+	return system(cmd) == 0;
+}
+
+double test_seconds(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int test_result(void) {
+	if (test_failures)
+		fprintf(stderr, "%d checks failed\n", test_failures);
+	return test_failures ? 1 : 0;
+}
@@ -0,0 +1,39 @@
+#ifndef __HOSTTEST_TEST_H__
+#define __HOSTTEST_TEST_H__
+
+#include <stdio.h>
+
+#include "shim.h"
+
+// Each test program counts its failed checks and exits non-zero if there
+// was one, which is all ctest looks at.
+
+extern int test_failures;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		test_failures++; \
+	} \
+} while (0)
+
+#define CHECK_EQ(a, b) do { \
+	long long _a = (long long)(a), _b = (long long)(b); \
+	if (_a != _b) { \
+		fprintf(stderr, "%s:%d: check failed: %s == %s (%lld != %lld)\n", __FILE__, __LINE__, #a, #b, _a, _b); \
+		test_failures++; \
+	} \
+} while (0)
+
+// a fresh directory to stand in for the devices, removed at exit
+const char *test_root(void);
+// creates a device path with its parents, files get size bytes of a
+// pattern that depends on seed
+void test_mkdir(const char *path);
+void test_write(const char *path, size_t size, unsigned int seed);
+// whether two device paths hold the same tree, file contents included
+int test_same_tree(const char *a, const char *b);
+double test_seconds(void);
+int test_result(void);
+
+#endif
@@ -0,0 +1,180 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <psp2/io/fcntl.h>
+
+#include "aio.h"
+#include "bufpool.h"
+#include "test.h"
+
+// Copies files of awkward sizes through the async engine, to one target
+// and fanned out to several, checks how many source descriptors each copy
+// opens and that a failing target is dropped, then sweeps the queue depth
+// on a device with a fixed cost per call. The shim runs every async
+// request on a thread of its own, so requests in flight overlap the way
+// they do on the Vita.
+
+#define BLOCK AIO_DEFAULT_BLOCK
+#define SWEEP_SIZE (8 * 1024 * 1024)
+#define SWEEP_LATENCY_US 500
+
+typedef struct {
+	SceOff last;
+	unsigned int calls;
+	int backwards;
+} Progress;
+
+static void on_progress(void *arg, SceOff done, SceOff size) {
+	Progress *p = arg;
+
+	if (done <= p->last || done > size)
+		p->backwards++;
+	p->last = done;
+	p->calls++;
+}
+
+static SceUID open_target(const char *path) {
+	return sceIoOpen(path, SCE_O_WRONLY | SCE_O_CREAT | SCE_O_TRUNC, 0777);
+}
+
+static void test_sizes(void) {
+	static const SceOff sizes[] = { 0, 1, BLOCK - 1, BLOCK, BLOCK + 1, 2 * BLOCK, 5 * BLOCK + 17, 16 * BLOCK };
+	char src[64], dst[64];
+
+	test_mkdir("ux0:aio");
+	test_mkdir("uma0:aio");
+	for (size_t i = 0; i < sizeof(sizes)/sizeof(*sizes); i++) {
+		SceOff size = sizes[i];
+		SceOff blocks = (size + BLOCK - 1) / BLOCK;
+		int depth = (blocks < AIO_DEFAULT_DEPTH) ? (int)blocks : AIO_DEFAULT_DEPTH;
+		Progress progress = { 0 };
+		ShimStats shim;
+		AioStats aio;
+		SceUID fd;
+
+		snprintf(src, sizeof(src), "ux0:aio/f%zu", i);
+		snprintf(dst, sizeof(dst), "uma0:aio/f%zu", i);
+		test_write(src, size, i);
+		CHECK((fd = open_target(dst)) >= 0);
+
+		shim_reset_stats();
+		aio_reset_stats();
+		CHECK_EQ(aio_copy(fd, src, size, on_progress, &progress), 0);
+		sceIoClose(fd);
+		shim_get_stats(&shim);
+		aio_get_stats(&aio);
+
+		// one source descriptor per block in flight, never more than blocks
+		CHECK_EQ(shim.opens, depth);
+		CHECK_EQ(aio.bytes_read, size);
+		CHECK_EQ(aio.bytes_written, size);
+		CHECK_EQ(progress.backwards, 0);
+		CHECK_EQ(progress.last, size);
+		CHECK_EQ(progress.calls, blocks);
+		CHECK(test_same_tree(src, dst));
+	}
+}
+
+static void test_fan_out(void) {
+	static const char *targets[] = { "uma0:fan/a", "uma0:fan/b", "uma0:fan/c" };
+	SceOff size = 7 * BLOCK + 5;
+	SceUID fds[3];
+	int alive[3];
+	AioStats aio;
+
+	test_mkdir("ux0:fan");
+	test_mkdir("uma0:fan");
+	test_write("ux0:fan/src", size, 7);
+
+	for (int t = 0; t < 3; t++) {
+		fds[t] = open_target(targets[t]);
+		alive[t] = 1;
+	}
+	aio_reset_stats();
+	CHECK_EQ(aio_copy_multi(fds, alive, 3, "ux0:fan/src", size, NULL, NULL), 0);
+	aio_get_stats(&aio);
+	// each block is read once whatever the number of targets
+	CHECK_EQ(aio.bytes_read, size);
+	CHECK_EQ(aio.bytes_written, 3 * size);
+	for (int t = 0; t < 3; t++) {
+		sceIoClose(fds[t]);
+		CHECK(alive[t]);
+		CHECK(test_same_tree("ux0:fan/src", targets[t]));
+	}
+
+	// a target that can't be written is dropped, the others still get the file
+	fds[0] = open_target(targets[0]);
+	fds[1] = sceIoOpen("ux0:fan/src", SCE_O_RDONLY, 0);
+	fds[2] = open_target(targets[2]);
+	for (int t = 0; t < 3; t++)
+		alive[t] = 1;
+	CHECK_EQ(aio_copy_multi(fds, alive, 3, "ux0:fan/src", size, NULL, NULL), 0);
+	for (int t = 0; t < 3; t++)
+		sceIoClose(fds[t]);
+	CHECK(alive[0] && !alive[1] && alive[2]);
+	CHECK(test_same_tree("ux0:fan/src", targets[0]));
+	CHECK(test_same_tree("ux0:fan/src", targets[2]));
+
+	// without a target left the copy fails, single block files included
+	for (int i = 0; i < 2; i++) {
+		SceOff len = i ? size : 100;
+		int one = 1;
+
+		fds[0] = sceIoOpen("ux0:fan/src", SCE_O_RDONLY, 0);
+		CHECK(aio_copy_multi(fds, &one, 1, "ux0:fan/src", len, NULL, NULL) < 0);
+		CHECK(!one);
+		sceIoClose(fds[0]);
+	}
+
+	CHECK(aio_copy(fds[0], "ux0:fan/missing", size, NULL, NULL) < 0);
+}
+
+static void sweep(void) {
+	double base = 0, deep = 0;
+
+	test_mkdir("ux0:sweep");
+	test_mkdir("uma0:sweep");
+	test_write("ux0:sweep/src", SWEEP_SIZE, 3);
+
+	shim_set_latency(SWEEP_LATENCY_US);
+	printf("%d MiB in %d KiB blocks, %d us per call\n", SWEEP_SIZE >> 20, BLOCK >> 10, SWEEP_LATENCY_US);
+	printf("%5s %8s %8s\n", "depth", "s", "MiB/s");
+	for (int depth = 1; depth <= AIO_MAX_DEPTH; depth *= 2) {
+		double start, seconds;
+		SceUID fd;
+
+		CHECK_EQ(aio_init(depth, BLOCK), 0);
+		fd = open_target("uma0:sweep/dst");
+		start = test_seconds();
+		CHECK_EQ(aio_copy(fd, "ux0:sweep/src", SWEEP_SIZE, NULL, NULL), 0);
+		seconds = test_seconds() - start;
+		sceIoClose(fd);
+		CHECK(test_same_tree("ux0:sweep/src", "uma0:sweep/dst"));
+
+		printf("%5d %8.3f %8.1f\n", depth, seconds, SWEEP_SIZE / seconds / (1 << 20));
+		if (depth == 1)
+			base = seconds;
+		if (depth == AIO_DEFAULT_DEPTH)
+			deep = seconds;
+	}
+	shim_set_latency(0);
+
+	// reads in flight hide the cost of each call
+	CHECK(deep < base);
+}
+
+int main(void) {
+	test_root();
+	shim_set_verbose(0);
+
+	CHECK_EQ(pool_init(POOL_DEFAULT_CAP), 0);
+	CHECK_EQ(aio_init(AIO_DEFAULT_DEPTH, BLOCK), 0);
+
+	test_sizes();
+	test_fan_out();
+	sweep();
+
+	aio_exit();
+	pool_exit();
+	return test_result();
+}
@@ -0,0 +1,203 @@
+#include <string.h>
+
+#include <psp2/io/fcntl.h>
+#include <psp2/io/stat.h>
+
+#include "aio.h"
+#include "archive.h"
+#include "bufpool.h"
+#include "copy.h"
+#include "rules.h"
+#include "test.h"
+
+// Packs trees and restores them again: files across block boundaries, empty
+// files and directories, an index big enough to spill, timestamps, rules.
+// Archives made up by hand with names that point out of the restore root
+// must be refused before anything is written. The benchmark then moves a
+// tree of small files by pack and restore and by the installer's own
+// copy_directory(), on a device with a fixed cost per call.
+
+#define SPILL_FILES 1500
+#define BENCH_FILES 2000
+#define BENCH_LATENCY_US 50
+
+static void write_tree(void) {
+	char path[64];
+
+	test_mkdir("ux0:tree/a/b/c");
+	test_mkdir("ux0:tree/empty");
+	test_mkdir("ux0:tree/many");
+	test_write("ux0:tree/zero", 0, 1);
+	test_write("ux0:tree/a/block", ARCHIVE_BLOCK, 2);
+	test_write("ux0:tree/a/b/block-1", ARCHIVE_BLOCK - 1, 3);
+	test_write("ux0:tree/a/b/c/block+1", ARCHIVE_BLOCK + 1, 4);
+	test_write("ux0:tree/a/b/c/large", 3 * ARCHIVE_BLOCK + 12345, 5);
+	// enough entries for the index to spill to its scratch file
+	for (int i = 0; i < SPILL_FILES; i++) {
+		snprintf(path, sizeof(path), "ux0:tree/many/file-with-a-longer-name-%04d", i);
+		test_write(path, i % 300, i);
+	}
+}
+
+static void test_round_trip(void) {
+	ArchiveStats pack, restore;
+	SceIoStat src, dst;
+
+	CHECK_EQ(archive_pack("uma0:tree.pkg", "ux0:tree", NULL, &pack), 0);
+	CHECK_EQ(pack.files, 5 + SPILL_FILES);
+	CHECK_EQ(pack.dirs, 5);
+	// the index scratch file is gone
+	CHECK(sceIoGetstat("uma0:tree.pkg~idx", &dst) < 0);
+
+	CHECK_EQ(archive_restore("uma0:tree.pkg", "uma0:tree", &restore), 0);
+	CHECK_EQ(restore.files, pack.files);
+	CHECK_EQ(restore.dirs, pack.dirs);
+	CHECK_EQ(restore.bytes, pack.bytes);
+	CHECK_EQ(restore.failed, 0);
+	CHECK(test_same_tree("ux0:tree", "uma0:tree"));
+
+	CHECK_EQ(sceIoGetstat("ux0:tree/a/b/c/large", &src), 0);
+	CHECK_EQ(sceIoGetstat("uma0:tree/a/b/c/large", &dst), 0);
+	CHECK(memcmp(&src.st_mtime, &dst.st_mtime, sizeof(src.st_mtime)) == 0);
+}
+
+static void test_rules(void) {
+	Rules *rules = rules_create();
+	ArchiveStats stats;
+	SceIoStat stat;
+
+	CHECK_EQ(rules_add(rules, RULE_INCLUDE, "a/b", 0), 0);
+	CHECK_EQ(archive_pack("uma0:part.pkg", "ux0:tree", rules, &stats), 0);
+	rules_free(rules);
+	CHECK_EQ(stats.files, 3);
+
+	CHECK_EQ(archive_restore("uma0:part.pkg", "uma0:part", &stats), 0);
+	CHECK(test_same_tree("ux0:tree/a/b", "uma0:part/a/b"));
+	CHECK(sceIoGetstat("uma0:part/a/block", &stat) < 0);
+	CHECK(sceIoGetstat("uma0:part/many", &stat) < 0);
+}
+
+// an archive with a single record of the given type and name
+static void write_archive(const char *path, int type, const char *name) {
+	ArchiveHeader header = { ARCHIVE_MAGIC, ARCHIVE_VERSION };
+	ArchiveTrailer trailer;
+	ArchiveEntry entry;
+	SceUID fd;
+
+	memset(&entry, 0, sizeof(entry));
+	entry.type = type;
+	entry.name_len = strlen(name);
+	entry.size = (type == ARCHIVE_FILE) ? 4 : 0;
+	memset(&trailer, 0, sizeof(trailer));
+	trailer.magic = ARCHIVE_MAGIC;
+	trailer.count = 1;
+	trailer.bytes = entry.size;
+	trailer.index_offset = sizeof(header) + sizeof(entry) + entry.name_len + entry.size;
+
+	fd = sceIoOpen(path, SCE_O_WRONLY | SCE_O_CREAT | SCE_O_TRUNC, 0777);
+	sceIoWrite(fd, &header, sizeof(header));
+	sceIoWrite(fd, &entry, sizeof(entry));
+	sceIoWrite(fd, name, entry.name_len);
+	sceIoWrite(fd, "evil", entry.size);
+	sceIoWrite(fd, &trailer, sizeof(trailer));
+	sceIoClose(fd);
+}
+
+static void test_bad_names(void) {
+	static const char *names[] = {
+		"", "/abs", "../out", "a/../../out", "a/..", "..", "./x", "a//b", "a/", "ux0:out", "a\\..\\..\\out",
+	};
+	ArchiveStats stats;
+	SceIoStat stat;
+
+	write_archive("uma0:ok.pkg", ARCHIVE_FILE, "in/x");
+	test_mkdir("uma0:jail/in");
+	CHECK_EQ(archive_restore("uma0:ok.pkg", "uma0:jail", &stats), 0);
+	CHECK_EQ(stats.files, 1);
+
+	for (size_t i = 0; i < sizeof(names)/sizeof(*names); i++) {
+		for (int type = ARCHIVE_DIR; type <= ARCHIVE_FILE; type++) {
+			write_archive("uma0:bad.pkg", type, names[i]);
+			if (archive_restore("uma0:bad.pkg", "uma0:jail/in", &stats) == 0 || stats.files || stats.dirs) {
+				fprintf(stderr, "restored \"%s\"\n", names[i]);
+				test_failures++;
+			}
+		}
+	}
+	CHECK(sceIoGetstat("uma0:jail/out", &stat) < 0);
+	CHECK(sceIoGetstat("uma0:out", &stat) < 0);
+	CHECK(sceIoGetstat("ux0:out", &stat) < 0);
+
+	write_archive("uma0:bad.pkg", 7, "x");
+	CHECK(archive_restore("uma0:bad.pkg", "uma0:jail", &stats) < 0);
+	// not an archive at all
+	CHECK(archive_restore("ux0:tree/a/block", "uma0:jail", &stats) < 0);
+}
+
+static void report(const char *what, double seconds, const ShimStats *s, uint64_t bytes) {
+	printf("%-14s %8.3f %9.1f %9.0f %7u %7u %7u\n", what, seconds, bytes / seconds / 1048576.0,
+	       BENCH_FILES / seconds, s->opens, s->reads, s->writes);
+}
+
+static void bench(void) {
+	ArchiveStats pack, restore;
+	ShimStats stats;
+	double start, copy_s;
+	uint64_t copy_bytes = 0;
+	char path[64];
+
+	test_mkdir("ux0:bench");
+	for (int i = 0; i < BENCH_FILES; i++) {
+		snprintf(path, sizeof(path), "ux0:bench/d%02d", i / 100);
+		test_mkdir(path);
+		snprintf(path, sizeof(path), "ux0:bench/d%02d/f%04d", i / 100, i);
+		test_write(path, 512 + (i * 37) % 4096, i);
+		copy_bytes += 512 + (i * 37) % 4096;
+	}
+
+	shim_set_latency(BENCH_LATENCY_US);
+	printf("%d files of 0.5 to 4.5 KiB, %d us per call\n", BENCH_FILES, BENCH_LATENCY_US);
+	printf("%-14s %8s %9s %9s %7s %7s %7s\n", "", "s", "MiB/s", "files/s", "opens", "reads", "writes");
+
+	shim_reset_stats();
+	start = test_seconds();
+	CHECK_EQ(copy_directory("uma0:bench-copy", "ux0:bench"), 0);
+	copy_s = test_seconds() - start;
+	shim_get_stats(&stats);
+	report("copy_directory", copy_s, &stats, copy_bytes);
+	CHECK(test_same_tree("ux0:bench", "uma0:bench-copy"));
+
+	shim_reset_stats();
+	CHECK_EQ(archive_pack("uma0:bench.pkg", "ux0:bench", NULL, &pack), 0);
+	shim_get_stats(&stats);
+	report("pack", pack.seconds, &stats, pack.bytes);
+
+	shim_reset_stats();
+	CHECK_EQ(archive_restore("uma0:bench.pkg", "uma0:bench-restore", &restore), 0);
+	shim_get_stats(&stats);
+	report("restore", restore.seconds, &stats, restore.bytes);
+	CHECK(test_same_tree("ux0:bench", "uma0:bench-restore"));
+	shim_set_latency(0);
+
+	// one archive written in big blocks beats a file per file copy
+	CHECK(pack.seconds < copy_s);
+}
+
+int main(void) {
+	test_root();
+	shim_set_verbose(0);
+	test_mkdir("uma0:");
+
+	CHECK_EQ(pool_init(POOL_DEFAULT_CAP), 0);
+	CHECK_EQ(aio_init(AIO_DEFAULT_DEPTH, AIO_DEFAULT_BLOCK), 0);
+
+	write_tree();
+	test_round_trip();
+	test_rules();
+	test_bad_names();
+	bench();
+
+	aio_exit();
+	pool_exit();
+	return test_result();
+}
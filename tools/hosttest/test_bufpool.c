@@ -0,0 +1,142 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "bufpool.h"
+#include "test.h"
+
+// The transfer buffer pool on its own: every buffer starts on a slot
+// boundary and takes whole slots, the cap bounds the slots and what does
+// not fit under it fails and is counted, first fit reuses freed slots and
+// a request larger than any free run fails even with enough slots free.
+// The stats must follow all of it, and the memblock must go on exit.
+
+#define SLOT POOL_SLOT_SIZE
+
+static int aligned(const void *p) {
+	return ((uintptr_t)p & (SLOT - 1)) == 0;
+}
+
+static void test_alignment(void) {
+	static const size_t sizes[] = { 0, 1, SLOT - 1, SLOT, SLOT + 1, 3 * SLOT };
+	char *bufs[sizeof(sizes)/sizeof(*sizes)];
+	PoolStats stats;
+
+	CHECK_EQ(pool_init(POOL_DEFAULT_CAP), 0);
+	for (size_t i = 0; i < sizeof(sizes)/sizeof(*sizes); i++) {
+		CHECK((bufs[i] = pool_alloc(sizes[i])) != NULL);
+		CHECK(aligned(bufs[i]));
+		// whole slots, none shared with another buffer
+		memset(bufs[i], (int)i, sizes[i] ? sizes[i] : 1);
+	}
+	for (size_t i = 0; i < sizeof(sizes)/sizeof(*sizes); i++) {
+		size_t size = sizes[i] ? sizes[i] : 1;
+		CHECK(bufs[i][0] == (char)i && bufs[i][size - 1] == (char)i);
+	}
+
+	pool_get_stats(&stats);
+	CHECK_EQ(stats.slots, POOL_DEFAULT_CAP / SLOT);
+	CHECK_EQ(stats.in_use, 1 + 1 + 1 + 1 + 2 + 3);
+	CHECK_EQ(stats.allocs, sizeof(sizes)/sizeof(*sizes));
+	CHECK_EQ(stats.failures, 0);
+
+	for (size_t i = 0; i < sizeof(sizes)/sizeof(*sizes); i++)
+		pool_free(bufs[i]);
+	pool_get_stats(&stats);
+	CHECK_EQ(stats.in_use, 0);
+	CHECK_EQ(stats.peak, 9);
+	pool_exit();
+}
+
+static void test_cap(void) {
+	ShimStats shim;
+	PoolStats stats;
+	void *a, *b;
+
+	// under a slot still gives one
+	CHECK_EQ(pool_init(1), 0);
+	pool_get_stats(&stats);
+	CHECK_EQ(stats.slots, 1);
+	pool_exit();
+
+	// and no more than the slot map holds
+	CHECK_EQ(pool_init(4 * POOL_MAX_SLOTS * SLOT), 0);
+	pool_get_stats(&stats);
+	CHECK_EQ(stats.slots, POOL_MAX_SLOTS);
+	CHECK((a = pool_alloc(POOL_MAX_SLOTS * SLOT)) != NULL);
+	pool_free(a);
+	pool_exit();
+
+	CHECK_EQ(pool_init(4 * SLOT), 0);
+	CHECK(pool_alloc(5 * SLOT) == NULL);
+	CHECK((a = pool_alloc(3 * SLOT)) != NULL);
+	CHECK((b = pool_alloc(SLOT)) != NULL);
+	CHECK(pool_alloc(1) == NULL);
+	pool_get_stats(&stats);
+	CHECK_EQ(stats.in_use, 4);
+	CHECK_EQ(stats.peak, 4);
+	CHECK_EQ(stats.allocs, 2);
+	CHECK_EQ(stats.failures, 2);
+
+	// nothing there, nothing freed
+	pool_free(NULL);
+	pool_free((char *)a + SLOT);
+	pool_get_stats(&stats);
+	CHECK_EQ(stats.in_use, 4);
+
+	pool_free(b);
+	pool_free(a);
+	pool_exit();
+	shim_get_stats(&shim);
+	CHECK_EQ(shim.memblocks, 0);
+
+	// gone with the memblock
+	CHECK(pool_alloc(1) == NULL);
+}
+
+static void test_reuse(void) {
+	char *s[4], *two;
+	PoolStats stats;
+
+	CHECK_EQ(pool_init(4 * SLOT), 0);
+	for (int i = 0; i < 4; i++) {
+		CHECK((s[i] = pool_alloc(SLOT)) != NULL);
+		if (i > 0)
+			CHECK(s[i] == s[i - 1] + SLOT);
+	}
+
+	// two free slots, but not next to each other
+	pool_free(s[1]);
+	pool_free(s[3]);
+	CHECK(pool_alloc(2 * SLOT) == NULL);
+
+	// first fit takes the lowest free slot again
+	CHECK(pool_alloc(SLOT) == s[1]);
+	pool_free(s[1]);
+
+	pool_free(s[2]);
+	CHECK((two = pool_alloc(2 * SLOT)) == s[1]);
+	CHECK(pool_alloc(2 * SLOT) == NULL);
+	CHECK(pool_alloc(SLOT) == s[3]);
+
+	pool_get_stats(&stats);
+	CHECK_EQ(stats.in_use, 4);
+	CHECK_EQ(stats.peak, 4);
+	CHECK_EQ(stats.failures, 2);
+
+	pool_free(two);
+	pool_free(s[3]);
+	pool_free(s[0]);
+	CHECK(pool_alloc(4 * SLOT) == s[0]);
+	pool_exit();
+}
+
+int main(void) {
+	test_root();
+	shim_set_verbose(0);
+
+	test_alignment();
+	test_cap();
+	test_reuse();
+
+	return test_result();
+}
@@ -0,0 +1,258 @@
+#include <string.h>
+
+#include <psp2/io/fcntl.h>
+#include <psp2/io/stat.h>
+
+#include "aio.h"
+#include "bufpool.h"
+#include "copy.h"
+#include "test.h"
+#include "walker.h"
+#include "plugin/vitashell_kernel.h"
+
+// The comparison a delta copy makes before it copies a file back, on
+// single files and then through copy_tree() the way sync_back() runs it:
+// unchanged files, a changed size, a changed modification time and, with
+// verify, same sized files whose contents differ. Then the descriptors a
+// file copy opens: the source only as often as the copy engine reads it.
+// Last, a fan-out migration under every sync_mode, which must sync as often
+// as the mode says, with what each mode costs against none.
+
+#define FILE_SIZE 5000
+#define SYNC_FILES 64
+#define SYNC_FILE_SIZE (128 * 1024)
+#define SYNC_EVERY_FILES 8
+#define SYNC_EVERY_MB 2
+#define SYNC_LATENCY_US 20000
+#define SYNC_REQUEST_US 250
+
+// a fixed modification time, so files can be made to differ by seconds
+static void set_mtime(const char *path, int second) {
+	SceIoStat stat;
+
+	memset(&stat, 0, sizeof(stat));
+	stat.st_mtime.year = 2020;
+	stat.st_mtime.month = 6;
+	stat.st_mtime.day = 1;
+	stat.st_mtime.hour = 12;
+	stat.st_mtime.second = second;
+	CHECK_EQ(sceIoChstat(path, &stat, SCE_CST_MT), 0);
+}
+
+static void make(const char *path, size_t size, unsigned int seed, int second) {
+	test_write(path, size, seed);
+	set_mtime(path, second);
+}
+
+static int unchanged(const char *dst, const char *src, int verify) {
+	SceIoStat stat;
+
+	CHECK_EQ(sceIoGetstat(src, &stat), 0);
+	return copy_unchanged(dst, src, &stat, verify);
+}
+
+static void test_unchanged(void) {
+	test_mkdir("uma0:one");
+	test_mkdir("ux0:one");
+	make("uma0:one/src", FILE_SIZE, 1, 10);
+
+	// nothing there yet
+	CHECK_EQ(unchanged("ux0:one/missing", "uma0:one/src", 0), 0);
+	CHECK_EQ(unchanged("ux0:one/missing", "uma0:one/src", 1), 0);
+
+	make("ux0:one/same", FILE_SIZE, 1, 10);
+	CHECK_EQ(unchanged("ux0:one/same", "uma0:one/src", 0), 1);
+	CHECK_EQ(unchanged("ux0:one/same", "uma0:one/src", 1), 1);
+
+	// FAT keeps times in 2 second steps
+	make("ux0:one/fat", FILE_SIZE, 1, 12);
+	CHECK_EQ(unchanged("ux0:one/fat", "uma0:one/src", 0), 1);
+
+	make("ux0:one/size", FILE_SIZE + 1, 1, 10);
+	CHECK_EQ(unchanged("ux0:one/size", "uma0:one/src", 0), 0);
+	CHECK_EQ(unchanged("ux0:one/size", "uma0:one/src", 1), 0);
+
+	make("ux0:one/mtime", FILE_SIZE, 1, 40);
+	CHECK_EQ(unchanged("ux0:one/mtime", "uma0:one/src", 0), 0);
+	// verify goes by the contents alone
+	CHECK_EQ(unchanged("ux0:one/mtime", "uma0:one/src", 1), 1);
+
+	// same size and time, other contents: only verify sees it
+	make("ux0:one/contents", FILE_SIZE, 2, 10);
+	CHECK_EQ(unchanged("ux0:one/contents", "uma0:one/src", 0), 1);
+	CHECK_EQ(unchanged("ux0:one/contents", "uma0:one/src", 1), 0);
+
+	// one byte off in the last of several blocks
+	make("ux0:one/tail", 3 * AIO_DEFAULT_BLOCK + 7, 1, 10);
+	make("uma0:one/tail", 3 * AIO_DEFAULT_BLOCK + 7, 1, 10);
+	CHECK_EQ(unchanged("ux0:one/tail", "uma0:one/tail", 1), 1);
+	SceUID fd = sceIoOpen("uma0:one/tail", SCE_O_WRONLY, 0);
+	CHECK(fd >= 0);
+	sceIoLseek(fd, -1, SCE_SEEK_END);
+	sceIoWrite(fd, "~", 1);
+	sceIoClose(fd);
+	set_mtime("uma0:one/tail", 10);
+	CHECK_EQ(unchanged("ux0:one/tail", "uma0:one/tail", 0), 1);
+	CHECK_EQ(unchanged("ux0:one/tail", "uma0:one/tail", 1), 0);
+}
+
+static void test_delta_tree(void) {
+	CopyDelta delta;
+	const char *dst = "ux0:tree";
+	int alive = 1;
+
+	test_mkdir("uma0:tree/sub");
+	make("uma0:tree/same", FILE_SIZE, 1, 10);
+	make("uma0:tree/size", FILE_SIZE, 2, 10);
+	make("uma0:tree/sub/mtime", FILE_SIZE, 3, 10);
+	make("uma0:tree/sub/contents", FILE_SIZE, 4, 10);
+	make("uma0:tree/new", FILE_SIZE, 5, 10);
+
+	test_mkdir("ux0:tree/sub");
+	make("ux0:tree/same", FILE_SIZE, 1, 10);
+	make("ux0:tree/size", FILE_SIZE - 1, 2, 10);
+	make("ux0:tree/sub/mtime", FILE_SIZE, 3, 30);
+	make("ux0:tree/sub/contents", FILE_SIZE, 40, 10);
+
+	memset(&delta, 0, sizeof(delta));
+	CHECK_EQ(copy_tree(&dst, &alive, 1, "uma0:tree", -1, NULL, WALK_ORDER_LARGE_FIRST, &delta), 0);
+	CHECK_EQ(delta.files_copied, 3);
+	CHECK_EQ(delta.files_avoided, 2);
+	CHECK_EQ(delta.bytes_copied, 3 * FILE_SIZE);
+	CHECK_EQ(delta.bytes_avoided, 2 * FILE_SIZE);
+	// by size and date the changed contents look the same
+	CHECK(!test_same_tree("uma0:tree", "ux0:tree"));
+
+	memset(&delta, 0, sizeof(delta));
+	delta.verify = 1;
+	CHECK_EQ(copy_tree(&dst, &alive, 1, "uma0:tree", -1, NULL, WALK_ORDER_LARGE_FIRST, &delta), 0);
+	CHECK_EQ(delta.files_copied, 1);
+	CHECK_EQ(delta.files_avoided, 4);
+	CHECK(test_same_tree("uma0:tree", "ux0:tree"));
+
+	// copies keep the times, a second run finds nothing to do
+	memset(&delta, 0, sizeof(delta));
+	CHECK_EQ(copy_tree(&dst, &alive, 1, "uma0:tree", -1, NULL, WALK_ORDER_LARGE_FIRST, &delta), 0);
+	CHECK_EQ(delta.files_copied, 0);
+	CHECK_EQ(delta.files_avoided, 5);
+}
+
+static void test_opens(void) {
+	ShimStats stats;
+
+	test_mkdir("ux0:opens");
+	test_write("ux0:opens/small", FILE_SIZE, 1);
+	test_write("ux0:opens/large", 8 * AIO_DEFAULT_BLOCK, 2);
+	test_mkdir("uma0:opens");
+
+	// one for the target, one for the single read
+	shim_reset_stats();
+	CHECK_EQ(copy_file("uma0:opens/small", "ux0:opens/small"), 0);
+	shim_get_stats(&stats);
+	CHECK_EQ(stats.opens, 2);
+
+	// one for the target, one per read in flight
+	shim_reset_stats();
+	CHECK_EQ(copy_file("uma0:opens/large", "ux0:opens/large"), 0);
+	shim_get_stats(&stats);
+	CHECK_EQ(stats.opens, 1 + AIO_DEFAULT_DEPTH);
+
+	CHECK(test_same_tree("ux0:opens", "uma0:opens"));
+	CHECK(copy_file("uma0:opens/missing", "ux0:opens/missing") < 0);
+}
+
+typedef struct {
+	int mode;
+	const char *name;
+	unsigned int interval;
+	unsigned int syncs; // per target
+} SyncCase;
+
+// none runs last, so every other mode starts from a clean device
+static const SyncCase sync_cases[] = {
+	{ USBMC_SYNC_STRICT, "strict", 0, SYNC_FILES },
+	{ USBMC_SYNC_FILES, "files", SYNC_EVERY_FILES, SYNC_FILES / SYNC_EVERY_FILES },
+	{ USBMC_SYNC_MB, "mb", SYNC_EVERY_MB, SYNC_FILES * SYNC_FILE_SIZE / (SYNC_EVERY_MB * 1024 * 1024) },
+	{ USBMC_SYNC_NONE, "none", 0, 0 },
+};
+
+#define SYNC_CASES (sizeof(sync_cases) / sizeof(*sync_cases))
+
+static void test_sync_modes(void) {
+	const char *dsts[] = { "uma0:sync", "grw0:sync" };
+	ShimStats stats[SYNC_CASES];
+	double seconds[SYNC_CASES];
+	char path[64];
+
+	test_mkdir("ux0:sync");
+	for (int i = 0; i < SYNC_FILES; i++) {
+		snprintf(path, sizeof(path), "ux0:sync/f%02d", i);
+		test_write(path, SYNC_FILE_SIZE, i);
+	}
+	test_mkdir("grw0:");
+
+	// a single target the plugin refused goes the same way
+	for (size_t c = 0; c < SYNC_CASES; c++) {
+		const SyncCase *sc = &sync_cases[c];
+		int alive = 1;
+
+		shim_set_sync_mode(sc->mode, sc->interval);
+		shim_reset_stats();
+		CHECK_EQ(copy_tree(dsts, &alive, 1, "ux0:sync", -1, NULL, WALK_ORDER_LARGE_FIRST, NULL), 0);
+		shim_get_stats(&stats[c]);
+		CHECK_EQ(stats[c].syncs, sc->syncs);
+		CHECK(test_same_tree("ux0:sync", dsts[0]));
+	}
+
+	shim_set_latency(SYNC_REQUEST_US);
+	shim_set_sync_latency(SYNC_LATENCY_US);
+	for (size_t c = 0; c < SYNC_CASES; c++) {
+		const SyncCase *sc = &sync_cases[c];
+		int alive[2] = { 1, 1 };
+		double start;
+
+		shim_set_sync_mode(sc->mode, sc->interval);
+		shim_reset_stats();
+		start = test_seconds();
+		CHECK_EQ(copy_tree(dsts, alive, 2, "ux0:sync", -1, NULL, WALK_ORDER_LARGE_FIRST, NULL), 0);
+		seconds[c] = test_seconds() - start;
+		shim_get_stats(&stats[c]);
+
+		CHECK_EQ(stats[c].syncs, 2 * sc->syncs);
+		CHECK(alive[0] && alive[1]);
+		CHECK(test_same_tree("ux0:sync", dsts[0]));
+		CHECK(test_same_tree("ux0:sync", dsts[1]));
+	}
+	shim_set_latency(0);
+	shim_set_sync_latency(0);
+	shim_set_sync_mode(USBMC_SYNC_DEFAULT, USBMC_SYNC_DEFAULT_INTERVAL);
+
+	printf("%d files of %d KiB fanned out to 2 targets, %d us per call, %d ms per sync\n", SYNC_FILES,
+	       SYNC_FILE_SIZE / 1024, SYNC_REQUEST_US, SYNC_LATENCY_US / 1000);
+	printf("%-8s %8s %8s %8s %8s %10s\n", "mode", "interval", "s", "MiB/s", "syncs", "vs none");
+	for (size_t c = 0; c < SYNC_CASES; c++) {
+		printf("%-8s %8u %8.3f %8.1f %8u %9.0f%%\n", sync_cases[c].name, sync_cases[c].interval, seconds[c],
+		       stats[c].bytes_written / seconds[c] / 1048576.0, stats[c].syncs,
+		       100.0 * (seconds[c] - seconds[SYNC_CASES - 1]) / seconds[SYNC_CASES - 1]);
+	}
+
+	// syncing every file costs the most
+	CHECK(seconds[0] > seconds[SYNC_CASES - 1]);
+}
+
+int main(void) {
+	test_root();
+	shim_set_verbose(0);
+
+	CHECK_EQ(pool_init(POOL_DEFAULT_CAP), 0);
+	CHECK_EQ(aio_init(AIO_DEFAULT_DEPTH, AIO_DEFAULT_BLOCK), 0);
+
+	test_unchanged();
+	test_delta_tree();
+	test_opens();
+	test_sync_modes();
+
+	aio_exit();
+	pool_exit();
+	return test_result();
+}
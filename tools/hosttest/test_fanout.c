@@ -0,0 +1,88 @@
+#include <string.h>
+
+#include <psp2/io/fcntl.h>
+
+#include "aio.h"
+#include "bufpool.h"
+#include "test.h"
+
+// Copies one file to one through AIO_MAX_TARGETS destinations, once fanned
+// out with a single read and once as separate copies, and reports what was
+// read from the source. Fanned out, the source reads stay at the size of
+// the file however many targets are added.
+
+#define FAN_SIZE (16 * 1024 * 1024)
+#define FAN_LATENCY_US 200
+
+static const char *targets[AIO_MAX_TARGETS] = { "uma0:dst", "grw0:dst", "imc0:dst", "xmc0:dst" };
+
+static void open_targets(SceUID *fds, int *alive, int count) {
+	for (int t = 0; t < count; t++) {
+		fds[t] = sceIoOpen(targets[t], SCE_O_WRONLY | SCE_O_CREAT | SCE_O_TRUNC, 0777);
+		CHECK(fds[t] >= 0);
+		alive[t] = 1;
+	}
+}
+
+static void close_targets(SceUID *fds, int count) {
+	for (int t = 0; t < count; t++) {
+		sceIoClose(fds[t]);
+		CHECK(test_same_tree("ux0:src", targets[t]));
+	}
+}
+
+int main(void) {
+	SceUID fds[AIO_MAX_TARGETS];
+	int alive[AIO_MAX_TARGETS];
+
+	test_root();
+	shim_set_verbose(0);
+	test_mkdir("ux0:");
+	for (int t = 0; t < AIO_MAX_TARGETS; t++) {
+		char dev[8];
+		snprintf(dev, sizeof(dev), "%.*s", (int)(strchr(targets[t], ':') - targets[t] + 1), targets[t]);
+		test_mkdir(dev);
+	}
+	test_write("ux0:src", FAN_SIZE, 1);
+
+	CHECK_EQ(pool_init(POOL_DEFAULT_CAP), 0);
+	CHECK_EQ(aio_init(AIO_DEFAULT_DEPTH, AIO_DEFAULT_BLOCK), 0);
+
+	shim_set_latency(FAN_LATENCY_US);
+	printf("%d MiB, %d us per call\n", FAN_SIZE >> 20, FAN_LATENCY_US);
+	printf("%7s %12s %12s %8s %13s %8s\n", "targets", "written MiB", "fan-out read", "s", "separate read", "s");
+	for (int count = 1; count <= AIO_MAX_TARGETS; count++) {
+		ShimStats fan, separate;
+		double start, fan_s, separate_s;
+
+		open_targets(fds, alive, count);
+		shim_reset_stats();
+		start = test_seconds();
+		CHECK_EQ(aio_copy_multi(fds, alive, count, "ux0:src", FAN_SIZE, NULL, NULL), 0);
+		fan_s = test_seconds() - start;
+		shim_get_stats(&fan);
+		close_targets(fds, count);
+
+		open_targets(fds, alive, count);
+		shim_reset_stats();
+		start = test_seconds();
+		for (int t = 0; t < count; t++)
+			CHECK_EQ(aio_copy(fds[t], "ux0:src", FAN_SIZE, NULL, NULL), 0);
+		separate_s = test_seconds() - start;
+		shim_get_stats(&separate);
+		close_targets(fds, count);
+
+		printf("%7d %12.0f %12.0f %8.3f %13.0f %8.3f\n", count, fan.bytes_written / 1048576.0,
+		       fan.bytes_read / 1048576.0, fan_s, separate.bytes_read / 1048576.0, separate_s);
+
+		// the source is read once however many targets there are
+		CHECK_EQ(fan.bytes_read, FAN_SIZE);
+		CHECK_EQ(fan.bytes_written, (uint64_t)count * FAN_SIZE);
+		CHECK_EQ(separate.bytes_read, (uint64_t)count * FAN_SIZE);
+	}
+	shim_set_latency(0);
+
+	aio_exit();
+	pool_exit();
+	return test_result();
+}
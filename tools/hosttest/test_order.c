@@ -0,0 +1,209 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <psp2/io/stat.h>
+
+#include "aio.h"
+#include "bufpool.h"
+#include "copy.h"
+#include "test.h"
+#include "walker.h"
+
+// Checks the visiting orders of the walker and that no directory handle is
+// open while an entry is visited, then copies the same directory with each
+// order through the installer's copy_tree() on a device with a fixed cost
+// per call and compares how soon half of the files and half of the bytes
+// are done.
+
+#define ORDER_FILES 12
+#define BENCH_SMALL 180
+#define BENCH_LARGE 20
+#define BENCH_SMALL_SIZE (4 * 1024)
+#define BENCH_LARGE_SIZE (2 * 1024 * 1024)
+#define BENCH_LATENCY_US 100
+
+static const char *order_names[] = { "dirent", "large first", "small first" };
+
+typedef struct {
+	char name[32];
+	int is_dir;
+	SceOff size;
+} Visit;
+
+typedef struct {
+	Visit visits[ORDER_FILES + 4];
+	int count;
+	int open_dirs;
+	size_t root_len;
+} OrderWalk;
+
+static void visit(OrderWalk *w, const char *path, const char *name, const SceIoStat *stat) {
+	ShimStats stats;
+
+	shim_get_stats(&stats);
+	if (stats.dirs != 0)
+		w->open_dirs++;
+	// only the entries of the root are recorded
+	if (strchr(path + w->root_len + 1, '/') != NULL)
+		return;
+	Visit *v = &w->visits[w->count++];
+	snprintf(v->name, sizeof(v->name), "%s", name);
+	v->is_dir = SCE_S_ISDIR(stat->st_mode) != 0;
+	v->size = stat->st_size;
+}
+
+static int order_enter(void *arg, const char *path, const char *name, const SceIoStat *stat, void *parent, void *frame) {
+	visit(arg, path, name, stat);
+	return WALK_CONTINUE;
+}
+
+static int order_file(void *arg, const char *path, const char *name, const SceIoStat *stat, void *parent) {
+	visit(arg, path, name, stat);
+	return WALK_CONTINUE;
+}
+
+static const WalkOps order_ops = {
+	0,
+	order_enter,
+	order_file,
+	NULL,
+};
+
+// where an entry was in dirent order
+static int dirent_index(const OrderWalk *dirent, const char *name) {
+	for (int i = 0; i < dirent->count; i++) {
+		if (strcmp(dirent->visits[i].name, name) == 0)
+			return i;
+	}
+	return -1;
+}
+
+static void test_orders(void) {
+	static const int sizes[ORDER_FILES] = { 300, 10, 2000, 10, 50, 0, 300, 7000, 1, 10, 2000, 64 };
+	OrderWalk walks[3];
+	char path[64];
+
+	test_mkdir("ux0:order");
+	for (int i = 0; i < ORDER_FILES; i++) {
+		snprintf(path, sizeof(path), "ux0:order/f%02d", i);
+		test_write(path, sizes[i], i);
+	}
+	for (int i = 0; i < 3; i++) {
+		snprintf(path, sizeof(path), "ux0:order/sub%d/x", i);
+		test_mkdir(path);
+	}
+	test_write("ux0:order/sub0/x/y", 100, 1);
+
+	for (int order = WALK_ORDER_DIRENT; order <= WALK_ORDER_SMALL_FIRST; order++) {
+		OrderWalk *w = &walks[order];
+
+		memset(w, 0, sizeof(*w));
+		w->root_len = strlen("ux0:order");
+		CHECK_EQ(walk_tree("ux0:order", order, &order_ops, w, NULL), 0);
+		CHECK_EQ(w->count, ORDER_FILES + 3);
+		// every directory is listed and closed before its entries are visited
+		CHECK_EQ(w->open_dirs, 0);
+	}
+
+	for (int order = WALK_ORDER_LARGE_FIRST; order <= WALK_ORDER_SMALL_FIRST; order++) {
+		const OrderWalk *w = &walks[order];
+
+		for (int i = 1; i < w->count; i++) {
+			const Visit *a = &w->visits[i - 1], *b = &w->visits[i];
+			int stable = dirent_index(&walks[0], a->name) < dirent_index(&walks[0], b->name);
+
+			// files first, then subdirectories in dirent order
+			CHECK(a->is_dir <= b->is_dir);
+			if (a->is_dir && b->is_dir)
+				CHECK(stable);
+			if (a->is_dir || b->is_dir)
+				continue;
+			if (order == WALK_ORDER_LARGE_FIRST)
+				CHECK(a->size >= b->size);
+			else
+				CHECK(a->size <= b->size);
+			// equal sizes keep their dirent order
+			if (a->size == b->size)
+				CHECK(stable);
+		}
+	}
+}
+
+typedef struct {
+	double start;
+	unsigned int files;
+	uint64_t bytes;
+	double half_files;
+	double half_bytes;
+} CopyProgress;
+
+// a file is done once all of it is written
+static void on_progress(void *arg, SceOff done, SceOff size) {
+	CopyProgress *p = arg;
+
+	if (done == 0 || done != size)
+		return;
+	p->files++;
+	p->bytes += size;
+	if (p->files == (BENCH_SMALL + BENCH_LARGE) / 2)
+		p->half_files = test_seconds() - p->start;
+	if (p->half_bytes == 0 && p->bytes * 2 >= (uint64_t)BENCH_SMALL * BENCH_SMALL_SIZE + (uint64_t)BENCH_LARGE * BENCH_LARGE_SIZE)
+		p->half_bytes = test_seconds() - p->start;
+}
+
+static void bench(void) {
+	double half_files[3];
+	char path[64];
+
+	// every tenth file is a large one
+	test_mkdir("ux0:bench");
+	for (int i = 0; i < BENCH_SMALL + BENCH_LARGE; i++) {
+		int large = (i % ((BENCH_SMALL + BENCH_LARGE) / BENCH_LARGE)) == 0;
+		snprintf(path, sizeof(path), "ux0:bench/f%03d", i);
+		test_write(path, large ? BENCH_LARGE_SIZE : BENCH_SMALL_SIZE, i);
+	}
+	test_mkdir("uma0:");
+
+	shim_set_latency(BENCH_LATENCY_US);
+	printf("%d files of %d KiB and %d of %d KiB, %d us per call\n",
+	       BENCH_SMALL, BENCH_SMALL_SIZE / 1024, BENCH_LARGE, BENCH_LARGE_SIZE / 1024, BENCH_LATENCY_US);
+	printf("%-12s %8s %10s %10s\n", "order", "total s", "half files", "half bytes");
+	for (int order = WALK_ORDER_DIRENT; order <= WALK_ORDER_SMALL_FIRST; order++) {
+		CopyProgress p;
+		char dst[64];
+		const char *dsts[] = { dst };
+		int alive = 1;
+
+		memset(&p, 0, sizeof(p));
+		snprintf(dst, sizeof(dst), "uma0:bench%d", order);
+		copy_set_progress(on_progress, &p);
+		p.start = test_seconds();
+		CHECK_EQ(copy_tree(dsts, &alive, 1, "ux0:bench", -1, NULL, order, NULL), 0);
+		printf("%-12s %8.3f %10.3f %10.3f\n", order_names[order], test_seconds() - p.start, p.half_files, p.half_bytes);
+
+		CHECK_EQ(p.files, BENCH_SMALL + BENCH_LARGE);
+		CHECK(test_same_tree("ux0:bench", dst));
+		half_files[order] = p.half_files;
+	}
+	copy_set_progress(NULL, NULL);
+	shim_set_latency(0);
+
+	// small files first shows progress on the file count sooner
+	CHECK(half_files[WALK_ORDER_SMALL_FIRST] < half_files[WALK_ORDER_LARGE_FIRST]);
+}
+
+int main(void) {
+	test_root();
+	shim_set_verbose(0);
+
+	CHECK_EQ(pool_init(POOL_DEFAULT_CAP), 0);
+	CHECK_EQ(aio_init(AIO_DEFAULT_DEPTH, AIO_DEFAULT_BLOCK), 0);
+
+	test_orders();
+	bench();
+
+	aio_exit();
+	pool_exit();
+
+	return test_result();
+}
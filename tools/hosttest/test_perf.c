@@ -0,0 +1,101 @@
+#include <unistd.h>
+
+#include "perf.h"
+#include "test.h"
+
+// The migration profile against the shim's power service: begin raises the
+// clocks and starts ticking, end puts the clocks back and leaves no thread
+// or semaphore behind, repeated calls do nothing, and a begin that fails
+// half way leaves nothing changed.
+
+static void check_clocks(int arm, int bus, int gpu_xbar) {
+	int a, b, g;
+
+	shim_get_clocks(&a, &b, &g);
+	CHECK_EQ(a, arm);
+	CHECK_EQ(b, bus);
+	CHECK_EQ(g, gpu_xbar);
+}
+
+static void check_objects(int threads, int semas) {
+	ShimStats stats;
+
+	shim_get_stats(&stats);
+	CHECK_EQ(stats.threads, threads);
+	CHECK_EQ(stats.semas, semas);
+}
+
+static void test_begin_end(void) {
+	ShimStats stats;
+	double start;
+
+	shim_set_clocks(333, 111, 111);
+	shim_reset_stats();
+	CHECK_EQ(perf_begin(), 0);
+	check_clocks(PERF_ARM_CLOCK, PERF_BUS_CLOCK, PERF_GPU_XBAR_CLOCK);
+	check_objects(1, 1);
+
+	// a second begin neither starts another thread nor saves the fast clocks
+	CHECK_EQ(perf_begin(), 0);
+	check_objects(1, 1);
+
+	// the thread ticks right away, not only after the first interval
+	usleep(100 * 1000);
+	shim_get_stats(&stats);
+	CHECK(stats.power_ticks >= 2);
+
+	// end wakes the thread instead of waiting out its interval
+	start = test_seconds();
+	perf_end();
+	CHECK(test_seconds() - start < PERF_TICK_INTERVAL / 2 / 1e6);
+	check_clocks(333, 111, 111);
+	check_objects(0, 0);
+
+	// nothing is put back a second time
+	shim_set_clocks(100, 100, 100);
+	perf_end();
+	check_clocks(100, 100, 100);
+}
+
+static void test_failures_restore(void) {
+	static const int what[] = { SHIM_FAIL_CREATE_SEMA, SHIM_FAIL_CREATE_THREAD, SHIM_FAIL_START_THREAD };
+
+	for (size_t i = 0; i < sizeof(what)/sizeof(*what); i++) {
+		shim_set_clocks(333, 111, 111);
+		shim_fail(what[i], 1);
+		CHECK(perf_begin() < 0);
+		check_clocks(333, 111, 111);
+		check_objects(0, 0);
+
+		// no profile is active, end has nothing to put back
+		shim_set_clocks(100, 100, 100);
+		perf_end();
+		check_clocks(100, 100, 100);
+
+		// and the next begin tries again
+		CHECK_EQ(perf_begin(), 0);
+		check_objects(1, 1);
+		perf_end();
+		check_clocks(100, 100, 100);
+		check_objects(0, 0);
+	}
+
+	// a clock that can't be changed is not fatal
+	shim_set_clocks(333, 111, 111);
+	shim_fail(SHIM_FAIL_SET_CLOCK, 1);
+	CHECK_EQ(perf_begin(), 0);
+	check_clocks(333, PERF_BUS_CLOCK, PERF_GPU_XBAR_CLOCK);
+	perf_end();
+	check_clocks(333, 111, 111);
+	check_objects(0, 0);
+}
+
+int main(void) {
+	test_root();
+	shim_set_verbose(0);
+
+	test_begin_end();
+	test_failures_restore();
+
+	return test_result();
+}
@@ -0,0 +1,169 @@
+#include <string.h>
+
+#include "planner.h"
+#include "rules.h"
+#include "test.h"
+
+// The footprint math of plan_tree() on a small tree worked out by hand:
+// files round up to whole clusters and empty ones take none, every
+// directory takes at least a cluster for its entries, and an entry costs
+// the worse of its exFAT and FAT32 size. Then the time a plan of a ux0
+// tree of 100k files takes, with and without rules.
+
+#define NAME_13 "file_00000000"
+
+#define BENCH_TITLES 100
+#define BENCH_DIRS 10
+#define BENCH_FILES 100 // per directory
+#define BENCH_PATHS (BENCH_TITLES * BENCH_DIRS * BENCH_FILES)
+
+static void write_tree(void) {
+	char path[512], name[256];
+
+	test_mkdir("ux0:plan/tai");
+	test_mkdir("ux0:plan/app/PCSE00000");
+	test_mkdir("ux0:plan/empty");
+	test_mkdir("ux0:plan/many");
+	test_mkdir("ux0:plan/short");
+	test_mkdir("ux0:plan/long");
+
+	test_write("ux0:plan/id.dat", 512, 1);
+	test_write("ux0:plan/tai/config.txt", 120, 2);
+	test_write("ux0:plan/app/PCSE00000/eboot.bin", 0, 3);
+	test_write("ux0:plan/app/PCSE00000/big.bin", 4097, 4);
+	for (int i = 0; i < 200; i++) {
+		snprintf(path, sizeof(path), "ux0:plan/many/f%03d", i);
+		test_write(path, 1, i);
+	}
+	// 13 characters: 3 exFAT entries against 2 FAT32 ones
+	for (int i = 0; i < 6; i++) {
+		snprintf(path, sizeof(path), "ux0:plan/short/" NAME_13);
+		path[strlen(path) - 1] += i;
+		test_write(path, 1, i);
+	}
+	// 200 characters: 16 exFAT entries against 17 FAT32 ones
+	memset(name, 'x', 200);
+	name[200] = '\0';
+	snprintf(path, sizeof(path), "ux0:plan/long/%s", name);
+	test_write(path, 1, 5);
+}
+
+static void check_tier(const PlanTier *t, unsigned int files, unsigned int dirs, uint64_t bytes, uint64_t footprint) {
+	CHECK_EQ(t->files, files);
+	CHECK_EQ(t->dirs, dirs);
+	CHECK_EQ(t->bytes, bytes);
+	CHECK_EQ(t->footprint, footprint);
+}
+
+static void test_clusters(void) {
+	Plan plan;
+
+	CHECK_EQ(plan_tree("ux0:plan", NULL, 4096, &plan), 0);
+	CHECK_EQ(plan.cluster, 4096);
+	// id.dat and tai/config.txt a cluster each, tai/ holds one entry
+	check_tier(&plan.tiers[TIER_CONFIG], 2, 1, 632, 3 * 4096);
+	// eboot.bin is empty, big.bin is a byte over one cluster, app/ and
+	// app/PCSE00000/ one cluster each
+	check_tier(&plan.tiers[TIER_APPS], 2, 2, 4097, 2 * 4096 + 2 * 4096);
+	// empty/ a cluster, many/ 200 entries of 96 bytes in 5 clusters plus a
+	// cluster per file, short/ and long/ a cluster each plus their files
+	check_tier(&plan.tiers[TIER_BULK], 200 + 6 + 1, 4, 207,
+	           4096 + (5 + 200) * 4096 + (1 + 6) * 4096 + (1 + 1) * 4096);
+	CHECK_EQ(plan.total.files, 2 + 2 + 207);
+	CHECK_EQ(plan.total.dirs, 1 + 2 + 4);
+	CHECK_EQ(plan.total.footprint, plan.tiers[TIER_CONFIG].footprint + plan.tiers[TIER_APPS].footprint + plan.tiers[TIER_BULK].footprint);
+
+	// bigger clusters only cost more, 0 picks the default of 32 KiB
+	CHECK_EQ(plan_tree("ux0:plan", NULL, 0, &plan), 0);
+	CHECK_EQ(plan.cluster, 32 * 1024);
+	check_tier(&plan.tiers[TIER_APPS], 2, 2, 4097, 3 * 32 * 1024);
+	check_tier(&plan.tiers[TIER_BULK], 207, 4, 207, (4 + 207) * 32 * 1024);
+}
+
+// a tree cut down by rules to one directory and what it holds
+static void plan_one(const char *dir, unsigned int cluster, Plan *plan) {
+	Rules *rules = rules_create();
+
+	CHECK_EQ(rules_add(rules, RULE_INCLUDE, dir, 0), 0);
+	CHECK_EQ(plan_tree("ux0:plan", rules, cluster, plan), 0);
+	rules_free(rules);
+}
+
+static void test_entries(void) {
+	Plan plan;
+
+	// six exFAT entry sets of 96 bytes overflow a 512 byte cluster, their
+	// FAT32 ones of 64 bytes would not
+	plan_one("short", 512, &plan);
+	check_tier(&plan.total, 6, 1, 6, 2 * 512 + 6 * 512);
+
+	// 17 FAT32 entries of 32 bytes overflow it, 16 exFAT ones would not
+	plan_one("long", 512, &plan);
+	check_tier(&plan.total, 1, 1, 1, 2 * 512 + 512);
+
+	// 200 names of 4 characters take 3 entries each
+	plan_one("many", 512, &plan);
+	check_tier(&plan.total, 200, 1, 200, (200 * 96 + 511) / 512 * 512 + 200 * 512);
+
+	plan_one("empty", 512, &plan);
+	check_tier(&plan.total, 0, 1, 0, 512);
+}
+
+static void bench(void) {
+	char path[128];
+	ShimStats stats;
+	Rules *rules;
+	Plan plan;
+	double start, seconds;
+
+	for (int t = 0; t < BENCH_TITLES; t++) {
+		for (int d = 0; d < BENCH_DIRS; d++) {
+			snprintf(path, sizeof(path), "ux0:bench/%s/PCSE%05d/dir%d", (t % 2) ? "app" : "video", t, d);
+			test_mkdir(path);
+			for (int f = 0; f < BENCH_FILES; f++) {
+				snprintf(path, sizeof(path), "ux0:bench/%s/PCSE%05d/dir%d/file%03d.bin", (t % 2) ? "app" : "video", t, d, f);
+				test_write(path, f, f);
+			}
+		}
+	}
+
+	shim_reset_stats();
+	start = test_seconds();
+	CHECK_EQ(plan_tree("ux0:bench", NULL, 0, &plan), 0);
+	seconds = test_seconds() - start;
+	shim_get_stats(&stats);
+	printf("%d files in %.3f s, %.0f ns per file, %u listings\n",
+	       BENCH_PATHS, seconds, seconds * 1e9 / BENCH_PATHS, stats.dopens);
+	CHECK_EQ(plan.total.files, BENCH_PATHS);
+	CHECK_EQ(plan.total.dirs, 2 + BENCH_TITLES * (1 + BENCH_DIRS));
+	CHECK_EQ(plan.tiers[TIER_APPS].files, BENCH_PATHS / 2);
+	CHECK_EQ(plan.tiers[TIER_BULK].files, BENCH_PATHS / 2);
+	// opens no file, lists every directory once
+	CHECK_EQ(stats.opens, 0);
+	CHECK_EQ(stats.dopens, 1 + plan.total.dirs);
+
+	rules = rules_create();
+	CHECK_EQ(rules_add(rules, RULE_EXCLUDE, "video", 0), 0);
+	start = test_seconds();
+	CHECK_EQ(plan_tree("ux0:bench", rules, 0, &plan), 0);
+	seconds = test_seconds() - start;
+	rules_free(rules);
+	printf("with rules %.3f s, %u files planned\n", seconds, plan.total.files);
+	CHECK_EQ(plan.total.files, BENCH_PATHS / 2);
+}
+
+int main(void) {
+	Plan plan;
+
+	test_root();
+	shim_set_verbose(0);
+
+	write_tree();
+	test_clusters();
+	test_entries();
+	bench();
+
+	CHECK(plan_tree("ux0:missing", NULL, 4096, &plan) < 0);
+
+	return test_result();
+}
@@ -0,0 +1,245 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "rules.h"
+#include "test.h"
+
+// Matches paths against compiled rules the way the walkers do, one
+// component at a time, then times it on 100k generated paths.
+
+#define BENCH_PATHS 100000
+
+// what a walk decides for rel, directories on the way included
+static int decide(const Rules *rules, const char *rel, int is_dir, uint64_t size) {
+	RulesState states[2];
+	char name[256];
+	int cur = 0, ret = RULES_COPY;
+
+	rules_root(rules, &states[0]);
+	while (*rel) {
+		const char *end = strchr(rel, '/');
+		size_t len = end ? (size_t)(end - rel) : strlen(rel);
+		int last = (end == NULL);
+
+		memcpy(name, rel, len);
+		name[len] = '\0';
+		ret = rules_step(rules, &states[cur], name, last ? is_dir : 1, last ? size : 0, &states[cur ^ 1]);
+		cur ^= 1;
+		// the walk never opens a skipped directory
+		if (!last && (ret == RULES_SKIP || ret == RULES_ERROR))
+			return ret;
+		rel += len + !last;
+	}
+	return ret;
+}
+
+typedef struct {
+	const char *rel;
+	int is_dir;
+	uint64_t size;
+	int expect;
+} Case;
+
+static void check_cases(const Rules *rules, const Case *cases, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		int ret = decide(rules, cases[i].rel, cases[i].is_dir, cases[i].size);
+		if (ret != cases[i].expect) {
+			fprintf(stderr, "\"%s\": %d, expected %d\n", cases[i].rel, ret, cases[i].expect);
+			test_failures++;
+		}
+	}
+}
+
+static void test_matching(void) {
+	static const Case cases[] = {
+		{ "data",                   1, 0,       RULES_DESCEND },
+		{ "data/myhomebrew",        1, 0,       RULES_COPY },
+		{ "DATA/MyHomebrew/x.bin",  0, 10,      RULES_COPY },
+		{ "data/other",             1, 0,       RULES_SKIP },
+		{ "data/other.txt",         0, 10,      RULES_SKIP },
+		{ "app",                    1, 0,       RULES_DESCEND },
+		{ "app/PCSE00000",          1, 0,       RULES_COPY },
+		{ "app/PCSE00001",          1, 0,       RULES_SKIP },
+		{ "user/00/savedata/PCSE00000/sdslot.dat", 0, 100, RULES_COPY },
+		{ "license/addcont/PCSE00000/x.rif", 0, 100, RULES_COPY },
+		{ "music",                  1, 0,       RULES_SKIP },
+		// '?' is one character, '*' any run within a name
+		{ "pspemu/ISO/game1.iso",   0, 1,       RULES_COPY },
+		{ "pspemu/ISO/game12.iso",  0, 1,       RULES_SKIP },
+		{ "pspemu/ISO/save.bin",    0, 1,       RULES_SKIP },
+		{ "pspemu/SAVEDATA/ULUS1",  1, 0,       RULES_COPY },
+		// "**" matches zero or more components, exclude beats include
+		{ "data/myhomebrew/temp",   1, 0,       RULES_SKIP },
+		{ "data/myhomebrew/a/b/temp", 1, 0,     RULES_SKIP },
+		{ "data/myhomebrew/tempo",  1, 0,       RULES_COPY },
+		// size limits only apply to files
+		{ "data/myhomebrew/big.bin", 0, 2048,   RULES_SKIP },
+		{ "data/myhomebrew/small.bin", 0, 1023, RULES_COPY },
+		// the deepest match decides
+		{ "data/myhomebrew/keep",   1, 0,       RULES_COPY },
+		{ "data/myhomebrew/logs",   1, 0,       RULES_SKIP },
+		{ "data/myhomebrew/logs/x", 0, 1,       RULES_SKIP },
+	};
+	Rules *rules = rules_create();
+
+	CHECK(rules != NULL);
+	CHECK_EQ(rules_add(rules, RULE_INCLUDE, "data/myhomebrew", 0), 0);
+	CHECK_EQ(rules_add_title(rules, "PCSE00000"), 0);
+	CHECK_EQ(rules_add(rules, RULE_INCLUDE, "pspemu/ISO/game?.iso", 0), 0);
+	CHECK_EQ(rules_add(rules, RULE_INCLUDE, "pspemu/SAVEDATA/*", 0), 0);
+	CHECK_EQ(rules_add(rules, RULE_EXCLUDE, "**/temp", 0), 0);
+	CHECK_EQ(rules_add(rules, RULE_EXCLUDE, "data/myhomebrew/*.bin", 1024), 0);
+	CHECK_EQ(rules_add(rules, RULE_EXCLUDE, "data/myhomebrew/logs", 0), 0);
+	CHECK(rules_has_includes(rules));
+	// nothing but separators is not a rule
+	CHECK(rules_add(rules, RULE_INCLUDE, "/", 0) < 0);
+
+	check_cases(rules, cases, sizeof(cases)/sizeof(*cases));
+	rules_free(rules);
+}
+
+static void test_excludes_only(void) {
+	static const Case cases[] = {
+		{ "app/PCSE00000/eboot.bin", 0, 100,    RULES_COPY },
+		{ "video",                  1, 0,       RULES_COPY },
+		{ "video/a.mp4",            0, 1 << 30, RULES_SKIP },
+		{ "video/b.mp4",            0, 100,     RULES_COPY },
+		{ "video/sub/c.mp4",        0, 2u << 30, RULES_SKIP },
+		{ "cache",                  1, 0,       RULES_SKIP },
+		{ "cache/x",                0, 1,       RULES_SKIP },
+	};
+	Rules *rules = rules_create();
+
+	// without an include rule everything not excluded is copied
+	CHECK_EQ(rules_add(rules, RULE_EXCLUDE, "video/**", 1 << 30), 0);
+	CHECK_EQ(rules_add(rules, RULE_EXCLUDE, "cache", 0), 0);
+	CHECK(!rules_has_includes(rules));
+	check_cases(rules, cases, sizeof(cases)/sizeof(*cases));
+	rules_free(rules);
+}
+
+static void test_overflow(void) {
+	Rules *rules = rules_create();
+	char pattern[64];
+
+	// every one of these is a glob of its own that matches "dx"
+	for (int i = 0; i < RULES_MAX_ACTIVE + 1; i++) {
+		memset(pattern, '*', i + 1);
+		strcpy(pattern + i + 1, "/keep");
+		CHECK_EQ(rules_add(rules, RULE_INCLUDE, pattern, 0), 0);
+	}
+	CHECK_EQ(decide(rules, "dx/keep", 0, 1), RULES_ERROR);
+	rules_free(rules);
+
+	rules = rules_create();
+	for (int i = 0; i < RULES_MAX_ACTIVE - 1; i++) {
+		memset(pattern, '*', i + 1);
+		strcpy(pattern + i + 1, "/keep");
+		CHECK_EQ(rules_add(rules, RULE_INCLUDE, pattern, 0), 0);
+	}
+	CHECK_EQ(decide(rules, "dx/keep", 0, 1), RULES_COPY);
+	rules_free(rules);
+}
+
+static void write_rules(const char *path, const char *text) {
+	char host[1024];
+	FILE *f = fopen(shim_path(path, host, sizeof(host)), "wb");
+
+	fputs(text, f);
+	fclose(f);
+}
+
+static void test_load(void) {
+	Rules *rules;
+
+	test_mkdir("ur0:tai");
+
+	write_rules("ur0:tai/good.txt",
+	            "# comment\r\n"
+	            "\r\n"
+	            "  title PCSE00000\r\n"
+	            "include data/myhomebrew\r\n"
+	            "exclude **/temp\r\n"
+	            "exclude video/** >1G\r\n"
+	            "exclude data/myhomebrew/*.bin >64k\n");
+	CHECK((rules = rules_load("ur0:tai/good.txt")) != NULL);
+	if (rules) {
+		CHECK_EQ(decide(rules, "app/PCSE00000/eboot.bin", 0, 1), RULES_COPY);
+		CHECK_EQ(decide(rules, "data/myhomebrew/a.bin", 0, 64 * 1024), RULES_SKIP);
+		CHECK_EQ(decide(rules, "data/myhomebrew/a.bin", 0, 64 * 1024 - 1), RULES_COPY);
+		rules_free(rules);
+	}
+
+	// one bad line fails the whole file
+	static const char *bad[] = {
+		"include\n",
+		"inclde data\n",
+		"include data >1K\n",
+		"exclude data 1K\n",
+		"exclude data >1Q\n",
+		"exclude data >K\n",
+		"exclude data >1K extra\n",
+		"title\n",
+		"title PCSE00000 PCSE00001\n",
+		"include /\n",
+	};
+	for (size_t i = 0; i < sizeof(bad)/sizeof(*bad); i++) {
+		char text[128];
+		snprintf(text, sizeof(text), "include data/ok\n%s", bad[i]);
+		write_rules("ur0:tai/bad.txt", text);
+		rules = rules_load("ur0:tai/bad.txt");
+		if (rules != NULL) {
+			fprintf(stderr, "accepted: %s", bad[i]);
+			test_failures++;
+			rules_free(rules);
+		}
+	}
+
+	CHECK(rules_load("ur0:tai/missing.txt") == NULL);
+}
+
+static void bench(void) {
+	static const char *top[] = { "app", "patch", "addcont", "data", "video", "music", "user", "license", "appmeta", "temp" };
+	Rules *rules = rules_create();
+	char pattern[64], path[128];
+	unsigned int copied = 0, seed = 1;
+	double start, seconds;
+
+	// a rules file of realistic size: some titles, globs and excludes
+	for (int i = 0; i < 40; i++) {
+		snprintf(pattern, sizeof(pattern), "PCSE%05d", i * 7);
+		rules_add_title(rules, pattern);
+	}
+	rules_add(rules, RULE_INCLUDE, "data/homebrew*", 0);
+	rules_add(rules, RULE_INCLUDE, "video/**/*.mp4", 0);
+	rules_add(rules, RULE_EXCLUDE, "**/temp", 0);
+	rules_add(rules, RULE_EXCLUDE, "**/*.log", 0);
+	rules_add(rules, RULE_EXCLUDE, "video/**", 1 << 30);
+
+	start = test_seconds();
+	for (int i = 0; i < BENCH_PATHS; i++) {
+		seed = seed * 1103515245 + 12345;
+		snprintf(path, sizeof(path), "%s/PCSE%05u/sce_sys/dir%u/file%u.%s",
+		         top[(seed >> 8) % 10], (seed >> 12) % 300, (seed >> 4) % 8, i, (seed & 1) ? "bin" : "log");
+		if (decide(rules, path, 0, seed % 100000) == RULES_COPY)
+			copied++;
+	}
+	seconds = test_seconds() - start;
+	rules_free(rules);
+
+	printf("%d paths in %.3f s, %.0f ns per path, %u copied\n",
+	       BENCH_PATHS, seconds, seconds * 1e9 / BENCH_PATHS, copied);
+	CHECK(copied > 0 && copied < BENCH_PATHS);
+}
+
+int main(void) {
+	test_root();
+
+	test_matching();
+	test_excludes_only();
+	test_overflow();
+	test_load();
+	bench();
+
+	return test_result();
+}
@@ -0,0 +1,165 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "aio.h"
+#include "bufpool.h"
+#include "copy.h"
+#include "test.h"
+#include "tiers.h"
+#include "walker.h"
+
+// Tier classification on single paths, then on a synthetic ux0 layout: a
+// walk that prunes with tier_may_contain() the way copy_tree() does must
+// still reach every file of the tier it copies. copy_by_priority() walks
+// once per tier, which must cost no more than listing the root again for
+// every tier after the first: each subtree belongs to a single tier.
+
+typedef struct {
+	const char *rel;
+	int tier;
+} Case;
+
+static const Case cases[] = {
+	{ "tai/config.txt",                  TIER_CONFIG },
+	{ "id.dat",                          TIER_CONFIG },
+	{ "license/app/PCSE00000/6488b7.rif", TIER_LICENSE },
+	{ "appmeta/PCSE00000/icon0.png",     TIER_APPMETA },
+	{ "user/00/savedata/PCSE00000/sdslot.dat", TIER_SAVES },
+	{ "app/PCSE00000/eboot.bin",         TIER_APPS },
+	{ "APP/pcse00000/EBOOT.BIN",         TIER_APPS },
+	{ "patch/PCSE00000/eboot.bin",       TIER_APPS },
+	{ "pspemu/ISO/game.iso",             TIER_APPS },
+	{ "video/clip.mp4",                  TIER_BULK },
+	{ "temp/x",                          TIER_CACHE },
+	{ "mms/db",                          TIER_CACHE },
+	// prefixes only match whole components
+	{ "application/x",                   TIER_BULK },
+	{ "tai2/config.txt",                 TIER_BULK },
+	{ "id.dat.bak",                      TIER_BULK },
+	{ "",                                TIER_BULK },
+};
+
+// directories and files of the layout, files end in a size
+static const char *layout[] = {
+	"tai/", "tai/config.txt:120",
+	"id.dat:512",
+	"license/", "license/app/", "license/app/PCSE00000/", "license/app/PCSE00000/a.rif:512",
+	"appmeta/", "appmeta/PCSE00000/", "appmeta/PCSE00000/icon0.png:4000",
+	"user/", "user/00/", "user/00/savedata/", "user/00/savedata/PCSE00000/", "user/00/savedata/PCSE00000/sdslot.dat:7000",
+	"app/", "app/PCSE00000/", "app/PCSE00000/eboot.bin:90000", "app/PCSE00000/sce_sys/", "app/PCSE00000/sce_sys/param.sfo:2000",
+	"patch/", "patch/PCSE00000/", "patch/PCSE00000/eboot.bin:80000",
+	"data/", "data/homebrew/", "data/homebrew/a.bin:100",
+	"video/", "video/clip.mp4:300000",
+	"picture/", "picture/SCREENSHOT/", "picture/SCREENSHOT/a.jpg:1000",
+	"temp/", "temp/x:10",
+	"misc/", "misc/notes.txt:10",
+};
+
+typedef struct {
+	int tier;
+	size_t root_len;
+	unsigned int files[TIER_COUNT];
+	unsigned int skipped;
+} WalkCount;
+
+static const char *rel(const WalkCount *c, const char *path) {
+	path += c->root_len;
+	return (*path == '/') ? path + 1 : path;
+}
+
+static int count_enter(void *arg, const char *path, const char *name, const SceIoStat *stat, void *parent, void *frame) {
+	WalkCount *c = arg;
+
+	if (c->tier >= 0 && !tier_may_contain(rel(c, path), c->tier)) {
+		c->skipped++;
+		return WALK_SKIP;
+	}
+	return WALK_CONTINUE;
+}
+
+static int count_file(void *arg, const char *path, const char *name, const SceIoStat *stat, void *parent) {
+	WalkCount *c = arg;
+
+	c->files[tier_classify(rel(c, path))]++;
+	return WALK_CONTINUE;
+}
+
+static const WalkOps count_ops = {
+	0,
+	count_enter,
+	count_file,
+	NULL,
+};
+
+int main(void) {
+	const char *dst = "uma0:tiers";
+	ShimStats walk, copy;
+	WalkCount all, one;
+	char path[256];
+
+	test_root();
+	shim_set_verbose(0);
+
+	for (size_t i = 0; i < sizeof(cases)/sizeof(*cases); i++) {
+		int tier = tier_classify(cases[i].rel);
+		if (tier != cases[i].tier) {
+			fprintf(stderr, "\"%s\": tier %d, expected %d\n", cases[i].rel, tier, cases[i].tier);
+			test_failures++;
+		}
+	}
+	CHECK(tier_may_contain("", TIER_SAVES));
+	CHECK(tier_may_contain("user", TIER_SAVES));
+	CHECK(!tier_may_contain("user", TIER_APPS));
+	CHECK(!tier_may_contain("app", TIER_SAVES));
+	CHECK(tier_may_contain("misc", TIER_BULK));
+	CHECK(strcmp(tier_name(TIER_COUNT), "unknown") == 0);
+
+	test_mkdir("ux0:");
+	for (size_t i = 0; i < sizeof(layout)/sizeof(*layout); i++) {
+		const char *colon = strrchr(layout[i], ':');
+		if (colon == NULL) {
+			snprintf(path, sizeof(path), "ux0:%s", layout[i]);
+			test_mkdir(path);
+		} else {
+			snprintf(path, sizeof(path), "ux0:%.*s", (int)(colon - layout[i]), layout[i]);
+			test_write(path, atoi(colon + 1), i);
+		}
+	}
+
+	memset(&all, 0, sizeof(all));
+	all.tier = -1;
+	all.root_len = strlen("ux0:");
+	CHECK_EQ(walk_tree("ux0:", WALK_ORDER_DIRENT, &count_ops, &all, NULL), 0);
+
+	// pruning by tier never loses a file of that tier
+	for (int tier = 0; tier < TIER_COUNT; tier++) {
+		memset(&one, 0, sizeof(one));
+		one.tier = tier;
+		one.root_len = all.root_len;
+		CHECK_EQ(walk_tree("ux0:", WALK_ORDER_DIRENT, &count_ops, &one, NULL), 0);
+		CHECK_EQ(one.files[tier], all.files[tier]);
+		printf("%-22s %2u files, %2u directories pruned\n", tier_name(tier), all.files[tier], one.skipped);
+	}
+	CHECK_EQ(all.files[TIER_CONFIG], 2);
+	CHECK_EQ(all.files[TIER_APPS], 4);
+	CHECK_EQ(all.files[TIER_BULK], 3);
+
+	CHECK_EQ(pool_init(POOL_DEFAULT_CAP), 0);
+	CHECK_EQ(aio_init(AIO_DEFAULT_DEPTH, AIO_DEFAULT_BLOCK), 0);
+
+	test_mkdir("uma0:");
+	shim_reset_stats();
+	CHECK_EQ(walk_tree("ux0:", WALK_ORDER_DIRENT, &count_ops, &all, NULL), 0);
+	shim_get_stats(&walk);
+	shim_reset_stats();
+	CHECK_EQ(copy_by_priority(&dst, 1, "ux0:", NULL), 0);
+	shim_get_stats(&copy);
+	CHECK(test_same_tree("ux0:", dst));
+	printf("one walk lists %u directories, the copy by tier %u\n", walk.dopens, copy.dopens);
+	CHECK_EQ(copy.dopens, walk.dopens + TIER_COUNT - 1);
+
+	aio_exit();
+	pool_exit();
+
+	return test_result();
+}
@@ -0,0 +1,178 @@
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "walker.h"
+
+// Walks trees that outgrow every initial allocation of the walker: a
+// thousand levels deep, and names as long as the host allows, many of
+// them per directory so the name pool moves while parents still use it.
+
+#define DEEP_LEVELS 1000
+#define LONG_LEVELS 8
+#define LONG_FILES 16
+#define LONG_NAME 250
+
+typedef struct {
+	int depth;
+} Frame;
+
+typedef struct {
+	unsigned int enters;
+	unsigned int leaves;
+	unsigned int files;
+	unsigned int bad;
+	int max_depth;
+	const char *skip;
+	const char *stop;
+	char last[PATH_MAX];
+} Walk;
+
+static int walk_enter(void *arg, const char *path, const char *name, const SceIoStat *stat, void *parent, void *frame) {
+	Walk *w = arg;
+	const Frame *p = parent;
+	Frame *f = frame;
+
+	if (w->skip && strcmp(name, w->skip) == 0)
+		return WALK_SKIP;
+	w->enters++;
+	f->depth = p->depth + 1;
+	if (f->depth > w->max_depth)
+		w->max_depth = f->depth;
+	if (!SCE_S_ISDIR(stat->st_mode))
+		w->bad++;
+	return WALK_CONTINUE;
+}
+
+static int walk_file(void *arg, const char *path, const char *name, const SceIoStat *stat, void *parent) {
+	Walk *w = arg;
+	size_t path_len = strlen(path), name_len = strlen(name);
+
+	w->files++;
+	// the path always ends in "/name"
+	if (path_len <= name_len || strcmp(path + path_len - name_len, name) != 0 || path[path_len - name_len - 1] != '/')
+		w->bad++;
+	snprintf(w->last, sizeof(w->last), "%s", path);
+	if (w->stop && strcmp(name, w->stop) == 0)
+		return WALK_ABORT;
+	return WALK_CONTINUE;
+}
+
+static void walk_leave(void *arg, const char *path, void *frame) {
+	Walk *w = arg;
+
+	w->leaves++;
+}
+
+static const WalkOps walk_ops = {
+	sizeof(Frame),
+	walk_enter,
+	walk_file,
+	walk_leave,
+};
+
+static int walk(const char *root, Walk *w) {
+	Frame root_frame = { 0 };
+	const char *skip = w->skip, *stop = w->stop;
+
+	memset(w, 0, sizeof(*w));
+	w->skip = skip;
+	w->stop = stop;
+	return walk_tree(root, WALK_ORDER_DIRENT, &walk_ops, w, &root_frame);
+}
+
+static void test_deep(void) {
+	static char path[PATH_MAX];
+	Walk w = { 0 };
+	size_t len;
+
+	len = snprintf(path, sizeof(path), "ux0:deep");
+	for (int i = 0; i < DEEP_LEVELS; i++)
+		len += snprintf(path + len, sizeof(path) - len, "/d");
+	test_mkdir(path);
+	snprintf(path + len, sizeof(path) - len, "/leaf.bin");
+	test_write(path, 100, 1);
+
+	CHECK_EQ(walk("ux0:deep", &w), 0);
+	CHECK_EQ(w.enters, DEEP_LEVELS);
+	CHECK_EQ(w.leaves, DEEP_LEVELS);
+	CHECK_EQ(w.max_depth, DEEP_LEVELS);
+	CHECK_EQ(w.files, 1);
+	CHECK_EQ(w.bad, 0);
+	CHECK(strcmp(w.last, path) == 0);
+	printf("deep: %d levels, %zu byte path\n", w.max_depth, strlen(w.last));
+}
+
+static void long_name(char *out, char c, size_t len, int index) {
+	memset(out, c, len);
+	snprintf(out + len - 3, 4, "%03d", index);
+}
+
+static void test_long_names(void) {
+	char path[PATH_MAX], name[256];
+	Walk w = { 0 };
+	size_t len;
+
+	len = snprintf(path, sizeof(path), "ux0:long");
+	for (int level = 0; level < LONG_LEVELS; level++) {
+		long_name(name, 'a' + level, 255, level);
+		len += snprintf(path + len, sizeof(path) - len, "/%s", name);
+		test_mkdir(path);
+		for (int i = 0; i < LONG_FILES; i++) {
+			long_name(name, 'A' + level, LONG_NAME, i);
+			snprintf(path + len, sizeof(path) - len, "/%s", name);
+			test_write(path, i, i);
+		}
+		path[len] = '\0';
+	}
+
+	CHECK_EQ(walk("ux0:long", &w), 0);
+	CHECK_EQ(w.enters, LONG_LEVELS);
+	CHECK_EQ(w.leaves, LONG_LEVELS);
+	CHECK_EQ(w.files, LONG_LEVELS * LONG_FILES);
+	CHECK_EQ(w.bad, 0);
+	printf("long names: %u files, %zu byte path\n", w.files, strlen(w.last));
+}
+
+static void test_skip_abort(void) {
+	Walk w = { 0 };
+
+	test_mkdir("ux0:tree/keep/sub");
+	test_mkdir("ux0:tree/skip/sub");
+	test_write("ux0:tree/keep/a", 1, 1);
+	test_write("ux0:tree/keep/sub/b", 1, 2);
+	test_write("ux0:tree/skip/c", 1, 3);
+	test_write("ux0:tree/skip/sub/d", 1, 4);
+	test_write("ux0:tree/e", 1, 5);
+
+	CHECK_EQ(walk("ux0:tree", &w), 0);
+	CHECK_EQ(w.enters, 4);
+	CHECK_EQ(w.files, 5);
+
+	// a skipped directory is neither listed nor left
+	w.skip = "skip";
+	CHECK_EQ(walk("ux0:tree", &w), 0);
+	CHECK_EQ(w.enters, 2);
+	CHECK_EQ(w.leaves, 2);
+	CHECK_EQ(w.files, 3);
+
+	w.skip = NULL;
+	w.stop = "b";
+	CHECK(walk("ux0:tree", &w) < 0);
+	CHECK(strcmp(w.last, "ux0:tree/keep/sub/b") == 0);
+
+	w.stop = NULL;
+	CHECK(walk("ux0:missing", &w) < 0);
+}
+
+int main(void) {
+	test_root();
+	shim_set_verbose(0);
+
+	test_deep();
+	test_long_names();
+	test_skip_abort();
+
+	return test_result();
+}
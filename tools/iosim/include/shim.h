@@ -0,0 +1,194 @@
+#ifndef __IOSIM_SHIM_H__
+#define __IOSIM_SHIM_H__
+
+// Host stand-ins for the kernel and taiHEN APIs the plugin's I/O modules
+// use. Devices are directories (ux0:foo becomes ROOT/ux0/foo) behind a model
+// of USB storage: every request queues on its device and takes a fixed cost
+// plus its transfer time, in real time, so the plugin's worker threads
+// overlap with the caller the way they do on the console. Exports hooked
+// with taiHookFunctionExportForKernel() run through their hooks, newest
+// first, whether a kernel module calls ksceIo* or a user process makes the
+// syscall below. The psp2kern and taihen headers next to this one only
+// include it, so plugin sources build unchanged.
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef int SceUID;
+typedef unsigned int SceSize;
+typedef unsigned int SceUInt;
+typedef unsigned int SceUInt32;
+typedef int SceMode;
+typedef int64_t SceOff;
+typedef int64_t SceInt64;
+typedef uint64_t SceUInt64;
+
+typedef struct {
+	unsigned short year;
+	unsigned short month;
+	unsigned short day;
+	unsigned short hour;
+	unsigned short minute;
+	unsigned short second;
+	unsigned int microsecond;
+} SceDateTime;
+
+typedef struct {
+	SceMode st_mode;
+	unsigned int st_attr;
+	SceOff st_size;
+	SceDateTime st_ctime;
+	SceDateTime st_atime;
+	SceDateTime st_mtime;
+	unsigned int st_private[6];
+} SceIoStat;
+
+typedef struct {
+	SceIoStat d_stat;
+	char d_name[256];
+	void *d_private;
+	int dummy;
+} SceIoDirent;
+
+#define KERNEL_PID 0x10005
+
+#define SCE_O_RDONLY 0x0001
+#define SCE_O_WRONLY 0x0002
+#define SCE_O_RDWR   (SCE_O_RDONLY | SCE_O_WRONLY)
+#define SCE_O_APPEND 0x0100
+#define SCE_O_CREAT  0x0200
+#define SCE_O_TRUNC  0x0400
+#define SCE_O_EXCL   0x0800
+
+#define SCE_SEEK_SET 0
+#define SCE_SEEK_CUR 1
+#define SCE_SEEK_END 2
+
+#define SCE_S_IFMT  0xF000
+#define SCE_S_IFDIR 0x1000
+#define SCE_S_IFREG 0x2000
+#define SCE_S_ISDIR(m) (((m) & SCE_S_IFMT) == SCE_S_IFDIR)
+#define SCE_S_ISREG(m) (((m) & SCE_S_IFMT) == SCE_S_IFREG)
+
+#define SCE_CST_MODE 0x0001
+#define SCE_CST_SIZE 0x0004
+#define SCE_CST_CT   0x0008
+#define SCE_CST_AT   0x0010
+#define SCE_CST_MT   0x0020
+
+#define SCE_KERNEL_MEMBLOCK_TYPE_KERNEL_RW 0x1020D006
+#define SCE_KERNEL_ATTR_MULTI 0x00001000
+#define SCE_EVENT_WAITAND 0x00000000
+#define SCE_EVENT_WAITOR  0x00000001
+
+typedef int (*SceKernelThreadEntry)(SceSize args, void *argp);
+
+#define ENTER_SYSCALL(state) do { (state) = 0; } while (0)
+#define EXIT_SYSCALL(state) do { (void)(state); } while (0)
+
+// taiHEN's own layout: a hook continues with the next one in the chain, the
+// last one with the original export
+struct _tai_hook_user {
+	struct _tai_hook_user *next;
+	const void *func;
+	const void *old;
+};
+
+typedef uintptr_t tai_hook_ref_t;
+
+#define TAI_ANY_LIBRARY 0xFFFFFFFF
+
+#define TAI_CONTINUE(type, h, ...) ({ \
+	struct _tai_hook_user *_cur = (struct _tai_hook_user *)(h); \
+	struct _tai_hook_user *_next = _cur->next; \
+	(_next == NULL) ? ((type(*)())_cur->old)(__VA_ARGS__) : ((type(*)())_next->func)(__VA_ARGS__); \
+})
+
+SceUID taiHookFunctionExportForKernel(SceUID pid, tai_hook_ref_t *p_hook, const char *module, uint32_t library_nid, uint32_t func_nid, const void *hook_func);
+int taiHookReleaseForKernel(SceUID tai_uid, tai_hook_ref_t hook);
+
+SceUID ksceIoOpen(const char *file, int flags, SceMode mode);
+SceUID ksceIoOpenForPid(SceUID pid, const char *file, int flags, SceMode mode);
+int ksceIoClose(SceUID fd);
+int ksceIoRead(SceUID fd, void *data, SceSize size);
+int ksceIoWrite(SceUID fd, const void *data, SceSize size);
+int ksceIoPread(SceUID fd, void *data, SceSize size, SceOff offset);
+int ksceIoPwrite(SceUID fd, const void *data, SceSize size, SceOff offset);
+SceOff ksceIoLseek(SceUID fd, SceOff offset, int whence);
+int ksceIoRemove(const char *file);
+int ksceIoRename(const char *oldname, const char *newname);
+int ksceIoMkdir(const char *dir, SceMode mode);
+int ksceIoRmdir(const char *path);
+SceUID ksceIoDopen(const char *dirname);
+int ksceIoDread(SceUID fd, SceIoDirent *dir);
+int ksceIoDclose(SceUID fd);
+int ksceIoGetstat(const char *file, SceIoStat *stat);
+int ksceIoGetstatByFd(SceUID fd, SceIoStat *stat);
+int ksceIoChstat(const char *file, SceIoStat *stat, int bits);
+int ksceIoChstatByFd(SceUID fd, SceIoStat *stat, int bits);
+int ksceIoSync(const char *device, unsigned int flags);
+int ksceIoSyncByFd(SceUID fd, int flags);
+
+SceUID ksceKernelAllocMemBlock(const char *name, SceUInt32 type, SceSize size, void *opt);
+int ksceKernelFreeMemBlock(SceUID uid);
+int ksceKernelGetMemBlockBase(SceUID uid, void **base);
+int ksceKernelMemcpyKernelToUser(uintptr_t dst, const void *src, SceSize len);
+int ksceKernelMemcpyUserToKernel(void *dst, uintptr_t src, SceSize len);
+int ksceKernelStrncpyUserToKernel(void *dst, uintptr_t src, SceSize len);
+
+SceUInt64 ksceKernelGetSystemTimeWide(void);
+SceUID ksceKernelGetProcessId(void);
+SceUID ksceKernelGetThreadId(void);
+int ksceKernelDelayThread(SceUInt delay);
+
+SceUID ksceKernelCreateThread(const char *name, SceKernelThreadEntry entry, int prio, SceSize stack, SceUInt attr, int cpu, const void *opt);
+int ksceKernelStartThread(SceUID thid, SceSize args, void *argp);
+int ksceKernelWaitThreadEnd(SceUID thid, int *stat, SceUInt *timeout);
+int ksceKernelDeleteThread(SceUID thid);
+SceUID ksceKernelCreateMutex(const char *name, SceUInt attr, int init, void *opt);
+int ksceKernelLockMutex(SceUID mutexid, int count, SceUInt *timeout);
+int ksceKernelUnlockMutex(SceUID mutexid, int count);
+int ksceKernelDeleteMutex(SceUID mutexid);
+SceUID ksceKernelCreateSema(const char *name, SceUInt attr, int init, int max, void *opt);
+int ksceKernelSignalSema(SceUID semaid, int signal);
+int ksceKernelWaitSema(SceUID semaid, int signal, SceUInt *timeout);
+int ksceKernelDeleteSema(SceUID semaid);
+SceUID ksceKernelCreateEventFlag(const char *name, SceUInt attr, SceUInt init, void *opt);
+int ksceKernelSetEventFlag(SceUID evfid, SceUInt bits);
+int ksceKernelClearEventFlag(SceUID evfid, SceUInt bits);
+int ksceKernelWaitEventFlag(SceUID evfid, SceUInt bits, SceUInt mode, SceUInt *out, SceUInt *timeout);
+int ksceKernelDeleteEventFlag(SceUID evfid);
+
+// the syscalls of a user process, run as the process set with shim_set_pid()
+SceUID sceIoOpen(const char *file, int flags, SceMode mode);
+int sceIoClose(SceUID fd);
+int sceIoRead(SceUID fd, void *data, SceSize size);
+SceOff sceIoLseek(SceUID fd, SceOff offset, int whence);
+SceUID sceIoDopen(const char *dirname);
+int sceIoDread(SceUID fd, SceIoDirent *dir);
+int sceIoDclose(SceUID fd);
+int sceIoGetstat(const char *file, SceIoStat *stat);
+int sceIoChstat(const char *file, SceIoStat *stat, int bits);
+
+// the directory holding one subdirectory per device
+void shim_set_root(const char *root);
+// maps a device path to the host path it stands for
+const char *shim_path(const char *path, char *out, size_t size);
+// the process the calling thread runs in, KERNEL_PID until set; threads
+// the plugin creates are kernel threads
+void shim_set_pid(SceUID pid);
+
+// what the modelled storage was asked to do
+typedef struct {
+	unsigned int requests;  // reads and writes
+	unsigned int lookups;   // opens, stats and directory opens
+	unsigned int entries;   // directory entries listed
+	unsigned int syncs;
+	uint64_t bytes_read;
+	uint64_t bytes_written;
+} ShimStats;
+
+void shim_get_stats(ShimStats *stats);
+void shim_reset_stats(void);
+
+#endif
@@ -0,0 +1,1001 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#undef st_atime
+#undef st_ctime
+#undef st_mtime
+
+#include "shim.h"
+#include "bulkcopy.h"
+#include "config.h"
+#include "dircache.h"
+#include "lazy.h"
+#include "readahead.h"
+#include "trace_format.h"
+#include "vitashell_kernel.h"
+
+// Runs the plugin's I/O modules on the host against the modelled storage of
+// shim.c, once without and once with them, and reports what they change:
+//   iosim readahead [TRACE]  read patterns, or the reads of a recorded trace
+//   iosim livearea           SceShell scanning the installed titles
+//   iosim sync               installer bulk copies under each sync_mode
+//   iosim bulkcopy           bulk copies with one buffer and with several
+//   iosim lazy               a user process during a lazy migration
+// Each benchmark checks what must hold whatever the timing, the data read
+// above all, and exits non-zero if something doesn't; ctest runs each one.
+
+#define USER_PID 0x40030011
+#define USER_FD 0x40010003
+
+#define TRACE_MAX_IDS 0x10000
+#define MAX_HANDLES 64
+
+typedef struct {
+	TraceRecord *recs;
+	int count;
+	int cap;
+	char **names;
+} Trace;
+
+typedef struct {
+	int32_t pid;
+	int32_t fd; // as recorded, -1 when the slot is free
+	SceUID real;
+	SceOff pos;
+} Handle;
+
+typedef struct {
+	double seconds;
+	uint64_t bytes;
+	unsigned int reads;
+	unsigned int bad; // reads that returned the wrong data
+	ShimStats device;
+} ReplayResult;
+
+static int failures = 0;
+static char root[256];
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		failures++; \
+	} \
+} while (0)
+
+static double seconds(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void remove_root(void) {
+	char cmd[300];
+
+	snprintf(cmd, sizeof(cmd), "rm -rf '%s'", root);
+	if (system(cmd) != 0)
+		fprintf(stderr, "could not remove %s\n", root);
+}
+
+static void make_root(void) {
+	const char *tmp = getenv("TMPDIR");
+
+	snprintf(root, sizeof(root), "%s/usbmc-iosim-XXXXXX", tmp ? tmp : "/tmp");
+	if (mkdtemp(root) == NULL) {
+		perror("mkdtemp");
+		exit(2);
+	}
+	atexit(remove_root);
+	shim_set_root(root);
+}
+
+// creates a device path with its parents, straight on the host
+static void make_dir(const char *path) {
+	char host[PATH_MAX];
+
+	shim_path(path, host, sizeof(host));
+	for (char *p = host + strlen(root) + 1; *p; p++) {
+		if (*p == '/') {
+			*p = '\0';
+			mkdir(host, 0755);
+			*p = '/';
+		}
+	}
+	mkdir(host, 0755);
+}
+
+// every file holds the same bytes at the same offsets, so any read can be
+// checked against where it was made
+static uint8_t file_byte(uint64_t off) {
+	return (uint8_t)(((uint32_t)off * 2654435761u) >> 24);
+}
+
+static void make_file(const char *path, uint64_t size) {
+	char host[PATH_MAX], buf[4096];
+	uint64_t off = 0;
+	FILE *f;
+
+	shim_path(path, host, sizeof(host));
+	if ((f = fopen(host, "wb")) == NULL) {
+		perror(host);
+		exit(2);
+	}
+	while (off < size) {
+		size_t n = (size - off < sizeof(buf)) ? size - off : sizeof(buf);
+		for (size_t i = 0; i < n; i++)
+			buf[i] = file_byte(off + i);
+		fwrite(buf, 1, n, f);
+		off += n;
+	}
+	fclose(f);
+}
+
+static void put(Trace *t, int op, uint16_t path, int32_t pid, int32_t fd, uint32_t size, uint64_t offset, int32_t result) {
+	TraceRecord *rec;
+
+	if (t->count == t->cap) {
+		t->cap = t->cap ? 2 * t->cap : 1024;
+		if ((t->recs = realloc(t->recs, t->cap * sizeof(TraceRecord))) == NULL) {
+			perror("realloc");
+			exit(2);
+		}
+	}
+	rec = &t->recs[t->count++];
+	memset(rec, 0, sizeof(*rec));
+	rec->op = op;
+	rec->path = path;
+	rec->pid = pid;
+	rec->fd = fd;
+	rec->size = size;
+	rec->offset = offset;
+	rec->result = result;
+}
+
+static void trace_init(Trace *t) {
+	memset(t, 0, sizeof(*t));
+	if ((t->names = calloc(TRACE_MAX_IDS, sizeof(char *))) == NULL) {
+		perror("calloc");
+		exit(2);
+	}
+}
+
+static void trace_free(Trace *t) {
+	for (int i = 0; i < TRACE_MAX_IDS; i++)
+		free(t->names[i]);
+	free(t->names);
+	free(t->recs);
+}
+
+// the records of a trace file the replay below knows, with their names
+static int trace_load(Trace *t, const char *path) {
+	TraceHeader header;
+	TraceRecord rec;
+	FILE *f;
+
+	if ((f = fopen(path, "rb")) == NULL) {
+		perror(path);
+		return -1;
+	}
+	if (fread(&header, sizeof(header), 1, f) != 1 || header.magic != TRACE_MAGIC ||
+	    header.version != TRACE_VERSION || header.record_size != sizeof(TraceRecord)) {
+		fprintf(stderr, "%s: not a version %d trace\n", path, TRACE_VERSION);
+		fclose(f);
+		return -1;
+	}
+
+	trace_init(t);
+	while (fread(&rec, sizeof(rec), 1, f) == 1) {
+		if (rec.op == TRACE_OP_NAME) {
+			size_t n = (rec.size + sizeof(TraceRecord) - 1) / sizeof(TraceRecord);
+			char *name = calloc(n + 1, sizeof(TraceRecord));
+			if (name == NULL || fread(name, sizeof(TraceRecord), n, f) != n) {
+				free(name);
+				break;
+			}
+			free(t->names[rec.path]);
+			t->names[rec.path] = name;
+		} else if (rec.op == TRACE_OP_OPEN || rec.op == TRACE_OP_CLOSE || rec.op == TRACE_OP_READ ||
+		           rec.op == TRACE_OP_PREAD || rec.op == TRACE_OP_LSEEK) {
+			put(t, rec.op, rec.path, rec.pid, rec.fd, rec.size, rec.offset, rec.result);
+		}
+	}
+	fclose(f);
+	return 0;
+}
+
+static Handle *find_handle(Handle *handles, int32_t pid, int32_t fd) {
+	for (int i = 0; i < MAX_HANDLES; i++) {
+		if (handles[i].fd == fd && handles[i].pid == pid)
+			return &handles[i];
+	}
+	return NULL;
+}
+
+// read-only opens of ux0 files, what read-ahead is about
+static int replayed_open(const Trace *t, const TraceRecord *rec) {
+	const char *name = t->names[rec->path];
+
+	return rec->result >= 0 && !(rec->size & SCE_O_WRONLY) && name && strncmp(name, "ux0:", 4) == 0;
+}
+
+// Every file a trace reads gets as large as the reads went, so they return
+// what they returned on the console. Seeks from the end are taken from the
+// furthest point seen so far.
+static void trace_files(const Trace *t) {
+	Handle handles[MAX_HANDLES];
+	uint64_t *extent = calloc(TRACE_MAX_IDS, sizeof(uint64_t));
+	uint16_t ids[MAX_HANDLES];
+	Handle *h;
+
+	memset(handles, 0xFF, sizeof(handles));
+	for (int i = 0; i < t->count; i++) {
+		const TraceRecord *rec = &t->recs[i];
+
+		if (rec->op == TRACE_OP_OPEN) {
+			if (replayed_open(t, rec) && (h = find_handle(handles, -1, -1)) != NULL) {
+				h->pid = rec->pid;
+				h->fd = rec->result;
+				h->pos = 0;
+				ids[h - handles] = rec->path;
+			}
+			continue;
+		}
+		if ((h = find_handle(handles, rec->pid, rec->fd)) == NULL)
+			continue;
+		uint64_t *end = &extent[ids[h - handles]];
+		if (rec->op == TRACE_OP_CLOSE) {
+			h->fd = h->pid = -1;
+		} else if (rec->op == TRACE_OP_LSEEK) {
+			h->pos = (rec->size == SCE_SEEK_SET) ? 0 : (rec->size == SCE_SEEK_CUR) ? h->pos : *end;
+			h->pos += (SceOff)rec->offset;
+		} else if (rec->result > 0) {
+			SceOff from = (rec->op == TRACE_OP_PREAD) ? (SceOff)rec->offset : h->pos;
+			if (from + rec->result > *end)
+				*end = from + rec->result;
+			if (rec->op == TRACE_OP_READ)
+				h->pos += rec->result;
+		}
+	}
+
+	for (int id = 0; id < TRACE_MAX_IDS; id++) {
+		if (extent[id] == 0)
+			continue;
+		char dir[PATH_MAX], *slash;
+		snprintf(dir, sizeof(dir), "%s", t->names[id]);
+		if ((slash = strrchr(dir, '/')) != NULL)
+			*slash = '\0';
+		else
+			dir[4] = '\0';
+		make_dir(dir);
+		make_file(t->names[id], extent[id]);
+	}
+	free(extent);
+}
+
+// Runs the reads of a trace back to back, through the syscalls for user
+// processes and the driver exports for the kernel, spending think_us after
+// each one like a reader doing something with its data.
+static void replay(const Trace *t, unsigned int think_us, ReplayResult *out) {
+	static char buf[1024 * 1024];
+	Handle handles[MAX_HANDLES];
+	Handle *h;
+	double start;
+
+	memset(out, 0, sizeof(*out));
+	memset(handles, 0xFF, sizeof(handles));
+	shim_reset_stats();
+	start = seconds();
+
+	for (int i = 0; i < t->count; i++) {
+		const TraceRecord *rec = &t->recs[i];
+		int kernel = (rec->pid == KERNEL_PID);
+		SceSize size = (rec->size < sizeof(buf)) ? rec->size : sizeof(buf);
+		int ret;
+
+		shim_set_pid(rec->pid);
+		if (rec->op == TRACE_OP_OPEN) {
+			if (!replayed_open(t, rec) || (h = find_handle(handles, -1, -1)) == NULL)
+				continue;
+			const char *name = t->names[rec->path];
+			h->real = kernel ? ksceIoOpen(name, SCE_O_RDONLY, 0) : sceIoOpen(name, SCE_O_RDONLY, 0);
+			if (h->real < 0)
+				continue;
+			h->pid = rec->pid;
+			h->fd = rec->result;
+			h->pos = 0;
+			continue;
+		}
+		if ((h = find_handle(handles, rec->pid, rec->fd)) == NULL)
+			continue;
+
+		switch (rec->op) {
+		case TRACE_OP_CLOSE:
+			if (kernel)
+				ksceIoClose(h->real);
+			else
+				sceIoClose(h->real);
+			h->fd = h->pid = -1;
+			break;
+		case TRACE_OP_LSEEK:
+			h->pos = kernel ? ksceIoLseek(h->real, rec->offset, rec->size) : sceIoLseek(h->real, rec->offset, rec->size);
+			break;
+		case TRACE_OP_READ:
+		case TRACE_OP_PREAD:
+			if (rec->op == TRACE_OP_PREAD)
+				ret = ksceIoPread(h->real, buf, size, rec->offset);
+			else
+				ret = kernel ? ksceIoRead(h->real, buf, size) : sceIoRead(h->real, buf, size);
+			if (ret < 0) {
+				out->bad++;
+				break;
+			}
+			SceOff from = (rec->op == TRACE_OP_PREAD) ? (SceOff)rec->offset : h->pos;
+			for (int j = 0; j < ret; j++) {
+				if ((uint8_t)buf[j] != file_byte(from + j)) {
+					out->bad++;
+					break;
+				}
+			}
+			if (rec->op == TRACE_OP_READ)
+				h->pos += ret;
+			out->bytes += ret;
+			out->reads++;
+			if (think_us)
+				usleep(think_us);
+			break;
+		}
+	}
+
+	for (int i = 0; i < MAX_HANDLES; i++) {
+		if (handles[i].fd == -1)
+			continue;
+		shim_set_pid(handles[i].pid);
+		if (handles[i].pid == KERNEL_PID)
+			ksceIoClose(handles[i].real);
+		else
+			sceIoClose(handles[i].real);
+	}
+	shim_set_pid(KERNEL_PID);
+
+	out->seconds = seconds() - start;
+	shim_get_stats(&out->device);
+}
+
+// Read-ahead: a 4 MiB file read in 16 KiB blocks from start to end, by a
+// game and by a kernel module, every fourth block of it, and blocks at
+// random. Streaming has to take far fewer requests, the others must not
+// read more from the device than they did without read-ahead.
+
+#define RA_FILE "ux0:data/stream.bin"
+#define RA_FILE_SIZE (4 * 1024 * 1024)
+#define RA_BLOCK (16 * 1024)
+#define RA_STRIDE (4 * RA_BLOCK)
+#define RA_RANDOM_READS 128
+#define RA_THINK_US 300 // decoding a block, say
+
+enum {
+	RA_SEQUENTIAL,
+	RA_SEQUENTIAL_KERNEL,
+	RA_STRIDED,
+	RA_RANDOM,
+	RA_RECORDED,
+};
+
+static const char *ra_pattern_names[] = {
+	"sequential", "sequential, kernel", "strided", "random", "recorded",
+};
+
+static void ra_pattern(Trace *t, int pattern) {
+	int32_t pid = (pattern == RA_SEQUENTIAL_KERNEL) ? KERNEL_PID : USER_PID;
+	uint32_t seed = 1;
+
+	trace_init(t);
+	t->names[0] = strdup(RA_FILE);
+	put(t, TRACE_OP_OPEN, 0, pid, USER_FD, SCE_O_RDONLY, 0, USER_FD);
+	switch (pattern) {
+	case RA_SEQUENTIAL:
+	case RA_SEQUENTIAL_KERNEL:
+		for (int off = 0; off < RA_FILE_SIZE; off += RA_BLOCK)
+			put(t, TRACE_OP_READ, 0, pid, USER_FD, RA_BLOCK, 0, RA_BLOCK);
+		break;
+	case RA_STRIDED:
+		for (int off = 0; off < RA_FILE_SIZE; off += RA_STRIDE) {
+			put(t, TRACE_OP_LSEEK, 0, pid, USER_FD, SCE_SEEK_SET, off, 0);
+			put(t, TRACE_OP_READ, 0, pid, USER_FD, RA_BLOCK, 0, RA_BLOCK);
+		}
+		break;
+	case RA_RANDOM:
+		for (int i = 0; i < RA_RANDOM_READS; i++) {
+			seed = seed * 1103515245 + 12345;
+			int off = (seed >> 8) % (RA_FILE_SIZE / RA_BLOCK) * RA_BLOCK;
+			put(t, TRACE_OP_LSEEK, 0, pid, USER_FD, SCE_SEEK_SET, off, 0);
+			put(t, TRACE_OP_READ, 0, pid, USER_FD, RA_BLOCK, 0, RA_BLOCK);
+		}
+		break;
+	}
+	put(t, TRACE_OP_CLOSE, 0, pid, USER_FD, 0, 0, 0);
+}
+
+static void ra_report(int pattern, int on, const ReplayResult *r) {
+	printf("%-19s %-3s %8.3f %8.1f %9u %11.1f\n", ra_pattern_names[pattern], on ? "on" : "off", r->seconds,
+	       r->bytes / r->seconds / 1048576.0, r->device.requests, r->device.bytes_read / 1048576.0);
+}
+
+static int bench_readahead(int argc, char *argv[]) {
+	Trace traces[RA_RECORDED + 1];
+	ReplayResult off[RA_RECORDED + 1], on[RA_RECORDED + 1];
+	int first = RA_SEQUENTIAL, last = RA_RANDOM;
+
+	if (argc > 1) {
+		if (trace_load(&traces[RA_RECORDED], argv[1]) < 0)
+			return 2;
+		trace_files(&traces[RA_RECORDED]);
+		first = last = RA_RECORDED;
+	} else {
+		make_dir("ux0:data");
+		make_file(RA_FILE, RA_FILE_SIZE);
+		for (int p = first; p <= last; p++)
+			ra_pattern(&traces[p], p);
+	}
+
+	for (int p = first; p <= last; p++)
+		replay(&traces[p], RA_THINK_US, &off[p]);
+	CHECK(readahead_init() == 0);
+	for (int p = first; p <= last; p++)
+		replay(&traces[p], RA_THINK_US, &on[p]);
+	readahead_exit();
+
+	if (first == RA_RECORDED)
+		printf("the reads of %s, ", argv[1]);
+	else
+		printf("16 KiB reads of a %d MiB file, ", RA_FILE_SIZE >> 20);
+	printf("%d us of work after each; read-ahead of %d to %d KiB, %d streams\n", RA_THINK_US,
+	       usbmc_config.readahead_min_window / 1024, usbmc_config.readahead_max_window / 1024,
+	       usbmc_config.readahead_streams);
+	printf("%-19s %-3s %8s %8s %9s %11s\n", "pattern", "ra", "s", "MiB/s", "requests", "device MiB");
+	for (int p = first; p <= last; p++) {
+		ra_report(p, 0, &off[p]);
+		ra_report(p, 1, &on[p]);
+
+		// what was read never depends on read-ahead
+		CHECK(off[p].bad == 0);
+		CHECK(on[p].bad == 0);
+		CHECK(on[p].bytes == off[p].bytes);
+		CHECK(on[p].reads == off[p].reads);
+
+		if (p == RA_SEQUENTIAL || p == RA_SEQUENTIAL_KERNEL)
+			CHECK(on[p].device.requests * 2 < off[p].device.requests);
+		else if (p != RA_RECORDED)
+			CHECK(on[p].device.bytes_read <= off[p].device.bytes_read * 5 / 4);
+		trace_free(&traces[p]);
+	}
+
+	return 0;
+}
+
+// Directory cache: SceShell building LiveArea, in a user process, lists
+// ux0:app and looks at every title in it: the files it shows, one that
+// only some titles have, and what sce_sys holds. The first scan with the
+// cache fills it, the second must be answered from it without listing a
+// directory or looking up a path on the device; only the directory opens
+// still go through. Every scan has to see the same.
+
+#define LA_TITLES 500
+
+typedef struct {
+	double seconds;
+	uint64_t digest; // of every name, stat and error seen
+	unsigned int dopens;
+	ShimStats device;
+	UsbmcDirCacheStats cache;
+} ScanResult;
+
+static void la_titles(void) {
+	char path[64];
+
+	for (int i = 0; i < LA_TITLES; i++) {
+		snprintf(path, sizeof(path), "ux0:app/PCSE%05d/sce_sys/livearea/contents", i);
+		make_dir(path);
+		snprintf(path, sizeof(path), "ux0:app/PCSE%05d/eboot.bin", i);
+		make_file(path, 4096 + i);
+		snprintf(path, sizeof(path), "ux0:app/PCSE%05d/sce_sys/param.sfo", i);
+		make_file(path, 1024 + i % 512);
+		snprintf(path, sizeof(path), "ux0:app/PCSE%05d/sce_sys/icon0.png", i);
+		make_file(path, 8192 + i);
+		if (i % 2 == 0) {
+			snprintf(path, sizeof(path), "ux0:app/PCSE%05d/sce_sys/livearea/contents/template.xml", i);
+			make_file(path, 2048);
+		}
+	}
+}
+
+static void la_mix(uint64_t *digest, const void *data, size_t size) {
+	for (size_t i = 0; i < size; i++)
+		*digest = (*digest ^ ((const uint8_t *)data)[i]) * 1099511628211ull;
+}
+
+static void la_stat(ScanResult *r, const char *path) {
+	SceIoStat stat;
+	int ret;
+
+	memset(&stat, 0, sizeof(stat));
+	ret = sceIoGetstat(path, &stat);
+	la_mix(&r->digest, &ret, sizeof(ret));
+	if (ret == 0) {
+		la_mix(&r->digest, &stat.st_mode, sizeof(stat.st_mode));
+		la_mix(&r->digest, &stat.st_size, sizeof(stat.st_size));
+		la_mix(&r->digest, &stat.st_mtime, sizeof(stat.st_mtime));
+	}
+}
+
+// lists a directory into names, LA_TITLES of them at most
+static int la_list(ScanResult *r, const char *path, char (*names)[16]) {
+	SceIoDirent dir;
+	SceUID fd;
+	int count = 0;
+
+	r->dopens++;
+	if ((fd = sceIoDopen(path)) < 0) {
+		la_mix(&r->digest, &fd, sizeof(fd));
+		return 0;
+	}
+	while (sceIoDread(fd, &dir) > 0) {
+		la_mix(&r->digest, dir.d_name, strlen(dir.d_name));
+		la_mix(&r->digest, &dir.d_stat.st_mode, sizeof(dir.d_stat.st_mode));
+		la_mix(&r->digest, &dir.d_stat.st_size, sizeof(dir.d_stat.st_size));
+		if (names && count < LA_TITLES)
+			snprintf(names[count++], sizeof(*names), "%s", dir.d_name);
+	}
+	sceIoDclose(fd);
+	return count;
+}
+
+static void la_scan(ScanResult *r) {
+	static char titles[LA_TITLES][16];
+	UsbmcDirCacheStats before;
+	char path[128];
+	double start;
+	int count;
+
+	memset(r, 0, sizeof(*r));
+	r->digest = 14695981039346656037ull;
+	shim_reset_stats();
+	shim_set_pid(USER_PID);
+	shellKernelGetDirCacheStats(&before);
+	start = seconds();
+
+	count = la_list(r, "ux0:app", titles);
+	for (int i = 0; i < count; i++) {
+		snprintf(path, sizeof(path), "ux0:app/%s/sce_sys/param.sfo", titles[i]);
+		la_stat(r, path);
+		snprintf(path, sizeof(path), "ux0:app/%s/sce_sys/icon0.png", titles[i]);
+		la_stat(r, path);
+		snprintf(path, sizeof(path), "ux0:app/%s/sce_sys/livearea/contents/template.xml", titles[i]);
+		la_stat(r, path);
+		snprintf(path, sizeof(path), "ux0:app/%s/sce_sys", titles[i]);
+		la_list(r, path, NULL);
+	}
+
+	r->seconds = seconds() - start;
+	shellKernelGetDirCacheStats(&r->cache);
+	// counted since the cache started, this scan's share is what matters
+	r->cache.hits -= before.hits;
+	r->cache.misses -= before.misses;
+	r->cache.flushes -= before.flushes;
+	shim_set_pid(KERNEL_PID);
+	shim_get_stats(&r->device);
+}
+
+static void la_report(const char *what, const ScanResult *r) {
+	printf("%-8s %8.3f %8u %8u %8u %8u %8u %8u\n", what, r->seconds, r->device.lookups, r->device.entries,
+	       r->cache.hits, r->cache.misses, r->cache.flushes, r->cache.used / 1024);
+}
+
+static int bench_livearea(int argc, char *argv[]) {
+	ScanResult none, cold, warm;
+	int mem = usbmc_config.dircache_mem;
+
+	la_titles();
+
+	usbmc_config.dircache_mem = 0;
+	CHECK(dircache_init() == 0);
+	la_scan(&none);
+	dircache_exit();
+
+	usbmc_config.dircache_mem = mem;
+	CHECK(dircache_init() == 0);
+	la_scan(&cold);
+	la_scan(&warm);
+	dircache_exit();
+
+	printf("%d titles, %d KiB of directory cache\n", LA_TITLES, mem / 1024);
+	printf("%-8s %8s %8s %8s %8s %8s %8s %8s\n", "scan", "s", "lookups", "entries", "hits", "misses", "flushes", "used KiB");
+	la_report("no cache", &none);
+	la_report("cold", &cold);
+	la_report("warm", &warm);
+
+	// the cache changes how long a scan takes, never what it sees
+	CHECK(cold.digest == none.digest);
+	CHECK(warm.digest == none.digest);
+	// filling it costs the device nothing extra
+	CHECK(cold.device.lookups == none.device.lookups);
+	CHECK(cold.device.entries == none.device.entries);
+	// and a warm scan only opens the directories
+	CHECK(cold.cache.flushes == 0);
+	CHECK(warm.cache.misses == 0);
+	CHECK(warm.device.entries == 0);
+	CHECK(warm.device.lookups == warm.dopens);
+
+	return 0;
+}
+
+// Sync modes: the installer migrating 64 files of 128 KiB from ux0 to uma0
+// through the plugin's bulk copy, once under every sync_mode, with small
+// intervals so the batched modes sync a few times. Each mode must sync as
+// often as it says and copy the same. A finished batch syncs what it left,
+// except under USBMC_SYNC_NONE, which runs last so the others start clean.
+
+#define BC_FILES 64
+#define BC_FILE_SIZE (128 * 1024)
+#define BC_SYNC_FILES 8
+#define BC_SYNC_MB 2
+
+static const struct {
+	int mode;
+	const char *name;
+	int interval;
+	unsigned int syncs;
+} bc_modes[] = {
+	{ USBMC_SYNC_STRICT, "strict", 0, BC_FILES },
+	{ USBMC_SYNC_FILES, "files", BC_SYNC_FILES, BC_FILES / BC_SYNC_FILES },
+	{ USBMC_SYNC_MB, "mb", BC_SYNC_MB, BC_FILES * BC_FILE_SIZE / (BC_SYNC_MB * 1024 * 1024) },
+	{ USBMC_SYNC_NONE, "none", 0, 0 },
+};
+
+#define BC_MODES (sizeof(bc_modes)/sizeof(*bc_modes))
+
+// whether a device path holds size bytes of what make_file() writes
+static int same_file(const char *path, uint64_t size) {
+	char host[PATH_MAX], buf[4096];
+	uint64_t off = 0;
+	size_t n;
+	FILE *f;
+
+	shim_path(path, host, sizeof(host));
+	if ((f = fopen(host, "rb")) == NULL)
+		return 0;
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+		for (size_t i = 0; i < n; i++) {
+			if ((uint8_t)buf[i] != file_byte(off + i)) {
+				fclose(f);
+				return 0;
+			}
+		}
+		off += n;
+	}
+	fclose(f);
+	return off == size;
+}
+
+static int bench_sync(int argc, char *argv[]) {
+	static char list[BC_FILES * 32];
+	UsbmcBulkCopyStatus status[BC_MODES];
+	ShimStats device[BC_MODES];
+	double time[BC_MODES];
+	char path[32];
+	int size = 0;
+
+	make_dir("ux0:src");
+	make_dir("uma0:dst");
+	for (int i = 0; i < BC_FILES; i++) {
+		snprintf(path, sizeof(path), "ux0:src/f%02d", i);
+		make_file(path, BC_FILE_SIZE);
+		size += snprintf(list + size, sizeof(list) - size, "ux0:src/f%02d", i) + 1;
+		size += snprintf(list + size, sizeof(list) - size, "uma0:dst/f%02d", i) + 1;
+	}
+
+	for (size_t m = 0; m < BC_MODES; m++) {
+		double start;
+
+		usbmc_config.sync_mode = bc_modes[m].mode;
+		usbmc_config.sync_interval = bc_modes[m].interval;
+		shim_reset_stats();
+		shim_set_pid(USER_PID);
+		start = seconds();
+		CHECK(shellKernelBulkCopy(list, size) == 0);
+		do {
+			usleep(1000);
+			shellKernelGetBulkCopyStatus(&status[m]);
+		} while (status[m].active);
+		time[m] = seconds() - start;
+		shim_set_pid(KERNEL_PID);
+		shim_get_stats(&device[m]);
+
+		CHECK(status[m].result == 0);
+		CHECK(status[m].files_done == BC_FILES);
+		CHECK(status[m].files_failed == 0);
+		CHECK(status[m].bytes_copied == (uint64_t)BC_FILES * BC_FILE_SIZE);
+		CHECK(status[m].syncs == bc_modes[m].syncs);
+		CHECK(device[m].syncs == bc_modes[m].syncs);
+		for (int i = 0; i < BC_FILES; i++) {
+			snprintf(path, sizeof(path), "uma0:dst/f%02d", i);
+			CHECK(same_file(path, BC_FILE_SIZE));
+		}
+	}
+	bulkcopy_exit();
+
+	printf("%d files of %d KiB from ux0 to uma0, %d MiB copy buffer\n", BC_FILES, BC_FILE_SIZE / 1024,
+	       usbmc_config.bulkcopy_mem >> 20);
+	printf("%-8s %8s %8s %8s %8s %10s\n", "mode", "interval", "s", "MiB/s", "syncs", "vs none");
+	for (size_t m = 0; m < BC_MODES; m++) {
+		printf("%-8s %8d %8.3f %8.1f %8u %9.0f%%\n", bc_modes[m].name, bc_modes[m].interval, time[m],
+		       status[m].bytes_copied / time[m] / 1048576.0, status[m].syncs,
+		       100.0 * (time[m] - time[BC_MODES - 1]) / time[BC_MODES - 1]);
+	}
+
+	// a sync per file costs more than the modelled drive's flushes ever vary
+	CHECK(time[0] > time[BC_MODES - 1]);
+
+	return 0;
+}
+
+// Bulk copy pipelining: a few large files copied from ux0 to uma0 with a
+// buffer that holds one block, so every read waits for the write before it,
+// then with buffers that hold several, so the reader runs ahead of the
+// writes. The same block size with and without the pipeline shows what the
+// overlap alone is worth; the default 1 MiB buffer adds what larger blocks
+// are worth.
+
+#define BP_FILES 8
+#define BP_FILE_SIZE (4 * 1024 * 1024)
+
+static const struct {
+	int mem;
+	const char *name;
+} bp_buffers[] = {
+	{ 64 * 1024, "1 x 64K" },
+	{ 256 * 1024, "4 x 64K" },
+	{ 1024 * 1024, "4 x 256K" },
+};
+
+#define BP_BUFFERS (sizeof(bp_buffers)/sizeof(*bp_buffers))
+
+static int bench_bulkcopy(int argc, char *argv[]) {
+	static char list[BP_FILES * 32];
+	UsbmcBulkCopyStatus status;
+	ShimStats device[BP_BUFFERS];
+	double time[BP_BUFFERS];
+	int mem = usbmc_config.bulkcopy_mem;
+	int mode = usbmc_config.sync_mode;
+	char path[32];
+	int size = 0;
+
+	make_dir("ux0:big");
+	make_dir("uma0:big");
+	for (int i = 0; i < BP_FILES; i++) {
+		snprintf(path, sizeof(path), "ux0:big/f%d", i);
+		make_file(path, BP_FILE_SIZE);
+		size += snprintf(list + size, sizeof(list) - size, "ux0:big/f%d", i) + 1;
+		size += snprintf(list + size, sizeof(list) - size, "uma0:big/f%d", i) + 1;
+	}
+
+	// syncs would only add the same cost to every run
+	usbmc_config.sync_mode = USBMC_SYNC_NONE;
+	for (size_t b = 0; b < BP_BUFFERS; b++) {
+		double start;
+
+		usbmc_config.bulkcopy_mem = bp_buffers[b].mem;
+		shim_reset_stats();
+		shim_set_pid(USER_PID);
+		start = seconds();
+		CHECK(shellKernelBulkCopy(list, size) == 0);
+		do {
+			usleep(1000);
+			shellKernelGetBulkCopyStatus(&status);
+		} while (status.active);
+		time[b] = seconds() - start;
+		shim_set_pid(KERNEL_PID);
+		shim_get_stats(&device[b]);
+
+		CHECK(status.result == 0);
+		CHECK(status.files_done == BP_FILES);
+		CHECK(status.bytes_copied == (uint64_t)BP_FILES * BP_FILE_SIZE);
+		for (int i = 0; i < BP_FILES; i++) {
+			snprintf(path, sizeof(path), "uma0:big/f%d", i);
+			CHECK(same_file(path, BP_FILE_SIZE));
+		}
+	}
+	bulkcopy_exit();
+	usbmc_config.bulkcopy_mem = mem;
+	usbmc_config.sync_mode = mode;
+
+	printf("%d files of %d MiB from ux0 to uma0\n", BP_FILES, BP_FILE_SIZE >> 20);
+	printf("%-8s %8s %8s %8s %10s\n", "buffer", "s", "MiB/s", "requests", "vs 1 x 64K");
+	for (size_t b = 0; b < BP_BUFFERS; b++) {
+		printf("%-8s %8.3f %8.1f %8u %9.0f%%\n", bp_buffers[b].name, time[b],
+		       (double)BP_FILES * BP_FILE_SIZE / time[b] / 1048576.0, device[b].requests,
+		       100.0 * (time[b] - time[0]) / time[0]);
+	}
+
+	// the same blocks, read while the last one is written
+	CHECK(device[1].requests == device[0].requests);
+	CHECK(time[1] < time[0]);
+
+	return 0;
+}
+
+// Lazy migration: a user process looking up, opening and listing files
+// that are still only on the original device, here uma0:. Without lazy
+// migration they are missing; with it every lookup falls through, reads
+// return the original data, a listing holds what both devices have once,
+// and an opened file is copied to USB in the background. The shim's
+// semaphores ignore timeouts, so the worker never trickles on its own and
+// the open is the only thing that can have copied the file.
+
+#define LZ_FILE_SIZE 100000
+#define LZ_WAIT_MS 5000
+
+static const char *lz_listing[] = { "both.bin", "usb.bin", "card.bin", "only" };
+
+#define LZ_NAMES (sizeof(lz_listing)/sizeof(*lz_listing))
+
+// how often each expected name is listed in dir, -1 for anything else
+static int lz_list(const char *dir, int *seen) {
+	SceIoDirent ent;
+	SceUID fd;
+	int ret;
+
+	memset(seen, 0, LZ_NAMES * sizeof(*seen));
+	if ((fd = sceIoDopen(dir)) < 0)
+		return fd;
+	while ((ret = sceIoDread(fd, &ent)) > 0) {
+		size_t i;
+		for (i = 0; i < LZ_NAMES && strcmp(ent.d_name, lz_listing[i]) != 0; i++);
+		if (i == LZ_NAMES)
+			return -1;
+		seen[i]++;
+	}
+	sceIoDclose(fd);
+	return ret;
+}
+
+static int lz_read(const char *path, uint64_t size) {
+	static uint8_t buf[LZ_FILE_SIZE + 1];
+	SceUID fd;
+	int rd;
+
+	if ((fd = sceIoOpen(path, SCE_O_RDONLY, 0)) < 0)
+		return fd;
+	rd = sceIoRead(fd, buf, sizeof(buf));
+	sceIoClose(fd);
+	if (rd != (int)size)
+		return -1;
+	for (int i = 0; i < rd; i++) {
+		if (buf[i] != file_byte(i))
+			return -1;
+	}
+	return 0;
+}
+
+static int bench_lazy(int argc, char *argv[]) {
+	UsbmcDirCacheStats before, after;
+	UsbmcLazyStatus status;
+	SceIoStat stat;
+	SceIoDirent ent;
+	int seen[LZ_NAMES];
+	SceUID fd;
+
+	make_dir("uma0:lz/only");
+	make_file("uma0:lz/card.bin", LZ_FILE_SIZE);
+	make_file("uma0:lz/both.bin", 10);
+	make_file("uma0:lz/only/deep.bin", 10);
+	make_dir("ux0:lz");
+	make_file("ux0:lz/both.bin", 10);
+	make_file("ux0:lz/usb.bin", 10);
+
+	// on USB alone nothing of the original device is there
+	shim_set_pid(USER_PID);
+	CHECK(sceIoGetstat("ux0:lz/card.bin", &stat) < 0);
+	CHECK(sceIoOpen("ux0:lz/card.bin", SCE_O_RDONLY, 0) < 0);
+	CHECK(lz_list("ux0:lz", seen) == 0 && seen[2] == 0 && seen[3] == 0);
+	shim_set_pid(KERNEL_PID);
+
+	// under the directory cache, hooked in the order the plugin does
+	CHECK(dircache_init() == 0);
+	CHECK(lazy_init() == 0);
+	shim_set_pid(USER_PID);
+
+	CHECK(sceIoGetstat("ux0:lz/card.bin", &stat) == 0 && stat.st_size == LZ_FILE_SIZE);
+	CHECK(sceIoGetstat("ux0:lz/missing.bin", &stat) < 0);
+
+	// misses go to the devices every time while the migration runs
+	shellKernelGetDirCacheStats(&before);
+	CHECK(sceIoGetstat("ux0:lz/missing.bin", &stat) < 0);
+	CHECK(sceIoGetstat("ux0:lz/missing.bin", &stat) < 0);
+	shellKernelGetDirCacheStats(&after);
+	CHECK(after.hits == before.hits && after.misses == before.misses + 2);
+
+	// a chstat from the process forgets the cached times
+	CHECK(sceIoGetstat("ux0:lz/usb.bin", &stat) == 0);
+	shellKernelGetDirCacheStats(&before);
+	CHECK(sceIoGetstat("ux0:lz/usb.bin", &stat) == 0);
+	CHECK(sceIoChstat("ux0:lz/usb.bin", &stat, SCE_CST_MT) == 0);
+	CHECK(sceIoGetstat("ux0:lz/usb.bin", &stat) == 0);
+	shellKernelGetDirCacheStats(&after);
+	CHECK(after.hits == before.hits + 1 && after.misses == before.misses + 1);
+
+	// both devices, each name once
+	CHECK(lz_list("ux0:lz", seen) == 0);
+	for (size_t i = 0; i < LZ_NAMES; i++)
+		CHECK(seen[i] == 1);
+
+	// only on the original device, listed all the same
+	CHECK((fd = sceIoDopen("ux0:lz/only")) >= 0);
+	CHECK(sceIoDread(fd, &ent) > 0 && strcmp(ent.d_name, "deep.bin") == 0);
+	CHECK(sceIoDread(fd, &ent) == 0);
+	sceIoDclose(fd);
+
+	CHECK(lz_read("ux0:lz/card.bin", LZ_FILE_SIZE) == 0);
+	shim_set_pid(KERNEL_PID);
+
+	// the open queued the file for copying
+	for (int ms = 0; ms < LZ_WAIT_MS; ms++) {
+		shellKernelGetLazyStatus(&status);
+		if (status.files_copied > 0)
+			break;
+		usleep(1000);
+	}
+	CHECK(status.files_copied == 1);
+	CHECK(status.bytes_copied == LZ_FILE_SIZE);
+	CHECK(same_file("ux0:lz/card.bin", LZ_FILE_SIZE));
+
+	// now read from USB, still listed once
+	shim_set_pid(USER_PID);
+	CHECK(lz_read("ux0:lz/card.bin", LZ_FILE_SIZE) == 0);
+	CHECK(lz_list("ux0:lz", seen) == 0 && seen[2] == 1);
+	shim_set_pid(KERNEL_PID);
+
+	lazy_exit();
+	dircache_exit();
+	printf("card-only lookups, opens and listings fell through, %u file copied on open\n", status.files_copied);
+
+	return 0;
+}
+
+static const struct {
+	const char *name;
+	int (*run)(int argc, char *argv[]);
+} benches[] = {
+	{ "readahead", bench_readahead },
+	{ "livearea", bench_livearea },
+	{ "sync", bench_sync },
+	{ "bulkcopy", bench_bulkcopy },
+	{ "lazy", bench_lazy },
+};
+
+int main(int argc, char *argv[]) {
+	int found = 0;
+
+	make_root();
+	for (size_t i = 0; i < sizeof(benches)/sizeof(*benches); i++) {
+		char *name[] = { (char *)benches[i].name, NULL };
+
+		if (argc >= 2 && strcmp(argv[1], benches[i].name) != 0)
+			continue;
+		found = 1;
+		if ((argc >= 2 ? benches[i].run(argc - 1, argv + 1) : benches[i].run(1, name)) != 0)
+			return 2;
+	}
+	if (!found) {
+		fprintf(stderr, "usage: %s [readahead [TRACE] | livearea | sync | bulkcopy | lazy]\n", argv[0]);
+		return 2;
+	}
+
+	printf("%s\n", failures ? "FAIL" : "PASS");
+	return failures ? 1 : 0;
+}
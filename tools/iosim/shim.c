@@ -0,0 +1,973 @@
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// the host struct stat names its time fields like SceIoStat does
+#undef st_atime
+#undef st_ctime
+#undef st_mtime
+
+#include "shim.h"
+#include "iohooks.h"
+
+// Kernel for iosim, see shim.h. The costs are rough figures for a USB 2.0
+// flash drive on the accessory port; change them to model another one. Only
+// how they compare matters. Errors come back the way SceIofilemgr reports
+// them, 0x80010000 plus the errno.
+
+#define COST_REQUEST_US 250   // command and completion of a read or write
+#define COST_LOOKUP_US  200   // walking the directories of a path
+#define COST_ENTRY_US   20    // one directory entry listed
+#define COST_SYNC_US    20000 // flushing the drive's write cache
+#define RATE_MB_S       30
+
+#define MAX_FDS 1024
+#define MAX_DIRS 256
+#define MAX_DEVICES 8
+#define MAX_OBJECTS 64
+#define MAX_HOOKS 64
+#define UID_DIR_BASE 0x40000
+#define UID_OBJECT_BASE 0x50000
+#define UID_HOOK_BASE 0x60000
+#define UID_THREAD_BASE 0x70000
+
+#define LIB_SceIofilemgrForDriver 0x40FD29C7
+#define TAI_ERROR_NOT_FOUND 0x90010002
+
+#define SCE_ERRNO(e) ((int)(0x80010000 | (e)))
+
+typedef struct {
+	char name[8];
+	uint64_t busy_until;
+} Device;
+
+typedef struct {
+	DIR *dir;
+	int dev;
+	char path[PATH_MAX];
+} HostDir;
+
+enum {
+	OBJECT_FREE,
+	OBJECT_MEMBLOCK,
+	OBJECT_THREAD,
+	OBJECT_MUTEX,
+	OBJECT_SEMA,
+	OBJECT_EVENTFLAG,
+};
+
+typedef struct {
+	int type;
+	// memblock
+	void *base;
+	// thread
+	SceUID uid;
+	pthread_t thread;
+	int started;
+	SceKernelThreadEntry entry;
+	SceSize args;
+	void *argp;
+	// mutex, sema and event flag
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int count;
+	SceUInt bits;
+} HostObject;
+
+typedef struct {
+	uint32_t library_nid;
+	uint32_t func_nid;
+	const void *func;
+	struct _tai_hook_user *hooks; // newest first
+} Export;
+
+static const char *root = ".";
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static ShimStats stats;
+
+static Device devices[MAX_DEVICES];
+static int num_devices = 0;
+static int fd_dev[MAX_FDS];
+static HostDir dirs[MAX_DIRS];
+static HostObject objects[MAX_OBJECTS];
+static struct _tai_hook_user *hooks[MAX_HOOKS];
+static Export *hook_exports[MAX_HOOKS];
+
+static __thread SceUID current_pid = KERNEL_PID;
+static __thread SceUID current_thid = 0;
+static SceUID next_thid = UID_THREAD_BASE;
+
+void shim_set_root(const char *dir) {
+	root = dir;
+}
+
+void shim_set_pid(SceUID pid) {
+	current_pid = pid;
+}
+
+void shim_get_stats(ShimStats *out) {
+	pthread_mutex_lock(&lock);
+	*out = stats;
+	pthread_mutex_unlock(&lock);
+}
+
+void shim_reset_stats(void) {
+	pthread_mutex_lock(&lock);
+	memset(&stats, 0, sizeof(stats));
+	pthread_mutex_unlock(&lock);
+}
+
+#define COUNT(field, n) do { \
+	pthread_mutex_lock(&lock); \
+	stats.field += (n); \
+	pthread_mutex_unlock(&lock); \
+} while (0)
+
+static uint64_t now_us(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// the device of a path, by the name in front of its colon
+static int device_of(const char *path) {
+	const char *colon = strchr(path, ':');
+	int len = colon ? (int)(colon - path) : 0;
+	int dev;
+
+	if (len >= (int)sizeof(devices[0].name))
+		len = sizeof(devices[0].name) - 1;
+
+	pthread_mutex_lock(&lock);
+	for (dev = 0; dev < num_devices; dev++) {
+		if (strncmp(devices[dev].name, path, len) == 0 && devices[dev].name[len] == '\0')
+			break;
+	}
+	if (dev == num_devices && num_devices < MAX_DEVICES) {
+		snprintf(devices[dev].name, sizeof(devices[dev].name), "%.*s", len, path);
+		num_devices++;
+	}
+	pthread_mutex_unlock(&lock);
+
+	return (dev < MAX_DEVICES) ? dev : 0;
+}
+
+// requests queue on their device and the caller waits for its own to finish
+static void device_busy(int dev, uint64_t us) {
+	struct timespec ts;
+	uint64_t start, end;
+
+	pthread_mutex_lock(&lock);
+	start = now_us();
+	if (devices[dev].busy_until > start)
+		start = devices[dev].busy_until;
+	end = start + us;
+	devices[dev].busy_until = end;
+	pthread_mutex_unlock(&lock);
+
+	// against the absolute end, so oversleeping doesn't add up
+	ts.tv_sec = end / 1000000;
+	ts.tv_nsec = (end % 1000000) * 1000;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+}
+
+static void transfer(int dev, SceSize bytes) {
+	device_busy(dev, COST_REQUEST_US + (uint64_t)bytes * 1000000 / (RATE_MB_S * 1048576));
+}
+
+static int fd_device(SceUID fd) {
+	return (fd >= 0 && fd < MAX_FDS) ? fd_dev[fd] : 0;
+}
+
+const char *shim_path(const char *path, char *out, size_t size) {
+	const char *colon = strchr(path, ':');
+
+	if (colon == NULL) {
+		snprintf(out, size, "%s", path);
+		return out;
+	}
+	// "ux0:" and "ux0:/" are the device root alike
+	const char *rest = colon + 1;
+	while (*rest == '/')
+		rest++;
+	snprintf(out, size, "%s/%.*s%s%s", root, (int)(colon - path), path, *rest ? "/" : "", rest);
+	return out;
+}
+
+static void to_datetime(const struct timespec *ts, SceDateTime *dt) {
+	struct tm tm;
+
+	gmtime_r(&ts->tv_sec, &tm);
+	dt->year = tm.tm_year + 1900;
+	dt->month = tm.tm_mon + 1;
+	dt->day = tm.tm_mday;
+	dt->hour = tm.tm_hour;
+	dt->minute = tm.tm_min;
+	dt->second = tm.tm_sec;
+	dt->microsecond = ts->tv_nsec / 1000;
+}
+
+static void to_iostat(const struct stat *st, SceIoStat *out) {
+	memset(out, 0, sizeof(*out));
+	out->st_mode = S_ISDIR(st->st_mode) ? SCE_S_IFDIR : SCE_S_IFREG;
+	out->st_mode |= st->st_mode & 0777;
+	out->st_size = S_ISDIR(st->st_mode) ? 0 : st->st_size;
+	to_datetime(&st->st_ctim, &out->st_ctime);
+	to_datetime(&st->st_atim, &out->st_atime);
+	to_datetime(&st->st_mtim, &out->st_mtime);
+}
+
+static int host_flags(int flags) {
+	int out;
+
+	if ((flags & SCE_O_RDWR) == SCE_O_RDWR)
+		out = O_RDWR;
+	else if (flags & SCE_O_WRONLY)
+		out = O_WRONLY;
+	else
+		out = O_RDONLY;
+	if (flags & SCE_O_APPEND)
+		out |= O_APPEND;
+	if (flags & SCE_O_CREAT)
+		out |= O_CREAT;
+	if (flags & SCE_O_TRUNC)
+		out |= O_TRUNC;
+	if (flags & SCE_O_EXCL)
+		out |= O_EXCL;
+	return out;
+}
+
+// What SceIofilemgr does below the hooks. User pointers are host pointers,
+// so the syscalls share these with the driver exports.
+
+static SceUID io_open(const char *file, int flags, SceMode mode) {
+	char path[PATH_MAX];
+	int dev = device_of(file);
+	int fd;
+
+	COUNT(lookups, 1);
+	device_busy(dev, COST_LOOKUP_US);
+	if ((fd = open(shim_path(file, path, sizeof(path)), host_flags(flags), 0644)) < 0)
+		return SCE_ERRNO(errno);
+	if (fd >= MAX_FDS) {
+		close(fd);
+		return SCE_ERRNO(EMFILE);
+	}
+	fd_dev[fd] = dev;
+	return fd;
+}
+
+static SceUID io_user_open(const char *file, int flags, SceMode mode, void *opt) {
+	return io_open(file, flags, mode);
+}
+
+static int io_close(SceUID fd) {
+	return close(fd) < 0 ? SCE_ERRNO(errno) : 0;
+}
+
+static int io_read(SceUID fd, void *data, SceSize size) {
+	ssize_t ret;
+
+	if ((ret = read(fd, data, size)) < 0)
+		return SCE_ERRNO(errno);
+	transfer(fd_device(fd), ret);
+	COUNT(requests, 1);
+	COUNT(bytes_read, ret);
+	return ret;
+}
+
+static int io_write(SceUID fd, const void *data, SceSize size) {
+	ssize_t ret;
+
+	if ((ret = write(fd, data, size)) < 0)
+		return SCE_ERRNO(errno);
+	transfer(fd_device(fd), ret);
+	COUNT(requests, 1);
+	COUNT(bytes_written, ret);
+	return ret;
+}
+
+static int io_pread(SceUID fd, void *data, SceSize size, SceOff offset) {
+	ssize_t ret;
+
+	if ((ret = pread(fd, data, size, offset)) < 0)
+		return SCE_ERRNO(errno);
+	transfer(fd_device(fd), ret);
+	COUNT(requests, 1);
+	COUNT(bytes_read, ret);
+	return ret;
+}
+
+static int io_pwrite(SceUID fd, const void *data, SceSize size, SceOff offset) {
+	ssize_t ret;
+
+	if ((ret = pwrite(fd, data, size, offset)) < 0)
+		return SCE_ERRNO(errno);
+	transfer(fd_device(fd), ret);
+	COUNT(requests, 1);
+	COUNT(bytes_written, ret);
+	return ret;
+}
+
+static SceOff io_lseek(SceUID fd, SceOff offset, int whence) {
+	off_t ret = lseek(fd, offset, whence);
+
+	return ret < 0 ? SCE_ERRNO(errno) : ret;
+}
+
+static int io_remove(const char *file) {
+	char path[PATH_MAX];
+
+	COUNT(lookups, 1);
+	device_busy(device_of(file), COST_LOOKUP_US);
+	return unlink(shim_path(file, path, sizeof(path))) < 0 ? SCE_ERRNO(errno) : 0;
+}
+
+static int io_rename(const char *oldname, const char *newname) {
+	char from[PATH_MAX], to[PATH_MAX];
+
+	COUNT(lookups, 1);
+	device_busy(device_of(oldname), COST_LOOKUP_US);
+	shim_path(oldname, from, sizeof(from));
+	shim_path(newname, to, sizeof(to));
+	return rename(from, to) < 0 ? SCE_ERRNO(errno) : 0;
+}
+
+static int io_mkdir(const char *dir, SceMode mode) {
+	char path[PATH_MAX];
+
+	COUNT(lookups, 1);
+	device_busy(device_of(dir), COST_LOOKUP_US);
+	return mkdir(shim_path(dir, path, sizeof(path)), 0755) < 0 ? SCE_ERRNO(errno) : 0;
+}
+
+static int io_rmdir(const char *dir) {
+	char path[PATH_MAX];
+
+	COUNT(lookups, 1);
+	device_busy(device_of(dir), COST_LOOKUP_US);
+	return rmdir(shim_path(dir, path, sizeof(path))) < 0 ? SCE_ERRNO(errno) : 0;
+}
+
+static HostDir *find_dir(SceUID fd) {
+	int i = fd - UID_DIR_BASE;
+
+	return (i >= 0 && i < MAX_DIRS && dirs[i].dir) ? &dirs[i] : NULL;
+}
+
+static SceUID io_dopen(const char *dirname) {
+	int dev = device_of(dirname);
+	DIR *dir;
+	char path[PATH_MAX];
+
+	COUNT(lookups, 1);
+	device_busy(dev, COST_LOOKUP_US);
+	if ((dir = opendir(shim_path(dirname, path, sizeof(path)))) == NULL)
+		return SCE_ERRNO(errno);
+
+	pthread_mutex_lock(&lock);
+	for (int i = 0; i < MAX_DIRS; i++) {
+		HostDir *d = &dirs[i];
+		if (d->dir)
+			continue;
+		d->dir = dir;
+		d->dev = dev;
+		strcpy(d->path, path);
+		pthread_mutex_unlock(&lock);
+		return UID_DIR_BASE + i;
+	}
+	pthread_mutex_unlock(&lock);
+	closedir(dir);
+	return SCE_ERRNO(EMFILE);
+}
+
+static int io_dread(SceUID fd, SceIoDirent *dir) {
+	HostDir *d = find_dir(fd);
+	struct dirent *e;
+	struct stat st;
+	char path[PATH_MAX + 256];
+
+	if (d == NULL)
+		return SCE_ERRNO(EBADF);
+
+	// the Vita lists neither "." nor ".."
+	do {
+		errno = 0;
+		if ((e = readdir(d->dir)) == NULL)
+			return errno ? SCE_ERRNO(errno) : 0;
+	} while (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0);
+
+	snprintf(path, sizeof(path), "%s/%s", d->path, e->d_name);
+	if (stat(path, &st) < 0)
+		return SCE_ERRNO(errno);
+
+	COUNT(entries, 1);
+	device_busy(d->dev, COST_ENTRY_US);
+	memset(dir, 0, sizeof(*dir));
+	to_iostat(&st, &dir->d_stat);
+	snprintf(dir->d_name, sizeof(dir->d_name), "%s", e->d_name);
+	return 1;
+}
+
+static int io_dclose(SceUID fd) {
+	HostDir *d = find_dir(fd);
+
+	if (d == NULL)
+		return SCE_ERRNO(EBADF);
+	closedir(d->dir);
+	pthread_mutex_lock(&lock);
+	d->dir = NULL;
+	pthread_mutex_unlock(&lock);
+	return 0;
+}
+
+static int io_getstat(const char *file, SceIoStat *out) {
+	char path[PATH_MAX];
+	struct stat st;
+
+	COUNT(lookups, 1);
+	device_busy(device_of(file), COST_LOOKUP_US);
+	if (stat(shim_path(file, path, sizeof(path)), &st) < 0)
+		return SCE_ERRNO(errno);
+	to_iostat(&st, out);
+	return 0;
+}
+
+// times are not carried over to the host, the cost of writing them is
+static int io_chstat(const char *file, SceIoStat *in, int bits) {
+	char path[PATH_MAX];
+	struct stat st;
+
+	COUNT(requests, 1);
+	device_busy(device_of(file), COST_LOOKUP_US + COST_REQUEST_US);
+	return stat(shim_path(file, path, sizeof(path)), &st) < 0 ? SCE_ERRNO(errno) : 0;
+}
+
+// the drive is flushed in the model, the host file system is left alone
+static int io_sync(const char *device, unsigned int flags) {
+	COUNT(syncs, 1);
+	device_busy(device_of(device), COST_SYNC_US);
+	return 0;
+}
+
+static Export exports[] = {
+	{ LIB_SceIofilemgrForDriver, NID_ksceIoOpen, io_open },
+	{ LIB_SceIofilemgrForDriver, NID_ksceIoClose, io_close },
+	{ LIB_SceIofilemgrForDriver, NID_ksceIoRead, io_read },
+	{ LIB_SceIofilemgrForDriver, NID_ksceIoWrite, io_write },
+	{ LIB_SceIofilemgrForDriver, NID_ksceIoLseek, io_lseek },
+	{ LIB_SceIofilemgrForDriver, NID_ksceIoRemove, io_remove },
+	{ LIB_SceIofilemgrForDriver, NID_ksceIoRename, io_rename },
+	{ LIB_SceIofilemgrForDriver, NID_ksceIoMkdir, io_mkdir },
+	{ LIB_SceIofilemgrForDriver, NID_ksceIoRmdir, io_rmdir },
+	{ LIB_SceIofilemgrForDriver, NID_ksceIoDopen, io_dopen },
+	{ LIB_SceIofilemgrForDriver, NID_ksceIoDread, io_dread },
+	{ LIB_SceIofilemgrForDriver, NID_ksceIoDclose, io_dclose },
+	{ LIB_SceIofilemgrForDriver, NID_ksceIoGetstat, io_getstat },
+	{ LIB_SceIofilemgrForDriver, NID_ksceIoChstat, io_chstat },
+	{ LIB_SceIofilemgrForDriver, NID_ksceIoPread, io_pread },
+	{ LIB_SceIofilemgrForDriver, NID_ksceIoPwrite, io_pwrite },
+	{ LIB_SceIofilemgrForDriver, NID_ksceIoSync, io_sync },
+	{ LIB_SceIofilemgr, NID_sceIoOpen, io_user_open },
+	{ LIB_SceIofilemgr, NID_sceIoClose, io_close },
+	{ LIB_SceIofilemgr, NID_sceIoRead, io_read },
+	{ LIB_SceIofilemgr, NID_sceIoWrite, io_write },
+	{ LIB_SceIofilemgr, NID_sceIoLseek, io_lseek },
+	{ LIB_SceIofilemgr, NID_sceIoRemove, io_remove },
+	{ LIB_SceIofilemgr, NID_sceIoRename, io_rename },
+	{ LIB_SceIofilemgr, NID_sceIoMkdir, io_mkdir },
+	{ LIB_SceIofilemgr, NID_sceIoRmdir, io_rmdir },
+	{ LIB_SceIofilemgr, NID_sceIoDopen, io_dopen },
+	{ LIB_SceIofilemgr, NID_sceIoDread, io_dread },
+	{ LIB_SceIofilemgr, NID_sceIoDclose, io_dclose },
+	{ LIB_SceIofilemgr, NID_sceIoGetstat, io_getstat },
+	{ LIB_SceIofilemgr, NID_sceIoChstat, io_chstat },
+};
+
+static Export *find_export(uint32_t nid) {
+	for (size_t i = 0; i < sizeof(exports)/sizeof(*exports); i++) {
+		if (exports[i].func_nid == nid)
+			return &exports[i];
+	}
+	return NULL;
+}
+
+// where a call of the export goes: its newest hook or the export itself
+static const void *entry(uint32_t nid) {
+	Export *e = find_export(nid);
+
+	return e->hooks ? e->hooks->func : e->func;
+}
+
+#define CALL(nid, type, ...) ((type(*)())entry(nid))(__VA_ARGS__)
+
+SceUID taiHookFunctionExportForKernel(SceUID pid, tai_hook_ref_t *p_hook, const char *module, uint32_t library_nid, uint32_t func_nid, const void *hook_func) {
+	Export *e = find_export(func_nid);
+	struct _tai_hook_user *h;
+
+	if (pid != KERNEL_PID || strcmp(module, "SceIofilemgr") != 0 || e == NULL ||
+	    (library_nid != TAI_ANY_LIBRARY && library_nid != e->library_nid))
+		return TAI_ERROR_NOT_FOUND;
+
+	for (int i = 0; i < MAX_HOOKS; i++) {
+		if (hooks[i])
+			continue;
+		if ((h = malloc(sizeof(*h))) == NULL)
+			break;
+		h->func = hook_func;
+		h->old = e->func;
+		h->next = e->hooks;
+		e->hooks = h;
+		hooks[i] = h;
+		hook_exports[i] = e;
+		*p_hook = (tai_hook_ref_t)h;
+		return UID_HOOK_BASE + i;
+	}
+	return SCE_ERRNO(ENOMEM);
+}
+
+int taiHookReleaseForKernel(SceUID tai_uid, tai_hook_ref_t hook) {
+	int i = tai_uid - UID_HOOK_BASE;
+	struct _tai_hook_user **link;
+
+	if (i < 0 || i >= MAX_HOOKS || hooks[i] == NULL || (tai_hook_ref_t)hooks[i] != hook)
+		return TAI_ERROR_NOT_FOUND;
+	for (link = &hook_exports[i]->hooks; *link != hooks[i]; link = &(*link)->next);
+	*link = hooks[i]->next;
+	free(hooks[i]);
+	hooks[i] = NULL;
+	return 0;
+}
+
+SceUID ksceIoOpen(const char *file, int flags, SceMode mode) {
+	return CALL(NID_ksceIoOpen, SceUID, file, flags, mode);
+}
+
+int ksceIoClose(SceUID fd) {
+	return CALL(NID_ksceIoClose, int, fd);
+}
+
+int ksceIoRead(SceUID fd, void *data, SceSize size) {
+	return CALL(NID_ksceIoRead, int, fd, data, size);
+}
+
+int ksceIoWrite(SceUID fd, const void *data, SceSize size) {
+	return CALL(NID_ksceIoWrite, int, fd, data, size);
+}
+
+int ksceIoPread(SceUID fd, void *data, SceSize size, SceOff offset) {
+	return CALL(NID_ksceIoPread, int, fd, data, size, offset);
+}
+
+int ksceIoPwrite(SceUID fd, const void *data, SceSize size, SceOff offset) {
+	return CALL(NID_ksceIoPwrite, int, fd, data, size, offset);
+}
+
+SceOff ksceIoLseek(SceUID fd, SceOff offset, int whence) {
+	return CALL(NID_ksceIoLseek, SceOff, fd, offset, whence);
+}
+
+int ksceIoRemove(const char *file) {
+	return CALL(NID_ksceIoRemove, int, file);
+}
+
+int ksceIoRename(const char *oldname, const char *newname) {
+	return CALL(NID_ksceIoRename, int, oldname, newname);
+}
+
+int ksceIoMkdir(const char *dir, SceMode mode) {
+	return CALL(NID_ksceIoMkdir, int, dir, mode);
+}
+
+int ksceIoRmdir(const char *path) {
+	return CALL(NID_ksceIoRmdir, int, path);
+}
+
+SceUID ksceIoDopen(const char *dirname) {
+	return CALL(NID_ksceIoDopen, SceUID, dirname);
+}
+
+int ksceIoDread(SceUID fd, SceIoDirent *dir) {
+	return CALL(NID_ksceIoDread, int, fd, dir);
+}
+
+int ksceIoDclose(SceUID fd) {
+	return CALL(NID_ksceIoDclose, int, fd);
+}
+
+int ksceIoGetstat(const char *file, SceIoStat *stat) {
+	return CALL(NID_ksceIoGetstat, int, file, stat);
+}
+
+int ksceIoChstat(const char *file, SceIoStat *stat, int bits) {
+	return CALL(NID_ksceIoChstat, int, file, stat, bits);
+}
+
+int ksceIoSync(const char *device, unsigned int flags) {
+	return CALL(NID_ksceIoSync, int, device, flags);
+}
+
+// the calls below have no hooks in the plugin and are not exports here
+
+// descriptors are host ones, every process shares them
+SceUID ksceIoOpenForPid(SceUID pid, const char *file, int flags, SceMode mode) {
+	return io_open(file, flags, mode);
+}
+
+int ksceIoGetstatByFd(SceUID fd, SceIoStat *out) {
+	struct stat st;
+
+	if (fstat(fd, &st) < 0)
+		return SCE_ERRNO(errno);
+	to_iostat(&st, out);
+	return 0;
+}
+
+int ksceIoChstatByFd(SceUID fd, SceIoStat *in, int bits) {
+	COUNT(requests, 1);
+	transfer(fd_device(fd), 0);
+	return 0;
+}
+
+int ksceIoSyncByFd(SceUID fd, int flags) {
+	COUNT(syncs, 1);
+	device_busy(fd_device(fd), COST_SYNC_US);
+	return 0;
+}
+
+SceUID sceIoOpen(const char *file, int flags, SceMode mode) {
+	return CALL(NID_sceIoOpen, SceUID, file, flags, mode, NULL);
+}
+
+int sceIoClose(SceUID fd) {
+	return CALL(NID_sceIoClose, int, fd);
+}
+
+int sceIoRead(SceUID fd, void *data, SceSize size) {
+	return CALL(NID_sceIoRead, int, fd, data, size);
+}
+
+SceOff sceIoLseek(SceUID fd, SceOff offset, int whence) {
+	return CALL(NID_sceIoLseek, SceOff, fd, offset, whence);
+}
+
+SceUID sceIoDopen(const char *dirname) {
+	return CALL(NID_sceIoDopen, SceUID, dirname);
+}
+
+int sceIoDread(SceUID fd, SceIoDirent *dir) {
+	return CALL(NID_sceIoDread, int, fd, dir);
+}
+
+int sceIoDclose(SceUID fd) {
+	return CALL(NID_sceIoDclose, int, fd);
+}
+
+int sceIoGetstat(const char *file, SceIoStat *stat) {
+	return CALL(NID_sceIoGetstat, int, file, stat);
+}
+
+int sceIoChstat(const char *file, SceIoStat *stat, int bits) {
+	return CALL(NID_sceIoChstat, int, file, stat, bits);
+}
+
+int shellKernelIsUx0Redirected() {
+	return 1;
+}
+
+int ksceKernelMemcpyKernelToUser(uintptr_t dst, const void *src, SceSize len) {
+	memcpy((void *)dst, src, len);
+	return 0;
+}
+
+int ksceKernelMemcpyUserToKernel(void *dst, uintptr_t src, SceSize len) {
+	memcpy(dst, (const void *)src, len);
+	return 0;
+}
+
+int ksceKernelStrncpyUserToKernel(void *dst, uintptr_t src, SceSize len) {
+	strncpy(dst, (const char *)src, len);
+	return strnlen(dst, len);
+}
+
+SceUInt64 ksceKernelGetSystemTimeWide(void) {
+	return now_us();
+}
+
+SceUID ksceKernelGetProcessId(void) {
+	return current_pid;
+}
+
+SceUID ksceKernelGetThreadId(void) {
+	if (current_thid == 0)
+		current_thid = __sync_fetch_and_add(&next_thid, 1);
+	return current_thid;
+}
+
+int ksceKernelDelayThread(SceUInt delay) {
+	usleep(delay);
+	return 0;
+}
+
+static HostObject *find_object(SceUID uid, int type) {
+	int i = uid - UID_OBJECT_BASE;
+
+	return (i >= 0 && i < MAX_OBJECTS && objects[i].type == type) ? &objects[i] : NULL;
+}
+
+static SceUID new_object(int type) {
+	pthread_mutex_lock(&lock);
+	for (int i = 0; i < MAX_OBJECTS; i++) {
+		if (objects[i].type == OBJECT_FREE) {
+			memset(&objects[i], 0, sizeof(objects[i]));
+			objects[i].type = type;
+			pthread_mutex_unlock(&lock);
+			return UID_OBJECT_BASE + i;
+		}
+	}
+	pthread_mutex_unlock(&lock);
+	return SCE_ERRNO(ENOMEM);
+}
+
+static void free_object(HostObject *o) {
+	pthread_mutex_lock(&lock);
+	o->type = OBJECT_FREE;
+	pthread_mutex_unlock(&lock);
+}
+
+SceUID ksceKernelAllocMemBlock(const char *name, SceUInt32 type, SceSize size, void *opt) {
+	SceUID uid;
+	void *base;
+
+	if ((base = aligned_alloc(0x1000, (size + 0xFFF) & ~0xFFF)) == NULL)
+		return SCE_ERRNO(ENOMEM);
+	if ((uid = new_object(OBJECT_MEMBLOCK)) < 0) {
+		free(base);
+		return uid;
+	}
+	find_object(uid, OBJECT_MEMBLOCK)->base = base;
+	return uid;
+}
+
+int ksceKernelFreeMemBlock(SceUID uid) {
+	HostObject *o = find_object(uid, OBJECT_MEMBLOCK);
+
+	if (o == NULL)
+		return SCE_ERRNO(EINVAL);
+	free(o->base);
+	free_object(o);
+	return 0;
+}
+
+int ksceKernelGetMemBlockBase(SceUID uid, void **base) {
+	HostObject *o = find_object(uid, OBJECT_MEMBLOCK);
+
+	if (o == NULL)
+		return SCE_ERRNO(EINVAL);
+	*base = o->base;
+	return 0;
+}
+
+static void *thread_run(void *arg) {
+	HostObject *o = arg;
+
+	current_pid = KERNEL_PID;
+	current_thid = o->uid;
+	o->entry(o->args, o->argp);
+	return NULL;
+}
+
+SceUID ksceKernelCreateThread(const char *name, SceKernelThreadEntry entry, int prio, SceSize stack, SceUInt attr, int cpu, const void *opt) {
+	HostObject *o;
+	SceUID uid;
+
+	if ((uid = new_object(OBJECT_THREAD)) < 0)
+		return uid;
+	o = find_object(uid, OBJECT_THREAD);
+	o->uid = uid;
+	o->entry = entry;
+	return uid;
+}
+
+int ksceKernelStartThread(SceUID thid, SceSize args, void *argp) {
+	HostObject *o = find_object(thid, OBJECT_THREAD);
+
+	if (o == NULL || o->started)
+		return SCE_ERRNO(EINVAL);
+	o->args = args;
+	o->argp = argp;
+	if (pthread_create(&o->thread, NULL, thread_run, o) != 0)
+		return SCE_ERRNO(EAGAIN);
+	o->started = 1;
+	return 0;
+}
+
+int ksceKernelWaitThreadEnd(SceUID thid, int *stat, SceUInt *timeout) {
+	HostObject *o = find_object(thid, OBJECT_THREAD);
+
+	if (o == NULL || !o->started)
+		return SCE_ERRNO(EINVAL);
+	pthread_join(o->thread, NULL);
+	o->started = 0;
+	return 0;
+}
+
+int ksceKernelDeleteThread(SceUID thid) {
+	HostObject *o = find_object(thid, OBJECT_THREAD);
+
+	// a thread has to end before it can go
+	if (o == NULL || o->started)
+		return SCE_ERRNO(EINVAL);
+	free_object(o);
+	return 0;
+}
+
+static SceUID new_waitable(int type, int count, SceUInt bits) {
+	HostObject *o;
+	SceUID uid;
+
+	if ((uid = new_object(type)) < 0)
+		return uid;
+	o = find_object(uid, type);
+	pthread_mutex_init(&o->lock, NULL);
+	pthread_cond_init(&o->cond, NULL);
+	o->count = count;
+	o->bits = bits;
+	return uid;
+}
+
+static int delete_waitable(SceUID uid, int type) {
+	HostObject *o = find_object(uid, type);
+
+	if (o == NULL)
+		return SCE_ERRNO(EINVAL);
+	pthread_cond_destroy(&o->cond);
+	pthread_mutex_destroy(&o->lock);
+	free_object(o);
+	return 0;
+}
+
+// a mutex is a semaphore of one here, nobody locks theirs twice
+SceUID ksceKernelCreateMutex(const char *name, SceUInt attr, int init, void *opt) {
+	return new_waitable(OBJECT_MUTEX, 1 - init, 0);
+}
+
+int ksceKernelLockMutex(SceUID mutexid, int count, SceUInt *timeout) {
+	HostObject *o = find_object(mutexid, OBJECT_MUTEX);
+
+	if (o == NULL)
+		return SCE_ERRNO(EINVAL);
+	pthread_mutex_lock(&o->lock);
+	while (o->count == 0)
+		pthread_cond_wait(&o->cond, &o->lock);
+	o->count = 0;
+	pthread_mutex_unlock(&o->lock);
+	return 0;
+}
+
+int ksceKernelUnlockMutex(SceUID mutexid, int count) {
+	HostObject *o = find_object(mutexid, OBJECT_MUTEX);
+
+	if (o == NULL)
+		return SCE_ERRNO(EINVAL);
+	pthread_mutex_lock(&o->lock);
+	o->count = 1;
+	pthread_cond_signal(&o->cond);
+	pthread_mutex_unlock(&o->lock);
+	return 0;
+}
+
+int ksceKernelDeleteMutex(SceUID mutexid) {
+	return delete_waitable(mutexid, OBJECT_MUTEX);
+}
+
+SceUID ksceKernelCreateSema(const char *name, SceUInt attr, int init, int max, void *opt) {
+	return new_waitable(OBJECT_SEMA, init, 0);
+}
+
+int ksceKernelSignalSema(SceUID semaid, int signal) {
+	HostObject *o = find_object(semaid, OBJECT_SEMA);
+
+	if (o == NULL)
+		return SCE_ERRNO(EINVAL);
+	pthread_mutex_lock(&o->lock);
+	o->count += signal;
+	pthread_cond_broadcast(&o->cond);
+	pthread_mutex_unlock(&o->lock);
+	return 0;
+}
+
+int ksceKernelWaitSema(SceUID semaid, int signal, SceUInt *timeout) {
+	HostObject *o = find_object(semaid, OBJECT_SEMA);
+
+	if (o == NULL)
+		return SCE_ERRNO(EINVAL);
+	pthread_mutex_lock(&o->lock);
+	while (o->count < signal)
+		pthread_cond_wait(&o->cond, &o->lock);
+	o->count -= signal;
+	pthread_mutex_unlock(&o->lock);
+	return 0;
+}
+
+int ksceKernelDeleteSema(SceUID semaid) {
+	return delete_waitable(semaid, OBJECT_SEMA);
+}
+
+SceUID ksceKernelCreateEventFlag(const char *name, SceUInt attr, SceUInt init, void *opt) {
+	return new_waitable(OBJECT_EVENTFLAG, 0, init);
+}
+
+int ksceKernelSetEventFlag(SceUID evfid, SceUInt bits) {
+	HostObject *o = find_object(evfid, OBJECT_EVENTFLAG);
+
+	if (o == NULL)
+		return SCE_ERRNO(EINVAL);
+	pthread_mutex_lock(&o->lock);
+	o->bits |= bits;
+	pthread_cond_broadcast(&o->cond);
+	pthread_mutex_unlock(&o->lock);
+	return 0;
+}
+
+// like the kernel's, keeps the bits given and clears the rest
+int ksceKernelClearEventFlag(SceUID evfid, SceUInt bits) {
+	HostObject *o = find_object(evfid, OBJECT_EVENTFLAG);
+
+	if (o == NULL)
+		return SCE_ERRNO(EINVAL);
+	pthread_mutex_lock(&o->lock);
+	o->bits &= bits;
+	pthread_mutex_unlock(&o->lock);
+	return 0;
+}
+
+int ksceKernelWaitEventFlag(SceUID evfid, SceUInt bits, SceUInt mode, SceUInt *out, SceUInt *timeout) {
+	HostObject *o = find_object(evfid, OBJECT_EVENTFLAG);
+
+	if (o == NULL)
+		return SCE_ERRNO(EINVAL);
+	pthread_mutex_lock(&o->lock);
+	while ((mode & SCE_EVENT_WAITOR) ? !(o->bits & bits) : (o->bits & bits) != bits)
+		pthread_cond_wait(&o->cond, &o->lock);
+	if (out)
+		*out = o->bits;
+	pthread_mutex_unlock(&o->lock);
+	return 0;
+}
+
+int ksceKernelDeleteEventFlag(SceUID evfid) {
+	return delete_waitable(evfid, OBJECT_EVENTFLAG);
+}
@@ -0,0 +1,381 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "trace_format.h"
+
+// Reads an I/O trace recorded by the usbmc plugin, prints where the time
+// went per phase and per operation, and optionally replays it: against a
+// directory tree standing in for the Vita devices (ux0:foo becomes
+// ROOT/ux0/foo), or against a simple device model with a fixed latency per
+// request plus a transfer rate. Descriptors are tracked by the process and
+// fd the trace recorded, not by path, so several handles on one file replay
+// as several handles.
+
+#define MAX_IDS 0x10000
+#define MAX_HANDLES 1024
+#define SCE_O_RDONLY 0x0001
+#define SCE_O_WRONLY 0x0002
+#define SCE_O_APPEND 0x0100
+#define SCE_O_CREAT  0x0200
+#define SCE_O_TRUNC  0x0400
+#define SCE_O_EXCL   0x0800
+
+enum {
+	REPLAY_NONE,
+	REPLAY_POSIX,
+	REPLAY_SIM,
+};
+
+typedef struct {
+	int32_t pid;
+	int32_t fd; // as recorded, -1 when the slot is free
+	int host;
+	DIR *dir;
+} Handle;
+
+typedef struct {
+	unsigned long ops;
+	unsigned long long bytes;
+	unsigned long long recorded_us;
+	unsigned long long replay_us;
+} Stats;
+
+static const char *op_names[TRACE_OP_COUNT] = {
+	"name", "mark", "dropped", "open", "close", "read", "write", "lseek",
+	"remove", "rename", "mkdir", "rmdir", "dopen", "dread", "dclose", "getstat",
+	"pread", "pwrite", "chstat", "devctl", "sync",
+};
+
+static const char *phase_names[TRACE_PHASE_COUNT] = {
+	"boot", "system", "installer", "plan", "copy", "bench",
+};
+
+static char *names[MAX_IDS];
+static Handle handles[MAX_HANDLES];
+static Stats phases[TRACE_PHASE_COUNT];
+static Stats ops[TRACE_OP_COUNT];
+
+static int mode = REPLAY_NONE;
+static const char *root = NULL;
+static double sim_mbps = 0, sim_latency_us = 0;
+static char *buffer = NULL;
+static size_t buffer_size = 0;
+
+static unsigned long long now_us(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+// "ux0:data/x" becomes "ROOT/ux0/data/x"
+static const char *host_path(uint16_t id, char *out, size_t size) {
+	const char *name = (id != TRACE_NO_PATH) ? names[id] : NULL;
+	const char *colon;
+
+	if (name == NULL || (colon = strchr(name, ':')) == NULL)
+		return NULL;
+	snprintf(out, size, "%s/%.*s/%s", root, (int)(colon - name), name, colon + 1);
+	return out;
+}
+
+static int host_flags(uint32_t flags) {
+	int out;
+
+	if ((flags & (SCE_O_RDONLY | SCE_O_WRONLY)) == (SCE_O_RDONLY | SCE_O_WRONLY))
+		out = O_RDWR;
+	else if (flags & SCE_O_WRONLY)
+		out = O_WRONLY;
+	else
+		out = O_RDONLY;
+	if (flags & SCE_O_APPEND)
+		out |= O_APPEND;
+	if (flags & SCE_O_CREAT)
+		out |= O_CREAT;
+	if (flags & SCE_O_TRUNC)
+		out |= O_TRUNC;
+	if (flags & SCE_O_EXCL)
+		out |= O_EXCL;
+	return out;
+}
+
+static char *data_buffer(size_t size) {
+	if (size > buffer_size) {
+		free(buffer);
+		if ((buffer = calloc(1, size)) == NULL) {
+			buffer_size = 0;
+			return NULL;
+		}
+		buffer_size = size;
+	}
+	return buffer;
+}
+
+static int is_transfer(int op) {
+	return op == TRACE_OP_READ || op == TRACE_OP_WRITE || op == TRACE_OP_PREAD || op == TRACE_OP_PWRITE;
+}
+
+static Handle *find_handle(int32_t pid, int32_t fd) {
+	for (int i = 0; i < MAX_HANDLES; i++) {
+		if (handles[i].fd >= 0 && handles[i].fd == fd && handles[i].pid == pid)
+			return &handles[i];
+	}
+	return NULL;
+}
+
+static void free_handle(Handle *h) {
+	if (h->host >= 0)
+		close(h->host);
+	if (h->dir)
+		closedir(h->dir);
+	h->fd = -1;
+	h->host = -1;
+	h->dir = NULL;
+}
+
+// the slot for a descriptor the trace just opened; one still holding the
+// same fd was never closed in the trace and is dropped
+static Handle *new_handle(int32_t pid, int32_t fd) {
+	Handle *h = find_handle(pid, fd);
+
+	if (h) {
+		free_handle(h);
+	} else {
+		for (int i = 0; i < MAX_HANDLES && h == NULL; i++) {
+			if (handles[i].fd < 0)
+				h = &handles[i];
+		}
+		if (h == NULL) {
+			fprintf(stderr, "more than %d descriptors open, fd 0x%08X not replayed\n", MAX_HANDLES, (unsigned int)fd);
+			return NULL;
+		}
+	}
+	h->pid = pid;
+	h->fd = fd;
+	return h;
+}
+
+static void replay_posix(const TraceRecord *rec) {
+	char path[1024], path2[1024];
+	struct stat st;
+	uint16_t id = rec->path;
+	Handle *h = NULL;
+	char *buf;
+
+	switch (rec->op) {
+	case TRACE_OP_OPEN:
+		if (rec->result >= 0 && host_path(id, path, sizeof(path)) && (h = new_handle(rec->pid, rec->result)))
+			h->host = open(path, host_flags(rec->size), 0666);
+		break;
+	case TRACE_OP_CLOSE:
+	case TRACE_OP_DCLOSE:
+		if ((h = find_handle(rec->pid, rec->fd)))
+			free_handle(h);
+		break;
+	case TRACE_OP_READ:
+	case TRACE_OP_WRITE:
+	case TRACE_OP_PREAD:
+	case TRACE_OP_PWRITE:
+		if ((h = find_handle(rec->pid, rec->fd)) == NULL || h->host < 0 || (buf = data_buffer(rec->size)) == NULL)
+			break;
+		if (rec->op == TRACE_OP_READ) {
+			if (read(h->host, buf, rec->size) < 0)
+				perror("read");
+		} else if (rec->op == TRACE_OP_PREAD) {
+			if (pread(h->host, buf, rec->size, rec->offset) < 0)
+				perror("pread");
+		} else if (rec->op == TRACE_OP_WRITE) {
+			if (write(h->host, buf, rec->result > 0 ? rec->result : 0) < 0)
+				perror("write");
+		} else {
+			if (pwrite(h->host, buf, rec->result > 0 ? rec->result : 0, rec->offset) < 0)
+				perror("pwrite");
+		}
+		break;
+	case TRACE_OP_LSEEK:
+		if ((h = find_handle(rec->pid, rec->fd)) && h->host >= 0)
+			lseek(h->host, rec->offset, rec->size);
+		break;
+	case TRACE_OP_REMOVE:
+		if (host_path(id, path, sizeof(path)))
+			unlink(path);
+		break;
+	case TRACE_OP_RENAME:
+		if (host_path(id, path, sizeof(path)) && host_path(rec->offset, path2, sizeof(path2)))
+			rename(path, path2);
+		break;
+	case TRACE_OP_MKDIR:
+		if (host_path(id, path, sizeof(path)))
+			mkdir(path, 0777);
+		break;
+	case TRACE_OP_RMDIR:
+		if (host_path(id, path, sizeof(path)))
+			rmdir(path);
+		break;
+	case TRACE_OP_DOPEN:
+		if (rec->result >= 0 && host_path(id, path, sizeof(path)) && (h = new_handle(rec->pid, rec->result)))
+			h->dir = opendir(path);
+		break;
+	case TRACE_OP_DREAD:
+		if ((h = find_handle(rec->pid, rec->fd)) && h->dir)
+			readdir(h->dir);
+		break;
+	case TRACE_OP_GETSTAT:
+		if (host_path(id, path, sizeof(path)))
+			stat(path, &st);
+		break;
+	case TRACE_OP_CHSTAT:
+		// the closest host call, whatever bits were changed
+		if (host_path(id, path, sizeof(path)))
+			utimes(path, NULL);
+		break;
+	case TRACE_OP_SYNC:
+		sync();
+		break;
+	// devctl has no host equivalent, it is only counted
+	}
+}
+
+static unsigned long long replay_sim(const TraceRecord *rec) {
+	double us = sim_latency_us;
+
+	if (is_transfer(rec->op) && rec->result > 0)
+		us += rec->result / (sim_mbps * 1024 * 1024) * 1000000;
+	return (unsigned long long)us;
+}
+
+static void account(const TraceRecord *rec) {
+	unsigned long long replay = 0;
+	unsigned long long bytes = 0;
+	int phase = (rec->phase < TRACE_PHASE_COUNT) ? rec->phase : TRACE_PHASE_SYSTEM;
+
+	if (mode == REPLAY_POSIX) {
+		unsigned long long start = now_us();
+		replay_posix(rec);
+		replay = now_us() - start;
+	} else if (mode == REPLAY_SIM) {
+		replay = replay_sim(rec);
+	}
+
+	if (is_transfer(rec->op) && rec->result > 0)
+		bytes = rec->result;
+
+	phases[phase].ops++;
+	phases[phase].bytes += bytes;
+	phases[phase].recorded_us += rec->duration;
+	phases[phase].replay_us += replay;
+	ops[rec->op].ops++;
+	ops[rec->op].bytes += bytes;
+	ops[rec->op].recorded_us += rec->duration;
+	ops[rec->op].replay_us += replay;
+}
+
+static void print_row(const char *label, const Stats *s) {
+	printf("%-12s%10lu%12.1f%14.1f", label, s->ops, s->bytes / 1048576.0, s->recorded_us / 1000.0);
+	if (mode != REPLAY_NONE)
+		printf("%14.1f", s->replay_us / 1000.0);
+	printf("\n");
+}
+
+static void print_header(const char *label) {
+	printf("\n%-12s%10s%12s%14s", label, "ops", "MB", "recorded ms");
+	if (mode != REPLAY_NONE)
+		printf("%14s", "replay ms");
+	printf("\n");
+}
+
+static void usage(const char *argv0) {
+	fprintf(stderr, "usage: %s TRACE [-r ROOT | -s MBPS,LATENCY_US]\n"
+	                "  -r ROOT   replay against ROOT/ux0, ROOT/uma0, ...\n"
+	                "  -s        replay against a simulated device\n", argv0);
+	exit(1);
+}
+
+int main(int argc, char *argv[]) {
+	TraceHeader header;
+	TraceRecord rec;
+	unsigned long dropped = 0, records = 0;
+	FILE *fp;
+
+	if (argc < 2)
+		usage(argv[0]);
+	for (int i = 2; i < argc; i++) {
+		if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+			mode = REPLAY_POSIX;
+			root = argv[++i];
+		} else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+			mode = REPLAY_SIM;
+			if (sscanf(argv[++i], "%lf,%lf", &sim_mbps, &sim_latency_us) != 2 || sim_mbps <= 0)
+				usage(argv[0]);
+		} else {
+			usage(argv[0]);
+		}
+	}
+
+	if ((fp = fopen(argv[1], "rb")) == NULL) {
+		fprintf(stderr, "%s: %s\n", argv[1], strerror(errno));
+		return 1;
+	}
+	if (fread(&header, sizeof(header), 1, fp) != 1 || header.magic != TRACE_MAGIC ||
+	    header.version != TRACE_VERSION || header.record_size != sizeof(TraceRecord)) {
+		fprintf(stderr, "%s: not a usbmc trace\n", argv[1]);
+		return 1;
+	}
+
+	for (int i = 0; i < MAX_HANDLES; i++) {
+		handles[i].fd = -1;
+		handles[i].host = -1;
+	}
+
+	while (fread(&rec, sizeof(rec), 1, fp) == 1) {
+		records++;
+		if (rec.op >= TRACE_OP_COUNT)
+			continue;
+
+		if (rec.op == TRACE_OP_NAME) {
+			size_t n = (rec.size + sizeof(rec) - 1) / sizeof(rec);
+			char *name = calloc(1, n * sizeof(rec) + 1);
+
+			if (name == NULL || fread(name, sizeof(rec), n, fp) != n) {
+				free(name);
+				break;
+			}
+			free(names[rec.path]);
+			names[rec.path] = name;
+			continue;
+		}
+		if (rec.op == TRACE_OP_DROPPED) {
+			dropped += rec.size;
+			continue;
+		}
+		if (rec.op == TRACE_OP_MARK)
+			continue;
+
+		account(&rec);
+	}
+	fclose(fp);
+
+	printf("%lu records, %lu dropped\n", records, dropped);
+
+	print_header("phase");
+	for (int i = 0; i < TRACE_PHASE_COUNT; i++) {
+		if (phases[i].ops)
+			print_row(phase_names[i], &phases[i]);
+	}
+
+	print_header("operation");
+	for (int i = 0; i < TRACE_OP_COUNT; i++) {
+		if (ops[i].ops)
+			print_row(op_names[i], &ops[i]);
+	}
+
+	return 0;
+}
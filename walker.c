@@ -0,0 +1,291 @@
+#include <psp2/io/dirent.h>
+#include <psp2/io/stat.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug_screen.h"
+#include "walker.h"
+
+#define printf psvDebugScreenPrintf
+
+#define PATH_INITIAL_CAP 256
+#define WALK_INITIAL_DEPTH 16
+#define WALK_INITIAL_ENTRIES 64
+#define WALK_INITIAL_NAMES 2048
+
+// a directory entry in the batch of its parent
+typedef struct {
+	size_t name;   // offset into the name pool
+	unsigned seq;  // dirent order, keeps the sort stable
+	SceIoStat stat;
+} WalkEntry;
+
+// one level of the walk: a range of the entry pool and where we are in it
+typedef struct {
+	size_t len;
+	size_t first;
+	size_t next;
+	size_t end;
+	size_t names;
+} WalkFrame;
+
+typedef struct {
+	WalkEntry *entries;
+	size_t count;
+	size_t cap;
+	char *names;
+	size_t names_len;
+	size_t names_cap;
+} WalkBatch;
+
+static int reserve(void **buf, size_t *cap, size_t need, size_t initial, size_t elem) {
+	size_t new_cap = *cap ? *cap : initial;
+	void *p;
+
+	if (need <= *cap)
+		return 0;
+	while (new_cap < need)
+		new_cap *= 2;
+	if ((p = realloc(*buf, new_cap * elem)) == NULL)
+		return -1;
+	*buf = p;
+	*cap = new_cap;
+	return 0;
+}
+
+static int path_reserve(PathBuf *path, size_t len) {
+	size_t cap = path->cap ? path->cap : PATH_INITIAL_CAP;
+	char *buf;
+
+	if (len < path->cap)
+		return 0;
+	while (cap <= len)
+		cap *= 2;
+	if ((buf = realloc(path->buf, cap)) == NULL)
+		return -1;
+	path->buf = buf;
+	path->cap = cap;
+	return 0;
+}
+
+int path_init(PathBuf *path, const char *root) {
+	size_t len = strlen(root);
+
+	path->buf = NULL;
+	path->cap = 0;
+	if (path_reserve(path, len) < 0)
+		return -1;
+	memcpy(path->buf, root, len + 1);
+	path->len = len;
+	return 0;
+}
+
+// appends "/name" and returns the previous length to truncate back to
+int path_push(PathBuf *path, const char *name) {
+	size_t old = path->len;
+	size_t len = strlen(name);
+
+	if (path_reserve(path, old + len + 1) < 0)
+		return -1;
+	path->buf[old] = '/';
+	memcpy(path->buf + old + 1, name, len + 1);
+	path->len = old + len + 1;
+	return old;
+}
+
+void path_truncate(PathBuf *path, size_t len) {
+	path->len = len;
+	path->buf[len] = '\0';
+}
+
+void path_free(PathBuf *path) {
+	free(path->buf);
+	path->buf = NULL;
+	path->len = path->cap = 0;
+}
+
+// files come before subdirectories, which keep their dirent order
+static int compare_kind(const WalkEntry *a, const WalkEntry *b) {
+	int a_dir = SCE_S_ISDIR(a->stat.st_mode) != 0;
+	int b_dir = SCE_S_ISDIR(b->stat.st_mode) != 0;
+
+	if (a_dir != b_dir)
+		return a_dir - b_dir;
+	return 0;
+}
+
+static int compare_seq(const WalkEntry *a, const WalkEntry *b) {
+	return (a->seq > b->seq) - (a->seq < b->seq);
+}
+
+static int compare_large_first(const void *pa, const void *pb) {
+	const WalkEntry *a = pa, *b = pb;
+	int ret;
+
+	if ((ret = compare_kind(a, b)) != 0)
+		return ret;
+	if (!SCE_S_ISDIR(a->stat.st_mode) && a->stat.st_size != b->stat.st_size)
+		return (a->stat.st_size < b->stat.st_size) ? 1 : -1;
+	return compare_seq(a, b);
+}
+
+static int compare_small_first(const void *pa, const void *pb) {
+	const WalkEntry *a = pa, *b = pb;
+	int ret;
+
+	if ((ret = compare_kind(a, b)) != 0)
+		return ret;
+	if (!SCE_S_ISDIR(a->stat.st_mode) && a->stat.st_size != b->stat.st_size)
+		return (a->stat.st_size > b->stat.st_size) ? 1 : -1;
+	return compare_seq(a, b);
+}
+
+// Reads the whole directory onto the top of the batch and closes the handle
+// before anything in it is touched, so listing and data I/O don't interleave
+// on the device.
+static int read_batch(WalkBatch *batch, const char *path, int order) {
+	SceIoDirent dir;
+	size_t first = batch->count;
+	unsigned seq = 0;
+	SceUID fd;
+	int ret;
+
+	if ((fd = sceIoDopen(path)) < 0) {
+		printf("sceIoDopen(%s): 0x%08X\n", path, fd);
+		return fd;
+	}
+
+	while ((ret = sceIoDread(fd, &dir)) > 0) {
+		size_t len = strlen(dir.d_name);
+		WalkEntry *e;
+
+		if (len == 0)
+			continue;
+		if (reserve((void **)&batch->entries, &batch->cap, batch->count + 1, WALK_INITIAL_ENTRIES, sizeof(WalkEntry)) < 0 ||
+		    reserve((void **)&batch->names, &batch->names_cap, batch->names_len + len + 1, WALK_INITIAL_NAMES, 1) < 0) {
+			ret = -1;
+			break;
+		}
+
+		e = &batch->entries[batch->count++];
+		e->name = batch->names_len;
+		e->seq = seq++;
+		e->stat = dir.d_stat;
+		memcpy(batch->names + batch->names_len, dir.d_name, len + 1);
+		batch->names_len += len + 1;
+	}
+	sceIoDclose(fd);
+
+	if (ret < 0) {
+		printf("sceIoDread(%s): 0x%08X\n", path, ret);
+		return ret;
+	}
+
+	if (order == WALK_ORDER_LARGE_FIRST)
+		qsort(batch->entries + first, batch->count - first, sizeof(WalkEntry), compare_large_first);
+	else if (order == WALK_ORDER_SMALL_FIRST)
+		qsort(batch->entries + first, batch->count - first, sizeof(WalkEntry), compare_small_first);
+
+	return 0;
+}
+
+// Depth-first walk with an explicit stack instead of recursion, so deep
+// trees cost heap instead of thread stack. Only the batches along the
+// current path are kept, stacked in one entry pool and one name pool.
+int walk_tree(const char *root, int order, const WalkOps *ops, void *arg, const void *root_frame) {
+	PathBuf path;
+	WalkBatch batch;
+	WalkFrame *stack = NULL;
+	char *frames = NULL;
+	size_t fs = ops->frame_size;
+	size_t cap = 0, frames_cap = 0;
+	int depth = 0;
+	int action;
+
+	memset(&batch, 0, sizeof(batch));
+	if (path_init(&path, root) < 0)
+		return -1;
+	if (reserve((void **)&stack, &cap, 1, WALK_INITIAL_DEPTH, sizeof(WalkFrame)) < 0 ||
+	    reserve((void **)&frames, &frames_cap, 1, WALK_INITIAL_DEPTH, fs ? fs : 1) < 0)
+		goto error;
+	if (fs)
+		memcpy(frames, root_frame, fs);
+
+	if (read_batch(&batch, root, order) < 0)
+		goto error;
+	stack[0].len = path.len;
+	stack[0].first = stack[0].next = 0;
+	stack[0].end = batch.count;
+	stack[0].names = 0;
+	depth = 1;
+
+	while (depth > 0) {
+		WalkFrame *top = &stack[depth - 1];
+		void *parent = frames + (depth - 1) * fs;
+		WalkEntry *e;
+		const char *name;
+
+		path_truncate(&path, top->len);
+
+		if (top->next == top->end) {
+			batch.count = top->first;
+			batch.names_len = top->names;
+			if (--depth > 0 && ops->leave)
+				ops->leave(arg, path.buf, frames + depth * fs);
+			continue;
+		}
+
+		e = &batch.entries[top->next++];
+		name = batch.names + e->name;
+		if (path_push(&path, name) < 0)
+			goto error;
+
+		if (!SCE_S_ISDIR(e->stat.st_mode)) {
+			if (ops->file && ops->file(arg, path.buf, name, &e->stat, parent) == WALK_ABORT)
+				goto error;
+			continue;
+		}
+
+		if (reserve((void **)&stack, &cap, depth + 1, WALK_INITIAL_DEPTH, sizeof(WalkFrame)) < 0 ||
+		    reserve((void **)&frames, &frames_cap, depth + 1, WALK_INITIAL_DEPTH, fs ? fs : 1) < 0)
+			goto error;
+		parent = frames + (depth - 1) * fs;
+
+		void *frame = frames + depth * fs;
+		action = ops->enter ? ops->enter(arg, path.buf, name, &e->stat, parent, frame) : WALK_CONTINUE;
+		if (action == WALK_ABORT)
+			goto error;
+		if (action == WALK_SKIP)
+			continue;
+
+		// the new batch goes on top of the unfinished one of its parent
+		stack[depth].len = path.len;
+		stack[depth].first = stack[depth].next = batch.count;
+		stack[depth].names = batch.names_len;
+		if (read_batch(&batch, path.buf, order) < 0) {
+			batch.count = stack[depth].first;
+			batch.names_len = stack[depth].names;
+			if (ops->leave)
+				ops->leave(arg, path.buf, frame);
+			continue;
+		}
+		stack[depth].end = batch.count;
+		depth++;
+	}
+
+	free(batch.entries);
+	free(batch.names);
+	free(frames);
+	free(stack);
+	path_free(&path);
+	return 0;
+
+error:
+	free(batch.entries);
+	free(batch.names);
+	free(frames);
+	free(stack);
+	path_free(&path);
+	return -1;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <psp2/io/stat.h>
+
+#include <stddef.h>
+
+// Growable path buffer; components are appended and truncated in place.
+typedef struct {
+	char *buf;
+	size_t len;
+	size_t cap;
+} PathBuf;
+
+int path_init(PathBuf *path, const char *root);
+int path_push(PathBuf *path, const char *name);
+void path_truncate(PathBuf *path, size_t len);
+void path_free(PathBuf *path);
+
+// order in which the entries of one directory are visited
+enum {
+	WALK_ORDER_DIRENT,      // as the filesystem lists them
+	WALK_ORDER_LARGE_FIRST, // biggest files first, for bandwidth
+	WALK_ORDER_SMALL_FIRST, // smallest files first, for visible progress
+};
+
+enum {
+	WALK_CONTINUE,
+	WALK_SKIP,
+	WALK_ABORT,
+};
+
+// Every directory level owns frame_size bytes of caller state. enter() fills
+// the new frame from its parent before the directory is opened and may skip
+// it; leave() is called once everything below an entered directory is done.
+// enter() and file() may also update the parent frame, a directory's own
+// frame stays in place until its leave().
+// Each directory is listed in full and closed before its entries are
+// visited; with a size order, files come before subdirectories.
+typedef struct {
+	size_t frame_size;
+	int (*enter)(void *arg, const char *path, const char *name, const SceIoStat *stat, void *parent, void *frame);
+	int (*file)(void *arg, const char *path, const char *name, const SceIoStat *stat, void *parent);
+	void (*leave)(void *arg, const char *path, void *frame);
+} WalkOps;
+
+int walk_tree(const char *root, int order, const WalkOps *ops, void *arg, const void *root_frame);